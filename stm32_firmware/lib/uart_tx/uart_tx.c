@@ -0,0 +1,176 @@
+#include "uart_tx.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#if (UART_TX_RING_SIZE & (UART_TX_RING_SIZE - 1)) != 0
+#error "UART_TX_RING_SIZE must be a power of two"
+#endif
+
+static uint8_t tx_ring[UART_TX_RING_SIZE];
+static DMA_HandleTypeDef hdma_tx;
+static USART_TypeDef* tx_uart = NULL;
+
+// Free-running byte positions (wrap-safe uint32 arithmetic):
+// tail <= commit <= reserve. Producers claim [reserve, reserve + len) and
+// publish it through commit once no other producer is mid-copy.
+static volatile uint32_t tx_reserve = 0;
+static volatile uint32_t tx_commit = 0;
+static volatile uint32_t tx_tail = 0;
+static volatile uint32_t tx_writers = 0;   // producers between claim and publish
+static volatile uint32_t tx_busy = 0;      // 1 while a DMA transfer is in flight
+static uint32_t tx_inflight = 0;           // length of that transfer
+
+static volatile uint32_t tx_overflows = 0;
+static volatile uint32_t tx_dropped = 0;
+
+static uint32_t atomic_add(volatile uint32_t* p, int32_t delta) {
+  uint32_t v;
+  do {
+    v = __LDREXW(p) + (uint32_t)delta;
+  } while (__STREXW(v, p));
+  return v;
+}
+
+static int atomic_cas(volatile uint32_t* p, uint32_t expect, uint32_t desired) {
+  if (__LDREXW(p) != expect) {
+    __CLREX();
+    return 0;
+  }
+  return __STREXW(desired, p) == 0;
+}
+
+// Start a DMA transfer for the next contiguous committed chunk, unless one
+// is already running. Called by producers and by the DMA completion.
+static void uart_tx_kick(void) {
+  for (;;) {
+    if (!atomic_cas(&tx_busy, 0, 1)) return;  // the running transfer will chain
+    uint32_t tail = tx_tail;
+    uint32_t avail = tx_commit - tail;
+    if (avail != 0) {
+      uint32_t off = tail & (UART_TX_RING_SIZE - 1);
+      uint32_t n = UART_TX_RING_SIZE - off;
+      if (n > avail) n = avail;
+      if (n > 0xFFFF) n = 0xFFFF;
+      tx_inflight = n;
+      HAL_DMA_Start_IT(&hdma_tx, (uint32_t)&tx_ring[off], (uint32_t)&tx_uart->DR, n);
+      return;
+    }
+    tx_busy = 0;
+    // a producer may have published while we held busy; look again
+    if (tx_commit == tx_tail) return;
+  }
+}
+
+// Leave the producer section; the last one out publishes everything claimed.
+// Nested producers (interrupts) always finish before the one they preempted,
+// so when the count drops to zero every claimed byte has been copied.
+static void uart_tx_publish(void) {
+  if (atomic_add(&tx_writers, -1) != 0) return;
+  uint32_t r = tx_reserve;
+  uint32_t c;
+  do {
+    c = __LDREXW(&tx_commit);
+    if ((int32_t)(r - c) <= 0) {  // a nested producer already published further
+      __CLREX();
+      break;
+    }
+  } while (__STREXW(r, &tx_commit));
+  uart_tx_kick();
+}
+
+static void uart_tx_dma_done(DMA_HandleTypeDef* hdma) {
+  (void)hdma;
+  tx_tail += tx_inflight;
+  tx_inflight = 0;
+  tx_busy = 0;
+  uart_tx_kick();
+}
+
+void uart_tx_init(UART_HandleTypeDef* huart, DMA_Stream_TypeDef* stream, uint32_t channel, IRQn_Type irq) {
+  if ((uint32_t)stream >= (uint32_t)DMA2_Stream0) {
+    __HAL_RCC_DMA2_CLK_ENABLE();
+  } else {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+  }
+
+  hdma_tx.Instance = stream;
+  hdma_tx.Init.Channel = channel;
+  hdma_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_tx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_tx.Init.Mode = DMA_NORMAL;
+  hdma_tx.Init.Priority = DMA_PRIORITY_LOW;
+  hdma_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&hdma_tx);
+  hdma_tx.XferCpltCallback = uart_tx_dma_done;
+  hdma_tx.XferErrorCallback = uart_tx_dma_done;  // drop the chunk, keep draining
+
+  tx_reserve = tx_commit = tx_tail = 0;
+  tx_writers = tx_busy = 0;
+  tx_uart = huart->Instance;
+  tx_uart->CR3 |= USART_CR3_DMAT;
+
+  // Lowest urgency: log traffic must never delay control interrupts
+  HAL_NVIC_SetPriority(irq, 6, 0);
+  HAL_NVIC_EnableIRQ(irq);
+}
+
+void uart_tx_dma_irq(void) {
+  HAL_DMA_IRQHandler(&hdma_tx);
+}
+
+int uart_tx_write(const void* data, size_t len) {
+  if (!tx_uart || !data || len == 0) return 0;
+
+  atomic_add(&tx_writers, 1);
+  uint32_t start;
+  for (;;) {
+    start = __LDREXW(&tx_reserve);
+    if (len > UART_TX_RING_SIZE || start + len - tx_tail > UART_TX_RING_SIZE) {
+      __CLREX();
+      atomic_add(&tx_overflows, 1);
+      atomic_add(&tx_dropped, (int32_t)len);
+      uart_tx_publish();
+      return 0;
+    }
+    if (__STREXW(start + (uint32_t)len, &tx_reserve) == 0) break;
+  }
+
+  // copy into the claimed region, splitting at the end of the ring
+  uint32_t off = start & (UART_TX_RING_SIZE - 1);
+  size_t first = UART_TX_RING_SIZE - off;
+  if (first > len) first = len;
+  memcpy(&tx_ring[off], data, first);
+  if (len > first) memcpy(tx_ring, (const uint8_t*)data + first, len - first);
+  __DMB();
+
+  uart_tx_publish();
+  return 1;
+}
+
+int uart_tx_puts(const char* s) {
+  if (!s) return 0;
+  return uart_tx_write(s, strlen(s));
+}
+
+int uart_tx_printf(const char* fmt, ...) {
+  char buf[UART_TX_PRINTF_MAX];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n <= 0) return 0;
+  if (n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+  return uart_tx_write(buf, (size_t)n);
+}
+
+size_t uart_tx_free(void) {
+  if (!tx_uart) return 0;
+  return UART_TX_RING_SIZE - (tx_reserve - tx_tail);
+}
+
+uint32_t uart_tx_overflow_count(void) { return tx_overflows; }
+uint32_t uart_tx_dropped_bytes(void) { return tx_dropped; }
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Queued UART transmit shared by both boards. Writers only append to a
+// lock-free ring (safe from any interrupt priority); DMA drains it in the
+// background. A message that does not fit is dropped whole and counted,
+// the caller never waits.
+#ifndef UART_TX_RING_SIZE
+#define UART_TX_RING_SIZE 2048  // must be a power of two
+#endif
+
+// Longest line uart_tx_printf() formats; longer output is truncated
+#define UART_TX_PRINTF_MAX 192
+
+// Attach to an initialized UART and its TX DMA stream/channel. The board
+// must call uart_tx_dma_irq() from that stream's IRQ handler.
+void uart_tx_init(UART_HandleTypeDef* huart, DMA_Stream_TypeDef* stream, uint32_t channel, IRQn_Type irq);
+void uart_tx_dma_irq(void);
+
+// Append bytes to the queue. Returns 1 if queued, 0 if dropped (full or not initialized).
+int uart_tx_write(const void* data, size_t len);
+int uart_tx_puts(const char* s);
+int uart_tx_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Bytes a write could claim right now. Bulk senders check this and retry
+// later instead of having their chunks dropped.
+size_t uart_tx_free(void);
+
+// Overflow accounting
+uint32_t uart_tx_overflow_count(void);  // messages dropped
+uint32_t uart_tx_dropped_bytes(void);   // bytes in those messages
+
+#ifdef __cplusplus
+}
+#endif
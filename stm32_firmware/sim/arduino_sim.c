@@ -0,0 +1,11 @@
+// Arduino core functions the Board B sources call
+#include "Arduino.h"
+#include "stm32f4xx_hal.h"
+
+void delay(uint32_t ms) {
+  HAL_Delay(ms);
+}
+
+uint32_t millis(void) {
+  return HAL_GetTick();
+}
@@ -0,0 +1,490 @@
+// Closed-loop benchmark of the Board B control code on the host: the real
+// firmware sources run against the board model (sim_board.c) and a BLDC
+// motor, driven by console commands as the backend would send them.
+//
+//   esc_bench <scenario> [--quiet] [--uart]
+//
+// --uart echoes the firmware's UART4 output to stdout.
+//
+// Scenarios: openloop (throttle step), speed (SPD step), torque (TRQ step),
+// launch (full throttle from rest against the cycle-by-cycle current limit),
+// trip (hardware shutdown on overvoltage and on the break input).
+// Results are printed as key=value lines; the exit status is non-zero when
+// a result is outside the limits of its scenario.
+#include "sim_board.h"
+#include "hal_sim.h"
+#include "config_parser.h"
+#include "esc_control.h"
+#include "safety_monitor.h"
+#include "uart_commands.h"
+#include "driver_tim1.h"
+#include "hall_sensor.h"
+#include "telemetry.h"
+#include "blackbox.h"
+#include "uart_tx.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Background loop period (main.cpp's loop() runs continuously; 100 us is
+// well inside its real pass time)
+#define LOOP_US 100u
+
+// Per-period samples kept for the step analysis
+#define TRACE_MAX (2u * 1000u * 1000u)
+
+typedef struct {
+  const char* name;
+  uint8_t control_mode;
+  const char* before;      // command giving the initial operating point
+  const char* step;        // command giving the step
+  uint32_t settle_ms;      // time at the initial point
+  uint32_t run_ms;         // time after the step
+  int track_current;       // 1: response of the current magnitude, 0: speed
+  // pass limits
+  double min_final;        // rpm or A after the step
+  double max_rise_ms;
+  double max_ripple_a;     // median per-period phase current ripple
+  uint32_t current_limit_ma;  // config current_limit (0: bench default)
+  double max_ibus_peak_a;  // highest DC link current (0: not checked)
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+  {"openloop", CONTROL_MODE_OPEN_LOOP, "t70", "t95", 600, 800, 0, 3000.0, 400.0, 2.0},
+  {"speed", CONTROL_MODE_SPEED, "SPD 1000", "SPD 2500", 1000, 1000, 0, 2000.0, 600.0, 2.0},
+  {"torque", CONTROL_MODE_TORQUE, "TRQ 1000", "TRQ 4000", 300, 300, 1, 2.0, 100.0, 2.0},
+  {"launch", CONTROL_MODE_OPEN_LOOP, "t10", "t100", 100, 800, 0, 3000.0, 800.0, 10.0, 8000, 9.0},
+};
+
+/* ---- Trace of the plant, one entry per PWM period ----------------------- */
+
+typedef struct {
+  float t_ms;
+  float rpm;
+  float i_mag;     // current space vector magnitude (A)
+  float ripple;    // peak-to-peak of the largest phase current (A)
+  float ibus_peak; // highest DC link current in the period (A)
+} trace_t;
+
+static trace_t* trace;
+static size_t trace_len;
+
+static void on_period(const sim_board_period_t* p, void* ctx) {
+  (void)ctx;
+  if (trace_len >= TRACE_MAX) return;
+  double sq = 0.0;
+  int big = 0;
+  for (int k = 0; k < 3; ++k) {
+    sq += p->i_mean[k] * p->i_mean[k];
+    if (fabs(p->i_mean[k]) > fabs(p->i_mean[big])) big = k;
+  }
+  trace_t* e = &trace[trace_len++];
+  e->t_ms = (float)(p->time_us / 1000.0);
+  e->rpm = (float)p->rpm;
+  e->i_mag = (float)sqrt(2.0 / 3.0 * sq);
+  e->ripple = (float)p->i_pp[big];
+  e->ibus_peak = (float)p->ibus_peak;
+}
+
+// Highest DC link current over the trace
+static double trace_ibus_peak(void) {
+  double peak = 0.0;
+  for (size_t k = 0; k < trace_len; ++k) {
+    if (trace[k].ibus_peak > peak) peak = trace[k].ibus_peak;
+  }
+  return peak;
+}
+
+/* ---- Control step timing ------------------------------------------------ */
+
+static uint64_t step_count;
+static uint64_t step_ns_total;
+static uint64_t step_ns_max;
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// esc_control_step with host timing around it
+static void timed_control_step(void) {
+  uint64_t t0 = host_ns();
+  esc_control_step();
+  uint64_t dt = host_ns() - t0;
+  step_ns_total += dt;
+  if (dt > step_ns_max) step_ns_max = dt;
+  ++step_count;
+}
+
+/* ---- Board bring-up and the background loop ----------------------------- */
+
+static UART_HandleTypeDef huart4;
+static int echo_uart = 0;
+
+void DMA1_Stream4_IRQHandler(void) {
+  uart_tx_dma_irq();
+}
+
+static void uart_to_stdout(uint8_t byte, void* ctx) {
+  (void)ctx;
+  if (echo_uart) fputc(byte, stdout);
+}
+
+static void bench_config(esc_config_t* cfg, uint8_t mode, const motor_params_t* mp) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->battery_cells = 3;
+  cfg->battery_voltage_mv = 12000;
+  cfg->battery_nominal_mv = 14800;
+  cfg->voltage_cutoff_mv = 9000;
+  cfg->sensor_type = 0;
+  cfg->sensor_max_rpm = 10000;
+  cfg->motor_kv = (uint16_t)mp->kv_rpm_per_v;
+  cfg->motor_poles = (uint8_t)(mp->pole_pairs * 2);
+  cfg->control_mode = mode;
+  cfg->current_limit = 20000;
+  cfg->overcurrent_limit = 40000;
+  cfg->pwm_frequency_khz = 100;
+  cfg->max_temp = 90;
+  cfg->speed_kp = ESC_DEFAULT_SPEED_KP;
+  cfg->speed_ki = ESC_DEFAULT_SPEED_KI;
+  cfg->accel_rpm_s = ESC_DEFAULT_ACCEL_RPM_S;
+  cfg->current_bw_hz = ESC_DEFAULT_CURRENT_BW_HZ;
+  cfg->motor_r_mohm = (uint16_t)lround(mp->r_ohm * 1000.0);
+  cfg->motor_l_uh = (uint16_t)lround(mp->l_h * 1e6);
+}
+
+// The part of main.cpp's setup() the control path depends on
+static void board_setup(const esc_config_t* cfg) {
+  huart4.Instance = UART4;
+  huart4.Init.BaudRate = 115200;
+  huart4.Init.WordLength = UART_WORDLENGTH_8B;
+  huart4.Init.StopBits = UART_STOPBITS_1;
+  huart4.Init.Parity = UART_PARITY_NONE;
+  huart4.Init.Mode = UART_MODE_TX_RX;
+  huart4.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart4.Init.OverSampling = UART_OVERSAMPLING_16;
+  HAL_UART_Init(&huart4);
+  uart_tx_init(&huart4, DMA1_Stream4, DMA_CHANNEL_4, DMA1_Stream4_IRQn);
+
+  safety_monitor_init();
+  uart_commands_init();
+  telemetry_init();
+  blackbox_init();
+  hall_sensor_init();
+  driver_init_tim1();
+  driver_disable();
+  driver_set_control_callback(timed_control_step);
+
+  // closed-loop modes need the sensors (bypass forces open loop)
+  safety_set_bypass(0);
+  esc_control_init(cfg);
+}
+
+static void command(const char* line) {
+  char buf[64];
+  int n = snprintf(buf, sizeof(buf), "%s\r\n", line);
+  uart_commands_feed((const uint8_t*)buf, (size_t)n);
+}
+
+// main.cpp loop(): supervision, with the command watchdog fed as the
+// backend's traffic would
+static void run_ms(uint32_t ms) {
+  uint64_t end = sim_board_time_us() + (uint64_t)ms * 1000u;
+  uint64_t next_kick = 0;
+  while (sim_board_time_us() < end) {
+    sim_board_advance_us(LOOP_US);
+    if (sim_board_time_us() >= next_kick) {
+      next_kick = sim_board_time_us() + 100000u;
+      uart_commands_reset_watchdog();
+    }
+    esc_control_update();
+    blackbox_poll();
+    safety_monitor_poll();
+  }
+}
+
+/* ---- Step analysis ------------------------------------------------------ */
+
+static int cmp_float(const void* a, const void* b) {
+  float x = *(const float*)a, y = *(const float*)b;
+  return (x > y) - (x < y);
+}
+
+// Response signal per period: speed as is; the current magnitude, which
+// carries the commutation ripple, as a centred 1 ms moving average
+static double* response_signal(int current) {
+  double* v = malloc(trace_len * sizeof(double));
+  if (!current) {
+    for (size_t k = 0; k < trace_len; ++k) v[k] = trace[k].rpm;
+    return v;
+  }
+  size_t half = driver_get_control_hz() / 2000u;
+  double* prefix = malloc((trace_len + 1) * sizeof(double));
+  prefix[0] = 0.0;
+  for (size_t k = 0; k < trace_len; ++k) prefix[k + 1] = prefix[k] + trace[k].i_mag;
+  for (size_t k = 0; k < trace_len; ++k) {
+    size_t a = k > half ? k - half : 0;
+    size_t b = k + half + 1 < trace_len ? k + half + 1 : trace_len;
+    v[k] = (prefix[b] - prefix[a]) / (double)(b - a);
+  }
+  free(prefix);
+  return v;
+}
+
+// Mean over [t0, t1) ms
+static double signal_mean(const double* v, double t0, double t1) {
+  double sum = 0.0;
+  size_t n = 0;
+  for (size_t k = 0; k < trace_len; ++k) {
+    if (trace[k].t_ms < t0 || trace[k].t_ms >= t1) continue;
+    sum += v[k];
+    ++n;
+  }
+  return n ? sum / n : 0.0;
+}
+
+// First time after t0 where the signal reaches level (in the step direction)
+static double signal_cross(const double* v, double t0, double level, int up) {
+  for (size_t k = 0; k < trace_len; ++k) {
+    if (trace[k].t_ms < t0) continue;
+    if (up ? v[k] >= level : v[k] <= level) return trace[k].t_ms;
+  }
+  return -1.0;
+}
+
+typedef struct {
+  double initial, final;
+  double rise_ms;       // 10% to 90% of the step
+  double overshoot_pct;
+  double settle_ms;     // from the step until it stays within 5%
+  double ripple_a;      // median per-period ripple after settling
+  double ripple_p95_a;
+} step_result_t;
+
+static void analyse_step(double t_step, double t_end, int current, step_result_t* r) {
+  double* v = response_signal(current);
+  r->initial = signal_mean(v, t_step - 50.0, t_step);
+  r->final = signal_mean(v, t_end - 50.0, t_end);
+  double span = r->final - r->initial;
+  int up = span >= 0.0;
+
+  double t10 = signal_cross(v, t_step, r->initial + 0.1 * span, up);
+  double t90 = signal_cross(v, t_step, r->initial + 0.9 * span, up);
+  r->rise_ms = (t10 >= 0.0 && t90 >= 0.0) ? t90 - t10 : -1.0;
+
+  double peak = r->final;
+  double last_out = t_step;
+  double band = fabs(span) * 0.05;
+  for (size_t k = 0; k < trace_len; ++k) {
+    if (trace[k].t_ms < t_step) continue;
+    if (up ? v[k] > peak : v[k] < peak) peak = v[k];
+    if (fabs(v[k] - r->final) > band) last_out = trace[k].t_ms;
+  }
+  r->overshoot_pct = span != 0.0 ? 100.0 * (peak - r->final) / span : 0.0;
+  r->settle_ms = last_out - t_step;
+  free(v);
+
+  size_t n = 0;
+  float* rip = malloc(trace_len * sizeof(float));
+  // a signal that never holds the band (ripple above 5% of the step) is
+  // taken as settled over the window its final value comes from
+  double t_settled = t_step + r->settle_ms;
+  if (t_settled > t_end - 50.0) t_settled = t_end - 50.0;
+  for (size_t k = 0; k < trace_len; ++k) {
+    if (trace[k].t_ms >= t_settled && trace[k].t_ms < t_end) rip[n++] = trace[k].ripple;
+  }
+  if (n) {
+    qsort(rip, n, sizeof(float), cmp_float);
+    r->ripple_a = rip[n / 2];
+    r->ripple_p95_a = rip[(n * 95) / 100];
+  } else {
+    r->ripple_a = r->ripple_p95_a = -1.0;
+  }
+  free(rip);
+}
+
+/* ---- Scenario ----------------------------------------------------------- */
+
+static int run_scenario(const scenario_t* sc, int quiet) {
+  motor_params_t mp;
+  motor_default_params(&mp);
+  sim_board_config_t bc;
+  sim_board_config_defaults(&bc);
+  bc.adc_noise_lsb = 2.0;
+
+  sim_board_init(&bc, &mp);
+  sim_board_set_uart_sink(uart_to_stdout, NULL);
+  trace_len = 0;
+  step_count = step_ns_total = step_ns_max = 0;
+
+  esc_config_t cfg;
+  bench_config(&cfg, sc->control_mode, &mp);
+  if (sc->current_limit_ma) cfg.current_limit = sc->current_limit_ma;
+  board_setup(&cfg);
+  run_ms(50);
+
+  uint64_t wall0 = host_ns();
+  uint64_t sim0 = sim_board_time_us();
+  uint64_t steps0 = step_count;
+  sim_board_set_observer(on_period, NULL);
+
+  command("ARM");
+  command(sc->before);
+  run_ms(sc->settle_ms);
+  double t_step = sim_board_time_us() / 1000.0;
+  command(sc->step);
+  run_ms(sc->run_ms);
+  double t_end = sim_board_time_us() / 1000.0;
+  command("STOP");
+
+  double wall_s = (host_ns() - wall0) / 1e9;
+  double sim_s = (sim_board_time_us() - sim0) / 1e6;
+  uint64_t steps = step_count - steps0;
+
+  step_result_t r;
+  analyse_step(t_step, t_end, sc->track_current, &r);
+  const char* unit = sc->track_current ? "a" : "rpm";
+
+  printf("scenario=%s\n", sc->name);
+  printf("control_hz=%u\n", (unsigned)driver_get_control_hz());
+  printf("deadtime_ns=%.0f\n", sim_board_deadtime_ticks() * 1e9 / sim_apb2_timer_hz());
+  printf("control_steps_per_sim_s=%.0f\n", steps / sim_s);
+  printf("control_steps_per_wall_s=%.0f\n", steps / wall_s);
+  printf("control_step_ns_mean=%.0f\n", steps ? (double)step_ns_total / steps : 0.0);
+  printf("control_step_ns_max=%llu\n", (unsigned long long)step_ns_max);
+  printf("realtime_factor=%.3f\n", sim_s / wall_s);
+  printf("initial_%s=%.2f\n", unit, r.initial);
+  printf("final_%s=%.2f\n", unit, r.final);
+  printf("rise_ms=%.2f\n", r.rise_ms);
+  printf("overshoot_pct=%.1f\n", r.overshoot_pct);
+  printf("settle_ms=%.2f\n", r.settle_ms);
+  printf("ripple_a_median=%.3f\n", r.ripple_a);
+  printf("ripple_a_p95=%.3f\n", r.ripple_p95_a);
+  printf("ibus_peak_a=%.2f\n", trace_ibus_peak());
+  printf("esc_flags=0x%02x\n", esc_control_get_flags());
+
+  int fail = 0;
+  double expected_hz = driver_get_control_hz();
+  if (fabs(steps / sim_s - expected_hz) > expected_hz * 0.01) {
+    printf("FAIL: control steps do not run at the control rate\n");
+    fail = 1;
+  }
+  if (r.final < sc->min_final) {
+    printf("FAIL: final %s %.2f below %.2f\n", unit, r.final, sc->min_final);
+    fail = 1;
+  }
+  if (r.rise_ms < 0.0 || r.rise_ms > sc->max_rise_ms) {
+    printf("FAIL: rise time %.2f ms (limit %.2f)\n", r.rise_ms, sc->max_rise_ms);
+    fail = 1;
+  }
+  double ibus_peak = trace_ibus_peak();
+  if (sc->max_ibus_peak_a > 0.0 && ibus_peak > sc->max_ibus_peak_a) {
+    printf("FAIL: bus current peak %.2f A (limit %.2f)\n", ibus_peak, sc->max_ibus_peak_a);
+    fail = 1;
+  }
+  if (r.ripple_a < 0.0 || r.ripple_a > sc->max_ripple_a) {
+    printf("FAIL: ripple %.3f A (limit %.3f)\n", r.ripple_a, sc->max_ripple_a);
+    fail = 1;
+  }
+  if (!quiet) printf("result=%s\n", fail ? "FAIL" : "PASS");
+  return fail;
+}
+
+/* ---- Hardware trips ----------------------------------------------------- */
+
+// Longest time from a fault to the bridge being off: one PWM period for the
+// next ADC conversion, plus the interrupt
+#define TRIP_MAX_US 15.0
+
+// Simulated time until TIM1 MOE clears, in us (-1: not within max_us)
+static double time_to_shutdown(uint32_t max_us) {
+  for (uint32_t us = 1; us <= max_us; ++us) {
+    sim_board_advance_us(1);
+    if (!(TIM1->BDTR & TIM_BDTR_MOE)) return us;
+  }
+  return -1.0;
+}
+
+// Check one trip: shut down in time, fault latched with the expected cause
+static int check_trip(const char* name, double shutdown_us, uint8_t flag) {
+  run_ms(5);
+  uint8_t flags = esc_control_get_flags();
+  printf("%s_shutdown_us=%.0f\n", name, shutdown_us);
+  printf("%s_esc_flags=0x%02x\n", name, flags);
+  int fail = 0;
+  if (shutdown_us < 0.0 || shutdown_us > TRIP_MAX_US) {
+    printf("FAIL: %s shutdown %.0f us (limit %.0f)\n", name, shutdown_us, TRIP_MAX_US);
+    fail = 1;
+  }
+  if (esc_control_get_state() != ESC_FAULT || !(flags & flag)) {
+    printf("FAIL: %s did not latch its fault\n", name);
+    fail = 1;
+  }
+  return fail;
+}
+
+static int run_trip(int quiet) {
+  motor_params_t mp;
+  motor_default_params(&mp);
+  sim_board_config_t bc;
+  sim_board_config_defaults(&bc);
+  bc.adc_noise_lsb = 2.0;
+  sim_board_init(&bc, &mp);
+  sim_board_set_uart_sink(uart_to_stdout, NULL);
+
+  esc_config_t cfg;
+  bench_config(&cfg, CONTROL_MODE_OPEN_LOOP, &mp);
+  board_setup(&cfg);
+  run_ms(50);
+  printf("scenario=trip\n");
+
+  // supply surge past the overvoltage limit: ADC3 watchdog
+  command("ARM");
+  command("t70");
+  run_ms(300);
+  sim_board_set_vbus(cfg.battery_nominal_mv * 1.1e-3);
+  int fail = check_trip("overvoltage", time_to_shutdown(1000), ESC_FLAG_FAULT_OVERVOLTAGE);
+  sim_board_set_vbus(bc.vbus_v);
+
+  // comparator on BKIN: the board trips without the CPU
+  command("STOP");
+  run_ms(100);
+  command("ARM");
+  command("t70");
+  run_ms(300);
+  sim_board_set_bkin_trip(1.0);
+  fail |= check_trip("break", time_to_shutdown(1000), ESC_FLAG_FAULT_OVERCURRENT);
+  command("STOP");
+
+  if (!quiet) printf("result=%s\n", fail ? "FAIL" : "PASS");
+  return fail;
+}
+
+// One scenario per process: the firmware keeps its state in statics, as on
+// the board, and is only initialised once
+int main(int argc, char** argv) {
+  const char* name = NULL;
+  int quiet = 0;
+  for (int k = 1; k < argc; ++k) {
+    if (strcmp(argv[k], "--quiet") == 0) quiet = 1;
+    else if (strcmp(argv[k], "--uart") == 0) echo_uart = 1;
+    else name = argv[k];
+  }
+  if (name && strcmp(name, "trip") == 0) return run_trip(quiet);
+  const scenario_t* sc = NULL;
+  for (size_t k = 0; name && k < sizeof(scenarios) / sizeof(scenarios[0]); ++k) {
+    if (strcmp(name, scenarios[k].name) == 0) sc = &scenarios[k];
+  }
+  if (!sc) {
+    fprintf(stderr, "usage: %s openloop|speed|torque|launch|trip [--quiet] [--uart]\n", argv[0]);
+    return 2;
+  }
+  trace = malloc(TRACE_MAX * sizeof(trace_t));
+  if (!trace) return 2;
+  int fail = run_scenario(sc, quiet);
+  free(trace);
+  return fail;
+}
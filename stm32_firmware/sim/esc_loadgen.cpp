@@ -0,0 +1,502 @@
+// Protocol load generator for Board B (real or virtual_board) on a serial
+// terminal. Streams throttle commands, STATUS queries, binary GET_STATUS
+// packets and config frame uploads at fixed rates and reports the
+// command-to-response latency of each.
+//
+//   esc_loadgen <tty> [options]
+//   esc_loadgen --spawn <virtual_board> [options]
+//
+// --spawn PATH     start PATH (a virtual_board) and use the terminal it prints
+// --duration S     run time per stage (default 10)
+// --throttle HZ    "t<N>" commands, answered by "<N>" (default 20)
+// --status HZ      "STATUS" commands, answered by "STATUS: ..." (default 2)
+// --packet HZ      binary GET_STATUS packets (default 5)
+// --frame HZ       config frame uploads, answered by "Frame saved" (default 0)
+// --timeout MS     a request unanswered this long is lost (default 2000, as
+//                  backend_node/core/escConnection.js)
+// --max-p99 MS     fail a stage whose p99 latency is above this (default 250)
+// --sweep N        run N stages, doubling every rate each stage, and report
+//                  the highest total rate that met the limits
+//
+// Latency runs from the last byte of a command reaching the terminal to the
+// end of its response, so it includes the wait behind earlier traffic on
+// both directions of the 115200 baud line. Results are key=value lines; the
+// exit status is non-zero when the first stage loses requests or misses
+// --max-p99.
+#include "config_parser.h"
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Binary protocol framing (esc_protocol.h)
+#define PROTO_START 0xAA
+#define PROTO_END 0x55
+#define PROTO_CMD_GET_STATUS 0x04
+#define PROTO_CMD_NACK 0x7F
+#define PROTO_LEN_MIN 3u
+#define PROTO_LEN_MAX 35u
+
+// Time for the board to boot and print its banner before the first stage
+#define SETTLE_MS 1000u
+
+enum { REQ_THROTTLE, REQ_STATUS, REQ_PACKET, REQ_FRAME, REQ_KINDS };
+
+static const char* const kind_name[REQ_KINDS] = {"throttle", "status", "packet", "frame"};
+
+struct request_t {
+  int tag;            // throttle value echoed back, -1 otherwise
+  uint64_t end;       // stream offset just past the request's last byte
+  uint64_t sent_ns;   // when that byte was written
+};
+
+struct kind_stats_t {
+  uint64_t sent = 0, answered = 0, errors = 0, lost = 0;
+  std::vector<double> latency_ms;
+};
+
+struct stage_t {
+  double rate_hz[REQ_KINDS];
+  double duration_s;
+  kind_stats_t kind[REQ_KINDS];
+  uint64_t tx_bytes = 0, rx_bytes = 0;
+};
+
+static int tty = -1;
+static double timeout_ms = 2000.0;
+
+// Transmit side: bytes not yet taken by the terminal, and the requests in
+// them that have not been fully written
+static std::vector<uint8_t> tx_pending;
+static uint64_t tx_written = 0;
+static uint64_t tx_queued = 0;
+static std::deque<request_t> unsent[REQ_KINDS];
+static std::deque<request_t> outstanding[REQ_KINDS];
+
+// Receive side parser
+static std::string rx_line;
+static std::vector<uint8_t> rx_packet;
+static int in_packet = 0;
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint16_t crc16_ccitt(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= (uint16_t)(data[i] << 8);
+    for (int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+/* ---- Terminal ----------------------------------------------------------- */
+
+static int tty_open(const char* path) {
+  tty = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (tty < 0) return 0;
+  struct termios tio;
+  if (tcgetattr(tty, &tio) != 0) return 0;
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  return tcsetattr(tty, TCSANOW, &tio) == 0;
+}
+
+// Start a virtual_board and return the terminal it announces
+static pid_t spawn_board(const char* exe, std::string* pty_path, FILE** out) {
+  int fds[2];
+  if (pipe(fds) != 0) return -1;
+  pid_t pid = fork();
+  if (pid < 0) return -1;
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execl(exe, exe, (char*)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  *out = fdopen(fds[0], "r");
+  char line[256];
+  while (fgets(line, sizeof(line), *out)) {
+    if (!strncmp(line, "pty=", 4)) {
+      line[strcspn(line, "\r\n")] = '\0';
+      *pty_path = line + 4;
+      return pid;
+    }
+  }
+  waitpid(pid, NULL, 0);
+  return -1;
+}
+
+/* ---- Requests ----------------------------------------------------------- */
+
+static void queue_request(int kind, const void* bytes, size_t len, int tag) {
+  const uint8_t* p = (const uint8_t*)bytes;
+  tx_pending.insert(tx_pending.end(), p, p + len);
+  tx_queued += len;
+  request_t r;
+  r.tag = tag;
+  r.end = tx_queued;
+  r.sent_ns = 0;
+  unsent[kind].push_back(r);
+}
+
+static void send_throttle(void) {
+  static int value = 0;
+  value = value % 99 + 1;  // 1..99: 0 is answered by "OK"
+  char cmd[16];
+  int n = snprintf(cmd, sizeof(cmd), "t%d\n", value);
+  queue_request(REQ_THROTTLE, cmd, (size_t)n, value);
+}
+
+static void send_status(void) {
+  queue_request(REQ_STATUS, "STATUS\n", 7, -1);
+}
+
+static void send_packet(void) {
+  uint8_t cmd = PROTO_CMD_GET_STATUS;
+  uint16_t crc = crc16_ccitt(&cmd, 1);
+  const uint8_t pkt[] = {PROTO_START, 0x00, 0x03, cmd, (uint8_t)(crc >> 8), (uint8_t)crc, PROTO_END};
+  queue_request(REQ_PACKET, pkt, sizeof(pkt), -1);
+}
+
+// Two configs in turn: the board only answers a frame that differs from the
+// stored one. The trailing newline clears the console parser, which sees the
+// frame bytes too.
+static void send_frame(void) {
+  static int which = 0;
+  esc_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.battery_cells = 3;
+  cfg.battery_voltage_mv = which ? 12600 : 12500;
+  cfg.battery_nominal_mv = 11100;
+  cfg.sensor_max_rpm = 20000;
+  cfg.motor_kv = 1000;
+  cfg.motor_poles = 14;
+  cfg.control_mode = CONTROL_MODE_OPEN_LOOP;
+  cfg.current_limit = 20000;
+  cfg.pwm_frequency_khz = 20;
+  cfg.max_temp = 80;
+  cfg.overcurrent_limit = 30000;
+  which ^= 1;
+
+  uint8_t frame[ESC_CONFIG_FRAME_LEN_V4 + 1];
+  size_t n = build_esc_config_frame(&cfg, frame, sizeof(frame));
+  frame[n++] = '\n';
+  queue_request(REQ_FRAME, frame, n, -1);
+}
+
+static void flush_tx(void) {
+  if (!tx_pending.empty()) {
+    ssize_t n = write(tty, tx_pending.data(), tx_pending.size());
+    if (n > 0) {
+      tx_pending.erase(tx_pending.begin(), tx_pending.begin() + n);
+      tx_written += (uint64_t)n;
+    }
+  }
+  uint64_t now = host_ns();
+  for (int k = 0; k < REQ_KINDS; ++k) {
+    while (!unsent[k].empty() && unsent[k].front().end <= tx_written) {
+      request_t r = unsent[k].front();
+      unsent[k].pop_front();
+      r.sent_ns = now;
+      outstanding[k].push_back(r);
+    }
+  }
+}
+
+/* ---- Responses ---------------------------------------------------------- */
+
+// Answer the oldest outstanding request of a kind (with the given tag, if any)
+static void answer(stage_t* st, int kind, int tag, int error) {
+  std::deque<request_t>& q = outstanding[kind];
+  for (size_t i = 0; i < q.size(); ++i) {
+    if (tag >= 0 && q[i].tag != tag) continue;
+    kind_stats_t& ks = st->kind[kind];
+    ks.answered++;
+    if (error) ks.errors++;
+    ks.latency_ms.push_back((host_ns() - q[i].sent_ns) / 1e6);
+    q.erase(q.begin() + (long)i);
+    return;
+  }
+}
+
+static void on_line(stage_t* st, const std::string& line) {
+  if (line.empty()) return;
+  if (!line.compare(0, 7, "STATUS:")) {
+    answer(st, REQ_STATUS, -1, 0);
+  } else if (line == "Frame saved") {
+    answer(st, REQ_FRAME, -1, 0);
+  } else if (!line.compare(0, 28, "Error: failed to write frame")) {
+    answer(st, REQ_FRAME, -1, 1);
+  } else if (line.find_first_not_of("0123456789") == std::string::npos) {
+    answer(st, REQ_THROTTLE, atoi(line.c_str()), 0);
+  }
+  // anything else is unsolicited (banner, telemetry) and ignored
+}
+
+static void on_packet(stage_t* st, const std::vector<uint8_t>& p) {
+  size_t len = ((size_t)p[1] << 8) | p[2];
+  size_t data_len = len - PROTO_LEN_MIN;
+  uint16_t crc = (uint16_t)(p[4 + data_len] << 8 | p[5 + data_len]);
+  if (p.back() != PROTO_END || crc != crc16_ccitt(&p[3], data_len + 1)) return;
+  if (p[3] == PROTO_CMD_GET_STATUS) answer(st, REQ_PACKET, -1, 0);
+  else if (p[3] == PROTO_CMD_NACK && data_len >= 1 && p[4] == PROTO_CMD_GET_STATUS) answer(st, REQ_PACKET, -1, 1);
+}
+
+// Text lines and binary packets share the line; a packet starts with 0xAA,
+// which never occurs in text
+static void on_rx(stage_t* st, const uint8_t* data, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t b = data[i];
+    if (in_packet) {
+      rx_packet.push_back(b);
+      if (rx_packet.size() == 3) {
+        size_t len = ((size_t)rx_packet[1] << 8) | rx_packet[2];
+        if (len < PROTO_LEN_MIN || len > PROTO_LEN_MAX) in_packet = 0;
+      } else if (rx_packet.size() > 3) {
+        size_t len = ((size_t)rx_packet[1] << 8) | rx_packet[2];
+        if (rx_packet.size() == len + 4) {
+          on_packet(st, rx_packet);
+          in_packet = 0;
+        }
+      }
+    } else if (b == PROTO_START) {
+      in_packet = 1;
+      rx_packet.assign(1, b);
+      rx_line.clear();
+    } else if (b == '\n') {
+      on_line(st, rx_line);
+      rx_line.clear();
+    } else if (b != '\r') {
+      rx_line.push_back((char)b);
+    }
+  }
+}
+
+static void expire(stage_t* st, uint64_t now) {
+  for (int k = 0; k < REQ_KINDS; ++k) {
+    std::deque<request_t>& q = outstanding[k];
+    while (!q.empty() && (now - q.front().sent_ns) / 1e6 > timeout_ms) {
+      q.pop_front();
+      st->kind[k].lost++;
+    }
+  }
+}
+
+static int requests_in_flight(void) {
+  for (int k = 0; k < REQ_KINDS; ++k) {
+    if (!unsent[k].empty() || !outstanding[k].empty()) return 1;
+  }
+  return 0;
+}
+
+/* ---- Stages ------------------------------------------------------------- */
+
+// Read for ms without sending; stale output is dropped unparsed
+static void discard_input(unsigned ms) {
+  uint64_t end = host_ns() + (uint64_t)ms * 1000000u;
+  uint8_t buf[512];
+  while (host_ns() < end) {
+    struct pollfd pfd = {tty, POLLIN, 0};
+    poll(&pfd, 1, 10);
+    while (read(tty, buf, sizeof(buf)) > 0) {}
+  }
+  rx_line.clear();
+  in_packet = 0;
+}
+
+static void run_stage(stage_t* st) {
+  typedef void (*sender_t)(void);
+  static const sender_t senders[REQ_KINDS] = {send_throttle, send_status, send_packet, send_frame};
+
+  uint64_t t0 = host_ns();
+  uint64_t end = t0 + (uint64_t)(st->duration_s * 1e9);
+  uint64_t drain_end = end + (uint64_t)(timeout_ms * 1e6);
+  double next_due[REQ_KINDS];
+  for (int k = 0; k < REQ_KINDS; ++k) next_due[k] = 0.0;
+  uint64_t written0 = tx_written;
+
+  for (;;) {
+    uint64_t now = host_ns();
+    if (now >= drain_end || (now >= end && !requests_in_flight())) break;
+
+    // offered load: requests go out on schedule whether or not the board keeps up
+    double t = (now - t0) / 1e9;
+    double wait_s = 0.01;
+    for (int k = 0; k < REQ_KINDS && now < end; ++k) {
+      if (st->rate_hz[k] <= 0.0) continue;
+      while (t >= next_due[k]) {
+        senders[k]();
+        st->kind[k].sent++;
+        next_due[k] += 1.0 / st->rate_hz[k];
+      }
+      wait_s = std::min(wait_s, next_due[k] - t);
+    }
+    flush_tx();
+
+    struct pollfd pfd = {tty, (short)(POLLIN | (tx_pending.empty() ? 0 : POLLOUT)), 0};
+    int wait_ms = (int)(wait_s * 1000.0);
+    poll(&pfd, 1, wait_ms > 0 ? wait_ms : 0);
+
+    uint8_t buf[1024];
+    ssize_t n;
+    while ((n = read(tty, buf, sizeof(buf))) > 0) {
+      st->rx_bytes += (uint64_t)n;
+      on_rx(st, buf, (size_t)n);
+    }
+    expire(st, host_ns());
+  }
+
+  // whatever is still queued counts against this stage
+  for (int k = 0; k < REQ_KINDS; ++k) {
+    st->kind[k].lost += unsent[k].size() + outstanding[k].size();
+    unsent[k].clear();
+    outstanding[k].clear();
+  }
+  tx_pending.clear();
+  tx_queued = tx_written;
+  st->tx_bytes = tx_written - written0;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return -1.0;
+  size_t i = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// Prints the stage and returns whether it met the limits
+static int report_stage(stage_t* st, const char* prefix, double max_p99_ms) {
+  double offered = 0.0, answered = 0.0, worst_p99 = 0.0;
+  uint64_t lost = 0, errors = 0;
+  for (int k = 0; k < REQ_KINDS; ++k) {
+    kind_stats_t& ks = st->kind[k];
+    offered += st->rate_hz[k];
+    answered += ks.answered / st->duration_s;
+    lost += ks.lost;
+    errors += ks.errors;
+    if (ks.sent == 0) continue;
+    std::sort(ks.latency_ms.begin(), ks.latency_ms.end());
+    double p99 = percentile(ks.latency_ms, 99);
+    worst_p99 = std::max(worst_p99, p99);
+    printf("%s%s_sent=%llu\n", prefix, kind_name[k], (unsigned long long)ks.sent);
+    printf("%s%s_answered=%llu\n", prefix, kind_name[k], (unsigned long long)ks.answered);
+    printf("%s%s_errors=%llu\n", prefix, kind_name[k], (unsigned long long)ks.errors);
+    printf("%s%s_lost=%llu\n", prefix, kind_name[k], (unsigned long long)ks.lost);
+    printf("%s%s_p50_ms=%.2f\n", prefix, kind_name[k], percentile(ks.latency_ms, 50));
+    printf("%s%s_p90_ms=%.2f\n", prefix, kind_name[k], percentile(ks.latency_ms, 90));
+    printf("%s%s_p99_ms=%.2f\n", prefix, kind_name[k], p99);
+    printf("%s%s_max_ms=%.2f\n", prefix, kind_name[k], ks.latency_ms.empty() ? -1.0 : ks.latency_ms.back());
+  }
+  printf("%soffered_hz=%.1f\n", prefix, offered);
+  printf("%sanswered_hz=%.1f\n", prefix, answered);
+  printf("%stx_bytes_per_s=%.0f\n", prefix, st->tx_bytes / st->duration_s);
+  printf("%srx_bytes_per_s=%.0f\n", prefix, st->rx_bytes / st->duration_s);
+  int ok = lost == 0 && errors == 0 && worst_p99 <= max_p99_ms;
+  printf("%sresult=%s\n", prefix, ok ? "PASS" : "FAIL");
+  fflush(stdout);
+  return ok;
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: esc_loadgen (<tty> | --spawn <virtual_board>) [--duration S] [--throttle HZ]\n"
+          "                   [--status HZ] [--packet HZ] [--frame HZ] [--timeout MS]\n"
+          "                   [--max-p99 MS] [--sweep N]\n");
+}
+
+int main(int argc, char** argv) {
+  const char* tty_path = NULL;
+  const char* spawn = NULL;
+  double duration_s = 10.0;
+  double rate[REQ_KINDS] = {20.0, 2.0, 5.0, 0.0};
+  double max_p99_ms = 250.0;
+  int sweep = 0;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    int has_value = i + 1 < argc;
+    if (!strcmp(a, "--spawn") && has_value) spawn = argv[++i];
+    else if (!strcmp(a, "--duration") && has_value) duration_s = atof(argv[++i]);
+    else if (!strcmp(a, "--throttle") && has_value) rate[REQ_THROTTLE] = atof(argv[++i]);
+    else if (!strcmp(a, "--status") && has_value) rate[REQ_STATUS] = atof(argv[++i]);
+    else if (!strcmp(a, "--packet") && has_value) rate[REQ_PACKET] = atof(argv[++i]);
+    else if (!strcmp(a, "--frame") && has_value) rate[REQ_FRAME] = atof(argv[++i]);
+    else if (!strcmp(a, "--timeout") && has_value) timeout_ms = atof(argv[++i]);
+    else if (!strcmp(a, "--max-p99") && has_value) max_p99_ms = atof(argv[++i]);
+    else if (!strcmp(a, "--sweep") && has_value) sweep = atoi(argv[++i]);
+    else if (a[0] != '-' && !tty_path) tty_path = a;
+    else {
+      usage();
+      return 2;
+    }
+  }
+  if ((!tty_path && !spawn) || duration_s <= 0.0) {
+    usage();
+    return 2;
+  }
+
+  pid_t board = -1;
+  FILE* board_out = NULL;
+  std::string spawned_path;
+  if (spawn) {
+    board = spawn_board(spawn, &spawned_path, &board_out);
+    if (board < 0) {
+      fprintf(stderr, "esc_loadgen: %s did not announce a terminal\n", spawn);
+      return 1;
+    }
+    tty_path = spawned_path.c_str();
+  }
+  if (!tty_open(tty_path)) {
+    fprintf(stderr, "esc_loadgen: cannot open %s: %s\n", tty_path, strerror(errno));
+    if (board > 0) kill(board, SIGTERM);
+    return 1;
+  }
+  printf("tty=%s\n", tty_path);
+  discard_input(SETTLE_MS);
+
+  int stages = sweep > 0 ? sweep : 1;
+  int first_ok = 0;
+  double best_hz = 0.0;
+  for (int s = 0; s < stages; ++s) {
+    stage_t st;
+    st.duration_s = duration_s;
+    for (int k = 0; k < REQ_KINDS; ++k) st.rate_hz[k] = rate[k] * (double)(1u << s);
+    char prefix[32] = "";
+    if (sweep > 0) snprintf(prefix, sizeof(prefix), "stage%d_", s);
+    run_stage(&st);
+    int ok = report_stage(&st, prefix, max_p99_ms);
+    if (s == 0) first_ok = ok;
+    if (!ok) break;
+    double offered = 0.0;
+    for (int k = 0; k < REQ_KINDS; ++k) offered += st.rate_hz[k];
+    best_hz = offered;
+  }
+  if (sweep > 0) printf("max_sustainable_hz=%.1f\n", best_hz);
+
+  close(tty);
+  if (board > 0) {
+    // pass the board's own counters through
+    kill(board, SIGTERM);
+    char line[256];
+    while (fgets(line, sizeof(line), board_out)) printf("board_%s", line);
+    fclose(board_out);
+    waitpid(board, NULL, 0);
+  }
+  return first_ok ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+// The frame store main.cpp provides, kept in RAM for builds that do not
+// include main.cpp
+#include "stm32f4xx_hal.h"
+#include "frame_store.h"
+#include <string.h>
+
+#define FRAME_STORE_MAX 256
+
+static uint8_t stored[FRAME_STORE_MAX];
+static size_t stored_len = 0;
+
+size_t frame_store_get(uint8_t* buf, size_t maxlen) {
+  if (buf && maxlen > 0) memcpy(buf, stored, stored_len < maxlen ? stored_len : maxlen);
+  return stored_len;
+}
+
+int frame_store_has(void) {
+  return stored_len != 0;
+}
+
+int frame_store_save(const uint8_t* data, size_t len) {
+  if (!data || len == 0 || len > FRAME_STORE_MAX) return 0;
+  memcpy(stored, data, len);
+  stored_len = len;
+  return 1;
+}
+
+static frame_store_cal_t stored_cal;
+static int has_cal = 0;
+
+int frame_store_get_cal(frame_store_cal_t* cal) {
+  if (!has_cal) return 0;
+  *cal = stored_cal;
+  return 1;
+}
+
+int frame_store_save_cal(const frame_store_cal_t* cal) {
+  stored_cal = *cal;
+  has_cal = 1;
+  return 1;
+}
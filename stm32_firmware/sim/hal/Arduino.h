@@ -0,0 +1,21 @@
+#pragma once
+
+// The part of the Arduino core main.cpp uses. The host front end
+// (virtual_board.cpp) plays the core's main(): setup() once, then loop().
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void delay(uint32_t ms);
+uint32_t millis(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+void setup(void);
+void loop(void);
@@ -0,0 +1,4 @@
+#pragma once
+
+// CMSIS device header; the register definitions live in the HAL shim
+#include "stm32f4xx_hal.h"
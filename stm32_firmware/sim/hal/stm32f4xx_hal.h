@@ -0,0 +1,643 @@
+#pragma once
+
+// Host stand-in for the STM32F4 HAL used by the Board B sources. Peripheral
+// registers are plain structs in host memory (hal_sim.c); the HAL calls the
+// firmware makes program them the way the real HAL would, and sim_board.c
+// turns the register state into timer events, ADC samples and interrupts.
+// Only what src/board_b and lib/uart_tx use is declared here.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __IO volatile
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { RESET = 0, SET = 1 } FlagStatus;
+typedef enum { DISABLE = 0, ENABLE = 1 } FunctionalState;
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+
+// Interrupt numbers as on the F405 (stm32f405xx.h)
+typedef enum {
+  EXTI0_IRQn = 6,
+  EXTI1_IRQn = 7,
+  EXTI2_IRQn = 8,
+  DMA1_Stream0_IRQn = 11,
+  DMA1_Stream1_IRQn = 12,
+  DMA1_Stream2_IRQn = 13,
+  DMA1_Stream3_IRQn = 14,
+  DMA1_Stream4_IRQn = 15,
+  DMA1_Stream5_IRQn = 16,
+  DMA1_Stream6_IRQn = 17,
+  ADC_IRQn = 18,
+  TIM1_BRK_TIM9_IRQn = 24,
+  TIM1_UP_TIM10_IRQn = 25,
+  TIM1_CC_IRQn = 27,
+  TIM2_IRQn = 28,
+  TIM4_IRQn = 30,
+  USART2_IRQn = 38,
+  DMA1_Stream7_IRQn = 47,
+  TIM5_IRQn = 50,
+  UART4_IRQn = 52,
+  TIM7_IRQn = 55,
+  DMA2_Stream0_IRQn = 56,
+  DMA2_Stream1_IRQn = 57,
+  DMA2_Stream2_IRQn = 58,
+  DMA2_Stream3_IRQn = 59,
+  DMA2_Stream4_IRQn = 60,
+  SIM_IRQ_COUNT = 82
+} IRQn_Type;
+
+/* ---- Register blocks ---------------------------------------------------- */
+
+typedef struct { __IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2]; } GPIO_TypeDef;
+typedef struct {
+  __IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR;
+  __IO uint32_t CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR;
+} TIM_TypeDef;
+typedef struct {
+  __IO uint32_t SR, CR1, CR2, SMPR1, SMPR2, JOFR1, JOFR2, JOFR3, JOFR4, HTR, LTR;
+  __IO uint32_t SQR1, SQR2, SQR3, JSQR, JDR1, JDR2, JDR3, JDR4, DR;
+} ADC_TypeDef;
+typedef struct { __IO uint32_t CSR, CCR, CDR; } ADC_Common_TypeDef;
+typedef struct { __IO uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR; } DMA_Stream_TypeDef;
+typedef struct { __IO uint32_t LISR, HISR, LIFCR, HIFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR; } USART_TypeDef;
+typedef struct { __IO uint32_t KR, PR, RLR, SR; } IWDG_TypeDef;
+typedef struct { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+typedef struct { __IO uint32_t MEMRMP, PMC, EXTICR[4], CMPCR; } SYSCFG_TypeDef;
+typedef struct {
+  __IO uint32_t CR, PLLCFGR, CFGR, CIR, AHB1RSTR, AHB2RSTR, AHB3RSTR, r0, APB1RSTR, APB2RSTR, r1[2];
+  __IO uint32_t AHB1ENR, AHB2ENR, AHB3ENR, r2, APB1ENR, APB2ENR, r3[2];
+  __IO uint32_t AHB1LPENR, AHB2LPENR, AHB3LPENR, r4, APB1LPENR, APB2LPENR, r5[2], BDCR, CSR;
+} RCC_TypeDef;
+typedef struct {
+  __IO uint32_t CR, SWTRIGR, DHR12R1, DHR12L1, DHR8R1, DHR12R2, DHR12L2, DHR8R2;
+  __IO uint32_t DHR12RD, DHR12LD, DHR8RD, DOR1, DOR2, SR;
+} DAC_TypeDef;
+typedef struct { __IO uint32_t CTRL, CYCCNT, CPICNT, EXCCNT, SLEEPCNT, LSUCNT, FOLDCNT, PCSR; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+typedef struct {
+  union { __IO uint8_t u8; __IO uint16_t u16; __IO uint32_t u32; } PORT[32];
+  uint32_t r0[864];
+  __IO uint32_t TER;
+  uint32_t r1[15];
+  __IO uint32_t TPR;
+  uint32_t r2[15];
+  __IO uint32_t TCR;
+} ITM_Type;
+
+extern GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC, sim_GPIOD;
+extern TIM_TypeDef sim_TIM1, sim_TIM2, sim_TIM4, sim_TIM5, sim_TIM7;
+extern ADC_TypeDef sim_ADC1, sim_ADC2, sim_ADC3;
+extern ADC_Common_TypeDef sim_ADC123_COMMON;
+extern DMA_TypeDef sim_DMA1, sim_DMA2;
+// DMA1 streams 0-7 then DMA2 streams 0-7, so address order matches the F4
+// memory map (lib/uart_tx compares stream pointers to pick the controller)
+extern DMA_Stream_TypeDef sim_dma_streams[16];
+extern USART_TypeDef sim_UART4, sim_USART2;
+extern IWDG_TypeDef sim_IWDG;
+extern EXTI_TypeDef sim_EXTI;
+extern SYSCFG_TypeDef sim_SYSCFG;
+extern RCC_TypeDef sim_RCC;
+extern DAC_TypeDef sim_DAC;
+extern DWT_Type sim_DWT;
+extern CoreDebug_Type sim_CoreDebug;
+extern ITM_Type sim_ITM;
+
+#define GPIOA (&sim_GPIOA)
+#define GPIOB (&sim_GPIOB)
+#define GPIOC (&sim_GPIOC)
+#define GPIOD (&sim_GPIOD)
+#define TIM1 (&sim_TIM1)
+#define TIM2 (&sim_TIM2)
+#define TIM4 (&sim_TIM4)
+#define TIM5 (&sim_TIM5)
+#define TIM7 (&sim_TIM7)
+#define ADC1 (&sim_ADC1)
+#define ADC2 (&sim_ADC2)
+#define ADC3 (&sim_ADC3)
+#define ADC123_COMMON (&sim_ADC123_COMMON)
+#define DMA1 (&sim_DMA1)
+#define DMA2 (&sim_DMA2)
+#define DMA1_Stream0 (&sim_dma_streams[0])
+#define DMA1_Stream2 (&sim_dma_streams[2])
+#define DMA1_Stream4 (&sim_dma_streams[4])
+#define DMA1_Stream6 (&sim_dma_streams[6])
+#define DMA2_Stream0 (&sim_dma_streams[8])
+#define DMA2_Stream2 (&sim_dma_streams[10])
+#define UART4 (&sim_UART4)
+#define USART2 (&sim_USART2)
+#define IWDG (&sim_IWDG)
+#define EXTI (&sim_EXTI)
+#define SYSCFG (&sim_SYSCFG)
+#define RCC (&sim_RCC)
+#define DAC (&sim_DAC)
+#define DWT (&sim_DWT)
+#define CoreDebug (&sim_CoreDebug)
+#define ITM (&sim_ITM)
+
+// 64 KB core-coupled RAM (blackbox.c places its ring here by address)
+extern uint8_t sim_ccm_ram[64 * 1024];
+#define CCMDATARAM_BASE ((uintptr_t)sim_ccm_ram)
+
+/* ---- GPIO --------------------------------------------------------------- */
+
+typedef struct { uint32_t Pin, Mode, Pull, Speed, Alternate; } GPIO_InitTypeDef;
+
+#define GPIO_PIN_0 0x0001u
+#define GPIO_PIN_1 0x0002u
+#define GPIO_PIN_2 0x0004u
+#define GPIO_PIN_3 0x0008u
+#define GPIO_PIN_4 0x0010u
+#define GPIO_PIN_5 0x0020u
+#define GPIO_PIN_6 0x0040u
+#define GPIO_PIN_7 0x0080u
+#define GPIO_PIN_8 0x0100u
+#define GPIO_PIN_9 0x0200u
+#define GPIO_PIN_10 0x0400u
+#define GPIO_PIN_11 0x0800u
+#define GPIO_PIN_12 0x1000u
+#define GPIO_PIN_13 0x2000u
+#define GPIO_PIN_14 0x4000u
+#define GPIO_PIN_15 0x8000u
+#define GPIO_MODE_INPUT 0u
+#define GPIO_MODE_OUTPUT_PP 1u
+#define GPIO_MODE_AF_PP 2u
+#define GPIO_MODE_AF_OD 0x12u
+#define GPIO_MODE_ANALOG 3u
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000u
+#define GPIO_NOPULL 0u
+#define GPIO_PULLUP 1u
+#define GPIO_PULLDOWN 2u
+#define GPIO_SPEED_FREQ_LOW 0u
+#define GPIO_SPEED_FREQ_HIGH 2u
+#define GPIO_SPEED_FREQ_VERY_HIGH 3u
+#define GPIO_AF1_TIM1 1u
+#define GPIO_AF2_TIM4 2u
+#define GPIO_AF7_USART2 7u
+#define GPIO_AF8_UART4 8u
+
+void HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint16_t pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state);
+
+/* ---- TIM ---------------------------------------------------------------- */
+
+typedef struct { uint32_t Prescaler, CounterMode, Period, ClockDivision, RepetitionCounter, AutoReloadPreload; } TIM_Base_InitTypeDef;
+typedef struct { TIM_TypeDef* Instance; TIM_Base_InitTypeDef Init; int State; } TIM_HandleTypeDef;
+typedef struct { uint32_t OCMode, Pulse, OCPolarity, OCNPolarity, OCFastMode, OCIdleState, OCNIdleState; } TIM_OC_InitTypeDef;
+typedef struct {
+  uint32_t OffStateRunMode, OffStateIDLEMode, LockLevel, DeadTime, BreakState, BreakPolarity, BreakFilter,
+      AutomaticOutput;
+} TIM_BreakDeadTimeConfigTypeDef;
+typedef struct { uint32_t MasterOutputTrigger, MasterSlaveMode; } TIM_MasterConfigTypeDef;
+typedef struct { uint32_t SlaveMode, InputTrigger, TriggerPolarity, TriggerPrescaler, TriggerFilter; } TIM_SlaveConfigTypeDef;
+typedef struct { uint32_t ICPolarity, ICSelection, ICPrescaler, ICFilter; } TIM_IC_InitTypeDef;
+typedef struct {
+  uint32_t ClearInputState, ClearInputSource, ClearInputPolarity, ClearInputPrescaler, ClearInputFilter;
+} TIM_ClearInputConfigTypeDef;
+
+#define TIM_COUNTERMODE_UP 0u
+#define TIM_CLOCKDIVISION_DIV1 0u
+#define TIM_AUTORELOAD_PRELOAD_ENABLE 0x80u
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0u
+#define TIM_OSSR_ENABLE 0x800u
+#define TIM_OSSI_ENABLE 0x400u
+#define TIM_LOCKLEVEL_OFF 0u
+#define TIM_BREAK_DISABLE 0u
+#define TIM_BREAK_ENABLE 0x1000u
+#define TIM_BREAKPOLARITY_HIGH 0x2000u
+#define TIM_BREAKPOLARITY_LOW 0u
+#define TIM_AUTOMATICOUTPUT_ENABLE 0x4000u
+#define TIM_AUTOMATICOUTPUT_DISABLE 0u
+#define TIM_OCMODE_TIMING 0u
+#define TIM_OCMODE_FORCED_INACTIVE 0x40u
+#define TIM_OCMODE_PWM1 0x60u
+#define TIM_OCMODE_PWM2 0x70u
+#define TIM_OCPOLARITY_HIGH 0u
+#define TIM_OCNPOLARITY_HIGH 0u
+#define TIM_OCFAST_DISABLE 0u
+#define TIM_OCIDLESTATE_RESET 0u
+#define TIM_OCNIDLESTATE_RESET 0u
+#define TIM_CHANNEL_1 0x0u
+#define TIM_CHANNEL_2 0x4u
+#define TIM_CHANNEL_3 0x8u
+#define TIM_CHANNEL_4 0xCu
+#define TIM_IT_UPDATE 0x1u
+#define TIM_IT_CC1 0x2u
+#define TIM_IT_CC2 0x4u
+#define TIM_IT_CC3 0x8u
+#define TIM_IT_CC4 0x10u
+#define TIM_IT_COM 0x20u
+#define TIM_IT_BREAK 0x80u
+#define TIM_FLAG_UPDATE 0x1u
+#define TIM_FLAG_CC1 0x2u
+#define TIM_FLAG_CC2 0x4u
+#define TIM_FLAG_CC3 0x8u
+#define TIM_FLAG_COM 0x20u
+#define TIM_FLAG_BREAK 0x80u
+#define TIM_DMA_UPDATE 0x100u
+#define TIM_DMA_CC1 0x200u
+#define TIM_TRGO_RESET 0u
+#define TIM_TRGO_UPDATE 0x20u
+#define TIM_TRGO_OC4REF 0x70u
+#define TIM_MASTERSLAVEMODE_DISABLE 0u
+#define TIM_MASTERSLAVEMODE_ENABLE 0x80u
+#define TIM_SLAVEMODE_DISABLE 0u
+#define TIM_SLAVEMODE_RESET 4u
+#define TIM_TS_ITR0 0u
+#define TIM_TS_ITR1 0x10u
+#define TIM_TRIGGERPOLARITY_RISING 0u
+#define TIM_TRIGGERPRESCALER_DIV1 0u
+#define TIM_ICPOLARITY_RISING 0u
+#define TIM_ICPOLARITY_FALLING 2u
+#define TIM_ICPOLARITY_BOTHEDGE 0xAu
+#define TIM_ICSELECTION_DIRECTTI 1u
+#define TIM_ICPSC_DIV1 0u
+#define TIM_CLEARINPUTSOURCE_NONE 0u
+#define TIM_CLEARINPUTSOURCE_ETR 1u
+#define TIM_CLEARINPUTPOLARITY_NONINVERTED 0u
+#define TIM_CLEARINPUTPOLARITY_INVERTED 0x8000u
+#define TIM_CLEARINPUTPRESCALER_DIV1 0u
+
+#define TIM_CR1_CEN 0x1u
+#define TIM_CR1_UDIS 0x2u
+#define TIM_CR1_URS 0x4u
+#define TIM_CR1_OPM 0x8u
+#define TIM_CR1_ARPE 0x80u
+#define TIM_CR2_CCPC 0x1u
+#define TIM_CR2_CCUS 0x4u
+#define TIM_CR2_MMS 0x70u
+#define TIM_SMCR_SMS 0x7u
+#define TIM_SMCR_TS 0x70u
+#define TIM_SMCR_ETF 0xF00u
+#define TIM_SMCR_ETPS 0x3000u
+#define TIM_SMCR_ECE 0x4000u
+#define TIM_SMCR_ETP 0x8000u
+#define TIM_DIER_UIE 0x1u
+#define TIM_DIER_CC1IE 0x2u
+#define TIM_DIER_CC4IE 0x10u
+#define TIM_DIER_BIE 0x80u
+#define TIM_SR_UIF 0x1u
+#define TIM_SR_CC1IF 0x2u
+#define TIM_SR_CC4IF 0x10u
+#define TIM_SR_COMIF 0x20u
+#define TIM_SR_BIF 0x80u
+#define TIM_EGR_UG 0x1u
+#define TIM_EGR_CC1G 0x2u
+#define TIM_EGR_COMG 0x20u
+#define TIM_CCMR1_CC1S 0x3u
+#define TIM_CCMR1_OC1PE 0x8u
+#define TIM_CCMR1_OC1M 0x70u
+#define TIM_CCMR1_OC1CE 0x80u
+#define TIM_CCMR1_OC2PE 0x800u
+#define TIM_CCMR1_OC2M 0x7000u
+#define TIM_CCMR1_OC2CE 0x8000u
+#define TIM_CCMR2_OC3PE 0x8u
+#define TIM_CCMR2_OC3M 0x70u
+#define TIM_CCMR2_OC3CE 0x80u
+#define TIM_CCMR2_OC4PE 0x800u
+#define TIM_CCMR2_OC4M 0x7000u
+#define TIM_CCER_CC1E 0x1u
+#define TIM_CCER_CC1P 0x2u
+#define TIM_CCER_CC1NE 0x4u
+#define TIM_CCER_CC1NP 0x8u
+#define TIM_CCER_CC2E 0x10u
+#define TIM_CCER_CC2NE 0x40u
+#define TIM_CCER_CC3E 0x100u
+#define TIM_CCER_CC3NE 0x400u
+#define TIM_CCER_CC4E 0x1000u
+#define TIM_BDTR_DTG 0xFFu
+#define TIM_BDTR_OSSI 0x400u
+#define TIM_BDTR_OSSR 0x800u
+#define TIM_BDTR_BKE 0x1000u
+#define TIM_BDTR_BKP 0x2000u
+#define TIM_BDTR_AOE 0x4000u
+#define TIM_BDTR_MOE 0x8000u
+
+#define __HAL_TIM_SET_COMPARE(h, ch, v) (*(&(h)->Instance->CCR1 + ((ch) >> 2)) = (v))
+#define __HAL_TIM_GET_COMPARE(h, ch) (*(&(h)->Instance->CCR1 + ((ch) >> 2)))
+#define __HAL_TIM_SET_AUTORELOAD(h, v) ((h)->Instance->ARR = (v))
+#define __HAL_TIM_GET_AUTORELOAD(h) ((h)->Instance->ARR)
+#define __HAL_TIM_SET_COUNTER(h, v) ((h)->Instance->CNT = (v))
+#define __HAL_TIM_GET_COUNTER(h) ((h)->Instance->CNT)
+#define __HAL_TIM_ENABLE(h) ((h)->Instance->CR1 |= TIM_CR1_CEN)
+#define __HAL_TIM_DISABLE(h) ((h)->Instance->CR1 &= ~TIM_CR1_CEN)
+#define __HAL_TIM_MOE_ENABLE(h) ((h)->Instance->BDTR |= TIM_BDTR_MOE)
+#define __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(h) ((h)->Instance->BDTR &= ~TIM_BDTR_MOE)
+#define __HAL_TIM_ENABLE_IT(h, it) ((h)->Instance->DIER |= (it))
+#define __HAL_TIM_DISABLE_IT(h, it) ((h)->Instance->DIER &= ~(it))
+#define __HAL_TIM_ENABLE_DMA(h, d) ((h)->Instance->DIER |= (d))
+#define __HAL_TIM_DISABLE_DMA(h, d) ((h)->Instance->DIER &= ~(d))
+#define __HAL_TIM_GET_FLAG(h, f) (((h)->Instance->SR & (f)) == (f))
+// Status flags are rc_w0 (writing 1 leaves a flag as it is); the HAL's
+// SR = ~f is an and-not on a plain variable
+#define __HAL_TIM_CLEAR_FLAG(h, f) ((h)->Instance->SR &= ~(f))
+#define __HAL_TIM_CLEAR_IT(h, f) ((h)->Instance->SR &= ~(f))
+#define __HAL_TIM_GET_IT_SOURCE(h, it) ((((h)->Instance->DIER & (it)) == (it)) ? SET : RESET)
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* oc, uint32_t channel);
+HAL_StatusTypeDef HAL_TIM_ConfigOCrefClear(TIM_HandleTypeDef* htim, TIM_ClearInputConfigTypeDef* cfg, uint32_t channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef* htim, uint32_t channel);
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Start(TIM_HandleTypeDef* htim, uint32_t channel);
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Stop(TIM_HandleTypeDef* htim, uint32_t channel);
+HAL_StatusTypeDef HAL_TIMEx_ConfigBreakDeadTime(TIM_HandleTypeDef* htim, TIM_BreakDeadTimeConfigTypeDef* cfg);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef* htim, TIM_MasterConfigTypeDef* cfg);
+HAL_StatusTypeDef HAL_TIM_SlaveConfigSynchro(TIM_HandleTypeDef* htim, TIM_SlaveConfigTypeDef* cfg);
+HAL_StatusTypeDef HAL_TIM_OC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* oc, uint32_t channel);
+HAL_StatusTypeDef HAL_TIM_IC_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_IC_InitTypeDef* ic, uint32_t channel);
+
+/* ---- ADC ---------------------------------------------------------------- */
+
+typedef struct {
+  uint32_t ClockPrescaler, Resolution, DataAlign;
+  FunctionalState ScanConvMode;
+  uint32_t EOCSelection;
+  FunctionalState ContinuousConvMode;
+  uint32_t NbrOfConversion;
+  FunctionalState DiscontinuousConvMode;
+  uint32_t NbrOfDiscConversion, ExternalTrigConv, ExternalTrigConvEdge;
+  FunctionalState DMAContinuousRequests;
+} ADC_InitTypeDef;
+struct __DMA_HandleTypeDef;
+typedef struct { ADC_TypeDef* Instance; ADC_InitTypeDef Init; struct __DMA_HandleTypeDef* DMA_Handle; int State; } ADC_HandleTypeDef;
+typedef struct { uint32_t Channel, Rank, SamplingTime, Offset; } ADC_ChannelConfTypeDef;
+typedef struct {
+  uint32_t WatchdogMode, HighThreshold, LowThreshold, Channel;
+  FunctionalState ITMode;
+  uint32_t WatchdogNumber;
+} ADC_AnalogWDGConfTypeDef;
+
+#define ADC_CHANNEL_0 0u
+#define ADC_CHANNEL_1 1u
+#define ADC_CHANNEL_2 2u
+#define ADC_CHANNEL_3 3u
+#define ADC_CHANNEL_13 13u
+#define ADC_CHANNEL_14 14u
+#define ADC_CHANNEL_15 15u
+#define ADC_CLOCK_SYNC_PCLK_DIV4 0x10000u
+#define ADC_RESOLUTION_12B 0u
+#define ADC_EXTERNALTRIGCONVEDGE_NONE 0u
+#define ADC_EXTERNALTRIGCONVEDGE_RISING 0x10000000u
+#define ADC_SOFTWARE_START 0x0F000001u
+#define ADC_EXTERNALTRIGCONV_T2_TRGO 0x06000000u
+#define ADC_DATAALIGN_RIGHT 0u
+#define ADC_EOC_SEQ_CONV 0u
+#define ADC_EOC_SINGLE_CONV 1u
+#define ADC_SAMPLETIME_3CYCLES 0u
+#define ADC_SAMPLETIME_15CYCLES 1u
+#define ADC_SAMPLETIME_28CYCLES 2u
+#define ADC_SAMPLETIME_56CYCLES 3u
+#define ADC_FLAG_AWD 0x1u
+#define ADC_FLAG_EOC 0x2u
+#define ADC_FLAG_JEOC 0x4u
+#define ADC_FLAG_OVR 0x20u
+#define ADC_CR1_AWDCH 0x1Fu
+#define ADC_CR1_EOCIE 0x20u
+#define ADC_CR1_AWDIE 0x40u
+#define ADC_CR1_SCAN 0x100u
+#define ADC_CR1_AWDSGL 0x200u
+#define ADC_CR1_JAWDEN 0x400000u
+#define ADC_CR1_AWDEN 0x800000u
+#define ADC_IT_AWD ADC_CR1_AWDIE
+#define ADC_ANALOGWATCHDOG_NONE 0u
+#define ADC_ANALOGWATCHDOG_SINGLE_REG (ADC_CR1_AWDSGL | ADC_CR1_AWDEN)
+#define ADC_ANALOGWATCHDOG_ALL_REG ADC_CR1_AWDEN
+#define ADC_CR2_ADON 0x1u
+#define ADC_CR2_CONT 0x2u
+#define ADC_CR2_DMA 0x100u
+#define ADC_CR2_DDS 0x200u
+
+#define __HAL_ADC_ENABLE(h) ((h)->Instance->CR2 |= ADC_CR2_ADON)
+#define __HAL_ADC_DISABLE(h) ((h)->Instance->CR2 &= ~ADC_CR2_ADON)
+#define __HAL_ADC_GET_FLAG(h, f) ((((h)->Instance->SR) & (f)) == (f))
+#define __HAL_ADC_CLEAR_FLAG(h, f) ((h)->Instance->SR &= ~(f))  // rc_w0, see TIM
+#define __HAL_ADC_ENABLE_IT(h, it) ((h)->Instance->CR1 |= (it))
+#define __HAL_ADC_DISABLE_IT(h, it) ((h)->Instance->CR1 &= ~(it))
+#define __HAL_ADC_GET_IT_SOURCE(h, it) ((((h)->Instance->CR1 & (it)) == (it)) ? SET : RESET)
+#define __HAL_LINKDMA(h, field, dma) do { (h)->field = &(dma); (dma).Parent = (h); } while (0)
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* cfg);
+HAL_StatusTypeDef HAL_ADC_AnalogWDGConfig(ADC_HandleTypeDef* hadc, ADC_AnalogWDGConfTypeDef* cfg);
+
+/* ---- DAC ---------------------------------------------------------------- */
+
+typedef struct { DAC_TypeDef* Instance; int State; } DAC_HandleTypeDef;
+typedef struct { uint32_t DAC_Trigger, DAC_OutputBuffer; } DAC_ChannelConfTypeDef;
+
+#define DAC_CHANNEL_1 0x0u
+#define DAC_CHANNEL_2 0x10u
+#define DAC_ALIGN_12B_R 0x0u
+#define DAC_TRIGGER_NONE 0x0u
+#define DAC_OUTPUTBUFFER_ENABLE 0x0u
+#define DAC_CR_EN1 0x1u
+#define DAC_CR_TEN1 0x4u
+
+HAL_StatusTypeDef HAL_DAC_Init(DAC_HandleTypeDef* hdac);
+HAL_StatusTypeDef HAL_DAC_ConfigChannel(DAC_HandleTypeDef* hdac, DAC_ChannelConfTypeDef* cfg, uint32_t channel);
+HAL_StatusTypeDef HAL_DAC_SetValue(DAC_HandleTypeDef* hdac, uint32_t channel, uint32_t alignment, uint32_t data);
+HAL_StatusTypeDef HAL_DAC_Start(DAC_HandleTypeDef* hdac, uint32_t channel);
+
+/* ---- DMA ---------------------------------------------------------------- */
+
+typedef struct {
+  uint32_t Channel, Direction, PeriphInc, MemInc, PeriphDataAlignment, MemDataAlignment, Mode, Priority, FIFOMode,
+      FIFOThreshold, MemBurst, PeriphBurst;
+} DMA_InitTypeDef;
+typedef struct __DMA_HandleTypeDef {
+  DMA_Stream_TypeDef* Instance;
+  DMA_InitTypeDef Init;
+  void* Parent;
+  int State;
+  void (*XferCpltCallback)(struct __DMA_HandleTypeDef* hdma);
+  void (*XferHalfCpltCallback)(struct __DMA_HandleTypeDef* hdma);
+  void (*XferM1CpltCallback)(struct __DMA_HandleTypeDef* hdma);
+  void (*XferErrorCallback)(struct __DMA_HandleTypeDef* hdma);
+} DMA_HandleTypeDef;
+
+#define DMA_CHANNEL_0 0u
+#define DMA_CHANNEL_1 0x02000000u
+#define DMA_CHANNEL_2 0x04000000u
+#define DMA_CHANNEL_4 0x08000000u
+#define DMA_PERIPH_TO_MEMORY 0u
+#define DMA_MEMORY_TO_PERIPH 0x40u
+#define DMA_PINC_DISABLE 0u
+#define DMA_MINC_ENABLE 0x400u
+#define DMA_PDATAALIGN_BYTE 0u
+#define DMA_PDATAALIGN_HALFWORD 0x800u
+#define DMA_PDATAALIGN_WORD 0x1000u
+#define DMA_MDATAALIGN_BYTE 0u
+#define DMA_MDATAALIGN_HALFWORD 0x2000u
+#define DMA_MDATAALIGN_WORD 0x4000u
+#define DMA_NORMAL 0u
+#define DMA_CIRCULAR 0x100u
+#define DMA_PRIORITY_LOW 0u
+#define DMA_PRIORITY_MEDIUM 0x10000u
+#define DMA_PRIORITY_HIGH 0x20000u
+#define DMA_PRIORITY_VERY_HIGH 0x30000u
+#define DMA_FIFOMODE_DISABLE 0u
+#define DMA_SxCR_EN 0x1u
+#define DMA_SxCR_HTIE 0x8u
+#define DMA_SxCR_TCIE 0x10u
+#define DMA_SxCR_CIRC 0x100u
+#define DMA_SxCR_DBM 0x40000u
+#define DMA_SxCR_CT 0x80000u
+
+#define __HAL_DMA_GET_COUNTER(h) ((h)->Instance->NDTR)
+#define __HAL_DMA_ENABLE(h) ((h)->Instance->CR |= DMA_SxCR_EN)
+#define __HAL_DMA_DISABLE(h) ((h)->Instance->CR &= ~DMA_SxCR_EN)
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma);
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t len);
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t len);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef* hdma);
+HAL_StatusTypeDef HAL_DMAEx_MultiBufferStart(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t dst2,
+                                             uint32_t len);
+
+/* ---- UART --------------------------------------------------------------- */
+
+typedef struct { uint32_t BaudRate, WordLength, StopBits, Parity, Mode, HwFlowCtl, OverSampling; } UART_InitTypeDef;
+typedef struct {
+  USART_TypeDef* Instance;
+  UART_InitTypeDef Init;
+  DMA_HandleTypeDef* hdmatx;
+  DMA_HandleTypeDef* hdmarx;
+  int gState;
+} UART_HandleTypeDef;
+
+#define UART_WORDLENGTH_8B 0u
+#define UART_STOPBITS_1 0u
+#define UART_PARITY_NONE 0u
+#define UART_MODE_TX_RX 0xCu
+#define UART_HWCONTROL_NONE 0u
+#define UART_OVERSAMPLING_16 0u
+#define UART_FLAG_ORE 0x8u
+#define UART_FLAG_IDLE 0x10u
+#define UART_FLAG_RXNE 0x20u
+#define UART_FLAG_TC 0x40u
+#define UART_IT_IDLE 0x10u
+#define USART_SR_ORE 0x8u
+#define USART_SR_IDLE 0x10u
+#define USART_SR_RXNE 0x20u
+#define USART_CR1_RE 0x4u
+#define USART_CR1_TE 0x8u
+#define USART_CR1_IDLEIE 0x10u
+#define USART_CR1_RXNEIE 0x20u
+#define USART_CR1_UE 0x2000u
+#define USART_CR3_DMAR 0x40u
+#define USART_CR3_DMAT 0x80u
+
+#define __HAL_UART_GET_FLAG(h, f) (((h)->Instance->SR & (f)) == (f))
+#define __HAL_UART_CLEAR_IDLEFLAG(h) do { (void)(h)->Instance->SR; (void)(h)->Instance->DR; } while (0)
+#define __HAL_UART_ENABLE_IT(h, it) ((h)->Instance->CR1 |= (it))
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart);
+
+/* ---- FLASH -------------------------------------------------------------- */
+
+typedef struct { uint32_t TypeErase, Banks, Sector, NbSectors, VoltageRange; } FLASH_EraseInitTypeDef;
+#define FLASH_TYPEERASE_SECTORS 0u
+#define FLASH_SECTOR_7 7u
+#define FLASH_VOLTAGE_RANGE_3 2u
+#define FLASH_TYPEPROGRAM_WORD 2u
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* erase, uint32_t* sector_error);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uint32_t address, uint64_t data);
+
+/* ---- RCC, NVIC and core ------------------------------------------------- */
+
+#define RCC_CFGR_PPRE1 0x1C00u
+#define RCC_CFGR_PPRE1_DIV1 0u
+#define RCC_CFGR_PPRE1_DIV4 0x1400u
+#define RCC_CFGR_PPRE2 0xE000u
+#define RCC_CFGR_PPRE2_DIV1 0u
+#define RCC_CFGR_PPRE2_DIV2 0x8000u
+#define RCC_CSR_RMVF 0x01000000u
+#define RCC_CSR_PINRSTF 0x04000000u
+#define CoreDebug_DEMCR_TRCENA_Msk 0x01000000u
+#define DWT_CTRL_CYCCNTENA_Msk 0x1u
+#define ITM_TCR_ITMENA_Msk 0x1u
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_TIM1_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_TIM2_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_TIM4_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_TIM5_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_TIM7_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_ADC1_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_ADC2_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_ADC3_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_DMA1_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_DMA2_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_UART4_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_USART2_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_SYSCFG_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_DAC_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_CCMDATARAMEN_CLK_ENABLE() do {} while (0)
+
+extern uint32_t SystemCoreClock;
+uint32_t HAL_RCC_GetHCLKFreq(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+HAL_StatusTypeDef HAL_Init(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t ms);
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub);
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+void HAL_NVIC_DisableIRQ(IRQn_Type irq);
+
+// PRIMASK: interrupts raised while it is set are held until it clears
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+
+// BASEPRI (priority in the top __NVIC_PRIO_BITS bits, 0 = off): interrupts
+// at that priority or below are held until it drops
+#define __NVIC_PRIO_BITS 4u
+uint32_t __get_BASEPRI(void);
+void __set_BASEPRI(uint32_t basepri);
+void __set_BASEPRI_MAX(uint32_t basepri);
+void __enable_irq(void);
+
+#define __DMB() __sync_synchronize()
+#define __DSB() __sync_synchronize()
+#define __ISB() __sync_synchronize()
+#define __NOP() do {} while (0)
+#define __WFI() do {} while (0)
+
+// Exclusive access: interrupts only run where the firmware calls into the
+// simulation, never between a load- and store-exclusive, so stores succeed
+uint32_t __LDREXW(volatile uint32_t* addr);
+uint32_t __STREXW(uint32_t value, volatile uint32_t* addr);
+void __CLREX(void);
+
+#define __CLZ(x) ((uint32_t)((x) ? __builtin_clz(x) : 32))
+
+static inline int32_t __SSAT(int32_t x, uint32_t n) {
+  int32_t hi = (1 << (n - 1)) - 1, lo = -(1 << (n - 1));
+  return x > hi ? hi : (x < lo ? lo : x);
+}
+static inline uint32_t __USAT(int32_t x, uint32_t n) {
+  int32_t hi = (int32_t)((1u << n) - 1u);
+  return x < 0 ? 0u : (uint32_t)(x > hi ? hi : x);
+}
+
+#ifdef __cplusplus
+}
+#endif
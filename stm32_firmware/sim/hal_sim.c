@@ -0,0 +1,777 @@
+#include "hal_sim.h"
+#include "sim_board.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ---- Register storage --------------------------------------------------- */
+
+GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC, sim_GPIOD;
+TIM_TypeDef sim_TIM1, sim_TIM2, sim_TIM4, sim_TIM5, sim_TIM7;
+ADC_TypeDef sim_ADC1, sim_ADC2, sim_ADC3;
+ADC_Common_TypeDef sim_ADC123_COMMON;
+DMA_TypeDef sim_DMA1, sim_DMA2;
+DMA_Stream_TypeDef sim_dma_streams[16];
+USART_TypeDef sim_UART4, sim_USART2;
+IWDG_TypeDef sim_IWDG;
+EXTI_TypeDef sim_EXTI;
+SYSCFG_TypeDef sim_SYSCFG;
+RCC_TypeDef sim_RCC;
+DAC_TypeDef sim_DAC;
+DWT_Type sim_DWT;
+CoreDebug_Type sim_CoreDebug;
+ITM_Type sim_ITM;
+uint8_t sim_ccm_ram[64 * 1024];
+
+uint32_t SystemCoreClock = 168000000u;
+
+/* ---- Vector table ------------------------------------------------------- */
+
+// Default handlers, overridden by the firmware's own definitions at link
+// time (as the startup file's weak aliases are)
+#define SIM_DEFAULT_HANDLER(name) \
+  void name(void) __attribute__((weak)); \
+  void name(void) {}
+
+SIM_DEFAULT_HANDLER(EXTI0_IRQHandler)
+SIM_DEFAULT_HANDLER(EXTI1_IRQHandler)
+SIM_DEFAULT_HANDLER(EXTI2_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream0_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream1_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream2_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream3_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream4_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream5_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream6_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA1_Stream7_IRQHandler)
+SIM_DEFAULT_HANDLER(ADC_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM1_BRK_TIM9_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM1_UP_TIM10_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM1_CC_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM2_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM4_IRQHandler)
+SIM_DEFAULT_HANDLER(USART2_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM5_IRQHandler)
+SIM_DEFAULT_HANDLER(UART4_IRQHandler)
+SIM_DEFAULT_HANDLER(TIM7_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA2_Stream0_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA2_Stream1_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA2_Stream2_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA2_Stream3_IRQHandler)
+SIM_DEFAULT_HANDLER(DMA2_Stream4_IRQHandler)
+
+static void (*const vectors[SIM_IRQ_COUNT])(void) = {
+  [EXTI0_IRQn] = EXTI0_IRQHandler,
+  [EXTI1_IRQn] = EXTI1_IRQHandler,
+  [EXTI2_IRQn] = EXTI2_IRQHandler,
+  [DMA1_Stream0_IRQn] = DMA1_Stream0_IRQHandler,
+  [DMA1_Stream1_IRQn] = DMA1_Stream1_IRQHandler,
+  [DMA1_Stream2_IRQn] = DMA1_Stream2_IRQHandler,
+  [DMA1_Stream3_IRQn] = DMA1_Stream3_IRQHandler,
+  [DMA1_Stream4_IRQn] = DMA1_Stream4_IRQHandler,
+  [DMA1_Stream5_IRQn] = DMA1_Stream5_IRQHandler,
+  [DMA1_Stream6_IRQn] = DMA1_Stream6_IRQHandler,
+  [DMA1_Stream7_IRQn] = DMA1_Stream7_IRQHandler,
+  [ADC_IRQn] = ADC_IRQHandler,
+  [TIM1_BRK_TIM9_IRQn] = TIM1_BRK_TIM9_IRQHandler,
+  [TIM1_UP_TIM10_IRQn] = TIM1_UP_TIM10_IRQHandler,
+  [TIM1_CC_IRQn] = TIM1_CC_IRQHandler,
+  [TIM2_IRQn] = TIM2_IRQHandler,
+  [TIM4_IRQn] = TIM4_IRQHandler,
+  [USART2_IRQn] = USART2_IRQHandler,
+  [TIM5_IRQn] = TIM5_IRQHandler,
+  [UART4_IRQn] = UART4_IRQHandler,
+  [TIM7_IRQn] = TIM7_IRQHandler,
+  [DMA2_Stream0_IRQn] = DMA2_Stream0_IRQHandler,
+  [DMA2_Stream1_IRQn] = DMA2_Stream1_IRQHandler,
+  [DMA2_Stream2_IRQn] = DMA2_Stream2_IRQHandler,
+  [DMA2_Stream3_IRQn] = DMA2_Stream3_IRQHandler,
+  [DMA2_Stream4_IRQn] = DMA2_Stream4_IRQHandler,
+};
+
+static const IRQn_Type dma_irq[16] = {
+  DMA1_Stream0_IRQn, DMA1_Stream1_IRQn, DMA1_Stream2_IRQn, DMA1_Stream3_IRQn,
+  DMA1_Stream4_IRQn, DMA1_Stream5_IRQn, DMA1_Stream6_IRQn, DMA1_Stream7_IRQn,
+  DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+  DMA2_Stream4_IRQn, SIM_IRQ_COUNT, SIM_IRQ_COUNT, SIM_IRQ_COUNT,
+};
+
+/* ---- NVIC --------------------------------------------------------------- */
+
+#define THREAD_PRIORITY 256
+
+static uint8_t irq_priority[SIM_IRQ_COUNT];
+static uint8_t irq_enabled[SIM_IRQ_COUNT];
+static uint8_t irq_pending[SIM_IRQ_COUNT];
+static uint32_t primask = 0;
+static uint32_t basepri = 0;
+static int running_priority = THREAD_PRIORITY;
+
+// Run pending interrupts that may preempt the current context, most urgent
+// first (lowest priority value, then lowest number, as the NVIC does)
+static void irq_dispatch(void) {
+  while (!primask) {
+    int best = -1;
+    int mask = basepri ? (int)(basepri >> (8u - __NVIC_PRIO_BITS)) : THREAD_PRIORITY;
+    if (mask > running_priority) mask = running_priority;
+    for (int i = 0; i < SIM_IRQ_COUNT; ++i) {
+      if (!irq_pending[i] || !irq_enabled[i] || !vectors[i]) continue;
+      if (irq_priority[i] >= mask) continue;
+      if (best < 0 || irq_priority[i] < irq_priority[best]) best = i;
+    }
+    if (best < 0) return;
+    irq_pending[best] = 0;
+    int saved = running_priority;
+    running_priority = irq_priority[best];
+    vectors[best]();
+    running_priority = saved;
+  }
+}
+
+void sim_irq_raise(IRQn_Type irq) {
+  if ((int)irq < 0 || irq >= SIM_IRQ_COUNT) return;
+  irq_pending[irq] = 1;
+  irq_dispatch();
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub) {
+  (void)sub;
+  if ((int)irq >= 0 && irq < SIM_IRQ_COUNT) irq_priority[irq] = (uint8_t)preempt;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq) {
+  if ((int)irq < 0 || irq >= SIM_IRQ_COUNT) return;
+  irq_enabled[irq] = 1;
+  irq_dispatch();
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type irq) {
+  if ((int)irq >= 0 && irq < SIM_IRQ_COUNT) irq_enabled[irq] = 0;
+}
+
+uint32_t __get_PRIMASK(void) { return primask; }
+
+void __set_PRIMASK(uint32_t value) {
+  primask = value & 1u;
+  irq_dispatch();
+}
+
+void __disable_irq(void) { primask = 1; }
+
+void __enable_irq(void) { __set_PRIMASK(0); }
+
+uint32_t __get_BASEPRI(void) { return basepri; }
+
+void __set_BASEPRI(uint32_t value) {
+  basepri = value & 0xFFu;
+  irq_dispatch();
+}
+
+// Raises the mask only (a lower-priority or zero value is ignored)
+void __set_BASEPRI_MAX(uint32_t value) {
+  value &= 0xFFu;
+  if (value && (basepri == 0 || value < basepri)) basepri = value;
+}
+
+// Single-threaded: interrupts only run between firmware statements that
+// reach the simulator (HAL_Delay, PRIMASK changes), never inside LDREX/STREX
+uint32_t __LDREXW(volatile uint32_t* addr) { return *addr; }
+
+uint32_t __STREXW(uint32_t value, volatile uint32_t* addr) {
+  *addr = value;
+  return 0;
+}
+
+void __CLREX(void) {}
+
+/* ---- RCC and time ------------------------------------------------------- */
+
+static uint32_t apb_divider(uint32_t ppre) {
+  // 0xx = 1, 100 = 2, 101 = 4, 110 = 8, 111 = 16
+  return (ppre & 4u) ? (2u << (ppre & 3u)) : 1u;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void) { return SystemCoreClock; }
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+  return SystemCoreClock / apb_divider((RCC->CFGR & RCC_CFGR_PPRE1) >> 10);
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void) {
+  return SystemCoreClock / apb_divider((RCC->CFGR & RCC_CFGR_PPRE2) >> 13);
+}
+
+uint32_t sim_apb1_timer_hz(void) {
+  uint32_t clk = HAL_RCC_GetPCLK1Freq();
+  return ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) ? clk * 2 : clk;
+}
+
+uint32_t sim_apb2_timer_hz(void) {
+  uint32_t clk = HAL_RCC_GetPCLK2Freq();
+  return ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1) ? clk * 2 : clk;
+}
+
+HAL_StatusTypeDef HAL_Init(void) { return HAL_OK; }
+
+uint32_t HAL_GetTick(void) { return (uint32_t)(sim_board_time_us() / 1000u); }
+
+// Blocking delays let simulated time (and its interrupts) run on
+void HAL_Delay(uint32_t ms) { sim_board_advance_us((uint64_t)ms * 1000u); }
+
+/* ---- GPIO and EXTI ------------------------------------------------------ */
+
+#define GPIO_MODE_IT_BIT 0x10000000u
+#define GPIO_MODE_RISING_BIT 0x00100000u
+#define GPIO_MODE_FALLING_BIT 0x00200000u
+
+static GPIO_TypeDef* exti_port[16];
+
+void HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init) {
+  for (uint32_t pin = 0; pin < 16; ++pin) {
+    if (!(init->Pin & (1u << pin))) continue;
+    uint32_t mode = init->Mode & 3u;
+    port->MODER = (port->MODER & ~(3u << (pin * 2))) | (mode << (pin * 2));
+    port->PUPDR = (port->PUPDR & ~(3u << (pin * 2))) | ((init->Pull & 3u) << (pin * 2));
+    if (init->Mode & GPIO_MODE_IT_BIT) {
+      exti_port[pin] = port;
+      EXTI->IMR |= 1u << pin;
+      if (init->Mode & GPIO_MODE_RISING_BIT) EXTI->RTSR |= 1u << pin;
+      if (init->Mode & GPIO_MODE_FALLING_BIT) EXTI->FTSR |= 1u << pin;
+    }
+  }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint16_t pin) {
+  return (port->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state) {
+  if (state) port->ODR |= pin;
+  else port->ODR &= ~(uint32_t)pin;
+}
+
+static IRQn_Type exti_irq(uint32_t line) {
+  static const IRQn_Type low[3] = {EXTI0_IRQn, EXTI1_IRQn, EXTI2_IRQn};
+  return line < 3 ? low[line] : SIM_IRQ_COUNT;
+}
+
+void sim_gpio_set_inputs(GPIO_TypeDef* port, uint16_t mask, uint16_t levels) {
+  uint32_t old = port->IDR;
+  uint32_t now = (old & ~(uint32_t)mask) | (levels & mask);
+  port->IDR = now;
+  uint32_t rising = ~old & now, falling = old & ~now;
+  for (uint32_t line = 0; line < 16; ++line) {
+    uint32_t bit = 1u << line;
+    if (exti_port[line] != port || !(EXTI->IMR & bit)) continue;
+    if (((rising & bit) && (EXTI->RTSR & bit)) || ((falling & bit) && (EXTI->FTSR & bit))) {
+      EXTI->PR |= bit;
+      sim_irq_raise(exti_irq(line));
+    }
+  }
+}
+
+/* ---- TIM ---------------------------------------------------------------- */
+
+// EGR writes (here and by the firmware) are applied by the board model at
+// its next timer tick
+static void tim_base_config(TIM_HandleTypeDef* htim) {
+  TIM_TypeDef* t = htim->Instance;
+  t->PSC = htim->Init.Prescaler;
+  t->ARR = htim->Init.Period;
+  t->RCR = htim->Init.RepetitionCounter;
+  t->CR1 = (t->CR1 & ~TIM_CR1_ARPE) | htim->Init.AutoReloadPreload;
+  t->EGR = TIM_EGR_UG;
+  t->SR |= TIM_SR_UIF;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim) {
+  tim_base_config(htim);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef* htim) {
+  tim_base_config(htim);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Init(TIM_HandleTypeDef* htim) {
+  tim_base_config(htim);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim) {
+  htim->Instance->CR1 |= TIM_CR1_CEN;
+  return HAL_OK;
+}
+
+static volatile uint32_t* tim_ccmr(TIM_TypeDef* t, uint32_t channel) {
+  return (channel < TIM_CHANNEL_3) ? &t->CCMR1 : &t->CCMR2;
+}
+
+static void tim_oc_config(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* oc, uint32_t channel, uint32_t preload) {
+  TIM_TypeDef* t = htim->Instance;
+  uint32_t shift = (channel & TIM_CHANNEL_2) ? 8u : 0u;
+  volatile uint32_t* ccmr = tim_ccmr(t, channel);
+  *ccmr = (*ccmr & ~(0xFFu << shift)) | ((oc->OCMode | preload) << shift);
+  __HAL_TIM_SET_COMPARE(htim, channel, oc->Pulse);
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* oc, uint32_t channel) {
+  tim_oc_config(htim, oc, channel, TIM_CCMR1_OC1PE);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* oc, uint32_t channel) {
+  tim_oc_config(htim, oc, channel, 0);
+  return HAL_OK;
+}
+
+// ETR as the OCREF clear input (the F4 has no other source): ETR filter,
+// prescaler and polarity in SMCR, OCxCE in the channel's CCMR half
+HAL_StatusTypeDef HAL_TIM_ConfigOCrefClear(TIM_HandleTypeDef* htim, TIM_ClearInputConfigTypeDef* cfg, uint32_t channel) {
+  TIM_TypeDef* t = htim->Instance;
+  if (cfg->ClearInputSource == TIM_CLEARINPUTSOURCE_ETR) {
+    t->SMCR = (t->SMCR & ~(TIM_SMCR_ETF | TIM_SMCR_ETPS | TIM_SMCR_ECE | TIM_SMCR_ETP)) |
+              cfg->ClearInputPolarity | cfg->ClearInputPrescaler | ((cfg->ClearInputFilter & 0xFu) << 8);
+  }
+  uint32_t ce = (channel & TIM_CHANNEL_2) ? TIM_CCMR1_OC2CE : TIM_CCMR1_OC1CE;
+  volatile uint32_t* ccmr = tim_ccmr(t, channel);
+  if (cfg->ClearInputState) *ccmr |= ce;
+  else *ccmr &= ~ce;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_IC_InitTypeDef* ic, uint32_t channel) {
+  TIM_TypeDef* t = htim->Instance;
+  uint32_t shift = (channel & TIM_CHANNEL_2) ? 8u : 0u;
+  volatile uint32_t* ccmr = tim_ccmr(t, channel);
+  *ccmr = (*ccmr & ~(0xFFu << shift)) | ((ic->ICSelection | (ic->ICFilter << 4)) << shift);
+  uint32_t ccer_shift = (channel >> 2) * 4u;
+  t->CCER = (t->CCER & ~(0xAu << ccer_shift)) | (ic->ICPolarity << ccer_shift);
+  return HAL_OK;
+}
+
+// As the HAL: main output and counter stop only once no channel is left on
+static void tim_outputs_changed(TIM_TypeDef* t) {
+  const uint32_t all = TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC3E | TIM_CCER_CC4E |
+                       TIM_CCER_CC1NE | TIM_CCER_CC2NE | TIM_CCER_CC3NE;
+  if ((t->CCER & all) == 0) {
+    if (t == TIM1) t->BDTR &= ~TIM_BDTR_MOE;
+    t->CR1 &= ~TIM_CR1_CEN;
+  }
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t channel) {
+  TIM_TypeDef* t = htim->Instance;
+  t->CCER |= TIM_CCER_CC1E << channel;
+  if (t == TIM1) t->BDTR |= TIM_BDTR_MOE;
+  t->CR1 |= TIM_CR1_CEN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef* htim, uint32_t channel) {
+  htim->Instance->CCER &= ~(TIM_CCER_CC1E << channel);
+  tim_outputs_changed(htim->Instance);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Start(TIM_HandleTypeDef* htim, uint32_t channel) {
+  TIM_TypeDef* t = htim->Instance;
+  t->CCER |= TIM_CCER_CC1NE << channel;
+  t->BDTR |= TIM_BDTR_MOE;
+  t->CR1 |= TIM_CR1_CEN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Stop(TIM_HandleTypeDef* htim, uint32_t channel) {
+  htim->Instance->CCER &= ~(TIM_CCER_CC1NE << channel);
+  tim_outputs_changed(htim->Instance);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_ConfigBreakDeadTime(TIM_HandleTypeDef* htim, TIM_BreakDeadTimeConfigTypeDef* cfg) {
+  // DeadTime goes into BDTR.DTG unchanged, as in the HAL: values above 127
+  // select the coarser DTG encodings
+  htim->Instance->BDTR = (cfg->DeadTime & TIM_BDTR_DTG) | cfg->LockLevel | cfg->OffStateIDLEMode |
+                         cfg->OffStateRunMode | cfg->BreakState | cfg->BreakPolarity | cfg->AutomaticOutput;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef* htim, TIM_MasterConfigTypeDef* cfg) {
+  TIM_TypeDef* t = htim->Instance;
+  t->CR2 = (t->CR2 & ~TIM_CR2_MMS) | cfg->MasterOutputTrigger;
+  t->SMCR = (t->SMCR & ~TIM_MASTERSLAVEMODE_ENABLE) | cfg->MasterSlaveMode;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_SlaveConfigSynchro(TIM_HandleTypeDef* htim, TIM_SlaveConfigTypeDef* cfg) {
+  TIM_TypeDef* t = htim->Instance;
+  t->SMCR = (t->SMCR & ~(TIM_SMCR_SMS | TIM_SMCR_TS)) | cfg->SlaveMode | cfg->InputTrigger;
+  return HAL_OK;
+}
+
+/* ---- ADC ---------------------------------------------------------------- */
+
+#define ADC_SQR1_L_SHIFT 20u
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc) {
+  ADC_TypeDef* a = hadc->Instance;
+  a->CR1 = hadc->Init.ScanConvMode ? ADC_CR1_SCAN : 0u;
+  a->CR2 = hadc->Init.ExternalTrigConvEdge | (hadc->Init.ExternalTrigConv & 0x0F000000u) |
+           (hadc->Init.ContinuousConvMode ? ADC_CR2_CONT : 0u) | (hadc->Init.DMAContinuousRequests ? ADC_CR2_DDS : 0u);
+  a->SQR1 = (hadc->Init.NbrOfConversion - 1u) << ADC_SQR1_L_SHIFT;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* cfg) {
+  ADC_TypeDef* a = hadc->Instance;
+  uint32_t rank = cfg->Rank - 1u;
+  volatile uint32_t* sqr = rank < 6 ? &a->SQR3 : (rank < 12 ? &a->SQR2 : &a->SQR1);
+  uint32_t shift = (rank % 6u) * 5u;
+  *sqr = (*sqr & ~(0x1Fu << shift)) | ((cfg->Channel & 0x1Fu) << shift);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_AnalogWDGConfig(ADC_HandleTypeDef* hadc, ADC_AnalogWDGConfTypeDef* cfg) {
+  ADC_TypeDef* a = hadc->Instance;
+  uint32_t cr1 = a->CR1 & ~(ADC_CR1_AWDSGL | ADC_CR1_JAWDEN | ADC_CR1_AWDEN | ADC_CR1_AWDCH | ADC_CR1_AWDIE);
+  cr1 |= cfg->WatchdogMode | (cfg->Channel & ADC_CR1_AWDCH);
+  if (cfg->ITMode == ENABLE) cr1 |= ADC_CR1_AWDIE;
+  a->HTR = cfg->HighThreshold;
+  a->LTR = cfg->LowThreshold;
+  a->CR1 = cr1;
+  return HAL_OK;
+}
+
+/* ---- DAC ---------------------------------------------------------------- */
+
+HAL_StatusTypeDef HAL_DAC_Init(DAC_HandleTypeDef* hdac) {
+  (void)hdac;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DAC_ConfigChannel(DAC_HandleTypeDef* hdac, DAC_ChannelConfTypeDef* cfg, uint32_t channel) {
+  DAC_TypeDef* d = hdac->Instance;
+  d->CR = (d->CR & ~(0xFFFu << channel)) | ((cfg->DAC_Trigger | cfg->DAC_OutputBuffer) << channel);
+  return HAL_OK;
+}
+
+// Without a trigger DHR moves to DOR on the next APB clock: at once here
+HAL_StatusTypeDef HAL_DAC_SetValue(DAC_HandleTypeDef* hdac, uint32_t channel, uint32_t alignment, uint32_t data) {
+  (void)alignment;
+  DAC_TypeDef* d = hdac->Instance;
+  if (channel == DAC_CHANNEL_1) {
+    d->DHR12R1 = data & 0xFFFu;
+    if (!(d->CR & DAC_CR_TEN1)) d->DOR1 = d->DHR12R1;
+  } else {
+    d->DHR12R2 = data & 0xFFFu;
+    if (!(d->CR & (DAC_CR_TEN1 << DAC_CHANNEL_2))) d->DOR2 = d->DHR12R2;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DAC_Start(DAC_HandleTypeDef* hdac, uint32_t channel) {
+  hdac->Instance->CR |= DAC_CR_EN1 << channel;
+  return HAL_OK;
+}
+
+/* ---- DMA ---------------------------------------------------------------- */
+
+#define DMA_FLAG_TE 0x08u
+#define DMA_FLAG_HT 0x10u
+#define DMA_FLAG_TC 0x20u
+#define DMA_SxCR_TEIE 0x4u
+#define DMA_SxCR_DIR 0xC0u
+#define DMA_SxCR_MINC 0x400u
+#define DMA_SxCR_MSIZE_SHIFT 13u
+
+static uint32_t dma_length[16];   // programmed NDTR, reloaded in circular mode
+
+static int dma_index(const DMA_Stream_TypeDef* s) {
+  return (int)(s - sim_dma_streams);
+}
+
+// Interrupt status register and bit offset of a stream's flags
+static volatile uint32_t* dma_isr(int idx, uint32_t* shift) {
+  static const uint8_t offsets[4] = {0, 6, 16, 22};
+  DMA_TypeDef* dma = idx < 8 ? DMA1 : DMA2;
+  *shift = offsets[idx & 3];
+  return (idx & 4) ? &dma->HISR : &dma->LISR;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma) {
+  DMA_InitTypeDef* in = &hdma->Init;
+  hdma->Instance->CR = in->Channel | in->Direction | in->PeriphInc | in->MemInc | in->PeriphDataAlignment |
+                       in->MemDataAlignment | in->Mode | in->Priority;
+  hdma->State = 1;
+  return HAL_OK;
+}
+
+static void dma_program(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t len) {
+  DMA_Stream_TypeDef* s = hdma->Instance;
+  int idx = dma_index(s);
+  s->CR &= ~(DMA_SxCR_EN | DMA_SxCR_DBM | DMA_SxCR_CT);
+  if ((s->CR & DMA_SxCR_DIR) == DMA_MEMORY_TO_PERIPH) {
+    s->PAR = dst;
+    s->M0AR = src;
+  } else {
+    s->PAR = src;
+    s->M0AR = dst;
+  }
+  s->NDTR = len;
+  dma_length[idx] = len;
+  uint32_t shift;
+  volatile uint32_t* isr = dma_isr(idx, &shift);
+  *isr &= ~((DMA_FLAG_TE | DMA_FLAG_HT | DMA_FLAG_TC) << shift);
+}
+
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t len) {
+  dma_program(hdma, src, dst, len);
+  hdma->Instance->CR |= DMA_SxCR_EN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t len) {
+  dma_program(hdma, src, dst, len);
+  uint32_t it = DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+  if (hdma->XferHalfCpltCallback) it |= DMA_SxCR_HTIE;
+  hdma->Instance->CR |= it | DMA_SxCR_EN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMAEx_MultiBufferStart(DMA_HandleTypeDef* hdma, uint32_t src, uint32_t dst, uint32_t dst2,
+                                             uint32_t len) {
+  dma_program(hdma, src, dst, len);
+  hdma->Instance->M1AR = dst2;
+  hdma->Instance->CR |= DMA_SxCR_DBM | DMA_SxCR_EN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma) {
+  hdma->Instance->CR &= ~(DMA_SxCR_EN | DMA_SxCR_TCIE | DMA_SxCR_HTIE | DMA_SxCR_TEIE);
+  return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef* hdma) {
+  DMA_Stream_TypeDef* s = hdma->Instance;
+  uint32_t shift;
+  volatile uint32_t* isr = dma_isr(dma_index(s), &shift);
+  if ((*isr & (DMA_FLAG_HT << shift)) && (s->CR & DMA_SxCR_HTIE)) {
+    *isr &= ~(DMA_FLAG_HT << shift);
+    if (hdma->XferHalfCpltCallback) hdma->XferHalfCpltCallback(hdma);
+  }
+  if ((*isr & (DMA_FLAG_TC << shift)) && (s->CR & DMA_SxCR_TCIE)) {
+    *isr &= ~(DMA_FLAG_TC << shift);
+    if (!(s->CR & (DMA_SxCR_CIRC | DMA_SxCR_DBM))) s->CR &= ~(DMA_SxCR_TCIE | DMA_SxCR_HTIE | DMA_SxCR_TEIE);
+    if ((s->CR & DMA_SxCR_DBM) && !(s->CR & DMA_SxCR_CT)) {
+      if (hdma->XferM1CpltCallback) hdma->XferM1CpltCallback(hdma);
+    } else if (hdma->XferCpltCallback) {
+      hdma->XferCpltCallback(hdma);
+    }
+  }
+}
+
+// Advance a stream by one item at addr; handles wrap, buffer switch and flags
+static void dma_item_done(DMA_Stream_TypeDef* s, int idx) {
+  uint32_t shift;
+  volatile uint32_t* isr = dma_isr(idx, &shift);
+  uint32_t left = --s->NDTR;
+  if (left == dma_length[idx] / 2) {
+    *isr |= DMA_FLAG_HT << shift;
+    if (s->CR & DMA_SxCR_HTIE) sim_irq_raise(dma_irq[idx]);
+  }
+  if (left != 0) return;
+  if (s->CR & (DMA_SxCR_CIRC | DMA_SxCR_DBM)) {
+    s->NDTR = dma_length[idx];
+    if (s->CR & DMA_SxCR_DBM) s->CR ^= DMA_SxCR_CT;
+  } else {
+    s->CR &= ~DMA_SxCR_EN;
+  }
+  *isr |= DMA_FLAG_TC << shift;
+  if (s->CR & DMA_SxCR_TCIE) sim_irq_raise(dma_irq[idx]);
+}
+
+static volatile uint8_t* dma_memory_item(DMA_Stream_TypeDef* s, int idx, uint32_t* size) {
+  *size = 1u << ((s->CR >> DMA_SxCR_MSIZE_SHIFT) & 3u);
+  uint32_t base = ((s->CR & DMA_SxCR_DBM) && (s->CR & DMA_SxCR_CT)) ? s->M1AR : s->M0AR;
+  uint32_t item = (s->CR & DMA_SxCR_MINC) ? dma_length[idx] - s->NDTR : 0u;
+  return (volatile uint8_t*)sim_addr(base + item * *size);
+}
+
+int sim_dma_periph_to_mem(DMA_Stream_TypeDef* s, uint32_t data) {
+  if (!(s->CR & DMA_SxCR_EN) || s->NDTR == 0) return 0;
+  int idx = dma_index(s);
+  uint32_t size;
+  volatile uint8_t* p = dma_memory_item(s, idx, &size);
+  if (size == 1) *p = (uint8_t)data;
+  else if (size == 2) *(volatile uint16_t*)p = (uint16_t)data;
+  else *(volatile uint32_t*)p = data;
+  dma_item_done(s, idx);
+  return 1;
+}
+
+int sim_dma_mem_to_periph(DMA_Stream_TypeDef* s, uint32_t* data) {
+  if (!(s->CR & DMA_SxCR_EN) || s->NDTR == 0) return 0;
+  int idx = dma_index(s);
+  uint32_t size;
+  volatile uint8_t* p = dma_memory_item(s, idx, &size);
+  if (size == 1) *data = *p;
+  else if (size == 2) *data = *(volatile uint16_t*)p;
+  else *data = *(volatile uint32_t*)p;
+  dma_item_done(s, idx);
+  return 1;
+}
+
+/* ---- UART --------------------------------------------------------------- */
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart) {
+  if (huart->Init.BaudRate == 0) return HAL_ERROR;
+  USART_TypeDef* u = huart->Instance;
+  u->BRR = HAL_RCC_GetPCLK1Freq() / huart->Init.BaudRate;  // UART4 and USART2 sit on APB1
+  u->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+  return HAL_OK;
+}
+
+/* ---- FLASH -------------------------------------------------------------- */
+
+// Only sector 7 (the firmware's config store) exists; sim_flash_attach maps
+// it at its real address so the firmware can read it through plain pointers.
+// Times are the F405 datasheet typicals at 2.7-3.6 V (x32 parallelism).
+#define FLASH_SECTOR7_BASE 0x08060000u
+#define FLASH_SECTOR7_SIZE (128u * 1024u)
+#define FLASH_ERASE_128K_US 875000u
+#define FLASH_PROGRAM_WORD_US 16u
+
+static uint8_t* flash_sector7;
+static int flash_locked = 1;
+
+int sim_flash_attach(const char* path) {
+  if (flash_sector7) return 1;
+  int fd = -1;
+  int flags = MAP_SHARED | MAP_FIXED_NOREPLACE;
+  if (path) {
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return 0;
+    struct stat st;
+    int fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    if (ftruncate(fd, FLASH_SECTOR7_SIZE) != 0) {
+      close(fd);
+      return 0;
+    }
+    if (fresh) {
+      // a new image starts erased
+      static uint8_t erased[4096];
+      memset(erased, 0xFF, sizeof(erased));
+      for (uint32_t off = 0; off < FLASH_SECTOR7_SIZE; off += sizeof(erased)) {
+        if (pwrite(fd, erased, sizeof(erased), off) != (ssize_t)sizeof(erased)) {
+          close(fd);
+          return 0;
+        }
+      }
+    }
+  } else {
+    flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+  }
+  void* p = mmap((void*)(uintptr_t)FLASH_SECTOR7_BASE, FLASH_SECTOR7_SIZE,
+                 PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (fd >= 0) close(fd);
+  if (p != (void*)(uintptr_t)FLASH_SECTOR7_BASE) {
+    // older kernels ignore MAP_FIXED_NOREPLACE and may map elsewhere
+    if (p != MAP_FAILED) munmap(p, FLASH_SECTOR7_SIZE);
+    return 0;
+  }
+  flash_sector7 = p;
+  if (!path) memset(flash_sector7, 0xFF, FLASH_SECTOR7_SIZE);
+  return 1;
+}
+
+// The F405 has one flash bank: code fetches stall while it is busy, so
+// interrupts stop too. Timers, DMA and the UART keep running.
+static void flash_busy_us(uint64_t us) {
+  uint32_t pm = __get_PRIMASK();
+  __disable_irq();
+  sim_board_advance_us(us);
+  __set_PRIMASK(pm);
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+  flash_locked = 0;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+  flash_locked = 1;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* erase, uint32_t* sector_error) {
+  if (sector_error) *sector_error = 0xFFFFFFFFu;
+  if (flash_locked || !flash_sector7 || erase->TypeErase != FLASH_TYPEERASE_SECTORS ||
+      erase->Sector != FLASH_SECTOR_7 || erase->NbSectors != 1) {
+    if (sector_error) *sector_error = erase->Sector;
+    return HAL_ERROR;
+  }
+  flash_busy_us(FLASH_ERASE_128K_US);
+  memset(flash_sector7, 0xFF, FLASH_SECTOR7_SIZE);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uint32_t address, uint64_t data) {
+  if (flash_locked || !flash_sector7 || type != FLASH_TYPEPROGRAM_WORD || (address & 3u) ||
+      address < FLASH_SECTOR7_BASE || address - FLASH_SECTOR7_BASE >= FLASH_SECTOR7_SIZE) {
+    return HAL_ERROR;
+  }
+  flash_busy_us(FLASH_PROGRAM_WORD_US);
+  // programming only clears bits; anything else is a programming sequence error
+  volatile uint32_t* w = (volatile uint32_t*)(flash_sector7 + (address - FLASH_SECTOR7_BASE));
+  *w &= (uint32_t)data;
+  return (*w == (uint32_t)data) ? HAL_OK : HAL_ERROR;
+}
+
+/* ---- Reset -------------------------------------------------------------- */
+
+void sim_hal_reset(void) {
+  // the firmware passes 32-bit addresses of its buffers to DMA (see sim_addr)
+  if ((uintptr_t)&sim_dma_streams[0] > UINT32_MAX || (uintptr_t)sim_ccm_ram > UINT32_MAX) {
+    fprintf(stderr, "sim: static data above 4 GB, link with -no-pie\n");
+    exit(2);
+  }
+
+  memset(&sim_GPIOA, 0, sizeof(sim_GPIOA));
+  memset(&sim_GPIOB, 0, sizeof(sim_GPIOB));
+  memset(&sim_GPIOC, 0, sizeof(sim_GPIOC));
+  memset(&sim_GPIOD, 0, sizeof(sim_GPIOD));
+  memset(&sim_TIM1, 0, sizeof(sim_TIM1));
+  memset(&sim_TIM2, 0, sizeof(sim_TIM2));
+  memset(&sim_TIM4, 0, sizeof(sim_TIM4));
+  memset(&sim_TIM5, 0, sizeof(sim_TIM5));
+  memset(&sim_TIM7, 0, sizeof(sim_TIM7));
+  memset(&sim_ADC1, 0, sizeof(sim_ADC1));
+  memset(&sim_ADC2, 0, sizeof(sim_ADC2));
+  memset(&sim_ADC3, 0, sizeof(sim_ADC3));
+  memset(&sim_DAC, 0, sizeof(sim_DAC));
+  sim_ADC1.HTR = sim_ADC2.HTR = sim_ADC3.HTR = 0xFFFu;
+  memset(&sim_DMA1, 0, sizeof(sim_DMA1));
+  memset(&sim_DMA2, 0, sizeof(sim_DMA2));
+  memset(sim_dma_streams, 0, sizeof(sim_dma_streams));
+  memset(dma_length, 0, sizeof(dma_length));
+  memset(&sim_UART4, 0, sizeof(sim_UART4));
+  memset(&sim_USART2, 0, sizeof(sim_USART2));
+  memset(&sim_EXTI, 0, sizeof(sim_EXTI));
+  memset(exti_port, 0, sizeof(exti_port));
+  memset(&sim_RCC, 0, sizeof(sim_RCC));
+  memset(irq_priority, 0, sizeof(irq_priority));
+  memset(irq_enabled, 0, sizeof(irq_enabled));
+  memset(irq_pending, 0, sizeof(irq_pending));
+  primask = 0;
+  basepri = 0;
+  flash_locked = 1;
+  running_priority = THREAD_PRIORITY;
+
+  SystemCoreClock = 168000000u;
+  RCC->CFGR = RCC_CFGR_PPRE1_DIV4 | RCC_CFGR_PPRE2_DIV2;
+}
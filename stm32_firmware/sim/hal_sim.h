@@ -0,0 +1,47 @@
+#pragma once
+
+#include "stm32f4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulation side of the HAL shim: what the board model (sim_board.c) uses
+// to act as the hardware towards the firmware.
+
+// Clear every register, the NVIC and the DMA bookkeeping; set the reset
+// clock tree (168 MHz core, APB1 /4, APB2 /2 as the F405 Arduino core does)
+void sim_hal_reset(void);
+
+// Raise an interrupt. It runs at once when enabled, unmasked and more
+// urgent than whatever is running, otherwise when that changes.
+void sim_irq_raise(IRQn_Type irq);
+
+// Drive input pins (mask selects the pins, levels their new state); edges
+// on pins routed to EXTI lines set the pending bit and raise the interrupt
+void sim_gpio_set_inputs(GPIO_TypeDef* port, uint16_t mask, uint16_t levels);
+
+// One DMA request on a stream. Returns 0 if the stream is not enabled.
+int sim_dma_periph_to_mem(DMA_Stream_TypeDef* stream, uint32_t data);
+int sim_dma_mem_to_periph(DMA_Stream_TypeDef* stream, uint32_t* data);
+
+// Map flash sector 7 (0x08060000, 128 KB, the firmware's config store) so
+// main.cpp can read it in place. With a path the sector is backed by that
+// file and survives restarts; without one it starts erased. Returns 0 if the
+// address range is taken. Without it, erase and program fail.
+int sim_flash_attach(const char* path);
+
+// Timer clock of an APB1 / APB2 timer in Hz (x2 when the APB is divided)
+uint32_t sim_apb1_timer_hz(void);
+uint32_t sim_apb2_timer_hz(void);
+
+// Host pointer behind a 32-bit address the firmware handed to a DMA stream.
+// The build links without PIE so static storage sits below 4 GB and the
+// firmware's (uint32_t) pointer casts are lossless.
+static inline volatile void* sim_addr(uint32_t addr) {
+  return (volatile void*)(uintptr_t)addr;
+}
+
+#ifdef __cplusplus
+}
+#endif
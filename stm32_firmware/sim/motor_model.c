@@ -0,0 +1,177 @@
+#include "motor_model.h"
+#include <math.h>
+#include <string.h>
+
+#define TWO_PI (2.0 * M_PI)
+#define DEG (M_PI / 180.0)
+
+// Below this a diode-conducting phase is considered to have stopped
+#define CURRENT_EPS 1e-6
+
+// Hall pattern per 60 degree sector, starting at 90 degrees electrical
+static const uint8_t hall_by_sector[6] = {0x1, 0x3, 0x2, 0x6, 0x4, 0x5};
+
+void motor_default_params(motor_params_t* p) {
+  memset(p, 0, sizeof(*p));
+  p->r_ohm = 0.1;
+  p->l_h = 50e-6;
+  p->kv_rpm_per_v = 1000.0;
+  p->pole_pairs = 7;
+  p->sinusoidal = 0;
+  p->j_kgm2 = 2e-5;
+  p->b_nms = 1e-6;
+  p->coulomb_nm = 2e-3;
+  p->fan_nms2 = 2e-8;
+  p->diode_v = 0.7;
+  p->hall_offset_deg = 0.0;
+}
+
+void motor_init(motor_t* m, const motor_params_t* p) {
+  memset(m, 0, sizeof(*m));
+  m->p = *p;
+  // Kv is quoted against the line-line voltage: the peak line-line back-EMF
+  // is 2E for a trapezoid (two flat tops in series) and sqrt(3)E for a sine
+  double v_ll_per_rad_s = 60.0 / (TWO_PI * p->kv_rpm_per_v);
+  m->ke = v_ll_per_rad_s / (p->sinusoidal ? sqrt(3.0) : 2.0);
+}
+
+double motor_theta_e(const motor_t* m) {
+  double t = fmod(m->theta_m * m->p.pole_pairs, TWO_PI);
+  return t < 0 ? t + TWO_PI : t;
+}
+
+// Back-EMF shape of phase U at electrical angle t: +1 on [30, 150] degrees,
+// -1 on [210, 330], linear in between (or a sine with the same phase)
+static double emf_shape(const motor_t* m, double t) {
+  t = fmod(t, TWO_PI);
+  if (t < 0) t += TWO_PI;
+  if (m->p.sinusoidal) return sin(t);
+  double d = t / DEG;
+  if (d < 30.0) return d / 30.0;
+  if (d < 150.0) return 1.0;
+  if (d < 210.0) return (180.0 - d) / 30.0;
+  if (d < 330.0) return -1.0;
+  return (d - 360.0) / 30.0;
+}
+
+uint8_t motor_hall(const motor_t* m) {
+  double t = motor_theta_e(m) / DEG - 90.0 - m->p.hall_offset_deg;
+  t = fmod(t, 360.0);
+  if (t < 0) t += 360.0;
+  int sector = (int)(t / 60.0);
+  if (sector > 5) sector = 5;
+  return hall_by_sector[sector];
+}
+
+double motor_rpm(const motor_t* m) {
+  return m->omega * 60.0 / TWO_PI;
+}
+
+double motor_bus_current(const motor_t* m, const motor_gate_t gate[3]) {
+  double ibus = 0.0;
+  for (int k = 0; k < 3; ++k) {
+    if (gate[k] == MOTOR_GATE_HIGH) ibus += m->i[k];
+    else if (gate[k] == MOTOR_GATE_OFF && m->i[k] < -CURRENT_EPS) ibus += m->i[k];  // high-side diode
+  }
+  return ibus;
+}
+
+void motor_step(motor_t* m, const motor_gate_t gate[3], double vbus, double dt) {
+  const double vf = m->p.diode_v;
+  double te = motor_theta_e(m);
+  double shape[3];
+  for (int k = 0; k < 3; ++k) {
+    shape[k] = emf_shape(m, te - k * 120.0 * DEG);
+    m->e[k] = m->ke * m->omega * shape[k];
+  }
+
+  // Terminal voltage of every phase whose voltage the bridge fixes: a switch
+  // that is on, or a body diode carrying the winding current
+  double v[3];
+  int fixed[3];
+  for (int k = 0; k < 3; ++k) {
+    fixed[k] = 1;
+    if (gate[k] == MOTOR_GATE_HIGH) v[k] = vbus;
+    else if (gate[k] == MOTOR_GATE_LOW) v[k] = 0.0;
+    else if (m->i[k] > CURRENT_EPS) v[k] = -vf;
+    else if (m->i[k] < -CURRENT_EPS) v[k] = vbus + vf;
+    else fixed[k] = 0;
+  }
+
+  // Star point from the fixed phases (their currents sum to zero); an open
+  // phase pushed past a rail by its back-EMF starts conducting through a
+  // diode, which changes the star point once
+  double vn = 0.0;
+  for (int pass = 0; pass < 2; ++pass) {
+    int n = 0;
+    double sum = 0.0;
+    for (int k = 0; k < 3; ++k) {
+      if (!fixed[k]) continue;
+      sum += v[k] - m->e[k];
+      ++n;
+    }
+    vn = n ? sum / n : 0.0;
+    if (n == 3 || pass == 1) break;
+    int changed = 0;
+    for (int k = 0; k < 3; ++k) {
+      if (fixed[k]) continue;
+      double vo = m->e[k] + vn;
+      if (vo > vbus + vf) {
+        v[k] = vbus + vf;
+        fixed[k] = changed = 1;
+      } else if (vo < -vf) {
+        v[k] = -vf;
+        fixed[k] = changed = 1;
+      }
+    }
+    if (!changed || n == 0) break;
+  }
+
+  int conducting = 0;
+  for (int k = 0; k < 3; ++k) conducting += fixed[k];
+
+  for (int k = 0; k < 3; ++k) {
+    if (!fixed[k] || conducting < 2) {
+      // no return path: the winding carries nothing and follows the star point
+      m->i[k] = 0.0;
+      m->v_term[k] = fixed[k] ? v[k] : m->e[k] + vn;
+      continue;
+    }
+    double di = (v[k] - m->e[k] - vn - m->p.r_ohm * m->i[k]) / m->p.l_h * dt;
+    double next = m->i[k] + di;
+    // a diode blocks once its current has decayed to zero
+    if (gate[k] == MOTOR_GATE_OFF && next * m->i[k] < 0.0) next = 0.0;
+    if (gate[k] == MOTOR_GATE_OFF && m->i[k] == 0.0) {
+      if ((v[k] > vbus && next > 0.0) || (v[k] < 0.0 && next < 0.0)) next = 0.0;
+    }
+    m->i[k] = next;
+    m->v_term[k] = v[k];
+  }
+
+  // keep Kirchhoff exact after clamping: the largest current takes the error
+  double sum = m->i[0] + m->i[1] + m->i[2];
+  if (fabs(sum) > CURRENT_EPS) {
+    int big = 0;
+    for (int k = 1; k < 3; ++k) {
+      if (fabs(m->i[k]) > fabs(m->i[big])) big = k;
+    }
+    m->i[big] -= sum;
+  }
+
+  // Mechanics
+  double torque = 0.0;
+  for (int k = 0; k < 3; ++k) torque += m->ke * shape[k] * m->i[k];
+  m->torque_nm = torque;
+
+  double w = m->omega;
+  double drag = m->p.b_nms * w + m->p.fan_nms2 * w * fabs(w) + m->load_nm;
+  double net = torque - drag;
+  if (fabs(w) < 1e-3 && fabs(net) <= m->p.coulomb_nm) {
+    m->omega = 0.0;  // static friction holds
+  } else {
+    double dry = (w > 0 || (w == 0 && net > 0)) ? m->p.coulomb_nm : -m->p.coulomb_nm;
+    m->omega = w + (net - dry) / m->p.j_kgm2 * dt;
+    if (w != 0.0 && m->omega * w < 0.0) m->omega = 0.0;  // friction stops, never reverses
+  }
+  m->theta_m += m->omega * dt;
+}
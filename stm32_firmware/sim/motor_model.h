@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Three-phase BLDC plant for the host simulation: star-connected windings
+// behind a six-switch bridge, trapezoidal or sinusoidal back-EMF, a rigid
+// rotor with friction and propeller-like load, and three hall sensors.
+//
+// Conventions: phase current is positive into the winding; electrical angle
+// 0 is where phase U back-EMF crosses zero going up; the hall pattern for
+// each 60 degree sector is the one driver_tim1.c drives forward from
+// (U+W- centred on 120 degrees).
+
+typedef enum { MOTOR_GATE_OFF = 0, MOTOR_GATE_LOW, MOTOR_GATE_HIGH } motor_gate_t;
+
+typedef struct {
+  double r_ohm;            // phase resistance
+  double l_h;              // phase inductance
+  double kv_rpm_per_v;     // speed constant (rpm per volt line-line)
+  int pole_pairs;
+  int sinusoidal;          // 0 = trapezoidal back-EMF, 1 = sinusoidal
+  double j_kgm2;           // rotor + load inertia
+  double b_nms;            // viscous friction (N*m per rad/s)
+  double coulomb_nm;       // dry friction
+  double fan_nms2;         // load torque per (rad/s)^2
+  double diode_v;          // body diode forward drop
+  double hall_offset_deg;  // hall placement error (electrical degrees)
+} motor_params_t;
+
+typedef struct {
+  motor_params_t p;
+  double ke;               // back-EMF per phase, V per mechanical rad/s
+  double i[3];             // phase currents (A)
+  double e[3];             // back-EMF (V)
+  double v_term[3];        // terminal voltages to bridge ground (V)
+  double omega;            // mechanical speed (rad/s)
+  double theta_m;          // mechanical angle (rad, unwrapped)
+  double torque_nm;        // electromagnetic torque
+  double load_nm;          // external load set by the user
+} motor_t;
+
+// Reasonable defaults: a 1000 KV, 14-pole outrunner on a small propeller
+void motor_default_params(motor_params_t* p);
+
+void motor_init(motor_t* m, const motor_params_t* p);
+
+// Advance by dt seconds with the bridge held in the given switch states
+void motor_step(motor_t* m, const motor_gate_t gate[3], double vbus, double dt);
+
+// Current through the DC link (what a low-side single shunt sees) for the
+// given switch states
+double motor_bus_current(const motor_t* m, const motor_gate_t gate[3]);
+
+// Hall pattern (bit 0 = U) at the present rotor angle
+uint8_t motor_hall(const motor_t* m);
+
+double motor_rpm(const motor_t* m);
+double motor_theta_e(const motor_t* m);   // wrapped to [0, 2*pi)
+
+#ifdef __cplusplus
+}
+#endif
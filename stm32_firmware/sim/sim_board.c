@@ -0,0 +1,619 @@
+#include "sim_board.h"
+#include "hal_sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Board constants, as in src/board_b/safety_params.h
+#define ADC_FULL_SCALE 4095.0
+#define ADC_REF_V 3.3
+#define SHUNT_OHMS 0.001
+#define SHUNT_GAIN 50.0
+#define VBUS_DIVIDER 11.0
+#define PHASE_DIVIDER 11.0
+#define TEMP_V_PER_DEG 0.010
+
+// Regular channels wired on Board B
+#define CH_VBUS 0
+#define CH_SHUNT 1
+#define CH_TEMP 2
+#define CH_BEMF_U 13
+
+#define ADC_SQR1_L_SHIFT 20u
+#define ADC_CR2_EXTSEL 0x0F000000u
+#define ADC_CR2_EXTEN 0x30000000u
+#define TIM_CCMR2_OC4M_SHIFT 12u
+#define TIM_CR2_MMS_OC4REF TIM_TRGO_OC4REF
+#define TIM_DIER_CC1IE_BIT TIM_DIER_CC1IE
+
+// State the registers do not hold: active (shadow) copies of preloaded
+// registers and the prescaler counters
+typedef struct {
+  uint32_t arr;
+  uint32_t ccr[4];
+  uint32_t rep;
+  uint32_t psc_count;
+} timer_shadow_t;
+
+static sim_board_config_t config;
+static motor_t motor;
+static uint64_t now_us;
+static int advancing;
+
+static timer_shadow_t tim1_sh, tim5_sh, tim7_sh;
+
+// Count at which ETRF cleared OCREF of the channels with OCxCE; holds until
+// the next update event
+#define TIM1_NO_CLEAR 0xFFFFFFFFu
+static uint32_t tim1_clear_at = TIM1_NO_CLEAR;
+
+// TIM1 is stepped at most this many ticks at a time while a high side is on
+// and the current limit comparator can fire: where the comparator is seen,
+// standing in for the ETR filter (fDTS/8, N = 8)
+#define TIM1_ETR_STEP 64u
+static uint32_t tim1_tick_acc;  // TIM1 counts owed, in units of 1/1e6 count
+static uint32_t uart_acc;       // UART4 bit clock accumulator
+static uint32_t uart_rx_acc;    // same for the receive line
+
+// Bytes on their way to the UART4 receive pin
+static uint8_t rx_queue[SIM_BOARD_UART_RX_QUEUE];
+static uint32_t rx_head, rx_count;
+static int rx_idle_due;         // a byte arrived, IDLE follows one quiet frame later
+
+static sim_board_uart_sink_t uart_sink;
+static void* uart_sink_ctx;
+static sim_board_observer_t observer;
+static void* observer_ctx;
+static sim_board_host_poll_t host_poll;
+static void* host_poll_ctx;
+static uint32_t host_poll_us, host_poll_acc;
+
+// Running statistics of the current PWM period
+static struct {
+  double t;
+  double i_min[3], i_max[3], i_int[3];
+  double ibus_int, ibus_max;
+} period_acc;
+
+static uint32_t noise_state;
+
+void sim_board_config_defaults(sim_board_config_t* cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->vbus_v = 12.0;
+  cfg->temp_c = 30.0;
+  cfg->adc_noise_lsb = 0.0;
+  cfg->seed = 1;
+  cfg->bkin_trip_a = 60.0;  // comparator at 3.0 V on the shunt amplifier
+}
+
+uint64_t sim_board_time_us(void) { return now_us; }
+
+motor_t* sim_board_motor(void) { return &motor; }
+
+void sim_board_set_vbus(double volts) { config.vbus_v = volts; }
+
+void sim_board_set_bkin_trip(double amps) { config.bkin_trip_a = amps; }
+
+void sim_board_set_uart_sink(sim_board_uart_sink_t sink, void* ctx) {
+  uart_sink = sink;
+  uart_sink_ctx = ctx;
+}
+
+size_t sim_board_uart_rx(const uint8_t* data, size_t len) {
+  size_t n = 0;
+  while (n < len && rx_count < SIM_BOARD_UART_RX_QUEUE) {
+    rx_queue[(rx_head + rx_count) % SIM_BOARD_UART_RX_QUEUE] = data[n++];
+    ++rx_count;
+  }
+  return n;
+}
+
+size_t sim_board_uart_rx_pending(void) { return rx_count; }
+
+void sim_board_set_host_poll(sim_board_host_poll_t poll, void* ctx, uint32_t interval_us) {
+  host_poll = poll;
+  host_poll_ctx = ctx;
+  host_poll_us = interval_us ? interval_us : 1u;
+  host_poll_acc = 0;
+}
+
+void sim_board_set_observer(sim_board_observer_t cb, void* ctx) {
+  observer = cb;
+  observer_ctx = ctx;
+}
+
+/* ---- ADC ---------------------------------------------------------------- */
+
+// Approximately normal noise from a sum of uniforms (xorshift32)
+static double adc_noise(void) {
+  if (config.adc_noise_lsb <= 0.0) return 0.0;
+  double sum = 0.0;
+  for (int k = 0; k < 4; ++k) {
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    sum += (double)noise_state / 4294967296.0 - 0.5;
+  }
+  return sum * sqrt(3.0) * config.adc_noise_lsb;
+}
+
+static uint32_t adc_counts(double pin_volts) {
+  double c = pin_volts / ADC_REF_V * ADC_FULL_SCALE + adc_noise();
+  if (c < 0.0) c = 0.0;
+  if (c > ADC_FULL_SCALE) c = ADC_FULL_SCALE;
+  return (uint32_t)lround(c);
+}
+
+// Pin voltage of a channel with the bridge in the given state
+static uint32_t adc_channel_value(uint32_t channel, const motor_gate_t gate[3]) {
+  switch (channel) {
+    case CH_VBUS:
+      return adc_counts(config.vbus_v / VBUS_DIVIDER);
+    case CH_SHUNT: {
+      // unipolar amplifier: reverse current reads as zero
+      double ibus = motor_bus_current(&motor, gate);
+      return adc_counts(ibus * SHUNT_OHMS * SHUNT_GAIN);
+    }
+    case CH_TEMP:
+      return adc_counts(config.temp_c * TEMP_V_PER_DEG);
+    case CH_BEMF_U:
+    case CH_BEMF_U + 1:
+    case CH_BEMF_U + 2: {
+      double v = motor.v_term[channel - CH_BEMF_U];
+      return adc_counts((v > 0.0 ? v : 0.0) / PHASE_DIVIDER);
+    }
+    default:
+      return 0;
+  }
+}
+
+// Analog watchdog on one regular conversion (RM0090 13.7): the flag is set
+// whenever a guarded channel converts outside [LTR, HTR]
+static void adc_watchdog(ADC_TypeDef* adc, uint32_t channel, uint32_t value) {
+  if (!(adc->CR1 & ADC_CR1_AWDEN)) return;
+  if ((adc->CR1 & ADC_CR1_AWDSGL) && channel != (adc->CR1 & ADC_CR1_AWDCH)) return;
+  if (value <= adc->HTR && value >= adc->LTR) return;
+  adc->SR |= ADC_FLAG_AWD;
+  if (adc->CR1 & ADC_CR1_AWDIE) sim_irq_raise(ADC_IRQn);
+}
+
+static uint32_t adc_rank_channel(const ADC_TypeDef* adc, uint32_t rank) {
+  uint32_t sqr = rank < 6 ? adc->SQR3 : (rank < 12 ? adc->SQR2 : adc->SQR1);
+  return (sqr >> ((rank % 6u) * 5u)) & 0x1Fu;
+}
+
+// One external trigger: convert the regular sequence and hand each result
+// to DMA. All ranks see the bridge as it is at the trigger (the shunt rank,
+// converted first, is the one that matters).
+static void adc_trigger(ADC_TypeDef* adc, DMA_Stream_TypeDef* stream, const motor_gate_t gate[3]) {
+  if (!(adc->CR2 & ADC_CR2_ADON)) return;
+  if ((adc->CR2 & ADC_CR2_EXTEN) != ADC_EXTERNALTRIGCONVEDGE_RISING) return;
+  if ((adc->CR2 & ADC_CR2_EXTSEL) != (ADC_EXTERNALTRIGCONV_T2_TRGO & ADC_CR2_EXTSEL)) return;
+  if (adc->SR & ADC_FLAG_OVR) return;  // conversions stop until the firmware clears OVR
+
+  uint32_t length = ((adc->SQR1 >> ADC_SQR1_L_SHIFT) & 0xFu) + 1u;
+  for (uint32_t rank = 0; rank < length; ++rank) {
+    uint32_t channel = adc_rank_channel(adc, rank);
+    uint32_t value = adc_channel_value(channel, gate);
+    adc->DR = value;
+    adc->SR |= ADC_FLAG_EOC;
+    adc_watchdog(adc, channel, value);
+    if (adc->CR2 & ADC_CR2_DMA) {
+      if (!sim_dma_periph_to_mem(stream, value)) {
+        adc->SR |= ADC_FLAG_OVR;
+        return;
+      }
+    }
+  }
+}
+
+// TIM1 OC4REF rising edge -> TRGO -> TIM2 reset (ITR0) -> TIM2 TRGO -> ADC1-3
+static void tim1_oc4_rising(const motor_gate_t gate[3]) {
+  if ((TIM1->CR2 & TIM_CR2_MMS) != TIM_CR2_MMS_OC4REF) return;
+  if (!(TIM2->CR1 & TIM_CR1_CEN)) return;
+  if ((TIM2->SMCR & (TIM_SMCR_SMS | TIM_SMCR_TS)) != (TIM_SLAVEMODE_RESET | TIM_TS_ITR0)) return;
+  if ((TIM2->CR2 & TIM_CR2_MMS) != TIM_TRGO_RESET) return;
+  TIM2->CNT = 0;
+  adc_trigger(ADC1, DMA2_Stream0, gate);
+  adc_trigger(ADC2, DMA2_Stream2, gate);
+  adc_trigger(ADC3, NULL, gate);  // no DMA stream modelled for ADC3
+}
+
+/* ---- TIM1 --------------------------------------------------------------- */
+
+// BDTR.DTG decode (RM0090 17.4.18), in timer clock ticks with CKD = 1
+uint32_t sim_board_deadtime_ticks(void) {
+  uint32_t dtg = TIM1->BDTR & TIM_BDTR_DTG;
+  if ((dtg & 0x80u) == 0) return dtg;
+  if ((dtg & 0xC0u) == 0x80u) return (64u + (dtg & 0x3Fu)) * 2u;
+  if ((dtg & 0xE0u) == 0xC0u) return (32u + (dtg & 0x1Fu)) * 8u;
+  return (32u + (dtg & 0x1Fu)) * 16u;
+}
+
+static uint32_t tim1_oc_mode(uint32_t ch) {
+  uint32_t ccmr = ch < 2 ? TIM1->CCMR1 : TIM1->CCMR2;
+  return (ccmr >> ((ch & 1u) ? 8u : 0u)) & TIM_CCMR1_OC1M;
+}
+
+// Gate state of phase ch at counter value cnt. OCxREF (PWM1) is high on
+// [0, ccr); the high side turns on DT after its rising edge, the low side DT
+// after its falling edge, and a pulse shorter than DT never comes through.
+static motor_gate_t tim1_gate(uint32_t ch, uint32_t cnt, uint32_t period, uint32_t dt) {
+  if (!(TIM1->BDTR & TIM_BDTR_MOE)) return MOTOR_GATE_OFF;
+  uint32_t ccer = TIM1->CCER >> (ch * 4u);
+  int high_en = (ccer & TIM_CCER_CC1E) != 0;
+  int low_en = (ccer & TIM_CCER_CC1NE) != 0;
+  if (!high_en && !low_en) return MOTOR_GATE_OFF;
+
+  uint32_t mode = tim1_oc_mode(ch);
+  uint32_t ccr = tim1_sh.ccr[ch];
+  // OCREF clear: the PWM1 high phase ended where ETRF rose
+  uint32_t ccmr = ch < 2 ? TIM1->CCMR1 : TIM1->CCMR2;
+  if (((ccmr >> ((ch & 1u) ? 8u : 0u)) & TIM_CCMR1_OC1CE) && tim1_clear_at < ccr) ccr = tim1_clear_at;
+  motor_gate_t g;
+  if (mode == TIM_OCMODE_FORCED_INACTIVE || (mode == TIM_OCMODE_PWM1 && ccr == 0)) {
+    g = MOTOR_GATE_LOW;
+  } else if (mode == TIM_OCMODE_PWM1 && ccr >= period) {
+    g = MOTOR_GATE_HIGH;
+  } else if (mode == TIM_OCMODE_PWM1) {
+    if (cnt < ccr) g = (cnt >= dt) ? MOTOR_GATE_HIGH : MOTOR_GATE_OFF;
+    else g = (cnt >= ccr + dt) ? MOTOR_GATE_LOW : MOTOR_GATE_OFF;
+  } else {
+    g = MOTOR_GATE_OFF;  // modes the firmware does not use on the bridge
+  }
+  if ((g == MOTOR_GATE_HIGH && !high_en) || (g == MOTOR_GATE_LOW && !low_en)) g = MOTOR_GATE_OFF;
+  return g;
+}
+
+static void tim1_gates(uint32_t cnt, uint32_t period, uint32_t dt, motor_gate_t gate[3]) {
+  for (uint32_t ch = 0; ch < 3; ++ch) gate[ch] = tim1_gate(ch, cnt, period, dt);
+}
+
+// The current limit comparator drives PA12 (TIM1_ETR) high while the bus
+// current is above the DAC1 threshold (same scale as the shunt ADC)
+static int limit_comparator(const motor_gate_t gate[3]) {
+  if (!(DAC->CR & DAC_CR_EN1)) return 0;
+  double threshold_a = DAC->DOR1 / ADC_FULL_SCALE * ADC_REF_V / (SHUNT_OHMS * SHUNT_GAIN);
+  return motor_bus_current(&motor, gate) > threshold_a;
+}
+
+// Whether an OCREF clear can still cut this period short
+static int tim1_clear_armed(void) {
+  const uint32_t ce = TIM_CCMR1_OC1CE | TIM_CCMR1_OC2CE;
+  if (tim1_clear_at != TIM1_NO_CLEAR || !(DAC->CR & DAC_CR_EN1)) return 0;
+  return (TIM1->CCMR1 & ce) || (TIM1->CCMR2 & TIM_CCMR2_OC3CE);
+}
+
+// ETRF (ETP applied) at count cnt
+static void tim1_etr_input(uint32_t cnt, const motor_gate_t gate[3]) {
+  int high = limit_comparator(gate);
+  sim_gpio_set_inputs(GPIOA, GPIO_PIN_12, high ? GPIO_PIN_12 : 0u);
+  if (TIM1->SMCR & TIM_SMCR_ETP) high = !high;
+  if (high && tim1_clear_at == TIM1_NO_CLEAR) tim1_clear_at = cnt;
+}
+
+// The board's overcurrent comparator pulls PB12 (TIM1_BKIN) low while the
+// bus current is above bkin_trip_a. With BKE set, the break input at its
+// active level (BKP) clears MOE at once and sets BIF.
+static void tim1_break_input(const motor_gate_t gate[3]) {
+  int fault = config.bkin_trip_a > 0.0 && motor_bus_current(&motor, gate) > config.bkin_trip_a;
+  sim_gpio_set_inputs(GPIOB, GPIO_PIN_12, fault ? 0u : GPIO_PIN_12);
+  if (!(TIM1->BDTR & TIM_BDTR_BKE)) return;
+  int pin_high = !fault;
+  int active_high = (TIM1->BDTR & TIM_BDTR_BKP) != 0;
+  if (pin_high == active_high) {
+    TIM1->BDTR &= ~TIM_BDTR_MOE;
+    TIM1->SR |= TIM_SR_BIF;
+    if (TIM1->DIER & TIM_DIER_BIE) sim_irq_raise(TIM1_BRK_TIM9_IRQn);
+  }
+}
+
+static void period_reset(void) {
+  memset(&period_acc, 0, sizeof(period_acc));
+  for (int k = 0; k < 3; ++k) period_acc.i_min[k] = period_acc.i_max[k] = motor.i[k];
+}
+
+static void period_report(void) {
+  if (observer && period_acc.t > 0.0) {
+    sim_board_period_t p;
+    p.time_us = now_us;
+    for (int k = 0; k < 3; ++k) {
+      p.i_pp[k] = period_acc.i_max[k] - period_acc.i_min[k];
+      p.i_mean[k] = period_acc.i_int[k] / period_acc.t;
+    }
+    p.ibus_mean = period_acc.ibus_int / period_acc.t;
+    p.ibus_peak = period_acc.ibus_max;
+    p.rpm = motor_rpm(&motor);
+    observer(&p, observer_ctx);
+  }
+  period_reset();
+}
+
+static void motor_advance(const motor_gate_t gate[3], double dt) {
+  double ibus = motor_bus_current(&motor, gate);
+  period_acc.ibus_int += ibus * dt;
+  motor_step(&motor, gate, config.vbus_v, dt);
+  period_acc.t += dt;
+  // the current within a segment is monotonic: its peak is at an end
+  if (ibus > period_acc.ibus_max) period_acc.ibus_max = ibus;
+  ibus = motor_bus_current(&motor, gate);
+  if (ibus > period_acc.ibus_max) period_acc.ibus_max = ibus;
+  for (int k = 0; k < 3; ++k) {
+    double i = motor.i[k];
+    period_acc.i_int[k] += i * dt;
+    if (i < period_acc.i_min[k]) period_acc.i_min[k] = i;
+    if (i > period_acc.i_max[k]) period_acc.i_max[k] = i;
+  }
+}
+
+// Update event: preloaded registers take effect, repetition counter reloads
+static void tim_load_shadows(TIM_TypeDef* t, timer_shadow_t* sh) {
+  sh->arr = t->ARR;
+  sh->ccr[0] = t->CCR1;
+  sh->ccr[1] = t->CCR2;
+  sh->ccr[2] = t->CCR3;
+  sh->ccr[3] = t->CCR4;
+  sh->rep = t->RCR;
+}
+
+// EGR bits written since the last tick (see tim_base_config in hal_sim.c)
+static void tim1_apply_egr(void) {
+  uint32_t egr = TIM1->EGR;
+  if (!egr) return;
+  TIM1->EGR = 0;
+  if (egr & TIM_EGR_UG) {
+    TIM1->CNT = 0;
+    tim_load_shadows(TIM1, &tim1_sh);
+    tim1_clear_at = TIM1_NO_CLEAR;
+  }
+  // COMG: CCMR/CCER are read live, so the preloaded bits are already in effect
+}
+
+// Registers without preload (or with it off) are used as written
+static void tim1_live_registers(void) {
+  if (!(TIM1->CR1 & TIM_CR1_ARPE)) tim1_sh.arr = TIM1->ARR;
+  if (!(TIM1->CCMR1 & TIM_CCMR1_OC1PE)) tim1_sh.ccr[0] = TIM1->CCR1;
+  if (!(TIM1->CCMR1 & TIM_CCMR1_OC2PE)) tim1_sh.ccr[1] = TIM1->CCR2;
+  if (!(TIM1->CCMR2 & TIM_CCMR2_OC3PE)) tim1_sh.ccr[2] = TIM1->CCR3;
+  if (!(TIM1->CCMR2 & TIM_CCMR2_OC4PE)) tim1_sh.ccr[3] = TIM1->CCR4;
+}
+
+static void tim1_update_event(void) {
+  period_report();
+  if (tim1_sh.rep > 0) {
+    --tim1_sh.rep;
+    return;
+  }
+  tim_load_shadows(TIM1, &tim1_sh);
+  tim1_clear_at = TIM1_NO_CLEAR;
+  TIM1->SR |= TIM_SR_UIF;
+  if (TIM1->DIER & TIM_DIER_UIE) sim_irq_raise(TIM1_UP_TIM10_IRQn);
+}
+
+// Advance TIM1 and the motor by one microsecond, splitting the interval at
+// every gate edge and at the ADC trigger
+static void tim1_run_us(void) {
+  tim1_apply_egr();
+  const double us = 1e-6;
+  if (!(TIM1->CR1 & TIM_CR1_CEN)) {
+    motor_gate_t gate[3];
+    tim1_gates(TIM1->CNT, tim1_sh.arr + 1u, sim_board_deadtime_ticks(), gate);
+    motor_advance(gate, us);
+    tim1_break_input(gate);
+    return;
+  }
+
+  uint32_t count_hz = sim_apb2_timer_hz() / (TIM1->PSC + 1u);
+  tim1_tick_acc += count_hz;
+  uint32_t ticks = tim1_tick_acc / 1000000u;
+  tim1_tick_acc %= 1000000u;
+  double tick_s = 1.0 / count_hz;
+  double left_s = us;
+
+  while (ticks > 0) {
+    tim1_apply_egr();
+    tim1_live_registers();
+    uint32_t period = tim1_sh.arr + 1u;
+    uint32_t dt = sim_board_deadtime_ticks();
+    uint32_t cnt = TIM1->CNT;
+    if (cnt >= period) cnt = 0;
+
+    // next instant anything changes
+    uint32_t next = period;
+    uint32_t marks[10] = {dt, tim1_sh.ccr[3]};
+    int nmarks = 2;
+    if (tim1_clear_at != TIM1_NO_CLEAR) marks[nmarks++] = tim1_clear_at + dt;
+    for (uint32_t ch = 0; ch < 3; ++ch) {
+      marks[nmarks++] = tim1_sh.ccr[ch];
+      marks[nmarks++] = tim1_sh.ccr[ch] + dt;
+    }
+    for (int k = 0; k < nmarks; ++k) {
+      if (marks[k] > cnt && marks[k] < next) next = marks[k];
+    }
+    uint32_t len = next - cnt;
+    if (len > ticks) len = ticks;
+
+    motor_gate_t gate[3];
+    tim1_gates(cnt, period, dt, gate);
+    int high_side_on = gate[0] == MOTOR_GATE_HIGH || gate[1] == MOTOR_GATE_HIGH || gate[2] == MOTOR_GATE_HIGH;
+    if (high_side_on && len > TIM1_ETR_STEP && tim1_clear_armed()) len = TIM1_ETR_STEP;
+    motor_advance(gate, len * tick_s);
+    tim1_break_input(gate);
+    left_s -= len * tick_s;
+    ticks -= len;
+    cnt += len;
+    tim1_etr_input(cnt, gate);
+
+    if (cnt >= period) {
+      TIM1->CNT = 0;
+      tim1_update_event();
+      continue;
+    }
+    TIM1->CNT = cnt;
+    uint32_t oc4 = tim1_oc_mode(3);
+    if (cnt == tim1_sh.ccr[3] && oc4 == TIM_OCMODE_PWM2) {
+      tim1_gates(cnt, period, dt, gate);
+      tim1_oc4_rising(gate);
+    }
+  }
+  if (left_s > 1e-12) {
+    // fractional tick left over from a non-integer clock ratio
+    motor_gate_t gate[3];
+    tim1_gates(TIM1->CNT, tim1_sh.arr + 1u, sim_board_deadtime_ticks(), gate);
+    motor_advance(gate, left_s);
+    tim1_break_input(gate);
+  }
+}
+
+/* ---- Basic timers (TIM5 time base, TIM7 open-loop stepper) -------------- */
+
+static void tim_basic_run_us(TIM_TypeDef* t, timer_shadow_t* sh, uint32_t timer_hz, IRQn_Type irq) {
+  uint32_t egr = t->EGR;
+  if (egr) {
+    t->EGR = 0;
+    if (egr & TIM_EGR_UG) {
+      t->CNT = 0;
+      sh->psc_count = 0;
+      sh->arr = t->ARR;
+      // an update event like any other unless URS restricts UIF to overflows
+      if (!(t->CR1 & TIM_CR1_URS)) {
+        t->SR |= TIM_SR_UIF;
+        if (t->DIER & TIM_DIER_UIE) sim_irq_raise(irq);
+      }
+    }
+    if (egr & TIM_EGR_CC1G) {
+      t->SR |= TIM_SR_CC1IF;
+      if (t->DIER & TIM_DIER_CC1IE_BIT) sim_irq_raise(irq);
+    }
+  }
+  if (!(t->CR1 & TIM_CR1_CEN)) return;
+  if (!(t->CR1 & TIM_CR1_ARPE)) sh->arr = t->ARR;
+
+  uint32_t psc = t->PSC + 1u;
+  uint32_t clocks = timer_hz / 1000000u;
+  sh->psc_count += clocks;
+  while (sh->psc_count >= psc) {
+    sh->psc_count -= psc;
+    if (t->CNT >= sh->arr) {
+      t->CNT = 0;
+      sh->arr = t->ARR;
+      t->SR |= TIM_SR_UIF;
+      if (t->DIER & TIM_DIER_UIE) sim_irq_raise(irq);
+    } else {
+      t->CNT++;
+    }
+    if (t->CNT == t->CCR1 && (t->CCMR1 & TIM_CCMR1_CC1S) == 0) {
+      t->SR |= TIM_SR_CC1IF;
+      if (t->DIER & TIM_DIER_CC1IE_BIT) sim_irq_raise(irq);
+    }
+  }
+}
+
+/* ---- UART4 -------------------------------------------------------------- */
+
+// Receive side. The shim cannot see the SR-then-DR read that clears IDLE and
+// ORE, so they are cleared when the next byte arrives instead.
+static void uart4_rx_run_us(void) {
+  const uint32_t cr1_on = USART_CR1_UE | USART_CR1_RE;
+  if ((UART4->CR1 & cr1_on) != cr1_on || UART4->BRR == 0) return;
+  if (rx_count == 0 && !rx_idle_due) {
+    uart_rx_acc = 0;  // line idle: the next byte starts when it is queued
+    return;
+  }
+  uart_rx_acc += HAL_RCC_GetPCLK1Freq() / UART4->BRR;
+  if (uart_rx_acc < 10u * 1000000u) return;
+  uart_rx_acc -= 10u * 1000000u;
+
+  if (rx_count == 0) {
+    // a whole frame time without a start bit
+    rx_idle_due = 0;
+    uart_rx_acc = 0;
+    UART4->SR |= USART_SR_IDLE;
+    if (UART4->CR1 & USART_CR1_IDLEIE) sim_irq_raise(UART4_IRQn);
+    return;
+  }
+
+  uint8_t byte = rx_queue[rx_head];
+  rx_head = (rx_head + 1u) % SIM_BOARD_UART_RX_QUEUE;
+  --rx_count;
+  rx_idle_due = 1;
+  UART4->SR &= ~(USART_SR_IDLE | USART_SR_ORE);
+  if ((UART4->CR3 & USART_CR3_DMAR) && sim_dma_periph_to_mem(DMA1_Stream2, byte)) return;
+  if (UART4->SR & USART_SR_RXNE) {
+    UART4->SR |= USART_SR_ORE;  // previous byte not read: this one is lost
+  } else {
+    UART4->DR = byte;
+    UART4->SR |= USART_SR_RXNE;
+  }
+  if (UART4->CR1 & USART_CR1_RXNEIE) sim_irq_raise(UART4_IRQn);
+}
+
+// Transmit side, drained from DMA1 Stream4
+static void uart4_run_us(void) {
+  uart4_rx_run_us();
+
+  if (!(UART4->CR3 & USART_CR3_DMAT) || UART4->BRR == 0) return;
+  uint32_t baud = HAL_RCC_GetPCLK1Freq() / UART4->BRR;
+  // 10 bits per byte (8N1)
+  uart_acc += baud;
+  while (uart_acc >= 10u * 1000000u) {
+    uart_acc -= 10u * 1000000u;
+    uint32_t byte;
+    if (!sim_dma_mem_to_periph(DMA1_Stream4, &byte)) {
+      uart_acc = 0;  // line idle: the next byte starts when it is written
+      return;
+    }
+    UART4->DR = byte & 0xFFu;
+    UART4->SR |= UART_FLAG_TC;
+    if (uart_sink) uart_sink((uint8_t)byte, uart_sink_ctx);
+  }
+}
+
+/* ---- Board -------------------------------------------------------------- */
+
+void sim_board_init(const sim_board_config_t* cfg, const motor_params_t* params) {
+  sim_hal_reset();
+  if (cfg) config = *cfg;
+  else sim_board_config_defaults(&config);
+  motor_init(&motor, params);
+  noise_state = config.seed ? config.seed : 1u;
+  now_us = 0;
+  advancing = 0;
+  memset(&tim1_sh, 0, sizeof(tim1_sh));
+  memset(&tim5_sh, 0, sizeof(tim5_sh));
+  memset(&tim7_sh, 0, sizeof(tim7_sh));
+  tim1_clear_at = TIM1_NO_CLEAR;
+  tim1_tick_acc = uart_acc = uart_rx_acc = 0;
+  rx_head = rx_count = 0;
+  rx_idle_due = 0;
+  uart_sink = NULL;
+  host_poll = NULL;
+  observer = NULL;
+  period_reset();
+
+  // hall lines idle high (pull-ups) until the model drives them
+  sim_gpio_set_inputs(GPIOC, 0x7, motor_hall(&motor));
+}
+
+void sim_board_advance_us(uint64_t us) {
+  if (advancing) {
+    // a blocking delay inside an interrupt handler would hang the real board
+    fprintf(stderr, "sim: HAL_Delay called from interrupt context\n");
+    abort();
+  }
+  advancing = 1;
+  for (uint64_t k = 0; k < us; ++k) {
+    ++now_us;
+    tim1_run_us();
+    sim_gpio_set_inputs(GPIOC, 0x7, motor_hall(&motor));
+    tim_basic_run_us(TIM5, &tim5_sh, sim_apb1_timer_hz(), TIM5_IRQn);
+    tim_basic_run_us(TIM7, &tim7_sh, sim_apb1_timer_hz(), TIM7_IRQn);
+    uart4_run_us();
+    if (host_poll && ++host_poll_acc >= host_poll_us) {
+      host_poll_acc = 0;
+      host_poll(host_poll_ctx);
+    }
+  }
+  advancing = 0;
+}
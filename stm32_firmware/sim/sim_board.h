@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "motor_model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Board B as seen from its pins: TIM1 gates drive the motor model through a
+// three-phase bridge, the shunt, bus, temperature and phase-voltage dividers
+// feed ADC1-3 at the TIM1 CH4 trigger, an overcurrent comparator drives the
+// TIM1 break input, the halls drive PC0-PC2, and UART4 sends and receives at
+// the line rate. Time advances in 1 us steps; TIM1 is resolved to its
+// switching edges within each step.
+
+typedef struct {
+  double vbus_v;         // supply voltage
+  double temp_c;         // board temperature (LM35 on PA2)
+  double adc_noise_lsb;  // rms noise added to every conversion (0 = none)
+  uint32_t seed;         // noise generator seed
+  double bkin_trip_a;    // overcurrent comparator on PB12 (TIM1_BKIN), 0 = not fitted
+} sim_board_config_t;
+
+// Per-PWM-period statistics, passed to the observer at every TIM1 update
+// event (once per period, whatever the repetition counter)
+typedef struct {
+  uint64_t time_us;
+  double i_pp[3];        // peak-to-peak phase current over the period (A)
+  double i_mean[3];      // mean phase current (A)
+  double ibus_mean;      // mean DC link current (A)
+  double ibus_peak;      // highest DC link current (A), what the shunt sees
+  double rpm;
+} sim_board_period_t;
+
+typedef void (*sim_board_observer_t)(const sim_board_period_t* period, void* ctx);
+typedef void (*sim_board_uart_sink_t)(uint8_t byte, void* ctx);
+typedef void (*sim_board_host_poll_t)(void* ctx);
+
+void sim_board_config_defaults(sim_board_config_t* cfg);
+
+// Reset the HAL shim and the motor. Call before the firmware's init code.
+void sim_board_init(const sim_board_config_t* cfg, const motor_params_t* motor);
+
+// Run the hardware (and any interrupts it raises) for us microseconds
+void sim_board_advance_us(uint64_t us);
+
+// Simulated time since sim_board_init
+uint64_t sim_board_time_us(void);
+
+motor_t* sim_board_motor(void);
+void sim_board_set_vbus(double volts);
+
+// Threshold of the overcurrent comparator on TIM1_BKIN (0 = not fitted)
+void sim_board_set_bkin_trip(double amps);
+
+// UART4 transmit bytes, one call per byte at the configured baud rate
+void sim_board_set_uart_sink(sim_board_uart_sink_t sink, void* ctx);
+
+// Queue bytes for the UART4 receive line. They are received one per frame
+// time at the configured baud rate, through the receive DMA when it is on.
+// Returns how many fit; offer the rest again later.
+#define SIM_BOARD_UART_RX_QUEUE 4096u
+size_t sim_board_uart_rx(const uint8_t* data, size_t len);
+
+// Bytes queued for reception that have not arrived yet
+size_t sim_board_uart_rx_pending(void);
+
+// Called every interval_us of simulated time, including inside HAL_Delay and
+// flash stalls: where a host front end exchanges bytes with the outside world
+// and paces the simulation against the wall clock
+void sim_board_set_host_poll(sim_board_host_poll_t poll, void* ctx, uint32_t interval_us);
+
+void sim_board_set_observer(sim_board_observer_t observer, void* ctx);
+
+// TIM1 dead time in timer ticks as decoded from BDTR.DTG
+uint32_t sim_board_deadtime_ticks(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,237 @@
+// Board B as a Linux process: main.cpp's setup() and loop() run against the
+// board model with UART4 on a pseudo-terminal, so the backend
+// (backend_node/core/escConnection.js) and esc_loadgen connect to it as they
+// would to the board's USB serial adapter.
+//
+//   virtual_board [--link PATH] [--flash FILE] [--duration S] [--free-run]
+//                 [--loop-us N]
+//
+// --link      symlink PATH to the terminal (e.g. /tmp/ttyESC) for a stable name
+// --flash     back flash sector 7 with FILE so a saved config survives restarts
+// --duration  exit after S seconds of simulated time (default: until SIGINT)
+// --free-run  do not pace simulated time against the wall clock
+// --loop-us   simulated time per loop() pass (default 20)
+//
+// The terminal path is printed as "pty=<path>" once it is ready; run
+// statistics are printed as key=value lines on exit.
+#include <Arduino.h>
+#include "sim_board.h"
+#include "hal_sim.h"
+#include "motor_model.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+#include "esc_protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Host I/O and pacing interval: bounds the latency the bridge adds
+#define HOST_POLL_US 100u
+
+// Firmware output not yet taken by the terminal. Beyond this the reader is
+// gone or stuck and bytes are dropped, as on an unread serial line.
+#define TX_BACKLOG_MAX (64u * 1024u)
+
+static int pty_master = -1;
+static int pty_slave = -1;
+static const char* link_path = NULL;
+static int free_run = 0;
+
+static uint8_t tx_backlog[TX_BACKLOG_MAX];
+static size_t tx_len = 0;
+
+static uint64_t wall0_ns;
+static uint64_t slip_ns = 0, max_slip_ns = 0;
+
+static struct {
+  uint64_t rx_bytes, tx_bytes, tx_lost;
+} stats;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void on_signal(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+/* ---- Pseudo-terminal ---------------------------------------------------- */
+
+static int pty_open(void) {
+  pty_master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (pty_master < 0 || grantpt(pty_master) != 0 || unlockpt(pty_master) != 0) return 0;
+  const char* name = ptsname(pty_master);
+  if (!name) return 0;
+
+  // Hold the slave open: the master then never sees EIO between clients, and
+  // the line discipline can be made raw. With the default settings the slave
+  // would echo the firmware's own output back into UART4.
+  pty_slave = open(name, O_RDWR | O_NOCTTY);
+  if (pty_slave < 0) return 0;
+  struct termios tio;
+  if (tcgetattr(pty_slave, &tio) != 0) return 0;
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  if (tcsetattr(pty_slave, TCSANOW, &tio) != 0) return 0;
+
+  int flags = fcntl(pty_master, F_GETFL);
+  fcntl(pty_master, F_SETFL, flags | O_NONBLOCK);
+
+  if (link_path) {
+    unlink(link_path);
+    if (symlink(name, link_path) != 0) {
+      fprintf(stderr, "virtual_board: cannot link %s: %s\n", link_path, strerror(errno));
+      link_path = NULL;
+    }
+  }
+  printf("pty=%s\n", name);
+  fflush(stdout);
+  return 1;
+}
+
+// UART4 transmit pin
+static void on_uart_tx(uint8_t byte, void* ctx) {
+  (void)ctx;
+  if (tx_len < TX_BACKLOG_MAX) {
+    tx_backlog[tx_len++] = byte;
+  } else {
+    stats.tx_lost++;
+  }
+}
+
+static void pty_flush_tx(void) {
+  if (tx_len == 0) return;
+  ssize_t n = write(pty_master, tx_backlog, tx_len);
+  if (n <= 0) return;
+  memmove(tx_backlog, tx_backlog + n, tx_len - (size_t)n);
+  tx_len -= (size_t)n;
+  stats.tx_bytes += (uint64_t)n;
+}
+
+// Take only what the receive line can queue; the rest stays in the terminal
+// and holds the writer back, as the line rate would
+static void pty_fill_rx(void) {
+  uint8_t buf[512];
+  size_t room = SIM_BOARD_UART_RX_QUEUE - sim_board_uart_rx_pending();
+  if (room > sizeof(buf)) room = sizeof(buf);
+  if (room == 0) return;
+  ssize_t n = read(pty_master, buf, room);
+  if (n <= 0) return;
+  sim_board_uart_rx(buf, (size_t)n);
+  stats.rx_bytes += (uint64_t)n;
+}
+
+/* ---- Host side of the simulation ---------------------------------------- */
+
+static void host_poll(void* ctx) {
+  (void)ctx;
+  pty_fill_rx();
+  pty_flush_tx();
+
+  if (free_run) return;
+  uint64_t target = wall0_ns + slip_ns + sim_board_time_us() * 1000u;
+  uint64_t now = host_ns();
+  if (now < target) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(target / 1000000000ull);
+    ts.tv_nsec = (long)(target % 1000000000ull);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  } else {
+    // Behind (host busy or descheduled): let the wall clock slip rather than
+    // catch up, which would squeeze line and firmware timing below real time
+    slip_ns += now - target;
+    if (now - target > max_slip_ns) max_slip_ns = now - target;
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: virtual_board [--link PATH] [--flash FILE] [--duration S] [--free-run] "
+          "[--loop-us N]\n");
+}
+
+int main(int argc, char** argv) {
+  const char* flash_path = NULL;
+  double duration_s = 0.0;
+  unsigned loop_us = 20;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    int has_value = i + 1 < argc;
+    if (!strcmp(a, "--link") && has_value) link_path = argv[++i];
+    else if (!strcmp(a, "--flash") && has_value) flash_path = argv[++i];
+    else if (!strcmp(a, "--duration") && has_value) duration_s = atof(argv[++i]);
+    else if (!strcmp(a, "--loop-us") && has_value) loop_us = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(a, "--free-run")) free_run = 1;
+    else {
+      usage();
+      return 2;
+    }
+  }
+  if (loop_us == 0) loop_us = 1;
+
+  motor_params_t mp;
+  motor_default_params(&mp);
+  sim_board_config_t bc;
+  sim_board_config_defaults(&bc);
+  bc.adc_noise_lsb = 2.0;
+  sim_board_init(&bc, &mp);
+
+  if (!sim_flash_attach(flash_path)) {
+    fprintf(stderr, "virtual_board: cannot map flash sector 7%s%s\n",
+            flash_path ? " from " : "", flash_path ? flash_path : "");
+    return 1;
+  }
+  if (!pty_open()) {
+    fprintf(stderr, "virtual_board: cannot open a pseudo-terminal: %s\n", strerror(errno));
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  sim_board_set_uart_sink(on_uart_tx, NULL);
+  sim_board_set_host_poll(host_poll, NULL, HOST_POLL_US);
+  wall0_ns = host_ns();
+
+  // What the Arduino core's main() does
+  uint64_t end_us = (uint64_t)(duration_s * 1e6);
+  setup();
+  while (!stop_requested && (end_us == 0 || sim_board_time_us() < end_us)) {
+    loop();
+    sim_board_advance_us(loop_us);
+  }
+  pty_flush_tx();
+
+  double sim_s = sim_board_time_us() / 1e6;
+  double wall_s = (host_ns() - wall0_ns) / 1e9;
+  printf("sim_s=%.3f\n", sim_s);
+  printf("wall_s=%.3f\n", wall_s);
+  printf("realtime_factor=%.2f\n", wall_s > 0.0 ? sim_s / wall_s : 0.0);
+  printf("slip_ms=%.3f\n", slip_ns / 1e6);
+  printf("max_slip_ms=%.3f\n", max_slip_ns / 1e6);
+  printf("uart_rx_bytes=%llu\n", (unsigned long long)stats.rx_bytes);
+  printf("uart_tx_bytes=%llu\n", (unsigned long long)stats.tx_bytes);
+  printf("uart_rx_overrun_bytes=%lu\n", (unsigned long)uart_rx_overrun_bytes());
+  printf("uart_tx_dropped_msgs=%lu\n", (unsigned long)uart_tx_overflow_count());
+  printf("pty_tx_lost_bytes=%llu\n", (unsigned long long)stats.tx_lost);
+  printf("proto_packets=%lu\n", (unsigned long)esc_protocol_packets());
+  printf("proto_errors=%lu\n", (unsigned long)esc_protocol_errors());
+
+  if (link_path) unlink(link_path);
+  close(pty_slave);
+  close(pty_master);
+  return 0;
+}
@@ -18,6 +18,14 @@ struct AppConfig {
   uint16_t control_current_limit = 0;
   uint16_t control_pwm_frequency = 0;
   uint8_t control_brake_enabled = 0;
+  // speed loop (0.01 mA/rpm, 0.01 mA/(rpm*s), rpm/s); all zero = Board B defaults
+  uint16_t control_speed_kp = 0;
+  uint16_t control_speed_ki = 0;
+  uint16_t control_accel_limit = 0;
+  // current loop (Hz, mOhm, uH); all zero = Board B defaults
+  uint16_t control_current_bandwidth = 0;
+  uint16_t motor_resistance = 0;
+  uint16_t motor_inductance = 0;
   uint8_t safety_max_tempreature = 0;
   uint16_t safety_overcurrent_limit = 0;
   uint8_t reserved[3] = {0,0,0};
@@ -126,6 +126,9 @@ bool jsonparser::parse_json_to_appconfig(const std::vector<uint8_t>& json, AppCo
     }
     if (find_int_in_range(s, mstart, mend, "\"kv\"", tmpi)) { out.motor_kv = (int32_t)tmpi; any = true; }
     if (find_int_in_range(s, mstart, mend, "\"poles\"", tmpi)) { out.motor_poles = (uint8_t)tmpi; any = true; }
+    // optional electrical parameters for current loop tuning (mOhm, uH)
+    if (find_int_in_range(s, mstart, mend, "\"resistance\"", tmpi)) { out.motor_resistance = (uint16_t)tmpi; any = true; }
+    if (find_int_in_range(s, mstart, mend, "\"inductance\"", tmpi)) { out.motor_inductance = (uint16_t)tmpi; any = true; }
   }
 
   // control object
@@ -140,6 +143,11 @@ bool jsonparser::parse_json_to_appconfig(const std::vector<uint8_t>& json, AppCo
     if (find_int_in_range(s, cstart, cend, "\"pwmFrequency\"", tmpi)) { out.control_pwm_frequency = (uint16_t)tmpi; any = true; }
     // optional brake flag
     if (find_int_in_range(s, cstart, cend, "\"brakeEnabled\"", tmpi)) { out.control_brake_enabled = (uint8_t)tmpi; any = true; }
+    // optional speed loop tuning
+    if (find_int_in_range(s, cstart, cend, "\"speedKp\"", tmpi)) { out.control_speed_kp = (uint16_t)tmpi; any = true; }
+    if (find_int_in_range(s, cstart, cend, "\"speedKi\"", tmpi)) { out.control_speed_ki = (uint16_t)tmpi; any = true; }
+    if (find_int_in_range(s, cstart, cend, "\"accelLimit\"", tmpi)) { out.control_accel_limit = (uint16_t)tmpi; any = true; }
+    if (find_int_in_range(s, cstart, cend, "\"currentBandwidth\"", tmpi)) { out.control_current_bandwidth = (uint16_t)tmpi; any = true; }
   }
 
   // safety object
@@ -7,6 +7,7 @@
 #include "app_config.h"
 #include "json_parser.h"
 #include "protocol.h"
+#include "uart_tx.h"
 
 // ITM trace init (SWO)
 extern "C" void trace_init(uint32_t cpu_hz, uint32_t swo_hz);
@@ -15,6 +16,11 @@ extern "C" void trace_init(uint32_t cpu_hz, uint32_t swo_hz);
 
 UART_HandleTypeDef huart2;
 
+// USART2 TX DMA (DMA1 Stream6 Channel4) drains the shared transmit queue
+extern "C" void DMA1_Stream6_IRQHandler(void) {
+  uart_tx_dma_irq();
+}
+
 
 // Flash storage configuration
 #define FLASH_STORAGE_BASE 0x08060000UL // sector 7 start for STM32F401RE (128KB sector)
@@ -101,6 +107,7 @@ void initUSART2() {
   huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
   huart2.Init.OverSampling = UART_OVERSAMPLING_16;
   HAL_UART_Init(&huart2);
+  uart_tx_init(&huart2, DMA1_Stream6, DMA_CHANNEL_4, DMA1_Stream6_IRQn);
 }
 
 // Keep legacy LED pin and add support for common F4 discovery/nucleo LEDs
@@ -187,6 +194,12 @@ static void debug_print_config() {
   Serial.print("control_current_limit: "); Serial.println((int)current_config.control_current_limit);
   Serial.print("control_pwm_frequency: "); Serial.println((int)current_config.control_pwm_frequency);
   Serial.print("control_brake_enabled: "); Serial.println((int)current_config.control_brake_enabled);
+  Serial.print("control_speed_kp: "); Serial.println((int)current_config.control_speed_kp);
+  Serial.print("control_speed_ki: "); Serial.println((int)current_config.control_speed_ki);
+  Serial.print("control_accel_limit: "); Serial.println((int)current_config.control_accel_limit);
+  Serial.print("control_current_bandwidth: "); Serial.println((int)current_config.control_current_bandwidth);
+  Serial.print("motor_resistance: "); Serial.println((int)current_config.motor_resistance);
+  Serial.print("motor_inductance: "); Serial.println((int)current_config.motor_inductance);
   Serial.print("safety_max_tempreature: "); Serial.println((int)current_config.safety_max_tempreature);
   Serial.print("safety_overcurrent_limit: "); Serial.println((int)current_config.safety_overcurrent_limit);
   Serial.print("reserved: ");
@@ -197,7 +210,7 @@ static void debug_print_config() {
 // send a NUL-terminated string over USART2 if available
 static void usart2_print(const char* s) {
   if (huart2.Instance != NULL) {
-    HAL_UART_Transmit(&huart2, (uint8_t*)s, (uint16_t)strlen(s), 200);
+    uart_tx_puts(s);
   }
 }
 
@@ -218,6 +231,12 @@ static void debug_print_config_uart() {
   snprintf(buf, sizeof(buf), "control_current_limit: %d\r\n", (int)current_config.control_current_limit); usart2_print(buf);
   snprintf(buf, sizeof(buf), "control_pwm_frequency: %d\r\n", (int)current_config.control_pwm_frequency); usart2_print(buf);
   snprintf(buf, sizeof(buf), "control_brake_enabled: %d\r\n", (int)current_config.control_brake_enabled); usart2_print(buf);
+  snprintf(buf, sizeof(buf), "control_speed_kp: %d\r\n", (int)current_config.control_speed_kp); usart2_print(buf);
+  snprintf(buf, sizeof(buf), "control_speed_ki: %d\r\n", (int)current_config.control_speed_ki); usart2_print(buf);
+  snprintf(buf, sizeof(buf), "control_accel_limit: %d\r\n", (int)current_config.control_accel_limit); usart2_print(buf);
+  snprintf(buf, sizeof(buf), "control_current_bandwidth: %d\r\n", (int)current_config.control_current_bandwidth); usart2_print(buf);
+  snprintf(buf, sizeof(buf), "motor_resistance: %d\r\n", (int)current_config.motor_resistance); usart2_print(buf);
+  snprintf(buf, sizeof(buf), "motor_inductance: %d\r\n", (int)current_config.motor_inductance); usart2_print(buf);
   snprintf(buf, sizeof(buf), "safety_max_tempreature: %d\r\n", (int)current_config.safety_max_tempreature); usart2_print(buf);
   snprintf(buf, sizeof(buf), "safety_overcurrent_limit: %d\r\n", (int)current_config.safety_overcurrent_limit); usart2_print(buf);
   snprintf(buf, sizeof(buf), "reserved: %d,%d,%d\r\n", (int)current_config.reserved[0], (int)current_config.reserved[1], (int)current_config.reserved[2]); usart2_print(buf);
@@ -227,13 +246,22 @@ static void debug_print_config_uart() {
 // print hex over usart2
 static void print_hex_uart(const uint8_t* buf, size_t len) {
   if (huart2.Instance == NULL) return;
-  char s[8];
+  // format the whole dump and queue it as one message so lines never interleave
+  static const char hex[] = "0123456789ABCDEF";
+  char line[3 * 64 + 2];
+  size_t n = 0;
   for (size_t i = 0; i < len; ++i) {
-    snprintf(s, sizeof(s), "%02X", buf[i]);
-    usart2_print(s);
-    if (i + 1 < len) usart2_print(" ");
+    if (n + 3 > sizeof(line) - 2) {
+      uart_tx_write(line, n);
+      n = 0;
+    }
+    line[n++] = hex[(buf[i] >> 4) & 0xF];
+    line[n++] = hex[buf[i] & 0xF];
+    if (i + 1 < len) line[n++] = ' ';
   }
-  usart2_print("\r\n");
+  line[n++] = '\r';
+  line[n++] = '\n';
+  uart_tx_write(line, n);
 }
 
 // forward-declare print_hex (defined later) so earlier helpers can call it
@@ -242,7 +270,7 @@ static void print_hex(const uint8_t* buf, size_t len);
 // Send a frame to Board B (USART2) if available
 static void send_frame_to_board_b(const uint8_t* frame, size_t len) {
   if (huart2.Instance == NULL || len == 0) return;
-  HAL_UART_Transmit(&huart2, (uint8_t*)frame, (uint16_t)len, 500);
+  uart_tx_write(frame, len);
 
   if (Serial && !suppress_serial) {
     Serial.print("Sent to Board B (HEX): ");
@@ -291,7 +319,7 @@ static bool store_and_apply_payload(const std::vector<uint8_t>& payload) {
         // Only do this when explicitly enabled to avoid garbled characters
         // on monitors that listen on the same UART.
         if (send_binary_on_uart && huart2.Instance != NULL) {
-          HAL_UART_Transmit(&huart2, frame_buf, flen, 500);
+          uart_tx_write(frame_buf, flen);
         }
         sent_on_receive = true;
       }
@@ -425,8 +453,8 @@ void setup() {
         Serial.write("\r\n");
       }
       if (huart2.Instance != NULL) {
-        HAL_UART_Transmit(&huart2, (uint8_t*)stored_data.data(), stored_data.size(), 3000);
-        HAL_UART_Transmit(&huart2, (uint8_t*)"\r\n", 2, 50);
+        uart_tx_write(stored_data.data(), stored_data.size());
+        uart_tx_puts("\r\n");
       }
       // ensure parsed and printed
       if (!config_ready) {
@@ -450,7 +478,7 @@ void setup() {
           // Transmit binary frame over USART2 (for downstream ESC)
           // Guarded to avoid garbled output on monitors sharing the same UART.
           if (send_binary_on_uart && huart2.Instance != NULL) {
-            HAL_UART_Transmit(&huart2, frame_buf, flen, 500);
+            uart_tx_write(frame_buf, flen);
           }
           // Also send binary over CAN and I2C
           send_frame_can(frame_buf, flen);
@@ -593,8 +621,8 @@ void loop() {
               Serial.write("\r\n");
             }
             if (huart2.Instance != NULL) {
-              HAL_UART_Transmit(&huart2, (uint8_t*)stored_data.data(), stored_data.size(), 3000);
-              HAL_UART_Transmit(&huart2, (uint8_t*)"\r\n", 2, 50);
+              uart_tx_write(stored_data.data(), stored_data.size());
+              uart_tx_puts("\r\n");
             }
             // Also attempt to parse and print parsed AppConfig for verification
             if (!config_ready) {
@@ -616,7 +644,7 @@ void loop() {
         } else {
           // long press: send JSON only over USART2 (no USB print)
           if (!stored_data.empty()) {
-            HAL_UART_Transmit(&huart2, (uint8_t*)stored_data.data(), stored_data.size(), 3000);
+            uart_tx_write(stored_data.data(), stored_data.size());
             // Also pack deterministic frame and send after raw JSON
             if (!config_ready) {
               if (jsonparser::parse_json_to_appconfig(stored_data, current_config)) {
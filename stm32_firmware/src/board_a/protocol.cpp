@@ -12,13 +12,17 @@
 // Current Limit (2B) | PWM Freq (2B) | Brake (1B) | Max Temp (2B) | Overcurrent (2B) |
 // Reserved (3B) | Checksum (1B)
 size_t pack_appconfig_frame(const AppConfig& cfg, uint8_t* buf, size_t bufsize) {
-  const size_t FRAME_LEN = 29;
+  // version 2 appends the speed loop settings, version 3 the current loop
+  // settings; the shortest version that carries every given field is used
+  const bool has_current = cfg.control_current_bandwidth || cfg.motor_resistance || cfg.motor_inductance;
+  const bool has_speed = has_current || cfg.control_speed_kp || cfg.control_speed_ki || cfg.control_accel_limit;
+  const size_t FRAME_LEN = has_current ? 41 : has_speed ? 35 : 29;
   if (!buf || bufsize < FRAME_LEN) return 0;
   size_t idx = 0;
   buf[idx++] = 0xAA;
   buf[idx++] = 0x55;
   // version
-  buf[idx++] = cfg.version;
+  buf[idx++] = has_current ? 3 : has_speed ? 2 : cfg.version;
   // cells
   buf[idx++] = cfg.battery_cells;
   // voltage mV (uint16 BE)
@@ -63,6 +67,22 @@ size_t pack_appconfig_frame(const AppConfig& cfg, uint8_t* buf, size_t bufsize)
   buf[idx++] = cfg.reserved[0];
   buf[idx++] = cfg.reserved[1];
   buf[idx++] = cfg.reserved[2];
+  if (has_speed) {
+    buf[idx++] = (uint8_t)((cfg.control_speed_kp >> 8) & 0xFF);
+    buf[idx++] = (uint8_t)(cfg.control_speed_kp & 0xFF);
+    buf[idx++] = (uint8_t)((cfg.control_speed_ki >> 8) & 0xFF);
+    buf[idx++] = (uint8_t)(cfg.control_speed_ki & 0xFF);
+    buf[idx++] = (uint8_t)((cfg.control_accel_limit >> 8) & 0xFF);
+    buf[idx++] = (uint8_t)(cfg.control_accel_limit & 0xFF);
+  }
+  if (has_current) {
+    buf[idx++] = (uint8_t)((cfg.control_current_bandwidth >> 8) & 0xFF);
+    buf[idx++] = (uint8_t)(cfg.control_current_bandwidth & 0xFF);
+    buf[idx++] = (uint8_t)((cfg.motor_resistance >> 8) & 0xFF);
+    buf[idx++] = (uint8_t)(cfg.motor_resistance & 0xFF);
+    buf[idx++] = (uint8_t)((cfg.motor_inductance >> 8) & 0xFF);
+    buf[idx++] = (uint8_t)(cfg.motor_inductance & 0xFF);
+  }
 
   // checksum: XOR of bytes from version (index 2) up to last payload byte (index FRAME_LEN-2)
   uint8_t chk = 0;
@@ -0,0 +1,75 @@
+#include "adc_filter.h"
+#include <string.h>
+
+int adc_filter_init(adc_filter_t* f, const adc_filter_config_t* cfg) {
+  uint8_t os = cfg->oversample;
+  if (os == 0 || os > ADC_FILTER_MAX_OVERSAMPLE || (os & (os - 1))) return 0;
+  if (cfg->median != 1 && cfg->median != 3 && cfg->median != 5) return 0;
+  if (cfg->kind == ADC_FILTER_IIR && cfg->shift > ADC_FILTER_MAX_IIR_SHIFT) return 0;
+  if (cfg->kind == ADC_FILTER_AVERAGE && cfg->shift > ADC_FILTER_MAX_AVG_SHIFT) return 0;
+  if (cfg->kind > ADC_FILTER_AVERAGE) return 0;
+
+  uint16_t out = f->out;
+  memset(f, 0, sizeof(*f));
+  f->cfg = *cfg;
+  while ((1u << f->os_log2) < os) f->os_log2++;
+  f->out = out;  // held until the first step with the new settings
+  return 1;
+}
+
+// Median of n (odd, <= ADC_FILTER_MAX_MEDIAN) values
+static uint16_t median_of(const uint16_t* v, uint8_t n) {
+  uint16_t s[ADC_FILTER_MAX_MEDIAN];
+  for (uint8_t i = 0; i < n; ++i) {
+    uint16_t x = v[i];
+    uint8_t j = i;
+    for (; j > 0 && s[j - 1] > x; --j) s[j] = s[j - 1];
+    s[j] = x;
+  }
+  return s[n / 2];
+}
+
+void adc_filter_step(adc_filter_t* f) {
+  // Oversampling sum to counts with ADC_FILTER_FRAC_BITS fractional bits
+  uint32_t acc = f->acc;
+  uint16_t x = (f->os_log2 >= ADC_FILTER_FRAC_BITS)
+                 ? (uint16_t)(acc >> (f->os_log2 - ADC_FILTER_FRAC_BITS))
+                 : (uint16_t)(acc << (ADC_FILTER_FRAC_BITS - f->os_log2));
+  f->acc = 0;
+  f->count = 0;
+
+  // The first input fills the history, so there is no ramp up from zero
+  uint8_t shift = f->cfg.shift;
+  uint8_t taps = (uint8_t)(1u << shift);
+  if (!f->primed) {
+    f->primed = 1;
+    for (uint8_t i = 0; i < f->cfg.median; ++i) f->med[i] = x;
+    if (f->cfg.kind == ADC_FILTER_AVERAGE) {
+      for (uint8_t i = 0; i < taps; ++i) f->avg[i] = x;
+      f->avg_sum = (uint32_t)x << shift;
+    }
+    f->iir = (uint32_t)x << shift;
+  }
+
+  if (f->cfg.median > 1) {
+    f->med[f->med_pos] = x;
+    if (++f->med_pos >= f->cfg.median) f->med_pos = 0;
+    x = median_of(f->med, f->cfg.median);
+  }
+
+  switch (f->cfg.kind) {
+    case ADC_FILTER_IIR:
+      f->iir += x - (f->iir >> shift);
+      x = (uint16_t)(f->iir >> shift);
+      break;
+    case ADC_FILTER_AVERAGE:
+      f->avg_sum += x - f->avg[f->avg_pos];
+      f->avg[f->avg_pos] = x;
+      f->avg_pos = (uint8_t)((f->avg_pos + 1) & (taps - 1));
+      x = (uint16_t)(f->avg_sum >> shift);
+      break;
+    default:
+      break;
+  }
+  f->out = x;
+}
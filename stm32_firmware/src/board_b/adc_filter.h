@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-point filter for one ADC channel, fed one 12-bit sample per scan.
+// Stages, in order:
+//   oversampling  sum `oversample` scans (power of two, 1-64) into one
+//                 filter input; the rest of the pipeline runs once per sum
+//   median        median of the last `median` inputs (1 = off, 3 or 5),
+//                 rejects single-scan spikes
+//   smoothing     ADC_FILTER_IIR: first order, alpha = 2^-shift (shift 0-8)
+//                 ADC_FILTER_AVERAGE: moving average of 2^shift inputs (0-4)
+// Values past the oversampling stage are ADC counts with ADC_FILTER_FRAC_BITS
+// fractional bits, so oversampling adds resolution up to 16x.
+#define ADC_FILTER_FRAC_BITS   4
+#define ADC_FILTER_MAX_OVERSAMPLE 64
+#define ADC_FILTER_MAX_MEDIAN  5
+#define ADC_FILTER_MAX_IIR_SHIFT 8
+#define ADC_FILTER_MAX_AVG_SHIFT 4
+
+typedef enum {
+  ADC_FILTER_NONE = 0,
+  ADC_FILTER_IIR,
+  ADC_FILTER_AVERAGE
+} adc_filter_kind_t;
+
+typedef struct {
+  uint8_t oversample;  // scans per filter step
+  uint8_t median;      // spike rejector window
+  uint8_t kind;        // adc_filter_kind_t
+  uint8_t shift;       // IIR alpha or moving average length, as a power of two
+} adc_filter_config_t;
+
+typedef struct {
+  adc_filter_config_t cfg;
+  uint8_t os_log2;
+  uint8_t count;       // scans in acc
+  uint8_t primed;      // history holds real inputs
+  uint8_t med_pos;
+  uint8_t avg_pos;
+  uint32_t acc;
+  uint16_t med[ADC_FILTER_MAX_MEDIAN];
+  uint16_t avg[1u << ADC_FILTER_MAX_AVG_SHIFT];
+  uint32_t avg_sum;
+  uint32_t iir;        // output << shift
+  uint16_t out;        // counts, ADC_FILTER_FRAC_BITS fractional bits
+} adc_filter_t;
+
+// Reset the filter to cfg. Returns 0 (filter unchanged) if cfg is out of range.
+int adc_filter_init(adc_filter_t* f, const adc_filter_config_t* cfg);
+
+// Median and smoothing on a completed oversampling sum (adc_filter_push)
+void adc_filter_step(adc_filter_t* f);
+
+// Add one scan. Only every `oversample`-th call runs the filter stages;
+// returns 1 when that produced a new output.
+static inline int adc_filter_push(adc_filter_t* f, uint16_t sample) {
+  f->acc += sample;
+  if (++f->count < f->cfg.oversample) return 0;
+  adc_filter_step(f);
+  return 1;
+}
+
+// Latest output in counts with ADC_FILTER_FRAC_BITS fractional bits
+static inline uint16_t adc_filter_output(const adc_filter_t* f) {
+  return f->out;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,249 @@
+#include "bemf_sensorless.h"
+#include "safety_monitor.h"
+#include "safety_params.h"
+#include "fixed_point.h"
+#include "timebase.h"
+#include "stm32f4xx_hal.h"
+
+// Phase voltage divider taps (change to match your hardware wiring)
+#define BEMF_GPIO_PORT GPIOC
+#define BEMF_U_PIN GPIO_PIN_3
+#define BEMF_V_PIN GPIO_PIN_4
+#define BEMF_W_PIN GPIO_PIN_5
+#define BEMF_U_CHANNEL ADC_CHANNEL_13
+#define BEMF_V_CHANNEL ADC_CHANNEL_14
+#define BEMF_W_CHANNEL ADC_CHANNEL_15
+
+// Ignore the floating phase for this long after a commutation: the freewheel
+// diode clamps it to a rail until the winding current has decayed
+#define BEMF_MIN_BLANK_US 40u
+
+// Consecutive samples past the threshold that make a crossing
+#define BEMF_ZC_FILTER 2u
+
+// Forced steps with a crossing in a row before the engine takes over
+#define BEMF_LOCK_STEPS 12u
+
+// Consecutive missed or implausible crossings that count as desync
+#define BEMF_MAX_MISSES 6u
+
+// Slowest step the engine will try to track (below ~400 erpm BEMF is noise)
+#define BEMF_MAX_STEP_US 25000u
+
+enum { PHASE_U = 0, PHASE_V, PHASE_W, PHASE_COUNT };
+
+// Floating phase and BEMF slope of each step in commutation order
+static const uint8_t float_phase[6] = {PHASE_V, PHASE_U, PHASE_W, PHASE_V, PHASE_U, PHASE_W};
+#define STEP_RISING(step) (((step) & 1u) == 0u)
+
+static ADC_HandleTypeDef hadc2;
+static DMA_HandleTypeDef hdma_adc2;
+static volatile uint16_t bemf_dma_buf[PHASE_COUNT];
+
+// VBUS raw count -> phase raw count at Vbus/2 (dividers may differ)
+static int32_t half_vbus_q16 = 0;
+
+static bemf_commutate_cb_t commutate_cb = NULL;
+
+// Tracking state, touched only at interrupt priority 1
+static volatile int locked = 0;
+static uint8_t step = 0;
+static uint32_t comm_us = 0;         // last commutation
+static uint32_t zc_us = 0;           // last accepted crossing
+static int have_zc = 0;
+static uint32_t step_us = 0;         // filtered 60-degree interval
+static int zc_seen = 0;              // crossing found in the current step
+static int zc_armed = 0;             // saw the pre-crossing side after blanking
+static uint32_t zc_count = 0;        // filter: samples past the threshold
+static uint32_t good_steps = 0;
+static uint32_t misses = 0;
+static volatile uint32_t desyncs = 0;
+
+static void bemf_adc_config_rank(uint32_t channel, uint32_t rank) {
+  ADC_ChannelConfTypeDef sConfig = {0};
+  sConfig.Channel = channel;
+  sConfig.Rank = rank;
+  sConfig.SamplingTime = ADC_SAMPLETIME_15CYCLES;
+  HAL_ADC_ConfigChannel(&hadc2, &sConfig);
+}
+
+static void MX_ADC2_Init(void) {
+  __HAL_RCC_ADC2_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  // Same TIM2 TRGO trigger as ADC1 (safety_monitor.c), so phase voltages are
+  // sampled mid on-time together with the shunt
+  hadc2.Instance = ADC2;
+  hadc2.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+  hadc2.Init.Resolution = ADC_RESOLUTION_12B;
+  hadc2.Init.ScanConvMode = ENABLE;
+  hadc2.Init.ContinuousConvMode = DISABLE;
+  hadc2.Init.DiscontinuousConvMode = DISABLE;
+  hadc2.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  hadc2.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
+  hadc2.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  hadc2.Init.NbrOfConversion = PHASE_COUNT;
+  hadc2.Init.DMAContinuousRequests = ENABLE;
+  hadc2.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+  HAL_ADC_Init(&hadc2);
+
+  bemf_adc_config_rank(BEMF_U_CHANNEL, PHASE_U + 1);
+  bemf_adc_config_rank(BEMF_V_CHANNEL, PHASE_V + 1);
+  bemf_adc_config_rank(BEMF_W_CHANNEL, PHASE_W + 1);
+
+  // ADC2 -> DMA2 Stream2 Channel1, circular over one scan. Only the floating
+  // phase is used, so a scan torn across two triggers does no harm.
+  hdma_adc2.Instance = DMA2_Stream2;
+  hdma_adc2.Init.Channel = DMA_CHANNEL_1;
+  hdma_adc2.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_adc2.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_adc2.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_adc2.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_adc2.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  hdma_adc2.Init.Mode = DMA_CIRCULAR;
+  hdma_adc2.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma_adc2.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&hdma_adc2);
+  __HAL_LINKDMA(&hadc2, DMA_Handle, hdma_adc2);
+
+  HAL_DMA_Start(&hdma_adc2, (uint32_t)&hadc2.Instance->DR, (uint32_t)bemf_dma_buf, PHASE_COUNT);
+  hadc2.Instance->CR2 |= ADC_CR2_DMA | ADC_CR2_DDS;
+  __HAL_ADC_ENABLE(&hadc2);
+}
+
+void bemf_sensorless_init(bemf_commutate_cb_t cb) {
+  __HAL_RCC_GPIOC_CLK_ENABLE();
+  GPIO_InitTypeDef gpio = {0};
+  gpio.Pin = BEMF_U_PIN | BEMF_V_PIN | BEMF_W_PIN;
+  gpio.Mode = GPIO_MODE_ANALOG;
+  gpio.Pull = GPIO_NOPULL;
+  HAL_GPIO_Init(BEMF_GPIO_PORT, &gpio);
+
+  half_vbus_q16 = Q16_FROM_FLOAT(SAFETY_VBUS_DIVIDER / SAFETY_PHASE_DIVIDER / 2.0f);
+
+  timebase_init();
+  MX_ADC2_Init();
+
+  commutate_cb = cb;
+  bemf_sensorless_reset();
+}
+
+void bemf_sensorless_reset(void) {
+  timebase_cancel_alarm();
+  locked = 0;
+  have_zc = 0;
+  step_us = 0;
+  zc_seen = 0;
+  zc_armed = 0;
+  zc_count = 0;
+  good_steps = 0;
+  misses = 0;
+  comm_us = timebase_micros();
+}
+
+// Start of a new step, forced or scheduled
+static void bemf_enter_step(uint8_t next, uint32_t now) {
+  step = next;
+  comm_us = now;
+  zc_seen = 0;
+  zc_armed = 0;
+  zc_count = 0;
+}
+
+// TIM5 alarm: 30 degrees after the crossing
+static void bemf_commutate(void) {
+  if (!locked) return;
+  bemf_enter_step((uint8_t)((step + 1) % 6), timebase_micros());
+  bemf_commutate_cb_t cb = commutate_cb;
+  if (cb) cb(step);
+}
+
+static void bemf_lose_lock(void) {
+  timebase_cancel_alarm();
+  locked = 0;
+  good_steps = 0;
+  misses = 0;
+  desyncs++;
+}
+
+void bemf_sensorless_forced_step(uint8_t next) {
+  if (locked) return;
+  good_steps = zc_seen ? good_steps + 1 : 0;
+  bemf_enter_step(next, timebase_micros());
+}
+
+// A crossing: update the interval estimate and, once locked, schedule the
+// commutation half an interval (30 degrees) later
+static void bemf_on_zero_cross(uint32_t now) {
+  zc_seen = 1;
+  if (have_zc) {
+    uint32_t interval = now - zc_us;
+    if (step_us == 0) {
+      step_us = interval;
+    } else if (locked && (interval < step_us / 2 || interval > step_us * 2)) {
+      // implausible jump: keep the estimate, coast on it
+      if (++misses >= BEMF_MAX_MISSES) {
+        bemf_lose_lock();
+        return;
+      }
+      interval = step_us;
+    } else {
+      misses = 0;
+    }
+    step_us = (step_us * 3 + interval) / 4;
+  }
+  zc_us = now;
+  have_zc = 1;
+
+  if (!locked && good_steps >= BEMF_LOCK_STEPS && step_us && step_us < BEMF_MAX_STEP_US) {
+    locked = 1;
+    misses = 0;
+  }
+  if (locked) timebase_set_alarm(now + step_us / 2, bemf_commutate);
+}
+
+int bemf_sensorless_update(void) {
+  uint32_t now = timebase_micros();
+  uint32_t elapsed = now - comm_us;
+
+  if (locked && !zc_seen && step_us) {
+    // no crossing within two intervals: commutate blind and count a miss
+    if (elapsed > step_us * 2) {
+      if (++misses >= BEMF_MAX_MISSES) {
+        bemf_lose_lock();
+        return 0;
+      }
+      bemf_commutate();
+      return 1;
+    }
+  }
+  if (zc_seen) return locked;
+
+  uint32_t blank = step_us / 4;
+  if (blank < BEMF_MIN_BLANK_US) blank = BEMF_MIN_BLANK_US;
+  if (elapsed < blank) return locked;
+
+  int32_t threshold = q16_apply((int32_t)safety_get_last_raw_vbus(), half_vbus_q16);
+  int32_t v = (int32_t)bemf_dma_buf[float_phase[step]];
+  int past = STEP_RISING(step) ? (v > threshold) : (v < threshold);
+
+  if (!past) {
+    zc_armed = 1;
+    zc_count = 0;
+  } else if (zc_armed && ++zc_count >= BEMF_ZC_FILTER) {
+    bemf_on_zero_cross(now);
+  }
+  return locked;
+}
+
+int bemf_sensorless_is_locked(void) {
+  return locked;
+}
+
+uint32_t bemf_sensorless_desyncs(void) {
+  return desyncs;
+}
+
+uint32_t bemf_sensorless_step_us(void) {
+  return step_us;
+}
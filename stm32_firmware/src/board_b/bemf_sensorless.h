@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sensorless six-step commutation from back-EMF zero crossings.
+//
+// ADC2 samples the three phase voltages (PC3/PC4/PC5) on the same TIM1
+// mid-on-time trigger as the shunt scan. During each six-step sector the
+// undriven phase floats, and its voltage crosses Vbus/2 half way through the
+// sector. The crossing is timestamped (timebase.h) and the next commutation
+// is scheduled 30 electrical degrees later on the TIM5 alarm.
+//
+// Steps are indices 0..5 into esc_control's commutation order
+// (hall patterns 0x1, 0x3, 0x2, 0x6, 0x4, 0x5).
+
+// Commutate to the given step. Called from the TIM5 alarm interrupt or the
+// control step, both at priority 1.
+typedef void (*bemf_commutate_cb_t)(uint8_t step);
+
+// Configure ADC2 + DMA for the phase voltages and register the commutation hook
+void bemf_sensorless_init(bemf_commutate_cb_t cb);
+
+// Drop lock, cancel the pending commutation alarm and forget all timing
+// (arm, disarm, fault, halls back)
+void bemf_sensorless_reset(void);
+
+// The open-loop stepper just moved to this step. While unlocked the engine
+// watches for crossings after each forced step and locks once they are
+// consistent.
+void bemf_sensorless_forced_step(uint8_t step);
+
+// Per control step: sample the floating phase and run the zero-crossing,
+// timeout and desync logic. Returns 1 while locked (the engine commutates),
+// 0 when the caller must keep stepping open-loop.
+int bemf_sensorless_update(void);
+
+int bemf_sensorless_is_locked(void);
+
+// Lost lock after too many missed or implausible crossings (since boot)
+uint32_t bemf_sensorless_desyncs(void);
+
+// Latest 60-degree interval estimate in us (0 when not tracking)
+uint32_t bemf_sensorless_step_us(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,217 @@
+#include "blackbox.h"
+#include "esc_control.h"
+#include "safety_monitor.h"
+#include "driver_tim1.h"
+#include "timebase.h"
+#include "uart_commands.h"
+#include "uart_tx.h"
+#include "cobs.h"
+#include "stm32f4xx_hal.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert((BLACKBOX_SAMPLES & (BLACKBOX_SAMPLES - 1)) == 0, "BLACKBOX_SAMPLES must be a power of two");
+_Static_assert(BLACKBOX_SAMPLES * sizeof(blackbox_sample_t) <= 64u * 1024u, "blackbox ring exceeds CCM RAM");
+
+// The ring lives in CCM by address; nothing else is placed there
+static blackbox_sample_t* const ring = (blackbox_sample_t*)CCMDATARAM_BASE;
+
+typedef enum { BB_RECORDING = 0, BB_TRIGGERED, BB_FROZEN } bb_state_t;
+
+static volatile bb_state_t bb_state = BB_RECORDING;
+static volatile uint32_t head = 0;          // samples written since arm
+static volatile uint32_t post_left = 0;     // samples still to take after the trigger
+static uint32_t trigger_at = 0;             // value of head at the trigger
+static uint32_t trigger_us = 0;
+static volatile uint8_t trigger_cause = 0;
+
+static volatile uint8_t trigger_mask = BLACKBOX_TRIG_FAULT;
+static volatile uint32_t overcurrent_mA = 0;
+static uint32_t post_samples = BLACKBOX_POST_DEFAULT;
+
+// Dump in progress: next record to send (-1 = header, chunk count = end)
+static int dumping = 0;
+static int32_t dump_next = 0;
+
+void blackbox_arm(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  head = 0;
+  trigger_cause = 0;
+  dumping = 0;
+  bb_state = BB_RECORDING;
+  __set_PRIMASK(primask);
+}
+
+void blackbox_set_triggers(uint8_t mask, uint32_t oc_mA) {
+  trigger_mask = mask;
+  overcurrent_mA = oc_mA;
+}
+
+void blackbox_trigger(uint8_t cause) {
+  if (!(cause & (trigger_mask | BLACKBOX_TRIG_MANUAL))) return;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (bb_state == BB_RECORDING) {
+    trigger_cause = cause;
+    trigger_at = head;
+    trigger_us = timebase_micros();
+    post_left = post_samples;
+    bb_state = (post_left > 0) ? BB_TRIGGERED : BB_FROZEN;
+  }
+  __set_PRIMASK(primask);
+}
+
+void blackbox_control_tick(void) {
+  bb_state_t st = bb_state;
+  if (st == BB_FROZEN) return;
+
+  int32_t current_mA = safety_get_motor_current_sample_mA();
+  int32_t c10 = current_mA / 10;
+  if (c10 > INT16_MAX) c10 = INT16_MAX;
+  if (c10 < INT16_MIN) c10 = INT16_MIN;
+  uint32_t vbus_mv = safety_get_vbus_mV();
+
+  uint16_t ccr[3];
+  driver_get_compare(ccr);
+
+  blackbox_sample_t* s = &ring[head & (BLACKBOX_SAMPLES - 1)];
+  s->ccr[0] = ccr[0];
+  s->ccr[1] = ccr[1];
+  s->ccr[2] = ccr[2];
+  s->sector = driver_get_sector();
+  s->state = (uint8_t)esc_control_get_state();
+  s->current_10ma = (int16_t)c10;
+  s->vbus_mv = (uint16_t)(vbus_mv > 0xFFFF ? 0xFFFF : vbus_mv);
+  head++;
+
+  if (st == BB_TRIGGERED) {
+    if (--post_left == 0) bb_state = BB_FROZEN;
+    return;
+  }
+  uint32_t oc = overcurrent_mA;
+  if ((trigger_mask & BLACKBOX_TRIG_OVERCURRENT) && oc &&
+      (uint32_t)abs(current_mA) > oc) {
+    blackbox_trigger(BLACKBOX_TRIG_OVERCURRENT);
+  }
+}
+
+int blackbox_is_frozen(void) {
+  return bb_state == BB_FROZEN;
+}
+
+// Samples in the capture and the absolute index of the oldest one
+static uint32_t capture_len(uint32_t* first) {
+  uint32_t n = head < BLACKBOX_SAMPLES ? head : BLACKBOX_SAMPLES;
+  *first = head - n;
+  return n;
+}
+
+void blackbox_poll(void) {
+  if (!dumping) return;
+
+  uint32_t first;
+  uint32_t n = capture_len(&first);
+  int32_t chunks = (int32_t)((n + BLACKBOX_DUMP_CHUNK - 1) / BLACKBOX_DUMP_CHUNK);
+  uint8_t frame[COBS_FRAME_MAX(sizeof(blackbox_data_t))];
+
+  // as many records as the transmit ring has room for; the rest next pass
+  while (uart_tx_free() >= sizeof(frame)) {
+    size_t len;
+    if (dump_next < 0) {
+      blackbox_header_t h;
+      h.type = BLACKBOX_RECORD_HEADER;
+      h.cause = trigger_cause;
+      h.samples = (uint16_t)n;
+      h.trigger_index = (uint16_t)(trigger_at - first);
+      h.sample_size = sizeof(blackbox_sample_t);
+      h.sample_hz = driver_get_control_hz();
+      h.trigger_us = trigger_us;
+      len = cobs_frame(&h, sizeof(h), frame);
+    } else if (dump_next < chunks) {
+      // copy out of CCM (not DMA-accessible) into the frame buffer
+      blackbox_data_t d;
+      uint32_t at = (uint32_t)dump_next * BLACKBOX_DUMP_CHUNK;
+      uint32_t count = n - at < BLACKBOX_DUMP_CHUNK ? n - at : BLACKBOX_DUMP_CHUNK;
+      d.type = BLACKBOX_RECORD_DATA;
+      d.first = (uint16_t)at;
+      for (uint32_t i = 0; i < count; ++i) {
+        d.samples[i] = ring[(first + at + i) & (BLACKBOX_SAMPLES - 1)];
+      }
+      len = cobs_frame(&d, offsetof(blackbox_data_t, samples) + count * sizeof(blackbox_sample_t), frame);
+    } else {
+      const uint8_t end = BLACKBOX_RECORD_END;
+      len = cobs_frame(&end, 1, frame);
+      dumping = 0;
+    }
+    uart_tx_write(frame, len);
+    dump_next++;
+    if (!dumping) return;
+  }
+}
+
+static const char* state_name(bb_state_t st) {
+  switch (st) {
+    case BB_RECORDING: return "RECORDING";
+    case BB_TRIGGERED: return "TRIGGERED";
+    default: return "FROZEN";
+  }
+}
+
+// BLACKBOX [ARM | TRIG | DUMP | FAULT ON|OFF | OC <mA> | POST <samples>]
+static void blackbox_cmd(const uart_cmd_args_t* a) {
+  const char* p = a->text;
+  if (strcasecmp(p, "ARM") == 0) {
+    blackbox_arm();
+  } else if (strcasecmp(p, "TRIG") == 0) {
+    blackbox_trigger(BLACKBOX_TRIG_MANUAL);
+  } else if (strcasecmp(p, "DUMP") == 0) {
+    if (!blackbox_is_frozen()) {
+      uart_tx_puts("BLACKBOX: no capture\r\n");
+      return;
+    }
+    dump_next = -1;
+    dumping = 1;
+    return;
+  } else if (strncasecmp(p, "FAULT", 5) == 0) {
+    p += 5;
+    while (*p == ' ') ++p;
+    uint8_t mask = trigger_mask;
+    if (strcasecmp(p, "ON") == 0) mask |= BLACKBOX_TRIG_FAULT;
+    else if (strcasecmp(p, "OFF") == 0) mask &= (uint8_t)~BLACKBOX_TRIG_FAULT;
+    blackbox_set_triggers(mask, overcurrent_mA);
+  } else if (strncasecmp(p, "OC", 2) == 0) {
+    int mA = atoi(p + 2);
+    if (mA < 0) mA = 0;
+    uint8_t mask = mA ? (trigger_mask | BLACKBOX_TRIG_OVERCURRENT)
+                      : (trigger_mask & (uint8_t)~BLACKBOX_TRIG_OVERCURRENT);
+    blackbox_set_triggers(mask, (uint32_t)mA);
+  } else if (strncasecmp(p, "POST", 4) == 0) {
+    int post = atoi(p + 4);
+    if (post < 0) post = 0;
+    if (post > (int)BLACKBOX_SAMPLES - 1) post = (int)BLACKBOX_SAMPLES - 1;
+    post_samples = (uint32_t)post;  // used from the next trigger on
+  } else if (*p) {
+    uart_tx_puts("Usage: BLACKBOX [ARM|TRIG|DUMP|FAULT ON|OFF|OC <mA>|POST <n>]\r\n");
+    return;
+  }
+
+  uint32_t first;
+  uint32_t n = capture_len(&first);
+  uart_tx_printf("BLACKBOX: %s cause=0x%02X samples=%lu post=%lu fault=%s oc=%lumA\r\n",
+                 state_name(bb_state), trigger_cause, (unsigned long)n,
+                 (unsigned long)post_samples, (trigger_mask & BLACKBOX_TRIG_FAULT) ? "ON" : "OFF",
+                 (unsigned long)((trigger_mask & BLACKBOX_TRIG_OVERCURRENT) ? overcurrent_mA : 0));
+}
+
+static const uart_cmd_t blackbox_commands[] = {
+  {"BLACKBOX", UART_ARG_TEXT, blackbox_cmd, "[ARM|TRIG|DUMP|FAULT|OC|POST] Fault recorder"},
+};
+
+void blackbox_init(void) {
+  __HAL_RCC_CCMDATARAMEN_CLK_ENABLE();
+  memset(ring, 0, BLACKBOX_SAMPLES * sizeof(blackbox_sample_t));
+  blackbox_arm();
+  uart_commands_register(blackbox_commands, sizeof(blackbox_commands) / sizeof(blackbox_commands[0]));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Blackbox recorder: one sample per control step into a ring in the F405's
+// 64 KB CCM RAM (0x10000000, core-coupled, unused by the linker script).
+// A trigger lets BLACKBOX_POST_DEFAULT more samples in and then freezes the
+// ring, so the capture holds the run-up to the event at full loop rate.
+// 4096 samples cover ~41 ms at 100 kHz.
+#define BLACKBOX_SAMPLES      4096u   // power of two
+#define BLACKBOX_POST_DEFAULT (BLACKBOX_SAMPLES / 8)
+
+// Trigger sources (BLACKBOX_TRIG_MANUAL is always enabled)
+#define BLACKBOX_TRIG_FAULT       0x01   // esc_control_set_fault
+#define BLACKBOX_TRIG_OVERCURRENT 0x02   // |current| above the set threshold
+#define BLACKBOX_TRIG_MANUAL      0x80   // BLACKBOX TRIG / blackbox_trigger
+
+typedef struct __attribute__((packed)) {
+  uint16_t ccr[3];        // U/V/W compare values
+  uint8_t sector;         // driver_get_sector()
+  uint8_t state;          // esc_state_t
+  int16_t current_10ma;   // shunt sample of the step, saturated
+  uint16_t vbus_mv;
+} blackbox_sample_t;
+
+// Dump format: COBS frames (cobs.h), little-endian, in this order:
+//   header, data records with BLACKBOX_DUMP_CHUNK samples each (oldest
+//   first, the last one may be short), end.
+#define BLACKBOX_RECORD_HEADER 0x10
+#define BLACKBOX_RECORD_DATA   0x11
+#define BLACKBOX_RECORD_END    0x12
+#define BLACKBOX_DUMP_CHUNK    16
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;             // BLACKBOX_RECORD_HEADER
+  uint8_t cause;            // BLACKBOX_TRIG_* that froze the capture
+  uint16_t samples;         // samples in the dump
+  uint16_t trigger_index;   // index of the trigger sample within the dump
+  uint16_t sample_size;     // sizeof(blackbox_sample_t)
+  uint32_t sample_hz;       // control step rate
+  uint32_t trigger_us;      // timebase_micros() at the trigger
+} blackbox_header_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;             // BLACKBOX_RECORD_DATA
+  uint16_t first;           // index of the first sample in this record
+  blackbox_sample_t samples[BLACKBOX_DUMP_CHUNK];
+} blackbox_data_t;
+
+// Clear the ring and start recording; registers the BLACKBOX command
+void blackbox_init(void);
+
+// Start a fresh capture (drops a frozen one)
+void blackbox_arm(void);
+
+// Trigger sources (BLACKBOX_TRIG_*) and the overcurrent threshold (mA)
+void blackbox_set_triggers(uint8_t mask, uint32_t overcurrent_mA);
+
+// Raise a trigger; ignored if the source is disabled or a capture is
+// already pending. Safe from interrupts.
+void blackbox_trigger(uint8_t cause);
+
+// Called every control step (TIM1 update interrupt)
+void blackbox_control_tick(void);
+
+// Capture is complete and waiting to be dumped
+int blackbox_is_frozen(void);
+
+// Background work (call from loop): streams a requested dump through the
+// UART transmit ring as space frees up (CCM is not reachable by DMA)
+void blackbox_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
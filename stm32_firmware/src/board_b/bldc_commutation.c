@@ -0,0 +1,150 @@
+#include "bldc_commutation.h"
+#include "driver_tim1.h"
+#include "stm32f4xx_hal.h"
+
+// TIM7 counts at 1 MHz; the step period is kept in Q16 ticks and its
+// fraction carried from step to step, so the average rate is exact
+#define BLDC_TICK_HZ 1000000u
+
+static TIM_HandleTypeDef htim7;
+static int initialized = 0;
+
+static const uint8_t bldc_sequence[6] = {0x1, 0x3, 0x2, 0x6, 0x4, 0x5};
+
+static volatile int running = 0;
+static volatile uint8_t step = 0;
+static volatile int16_t duty_ticks = 0;
+static volatile bldc_step_cb_t step_cb = NULL;
+
+// Step rates in Q16 Hz. Written by the foreground, ramped by the ISR.
+static volatile uint32_t freq_q16 = 0;
+static volatile uint32_t target_q16 = 0;
+static volatile uint32_t ramp_q16 = 0;      // Hz per second
+static uint32_t period_frac = 0;            // carried tick fraction (Q16)
+
+static uint32_t hz_to_q16(float hz) {
+  if (hz < BLDC_COMMUTATION_MIN_HZ) hz = BLDC_COMMUTATION_MIN_HZ;
+  if (hz > BLDC_COMMUTATION_MAX_HZ) hz = BLDC_COMMUTATION_MAX_HZ;
+  return (uint32_t)(hz * 65536.0f);
+}
+
+// Ticks until the next step at the current rate, with the fraction dithered
+static uint32_t bldc_next_period(void) {
+  uint64_t period_q16 = ((uint64_t)BLDC_TICK_HZ << 32) / freq_q16;
+  period_q16 += period_frac;
+  period_frac = (uint32_t)(period_q16 & 0xFFFFu);
+  return (uint32_t)(period_q16 >> 16);
+}
+
+// One step of ramp: the rate changes by ramp * dt with dt = 1 / freq
+static void bldc_ramp(void) {
+  uint32_t f = freq_q16, target = target_q16, ramp = ramp_q16;
+  if (f == target) return;
+  uint32_t delta = ramp ? (uint32_t)(((uint64_t)ramp << 16) / f) : 0xFFFFFFFFu;
+  if (delta == 0) delta = 1;
+  if (f < target) {
+    f = (target - f > delta) ? f + delta : target;
+  } else {
+    f = (f - target > delta) ? f - delta : target;
+  }
+  freq_q16 = f;
+}
+
+void bldc_commutation_init(void) {
+  if (initialized) return;
+  __HAL_RCC_TIM7_CLK_ENABLE();
+
+  // TIM7 sits on APB1; its clock is 2x PCLK1 when the APB1 prescaler is not 1
+  uint32_t clk = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) clk *= 2;
+
+  htim7.Instance = TIM7;
+  htim7.Init.Prescaler = clk / BLDC_TICK_HZ - 1;
+  htim7.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim7.Init.Period = 0xFFFF;
+  htim7.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  HAL_TIM_Base_Init(&htim7);
+
+  // Same priority as the TIM1 control step: the two never preempt each
+  // other while writing the commutation outputs
+  HAL_NVIC_SetPriority(TIM7_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(TIM7_IRQn);
+
+  initialized = 1;
+}
+
+void bldc_commutation_start(float freq_hz) {
+  bldc_commutation_init();
+  bldc_commutation_stop();
+
+  freq_q16 = hz_to_q16(freq_hz);
+  target_q16 = freq_q16;
+  period_frac = 0;
+  step = 5;  // the first update below advances to step 0
+
+  __HAL_TIM_SET_COUNTER(&htim7, 0);
+  __HAL_TIM_SET_AUTORELOAD(&htim7, bldc_next_period() - 1);
+  running = 1;
+  __HAL_TIM_CLEAR_IT(&htim7, TIM_IT_UPDATE);
+  __HAL_TIM_ENABLE_IT(&htim7, TIM_IT_UPDATE);
+  // UG loads ARR now instead of after the first (0xFFFF) period and raises
+  // the update interrupt: the first step goes out from TIM7_IRQHandler like
+  // all the others, never from the caller's context racing the TIM1 and
+  // hall interrupts on the commutation outputs
+  htim7.Instance->EGR = TIM_EGR_UG;
+  __HAL_TIM_ENABLE(&htim7);
+}
+
+void bldc_commutation_stop(void) {
+  if (!initialized) return;
+  __HAL_TIM_DISABLE(&htim7);
+  __HAL_TIM_DISABLE_IT(&htim7, TIM_IT_UPDATE);
+  __HAL_TIM_CLEAR_IT(&htim7, TIM_IT_UPDATE);
+  running = 0;
+}
+
+void bldc_commutation_set_frequency(float freq_hz) {
+  target_q16 = hz_to_q16(freq_hz);
+}
+
+void bldc_commutation_set_ramp(float hz_per_s) {
+  ramp_q16 = (hz_per_s > 0.0f) ? (uint32_t)(hz_per_s * 65536.0f) : 0;
+}
+
+void bldc_commutation_set_duty(int percent) {
+  if (percent < 0) percent = 0;
+  if (percent > 100) percent = 100;
+  duty_ticks = (int16_t)((percent * DRIVER_PWM_PERIOD) / 100);
+}
+
+void bldc_commutation_set_step_callback(bldc_step_cb_t cb) {
+  step_cb = cb;
+}
+
+int bldc_commutation_is_running(void) {
+  return running;
+}
+
+uint8_t bldc_commutation_get_step(void) {
+  return step;
+}
+
+float bldc_commutation_get_frequency(void) {
+  return running ? (float)freq_q16 / 65536.0f : 0.0f;
+}
+
+// TIM7 update: advance one step and program the period after the next
+// (ARR is preloaded, so the value written now takes effect one step later)
+void TIM7_IRQHandler(void) {
+  if (!__HAL_TIM_GET_FLAG(&htim7, TIM_FLAG_UPDATE)) return;
+  __HAL_TIM_CLEAR_IT(&htim7, TIM_IT_UPDATE);
+  if (!running) return;
+
+  step = (uint8_t)((step + 1) % 6);
+  bldc_step_cb_t cb = step_cb;
+  if (cb) cb(step);
+  else driver_set_phase_pwm(bldc_sequence[step], duty_ticks);
+
+  bldc_ramp();
+  __HAL_TIM_SET_AUTORELOAD(&htim7, bldc_next_period() - 1);
+}
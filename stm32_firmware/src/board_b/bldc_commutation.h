@@ -6,27 +6,46 @@
 extern "C" {
 #endif
 
+// Open-loop six-step commutation clocked by TIM7. Frequencies are
+// commutation steps per second (6 steps per electrical revolution).
+#define BLDC_COMMUTATION_MIN_HZ 16.0f
+#define BLDC_COMMUTATION_MAX_HZ 20000.0f
+
+// Step hook, called from the TIM7 interrupt with the new step index (0..5,
+// hall order 0x1, 0x3, 0x2, 0x6, 0x4, 0x5)
+typedef void (*bldc_step_cb_t)(uint8_t step);
+
 // Initialize BLDC commutation engine
 void bldc_commutation_init(void);
 
-// Start open-loop commutation at specified frequency (Hz)
+// Start open-loop commutation at specified frequency (Hz). Step 0 is
+// applied from the TIM7 interrupt straight after the call.
 void bldc_commutation_start(float freq_hz);
 
 // Stop commutation
 void bldc_commutation_stop(void);
 
-// Set commutation frequency (Hz) - controls speed
+// Set commutation frequency (Hz) - controls speed. The step rate moves
+// towards it at the ramp rate.
 void bldc_commutation_set_frequency(float freq_hz);
 
+// Frequency ramp in Hz per second, applied on every step (0 = jump at once)
+void bldc_commutation_set_ramp(float hz_per_s);
+
 // Set PWM duty cycle (0-100%) - controls torque
 void bldc_commutation_set_duty(int percent);
 
-// Call periodically from main loop to advance commutation state
-void bldc_commutation_update(void);
+// By default each step drives the bridge at the set duty. A step callback
+// takes over the output instead (NULL restores the default).
+void bldc_commutation_set_step_callback(bldc_step_cb_t cb);
 
 // Check if commutation is active
 int bldc_commutation_is_running(void);
 
+// Current step index and step rate (Hz) including the ramp
+uint8_t bldc_commutation_get_step(void);
+float bldc_commutation_get_frequency(void);
+
 #ifdef __cplusplus
 }
 #endif
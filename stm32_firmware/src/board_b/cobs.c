@@ -0,0 +1,30 @@
+#include "cobs.h"
+
+size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out) {
+  size_t code_at = 0, n = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < len; ++i) {
+    if (in[i] == 0) {
+      out[code_at] = code;
+      code_at = n++;
+      code = 1;
+    } else {
+      out[n++] = in[i];
+      if (++code == 0xFF) {
+        out[code_at] = code;
+        code_at = n++;
+        code = 1;
+      }
+    }
+  }
+  out[code_at] = code;
+  return n;
+}
+
+size_t cobs_frame(const void* payload, size_t len, uint8_t* out) {
+  size_t n = 0;
+  out[n++] = 0;
+  n += cobs_encode((const uint8_t*)payload, len, &out[n]);
+  out[n++] = 0;
+  return n;
+}
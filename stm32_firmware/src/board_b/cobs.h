@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Consistent Overhead Byte Stuffing for the binary streams on UART4. A
+// frame is 0x00, COBS(payload), 0x00: the leading zero separates it from
+// console text queued just before it.
+
+// Worst-case frame size for a payload of len bytes
+#define COBS_FRAME_MAX(len) ((len) + (len) / 254 + 3)
+
+// Encode len bytes into out (at least len + len / 254 + 1 bytes). Returns
+// the encoded length; the output contains no zero bytes.
+size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out);
+
+// Encode a payload as a delimited frame. Returns the frame length.
+size_t cobs_frame(const void* payload, size_t len, uint8_t* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,10 +18,36 @@
 // 20: brake_enabled (uint8_t)
 // 21-22: max_temp (uint16_t)
 // 23-26: overcurrent_limit (uint32_t, mA)
+// Version 2 (data[2] >= 2) extension:
+// 28-29: speed_kp (uint16_t, 0.01 mA/rpm)
+// 30-31: speed_ki (uint16_t, 0.01 mA/(rpm*s))
+// 32-33: accel_rpm_s (uint16_t, rpm/s)
+// Version 3 extension:
+// 34-35: current_bw_hz (uint16_t, Hz)
+// 36-37: motor_r_mohm (uint16_t, phase resistance)
+// 38-39: motor_l_uh (uint16_t, phase inductance)
+// Version 4 extension:
+// 40-41: voltage_cutoff_mv (uint16_t, mV)
+// Last byte: XOR of bytes 2 .. len-2 (written by build_esc_config_frame)
 
 static uint16_t be16(const uint8_t* p) { return (uint16_t)(p[0] << 8 | p[1]); }
 static uint32_t be32(const uint8_t* p) { return (uint32_t)(p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]); }
 
+static void put_be16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+static void put_be32(uint8_t* p, uint32_t v) { put_be16(p, (uint16_t)(v >> 16)); put_be16(&p[2], (uint16_t)v); }
+
+// Optional field: zero (or absent) selects the default
+static uint16_t be16_or(const uint8_t* p, uint16_t def) {
+  uint16_t v = be16(p);
+  return v ? v : def;
+}
+
+size_t esc_config_frame_len(uint8_t version) {
+  if (version >= 4) return ESC_CONFIG_FRAME_LEN_V4;
+  if (version >= 3) return ESC_CONFIG_FRAME_LEN_V3;
+  return (version >= 2) ? ESC_CONFIG_FRAME_LEN_V2 : ESC_CONFIG_FRAME_LEN_V1;
+}
+
 int parse_esc_config(const uint8_t* data, size_t len, esc_config_t* out_cfg) {
   if (!data || !out_cfg) return 0;
   if (len < 27) return 0; // not enough data for expected layout
@@ -40,9 +66,62 @@ int parse_esc_config(const uint8_t* data, size_t len, esc_config_t* out_cfg) {
   out_cfg->max_temp = be16(&data[21]);
   out_cfg->overcurrent_limit = be32(&data[23]);
 
+  if (data[2] >= 2 && len >= ESC_CONFIG_FRAME_LEN_V2) {
+    out_cfg->speed_kp = be16_or(&data[28], ESC_DEFAULT_SPEED_KP);
+    out_cfg->speed_ki = be16_or(&data[30], ESC_DEFAULT_SPEED_KI);
+    out_cfg->accel_rpm_s = be16_or(&data[32], ESC_DEFAULT_ACCEL_RPM_S);
+  } else {
+    out_cfg->speed_kp = ESC_DEFAULT_SPEED_KP;
+    out_cfg->speed_ki = ESC_DEFAULT_SPEED_KI;
+    out_cfg->accel_rpm_s = ESC_DEFAULT_ACCEL_RPM_S;
+  }
+  if (data[2] >= 3 && len >= ESC_CONFIG_FRAME_LEN_V3) {
+    out_cfg->current_bw_hz = be16_or(&data[34], ESC_DEFAULT_CURRENT_BW_HZ);
+    out_cfg->motor_r_mohm = be16_or(&data[36], ESC_DEFAULT_MOTOR_R_MOHM);
+    out_cfg->motor_l_uh = be16_or(&data[38], ESC_DEFAULT_MOTOR_L_UH);
+  } else {
+    out_cfg->current_bw_hz = ESC_DEFAULT_CURRENT_BW_HZ;
+    out_cfg->motor_r_mohm = ESC_DEFAULT_MOTOR_R_MOHM;
+    out_cfg->motor_l_uh = ESC_DEFAULT_MOTOR_L_UH;
+  }
+  out_cfg->voltage_cutoff_mv = (data[2] >= 4 && len >= ESC_CONFIG_FRAME_LEN_V4) ? be16(&data[40]) : 0;
+
   // basic validation
   if (out_cfg->battery_cells == 0) return 0;
   if (out_cfg->pwm_frequency_khz == 0) out_cfg->pwm_frequency_khz = 20; // fallback
 
   return 1;
 }
+
+size_t build_esc_config_frame(const esc_config_t* cfg, uint8_t* out, size_t maxlen) {
+  if (!cfg || !out || maxlen < ESC_CONFIG_FRAME_LEN_V4) return 0;
+  memset(out, 0, ESC_CONFIG_FRAME_LEN_V4);
+
+  out[0] = 0xAA;
+  out[1] = 0x55;
+  out[2] = ESC_CONFIG_FRAME_VERSION;
+  put_be16(&out[3], (uint16_t)cfg->battery_voltage_mv);
+  put_be16(&out[5], (uint16_t)cfg->battery_nominal_mv);
+  out[7] = (uint8_t)cfg->battery_cells;
+  put_be16(&out[8], (uint16_t)cfg->sensor_max_rpm);
+  put_be16(&out[10], cfg->motor_kv);
+  out[12] = cfg->motor_poles;
+  out[13] = cfg->control_mode;
+  put_be32(&out[14], cfg->current_limit);
+  put_be16(&out[18], cfg->pwm_frequency_khz);
+  out[20] = cfg->brake_enabled;
+  put_be16(&out[21], cfg->max_temp);
+  put_be32(&out[23], cfg->overcurrent_limit);
+  put_be16(&out[28], cfg->speed_kp);
+  put_be16(&out[30], cfg->speed_ki);
+  put_be16(&out[32], cfg->accel_rpm_s);
+  put_be16(&out[34], cfg->current_bw_hz);
+  put_be16(&out[36], cfg->motor_r_mohm);
+  put_be16(&out[38], cfg->motor_l_uh);
+  put_be16(&out[40], cfg->voltage_cutoff_mv);
+
+  uint8_t chk = 0;
+  for (size_t i = 2; i < ESC_CONFIG_FRAME_LEN_V4 - 1; ++i) chk ^= out[i];
+  out[ESC_CONFIG_FRAME_LEN_V4 - 1] = chk;
+  return ESC_CONFIG_FRAME_LEN_V4;
+}
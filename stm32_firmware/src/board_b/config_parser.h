@@ -12,6 +12,25 @@ extern "C" {
 #define CONTROL_MODE_TORQUE       1
 #define CONTROL_MODE_SPEED        2
 
+// Frame length by version byte (data[2]). Version 2 appends the speed loop
+// settings, version 3 the current loop settings, version 4 the undervoltage
+// cutoff; missing or zero fields get the defaults below.
+#define ESC_CONFIG_FRAME_LEN_V1   29
+#define ESC_CONFIG_FRAME_LEN_V2   35
+#define ESC_CONFIG_FRAME_LEN_V3   41
+#define ESC_CONFIG_FRAME_LEN_V4   43
+#define ESC_CONFIG_FRAME_VERSION  4
+
+// Speed loop defaults for frames without them
+#define ESC_DEFAULT_SPEED_KP      1000  // 10.00 mA per rpm
+#define ESC_DEFAULT_SPEED_KI      5000  // 50.00 mA per rpm*s
+#define ESC_DEFAULT_ACCEL_RPM_S   5000
+
+// Current loop defaults
+#define ESC_DEFAULT_CURRENT_BW_HZ 1000
+#define ESC_DEFAULT_MOTOR_R_MOHM  100
+#define ESC_DEFAULT_MOTOR_L_UH    50
+
 typedef struct {
   uint16_t battery_cells;
   uint32_t battery_voltage_mv;
@@ -26,12 +45,26 @@ typedef struct {
   uint8_t brake_enabled;
   uint16_t max_temp;
   uint32_t overcurrent_limit;
+  uint16_t speed_kp;        // speed loop P gain, 0.01 mA (iq) per rpm of error
+  uint16_t speed_ki;        // speed loop I gain, 0.01 mA (iq) per rpm*s of error
+  uint16_t accel_rpm_s;     // speed setpoint slew limit
+  uint16_t current_bw_hz;   // current loop bandwidth
+  uint16_t motor_r_mohm;    // phase resistance
+  uint16_t motor_l_uh;      // phase inductance
+  uint16_t voltage_cutoff_mv; // derate below this bus voltage, 0 = 70% of battery
 } esc_config_t;
 
+// Total frame length (header to checksum) announced by a version byte
+size_t esc_config_frame_len(uint8_t version);
+
 // Parse a binary stored frame into esc_config_t.
 // Returns 1 on success, 0 on failure. Expects big-endian fields.
 int parse_esc_config(const uint8_t* data, size_t len, esc_config_t* out_cfg);
 
+// Build a current-version stored frame from a config (the inverse of
+// parse_esc_config). Returns the frame length, 0 if out is too small.
+size_t build_esc_config_frame(const esc_config_t* cfg, uint8_t* out, size_t maxlen);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,54 @@
+#include "current_ctrl.h"
+#include "driver_tim1.h"
+#include "foc_math.h"
+
+#define TWO_PI 6.2831853f
+#define SQRT3 1.7320508f
+
+static int32_t phase_kp_q16 = 0;
+static int32_t phase_ki_q16 = 0;
+static foc_pi_t pi_six_step;
+
+// Q16 gain in Q15 modulation per mA for a loop whose full-scale output is
+// full_scale_mv, given its gain in V/A
+static int32_t gain_q16(float volts_per_amp, float full_scale_mv) {
+  if (full_scale_mv <= 0.0f) return 0;
+  float q15_per_ma = volts_per_amp / full_scale_mv * 32767.0f;
+  return Q16_FROM_FLOAT(q15_per_ma);
+}
+
+void current_ctrl_init(const esc_config_t* cfg, uint32_t rate_hz) {
+  if (rate_hz == 0) rate_hz = 1;
+  float wc = TWO_PI * (float)cfg->current_bw_hz;
+  float r_ohm = (float)cfg->motor_r_mohm / 1000.0f;
+  float l_h = (float)cfg->motor_l_uh / 1000000.0f;
+  float vbus_mv = (float)(cfg->battery_nominal_mv ? cfg->battery_nominal_mv : cfg->battery_voltage_mv);
+
+  // FOC: Q15_ONE is a phase amplitude of Vbus / sqrt(3); plant is one phase
+  phase_kp_q16 = gain_q16(l_h * wc, vbus_mv / SQRT3);
+  phase_ki_q16 = gain_q16(r_ohm * wc / (float)rate_hz, vbus_mv / SQRT3);
+
+  // six-step: full duty puts Vbus across two phases in series (2R, 2L)
+  foc_pi_init(&pi_six_step,
+              gain_q16(2.0f * l_h * wc, vbus_mv),
+              gain_q16(2.0f * r_ohm * wc / (float)rate_hz, vbus_mv),
+              0, Q15_ONE);
+}
+
+void current_ctrl_reset(void) {
+  foc_pi_reset(&pi_six_step);
+}
+
+void current_ctrl_phase_gains(int32_t* kp_q16, int32_t* ki_q16) {
+  *kp_q16 = phase_kp_q16;
+  *ki_q16 = phase_ki_q16;
+}
+
+int16_t current_ctrl_run_six_step(int32_t target_mA, int32_t measured_mA) {
+  if (target_mA <= 0) {
+    foc_pi_reset(&pi_six_step);
+    return 0;
+  }
+  int32_t mod = foc_pi_run(&pi_six_step, target_mA - measured_mA);
+  return (int16_t)((mod * DRIVER_PWM_PERIOD) >> Q15_SHIFT);
+}
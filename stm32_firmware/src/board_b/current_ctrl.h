@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include "config_parser.h"
+#include "fixed_point.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Current loop tuning from the configured bandwidth and motor R/L
+// (pole-zero cancellation: kp = L * wc, ki = R * wc). Gains are Q16 in
+// Q15 modulation per mA of error; ki is per loop iteration.
+
+void current_ctrl_init(const esc_config_t* cfg, uint32_t rate_hz);
+void current_ctrl_reset(void);
+
+// Gains for a per-phase (FOC d/q) voltage loop
+void current_ctrl_phase_gains(int32_t* kp_q16, int32_t* ki_q16);
+
+// Six-step: regulate the shunt current of the conducting phase pair.
+// Returns the duty (0..DRIVER_PWM_PERIOD).
+int16_t current_ctrl_run_six_step(int32_t target_mA, int32_t measured_mA);
+
+#ifdef __cplusplus
+}
+#endif
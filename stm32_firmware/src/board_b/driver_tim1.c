@@ -1,16 +1,120 @@
 #include "driver_tim1.h"
 #include "stm32f4xx_hal.h"
+#include "uart_tx.h"
+#include "prof.h"
 
-extern UART_HandleTypeDef huart4;
+// CCER enable bits (main + complementary output) of each half-bridge. With
+// OSSR set, a disabled pair drives both gates to their inactive level, so the
+// phase is high-impedance rather than clamped low.
+#define CCER_PHASE_U (TIM_CCER_CC1E | TIM_CCER_CC1NE)
+#define CCER_PHASE_V (TIM_CCER_CC2E | TIM_CCER_CC2NE)
+#define CCER_PHASE_W (TIM_CCER_CC3E | TIM_CCER_CC3NE)
+#define CCER_PHASES_ALL (CCER_PHASE_U | CCER_PHASE_V | CCER_PHASE_W)
+
+// Role of a half-bridge within a commutation sector
+enum { PH_FLOAT = 0, PH_LOW, PH_PWM };
+
+// Six-step sectors by hall state. 0x0/0x7 are invalid: all low sides on.
+static const uint8_t sector_roles[8][3] = {
+  [0x0] = {PH_LOW,   PH_LOW,   PH_LOW},
+  [0x1] = {PH_PWM,   PH_FLOAT, PH_LOW},    // U+ W-
+  [0x2] = {PH_LOW,   PH_PWM,   PH_FLOAT},  // V+ U-
+  [0x3] = {PH_FLOAT, PH_PWM,   PH_LOW},    // V+ W-
+  [0x4] = {PH_FLOAT, PH_LOW,   PH_PWM},    // W+ V-
+  [0x5] = {PH_PWM,   PH_LOW,   PH_FLOAT},  // U+ V-
+  [0x6] = {PH_LOW,   PH_FLOAT, PH_PWM},    // W+ U-
+  [0x7] = {PH_LOW,   PH_LOW,   PH_LOW},
+};
+
+// Register image of one sector. All three CCRs carry the same duty; the
+// output mode (PWM1 / forced inactive = low side on) and the CCER enables
+// select the role. With CCPC set these bits are preloaded and only take
+// effect on the COM event, so a sector switches in one cycle.
+typedef struct {
+  uint32_t ccmr1;
+  uint32_t ccmr2;
+  uint32_t ccer;
+} driver_sector_t;
+
+// Entries 0..7 by hall state, then sinusoidal drive (all three switching)
+#define SECTOR_SVPWM 8
+#define SECTOR_NONE 0xFF
+static driver_sector_t sector_table[9];
+static volatile uint8_t active_sector = SECTOR_NONE;
 
 static TIM_HandleTypeDef htim1;
 static int driver_enabled = 0;
+static volatile driver_control_cb_t control_cb = NULL;
+static volatile driver_trip_cb_t trip_cb = NULL;
+
+// TIM1_BKIN: open-drain fault line, pulled low by the overcurrent comparator
+// on the shunt amplifier output (and the gate driver fault output)
+#define BKIN_GPIO_PORT GPIOB
+#define BKIN_PIN GPIO_PIN_12
+
+// TIM1_ETR: the current limit comparator (shunt amplifier against DAC1, see
+// safety_set_pulse_limit), high while the bus current is above the limit
+#define ETR_GPIO_PORT GPIOA
+#define ETR_PIN GPIO_PIN_12
+
+// ETR filter: fDTS/8, N = 8, i.e. 64 ticks (~0.4us) of a steady level before
+// OCREF clears. Blanks the reverse-recovery spike at each turn-on.
+#define ETR_FILTER 0x9
 
 // Wrapper for compatibility with old code
 void driver_init(void) {
   driver_init_tim1();
 }
 
+// Output mode bits of a role for channel 1/3 (CCMRx low half)
+static uint32_t driver_role_mode(uint8_t role) {
+  return (role == PH_PWM) ? TIM_OCMODE_PWM1 : TIM_OCMODE_FORCED_INACTIVE;
+}
+
+// Precompute the register image of every sector from the configured CCMRs
+static void driver_build_sector_table(void) {
+  uint32_t ccmr1 = htim1.Instance->CCMR1 & ~(TIM_CCMR1_OC1M | TIM_CCMR1_OC2M);
+  uint32_t ccmr2 = htim1.Instance->CCMR2 & ~TIM_CCMR2_OC3M;
+  static const uint32_t ccer_phase[3] = {CCER_PHASE_U, CCER_PHASE_V, CCER_PHASE_W};
+
+  for (uint32_t s = 0; s <= SECTOR_SVPWM; s++) {
+    uint8_t roles[3] = {PH_PWM, PH_PWM, PH_PWM};
+    if (s < SECTOR_SVPWM) {
+      roles[0] = sector_roles[s][0];
+      roles[1] = sector_roles[s][1];
+      roles[2] = sector_roles[s][2];
+    }
+    driver_sector_t* e = &sector_table[s];
+    e->ccmr1 = ccmr1 | driver_role_mode(roles[0]) | (driver_role_mode(roles[1]) << 8);
+    e->ccmr2 = ccmr2 | driver_role_mode(roles[2]);
+    e->ccer = 0;
+    for (int ph = 0; ph < 3; ph++) {
+      if (roles[ph] != PH_FLOAT) e->ccer |= ccer_phase[ph];
+    }
+  }
+}
+
+// BDTR.DTG for a dead time in timer ticks (RM0090 17.4.18: steps of 1, 2, 8
+// and 16 ticks), rounded up so the dead time is never shorter than asked
+static uint32_t driver_deadtime_dtg(uint32_t ticks) {
+  if (ticks <= 127) return ticks;
+  if (ticks <= 254) return 0x80 | ((ticks + 1) / 2 - 64);
+  if (ticks <= 504) return 0xC0 | ((ticks + 7) / 8 - 32);
+  if (ticks > 1008) ticks = 1008;
+  return 0xE0 | ((ticks + 15) / 16 - 32);
+}
+
+// Preload a sector and switch to it with a software COM event
+static void driver_commutate(uint8_t sector) {
+  if (sector == active_sector) return;
+  const driver_sector_t* e = &sector_table[sector];
+  TIM1->CCMR1 = e->ccmr1;
+  TIM1->CCMR2 = e->ccmr2;
+  TIM1->CCER = (TIM1->CCER & ~CCER_PHASES_ALL) | e->ccer;
+  TIM1->EGR = TIM_EGR_COMG;
+  active_sector = sector;
+}
+
 void driver_init_tim1(void) {
   __HAL_RCC_TIM1_CLK_ENABLE();
   __HAL_RCC_GPIOA_CLK_ENABLE();
@@ -29,26 +133,40 @@ void driver_init_tim1(void) {
   gpio.Pin = GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15;
   HAL_GPIO_Init(GPIOB, &gpio);
   
+  // PB12 as the break input (TIM1_BKIN), idle high
+  gpio.Pin = BKIN_PIN;
+  gpio.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(BKIN_GPIO_PORT, &gpio);
+  
+  // PA12 as the OCREF clear input (TIM1_ETR), idle low
+  gpio.Pin = ETR_PIN;
+  gpio.Pull = GPIO_PULLDOWN;
+  HAL_GPIO_Init(ETR_GPIO_PORT, &gpio);
+  
   // Timer configuration
   htim1.Instance = TIM1;
-  htim1.Init.Prescaler = 0;  // No prescaler, 84 MHz from APB2
+  htim1.Init.Prescaler = 0;  // No prescaler, 168 MHz (APB2 timer clock)
   htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim1.Init.Period = 1680 - 1;  // 50 kHz PWM (84MHz / 1680 = 50kHz, smoother for gate drivers)
+  htim1.Init.Period = DRIVER_PWM_PERIOD - 1;  // 100 kHz PWM (168 MHz / 1680)
   htim1.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
-  htim1.Init.RepetitionCounter = 0;
+  // Update event (and CCR preload transfer) once per control step
+  htim1.Init.RepetitionCounter = DRIVER_CONTROL_DIVIDER - 1;
   htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
   
   HAL_TIM_PWM_Init(&htim1);
   
-  // Configure dead-time: 3 microseconds (~252 ticks at 84MHz) to prevent shoot-through
+  // Configure dead-time: 3 microseconds to prevent shoot-through.
+  // Break: a low level on BKIN clears MOE in hardware, within a few timer
+  // clocks and without the CPU. With AOE off the outputs stay off until
+  // driver_enable sets MOE again.
   TIM_BreakDeadTimeConfigTypeDef sBreakDeadTimeConfig = {0};
   sBreakDeadTimeConfig.OffStateRunMode = TIM_OSSR_ENABLE;
   sBreakDeadTimeConfig.OffStateIDLEMode = TIM_OSSI_ENABLE;
   sBreakDeadTimeConfig.LockLevel = TIM_LOCKLEVEL_OFF;
-  sBreakDeadTimeConfig.DeadTime = 252;  // 3 microseconds dead-time (safer for gate drivers)
-  sBreakDeadTimeConfig.BreakState = TIM_BREAK_DISABLE;
-  sBreakDeadTimeConfig.BreakPolarity = TIM_BREAKPOLARITY_HIGH;
-  sBreakDeadTimeConfig.AutomaticOutput = TIM_AUTOMATICOUTPUT_ENABLE;
+  sBreakDeadTimeConfig.DeadTime = driver_deadtime_dtg(DRIVER_DEADTIME_TICKS);
+  sBreakDeadTimeConfig.BreakState = TIM_BREAK_ENABLE;
+  sBreakDeadTimeConfig.BreakPolarity = TIM_BREAKPOLARITY_LOW;
+  sBreakDeadTimeConfig.AutomaticOutput = TIM_AUTOMATICOUTPUT_DISABLE;
   
   HAL_TIMEx_ConfigBreakDeadTime(&htim1, &sBreakDeadTimeConfig);
   
@@ -66,14 +184,115 @@ void driver_init_tim1(void) {
   HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_2);
   HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_3);
   
+  // Cycle-by-cycle current limit: while ETRF is high, OCxREF of the bridge
+  // channels is held low until the next update event, so the on-time of the
+  // period ends as soon as the current reaches the limit and the low side
+  // freewheels. OCxCE is kept in every sector image (built from CCMR below).
+  TIM_ClearInputConfigTypeDef sClearInputConfig = {0};
+  sClearInputConfig.ClearInputState = ENABLE;
+  sClearInputConfig.ClearInputSource = TIM_CLEARINPUTSOURCE_ETR;
+  sClearInputConfig.ClearInputPolarity = TIM_CLEARINPUTPOLARITY_NONINVERTED;
+  sClearInputConfig.ClearInputPrescaler = TIM_CLEARINPUTPRESCALER_DIV1;
+  sClearInputConfig.ClearInputFilter = ETR_FILTER;
+  HAL_TIM_ConfigOCrefClear(&htim1, &sClearInputConfig, TIM_CHANNEL_1);
+  HAL_TIM_ConfigOCrefClear(&htim1, &sClearInputConfig, TIM_CHANNEL_2);
+  HAL_TIM_ConfigOCrefClear(&htim1, &sClearInputConfig, TIM_CHANNEL_3);
+  
+  // CH4 has no pin: its OC4REF rising edge (PWM2, CNT == CCR4) is the ADC
+  // trigger, exported on TRGO and placed mid on-time by driver_set_phase_pwm.
+  // It has no OCREF clear, so the trigger fires in limited periods too.
+  sConfigOC.OCMode = TIM_OCMODE_PWM2;
+  sConfigOC.Pulse = DRIVER_PWM_PERIOD / 2;
+  HAL_TIM_PWM_ConfigChannel(&htim1, &sConfigOC, TIM_CHANNEL_4);
+  
+  driver_build_sector_table();
+  // Preload CCxE/CCxNE/OCxM; COM is generated by software (the halls are on
+  // EXTI lines, not a timer hall interface)
+  htim1.Instance->CR2 |= TIM_CR2_CCPC;
+  htim1.Instance->CR2 &= ~TIM_CR2_CCUS;
+  
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_OC4REF;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  HAL_TIMEx_MasterConfigSynchronization(&htim1, &sMasterConfig);
+  
   driver_enabled = 0;
   
-  HAL_UART_Transmit(&huart4, (uint8_t*)"TIM1 Complementary PWM initialized (50 kHz, dead-time=3us)\r\n", 61, 50);
+  // Free-running time base with update interrupt: this is the control loop tick.
+  // Init generated an update event, clear it so the first tick is a real one.
+  __HAL_TIM_CLEAR_IT(&htim1, TIM_IT_UPDATE);
+  __HAL_TIM_ENABLE_IT(&htim1, TIM_IT_UPDATE);
+  HAL_NVIC_SetPriority(TIM1_UP_TIM10_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(TIM1_UP_TIM10_IRQn);
+  
+  // Break interrupt: only reports the trip, the hardware has already acted.
+  // Armed by driver_enable.
+  __HAL_TIM_DISABLE_IT(&htim1, TIM_IT_BREAK);
+  HAL_NVIC_SetPriority(TIM1_BRK_TIM9_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(TIM1_BRK_TIM9_IRQn);
+  __HAL_TIM_ENABLE(&htim1);
+  
+  uart_tx_puts("TIM1 Complementary PWM initialized (100 kHz, dead-time=3us, break on PB12)\r\n");
+}
+
+uint8_t driver_get_sector(void) {
+  return active_sector;
+}
+
+void driver_get_compare(uint16_t ccr[3]) {
+  ccr[0] = (uint16_t)htim1.Instance->CCR1;
+  ccr[1] = (uint16_t)htim1.Instance->CCR2;
+  ccr[2] = (uint16_t)htim1.Instance->CCR3;
+}
+
+void driver_set_control_callback(driver_control_cb_t cb) {
+  control_cb = cb;
+}
+
+uint32_t driver_get_control_hz(void) {
+  uint32_t clk = HAL_RCC_GetPCLK2Freq();
+  // timer clock runs at 2x PCLK2 when the APB2 prescaler is not 1
+  if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1) clk *= 2;
+  return clk / DRIVER_PWM_PERIOD / DRIVER_CONTROL_DIVIDER;
+}
+
+void driver_set_trip_callback(driver_trip_cb_t cb) {
+  trip_cb = cb;
+}
+
+void driver_trip(driver_trip_t source) {
+  __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(&htim1);
+  driver_trip_cb_t cb = trip_cb;
+  if (cb) cb(source);
+}
+
+// TIM1 break interrupt (shared with TIM9, which is unused). One report per
+// enable: BIF stays set while BKIN is held low.
+void TIM1_BRK_TIM9_IRQHandler(void) {
+  if (__HAL_TIM_GET_FLAG(&htim1, TIM_FLAG_BREAK)) {
+    __HAL_TIM_DISABLE_IT(&htim1, TIM_IT_BREAK);
+    __HAL_TIM_CLEAR_IT(&htim1, TIM_IT_BREAK);
+    driver_trip(DRIVER_TRIP_BREAK_INPUT);
+  }
+}
+
+// TIM1 update interrupt (shared with TIM10, which is unused)
+void TIM1_UP_TIM10_IRQHandler(void) {
+  if (__HAL_TIM_GET_FLAG(&htim1, TIM_FLAG_UPDATE)) {
+    __HAL_TIM_CLEAR_IT(&htim1, TIM_IT_UPDATE);
+    driver_control_cb_t cb = control_cb;
+    if (cb) cb();
+  }
 }
 
 void driver_enable(void) {
   if (driver_enabled) return;
   
+  // Report the next break. If BKIN is still low, MOE will not set and the
+  // interrupt fires straight away.
+  __HAL_TIM_CLEAR_IT(&htim1, TIM_IT_BREAK);
+  __HAL_TIM_ENABLE_IT(&htim1, TIM_IT_BREAK);
+  
   // Start PWM channels with complementary outputs
   HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1);
   HAL_TIMEx_PWMN_Start(&htim1, TIM_CHANNEL_1);
@@ -84,16 +303,21 @@ void driver_enable(void) {
   HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_3);
   HAL_TIMEx_PWMN_Start(&htim1, TIM_CHANNEL_3);
   
-  // Start main timer counter
-  HAL_TIM_Base_Start(&htim1);
+  // Start from the all-low sector (the enables above are preloaded)
+  active_sector = SECTOR_NONE;
+  driver_commutate(0x0);
+  
+  // Counter is already running (started in driver_init_tim1)
   
   driver_enabled = 1;
-  HAL_UART_Transmit(&huart4, (uint8_t*)"DRIVER: ENABLED (TIM1 Complementary PWM)\r\n", 43, 50);
+  uart_tx_puts("DRIVER: ENABLED (TIM1 Complementary PWM)\r\n");
 }
 
 void driver_disable(void) {
   if (!driver_enabled) return;
   
+  __HAL_TIM_DISABLE_IT(&htim1, TIM_IT_BREAK);
+  
   // Stop PWM channels
   HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1);
   HAL_TIMEx_PWMN_Stop(&htim1, TIM_CHANNEL_1);
@@ -104,74 +328,68 @@ void driver_disable(void) {
   HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_3);
   HAL_TIMEx_PWMN_Stop(&htim1, TIM_CHANNEL_3);
   
-  HAL_TIM_Base_Stop(&htim1);
+  // MOE is already off; apply the cleared (preloaded) enables too
+  htim1.Instance->EGR = TIM_EGR_COMG;
+  active_sector = SECTOR_NONE;
+  
+  // PWM_Stop halts the counter once all channels are off; restart it so the
+  // control interrupt keeps its cadence with outputs disabled
+  __HAL_TIM_ENABLE(&htim1);
   
   driver_enabled = 0;
-  HAL_UART_Transmit(&huart4, (uint8_t*)"DRIVER: DISABLED (TIM1)\r\n", 26, 50);
+  uart_tx_puts("DRIVER: DISABLED (TIM1)\r\n");
 }
 
 int driver_is_enabled(void) {
   return driver_enabled;
 }
 
+// Move the ADC trigger to the middle of the on-time so shunt samples are
+// taken away from the switching edges. CCR4 must stay > 0 or OC4REF never rises.
+static void driver_set_sample_point(int16_t duty) {
+  uint32_t ccr4 = (duty > 0) ? (uint32_t)duty / 2 : DRIVER_PWM_PERIOD / 2;
+  if (ccr4 < DRIVER_ADC_MIN_SAMPLE_TICKS) ccr4 = DRIVER_ADC_MIN_SAMPLE_TICKS;
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_4, ccr4);
+}
+
 void driver_set_phase_pwm(uint8_t hall_state, int16_t duty) {
+  PROF_SCOPE(PROF_PHASE_PWM);
+
   if (!driver_enabled || duty < 0) {
     // All phases off
     __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, 0);
     __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, 0);
     __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, 0);
+    driver_set_sample_point(0);
     return;
   }
   
-  if (duty > 1680) duty = 1680;  // New period = 1680 (50 kHz)
-  
-  // Apply commutation pattern based on Hall state
-  // Each Hall state activates one phase pair
-  switch (hall_state) {
-    case 0x5: // H5: U+ V- (activate U and GND V)
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, duty);  // U = PWM
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, 0);      // V = GND
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, 0);      // W = float
-      break;
-      
-    case 0x1: // H1: U+ W- 
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, duty);  // U = PWM
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, 0);      // V = float
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, 0);      // W = GND
-      break;
-      
-    case 0x3: // H3: V+ W-
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, 0);      // U = float
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, duty);  // V = PWM
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, 0);      // W = GND
-      break;
-      
-    case 0x2: // H2: V+ U-
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, 0);      // U = GND
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, duty);  // V = PWM
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, 0);      // W = float
-      break;
-      
-    case 0x6: // H6: W+ U-
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, 0);      // U = GND
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, 0);      // V = float
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, duty);  // W = PWM
-      break;
-      
-    case 0x4: // H4: W+ V-
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, 0);      // U = float
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, 0);      // V = GND
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, duty);  // W = PWM
-      break;
-      
-    default: // Invalid state, turn off
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, 0);
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, 0);
-      __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, 0);
+  if (duty > DRIVER_PWM_PERIOD) duty = DRIVER_PWM_PERIOD;
+  driver_set_sample_point(duty);
+  
+  // Same duty on all channels (preloaded, applied at the next update); the
+  // sector table decides which one switches, which is low and which floats
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, duty);
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, duty);
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, duty);
+  driver_commutate(hall_state & 0x7);
+}
+
+void driver_set_svpwm(const uint16_t ccr[3], uint16_t sample_at) {
+  if (!driver_enabled) {
+    driver_set_phase_pwm(0, -1);
+    return;
   }
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_1, ccr[0]);
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_2, ccr[1]);
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_3, ccr[2]);
+  driver_commutate(SECTOR_SVPWM);
+  if (sample_at < DRIVER_ADC_MIN_SAMPLE_TICKS) sample_at = DRIVER_ADC_MIN_SAMPLE_TICKS;
+  if (sample_at >= DRIVER_PWM_PERIOD) sample_at = DRIVER_PWM_PERIOD - 1;
+  __HAL_TIM_SET_COMPARE(&htim1, TIM_CHANNEL_4, sample_at);
 }
 
-// Direct PWM setters for testing (0-1680 scale with new 50kHz period)
+// Direct PWM setters for testing (0-1680 scale, 100 kHz period)
 void driver_set_pwm_u(int16_t duty) {
   if (duty < 0) duty = 0;
   if (duty > 1680) duty = 1680;
@@ -5,6 +5,38 @@
 extern "C" {
 #endif
 
+// TIM1 counter clock (APB2 timer clock, no prescaler)
+#define DRIVER_TIM1_CLOCK_HZ 168000000u
+
+// TIM1 period in timer ticks (ARR + 1); duty values are on this scale
+#define DRIVER_PWM_PERIOD 1680
+
+// PWM periods per control step (TIM1 repetition counter + 1). The current
+// loops run in the control step, so it runs every PWM period and has to
+// finish within one (the PROF control_step budget).
+#define DRIVER_CONTROL_DIVIDER 1
+
+// Earliest ADC trigger point after the PWM edge, in timer ticks (~1us)
+#define DRIVER_ADC_MIN_SAMPLE_TICKS 84
+
+// Complementary output dead-time in timer ticks (3us at 168 MHz). Encoded
+// into BDTR.DTG by driver_init_tim1, rounded up to the next step.
+#define DRIVER_DEADTIME_TICKS 504
+
+// Control step callback, invoked from the TIM1 update interrupt
+typedef void (*driver_control_cb_t)(void);
+
+// Hardware trip sources. Each one has already shut the bridge down (MOE
+// cleared) when the trip callback runs.
+typedef enum {
+  DRIVER_TRIP_BREAK_INPUT = 1,  // TIM1_BKIN (PB12) pulled low
+  DRIVER_TRIP_OVERCURRENT,      // ADC analog watchdog on the shunt
+  DRIVER_TRIP_OVERVOLTAGE,      // ADC analog watchdog on VBUS
+} driver_trip_t;
+
+// Trip callback, invoked from a priority 0 interrupt
+typedef void (*driver_trip_cb_t)(driver_trip_t source);
+
 // Initialize PWM hardware on TIM1 (PA8, PA9, PA10 for U/V/W phases)
 void driver_init_tim1(void);
 
@@ -16,10 +48,17 @@ void driver_enable(void);
 void driver_disable(void);
 
 // Set phase PWM for Hall-sensored commutation
-// Input: phase duty (0-1000) with optional direction
+// Input: phase duty (0-DRIVER_PWM_PERIOD) with optional direction
+// A new sector comes from a precomputed table and is switched atomically by a
+// TIM1 COM event; the undriven phase floats (both gates off) so its back-EMF
+// can be sensed. Duty changes apply at the next PWM period.
 void driver_set_phase_pwm(uint8_t hall_state, int16_t duty);
 
-// Direct PWM setting for testing (0-840 scale)
+// Sinusoidal drive: all three half-bridges switching with the given compare
+// values (0..DRIVER_PWM_PERIOD) and the ADC trigger at sample_at. Used by FOC.
+void driver_set_svpwm(const uint16_t ccr[3], uint16_t sample_at);
+
+// Direct PWM setting for testing (0-DRIVER_PWM_PERIOD scale)
 void driver_set_pwm_u(int16_t duty);
 void driver_set_pwm_v(int16_t duty);
 void driver_set_pwm_w(int16_t duty);
@@ -27,6 +66,26 @@ void driver_set_pwm_w(int16_t duty);
 // Query driver state
 int driver_is_enabled(void);
 
+// Output state for recorders: the active sector (hall state 0..7, 8 while
+// driving sinusoidally, 0xFF after enable/disable) and the U/V/W compares
+uint8_t driver_get_sector(void);
+void driver_get_compare(uint16_t ccr[3]);
+
+// Register the control step run on every TIM1 update event. The time base
+// keeps running while outputs are disabled, so the cadence never changes.
+void driver_set_control_callback(driver_control_cb_t cb);
+
+// Control step rate in Hz (TIM1 clock / period / divider)
+uint32_t driver_get_control_hz(void);
+
+// Shut the outputs down at once (clear MOE) and report source to the trip
+// callback. Safe from any interrupt; the outputs stay off until the next
+// driver_enable (AOE is off), after driver_disable has been called.
+void driver_trip(driver_trip_t source);
+
+// Register the callback for driver_trip and the break input
+void driver_set_trip_callback(driver_trip_cb_t cb);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,455 @@
+#include "dshot.h"
+#include "esc_control.h"
+#include "stm32f4xx_hal.h"
+#include "uart_tx.h"
+#include "uart_commands.h"
+
+// DShot input pin (change to match your hardware wiring)
+#define DSHOT_GPIO_PORT GPIOB
+#define DSHOT_PIN GPIO_PIN_6
+#define DSHOT_PIN_INDEX 6
+
+// One frame is 16 bits = 32 edges, each timestamped by TIM4 CH1
+#define DSHOT_BITS 16
+#define DSHOT_EDGES (DSHOT_BITS * 2)
+
+// TIM4 runs at the APB1 timer clock (84 MHz): DShot600 bit = 140 ticks,
+// DShot300 bit = 280 ticks. Accept +-25% around each.
+#define DSHOT600_BIT_MIN 105u
+#define DSHOT600_BIT_MAX 175u
+#define DSHOT300_BIT_MIN 210u
+#define DSHOT300_BIT_MAX 350u
+
+// Line quiet for this long (2 DShot300 bits) = gap between frames
+#define DSHOT_IDLE_TICKS 560u
+
+// Arm after this much continuous zero throttle; stop when frames cease
+#define DSHOT_ARM_MS 300u
+#define DSHOT_LINK_TIMEOUT_MS 100u
+
+// Settings commands only act after this many identical frames in a row
+#define DSHOT_CMD_REPEATS 6u
+
+// Bidirectional reply: 21 GCR line bits at 5/4 of the frame bit rate, sent
+// this long after the frame (the flight controller switches to receive)
+#define DSHOT_TELEM_TURNAROUND_US 30u
+#define DSHOT_TELEM_BITS 21
+#define DSHOT_TELEM_MAX_WORDS 48
+
+static TIM_HandleTypeDef htim4;
+static DMA_HandleTypeDef hdma_tim4_ch1;
+static DMA_HandleTypeDef hdma_tim4_up;
+static volatile uint16_t edge_buf[DSHOT_EDGES];
+
+// Bidirectional DShot: inverted frames (idle high), answered with eRPM.
+// Decided from the idle level each time the receiver resynchronises.
+static volatile int bidirectional = 0;
+
+// Reply waveform: one CCR1 value per line bit (0 = low, > ARR = high)
+static uint16_t reply_buf[DSHOT_TELEM_MAX_WORDS];
+static uint32_t capture_ccmr1 = 0;   // CH1 input capture setup, restored after a reply
+static uint32_t capture_ccer = 0;
+static uint32_t tim4_clk = 0;
+static volatile uint32_t replies_sent = 0;
+
+static const uint8_t gcr_table[16] = {
+  0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17,
+  0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F
+};
+
+static volatile uint32_t frames_ok = 0;
+static volatile uint32_t frames_bad = 0;
+static volatile uint32_t last_frame_ms = 0;
+static volatile uint32_t bitrate = 0;
+static volatile uint16_t last_value = 0;
+static volatile uint32_t zero_since_ms = 0;   // start of the current zero-throttle run, 0 if none
+
+// Command repeat tracking (interrupt) and hand-off to dshot_poll
+static uint16_t cmd_value = 0xFFFF;
+static uint32_t cmd_count = 0;
+static volatile int16_t cmd_pending = -1;
+
+static int dshot_armed = 0;    // esc_arm was issued by the DShot link
+static int link_reported = 0;
+
+static void dshot_dma_done(DMA_HandleTypeDef* hdma);
+static void dshot_reply_done(DMA_HandleTypeDef* hdma);
+
+// Stop DMA captures and watch single edges until the line has been quiet for
+// DSHOT_IDLE_TICKS, so the next capture run starts on a frame's first edge
+static void dshot_hunt(void) {
+  __HAL_TIM_DISABLE_DMA(&htim4, TIM_DMA_CC1);
+  HAL_DMA_Abort(&hdma_tim4_ch1);
+  __HAL_TIM_SET_COMPARE(&htim4, TIM_CHANNEL_2, (uint16_t)(htim4.Instance->CNT + DSHOT_IDLE_TICKS));
+  __HAL_TIM_CLEAR_IT(&htim4, TIM_IT_CC1 | TIM_IT_CC2);
+  __HAL_TIM_ENABLE_IT(&htim4, TIM_IT_CC1 | TIM_IT_CC2);
+}
+
+// Line is idle between frames: capture the next 32 edges by DMA
+static void dshot_arm_capture(void) {
+  __HAL_TIM_DISABLE_IT(&htim4, TIM_IT_CC1 | TIM_IT_CC2);
+  (void)htim4.Instance->CCR1;  // drop a stale capture
+  __HAL_TIM_CLEAR_IT(&htim4, TIM_IT_CC1);
+  HAL_DMA_Start_IT(&hdma_tim4_ch1, (uint32_t)&htim4.Instance->CCR1, (uint32_t)edge_buf, DSHOT_EDGES);
+  __HAL_TIM_ENABLE_DMA(&htim4, TIM_DMA_CC1);
+}
+
+// DSHOT console command: link and frame statistics
+static void dshot_cmd_status(const uart_cmd_args_t* a) {
+  (void)a;
+  uart_tx_printf("DSHOT: link=%s rate=%lu bidir=%s value=%u ok=%lu bad=%lu telem=%lu\r\n",
+                 dshot_link_ok() ? "UP" : "DOWN", (unsigned long)bitrate,
+                 bidirectional ? "YES" : "NO", (unsigned)last_value, (unsigned long)frames_ok,
+                 (unsigned long)frames_bad, (unsigned long)replies_sent);
+}
+
+static const uart_cmd_t dshot_commands[] = {
+  {"DSHOT", UART_ARG_NONE, dshot_cmd_status, "DShot link statistics"},
+};
+
+void dshot_init(void) {
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_TIM4_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  // PB6 = TIM4_CH1, pulled low so an unplugged input reads idle (switched
+  // to pull-up once a bidirectional, idle-high link is seen)
+  GPIO_InitTypeDef gpio = {0};
+  gpio.Pin = DSHOT_PIN;
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_PULLDOWN;
+  gpio.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  gpio.Alternate = GPIO_AF2_TIM4;
+  HAL_GPIO_Init(DSHOT_GPIO_PORT, &gpio);
+
+  // TIM4 sits on APB1; its clock is 2x PCLK1 when the APB1 prescaler is not 1
+  tim4_clk = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) tim4_clk *= 2;
+
+  // Free-running 16-bit counter at the full timer clock; frames are at most
+  // ~4500 ticks long, so wrap-around only needs uint16_t differences
+  htim4.Instance = TIM4;
+  htim4.Init.Prescaler = 0;
+  htim4.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim4.Init.Period = 0xFFFF;
+  htim4.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim4.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  HAL_TIM_IC_Init(&htim4);
+
+  // CH1 captures both edges of PB6
+  TIM_IC_InitTypeDef sConfigIC = {0};
+  sConfigIC.ICPolarity = TIM_ICPOLARITY_BOTHEDGE;
+  sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+  sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+  sConfigIC.ICFilter = 2;  // 4 samples at f_CK_INT: rejects <50ns glitches
+  HAL_TIM_IC_ConfigChannel(&htim4, &sConfigIC, TIM_CHANNEL_1);
+
+  // CH2 has no pin: compare used as the inter-frame idle timeout while hunting
+  TIM_OC_InitTypeDef sConfigOC = {0};
+  sConfigOC.OCMode = TIM_OCMODE_TIMING;
+  HAL_TIM_OC_ConfigChannel(&htim4, &sConfigOC, TIM_CHANNEL_2);
+
+  // TIM4_CH1 -> DMA1 Stream0 Channel2, one frame per transfer
+  hdma_tim4_ch1.Instance = DMA1_Stream0;
+  hdma_tim4_ch1.Init.Channel = DMA_CHANNEL_2;
+  hdma_tim4_ch1.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_tim4_ch1.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_tim4_ch1.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_tim4_ch1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_tim4_ch1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  hdma_tim4_ch1.Init.Mode = DMA_NORMAL;
+  hdma_tim4_ch1.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+  hdma_tim4_ch1.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&hdma_tim4_ch1);
+  hdma_tim4_ch1.XferCpltCallback = dshot_dma_done;
+
+  // TIM4_UP -> DMA1 Stream6 Channel2: rewrites CCR1 once per reply bit.
+  // (DMA1 cannot reach the GPIO port, so the reply goes out through CH1 PWM.)
+  hdma_tim4_up.Instance = DMA1_Stream6;
+  hdma_tim4_up.Init.Channel = DMA_CHANNEL_2;
+  hdma_tim4_up.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_tim4_up.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_tim4_up.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_tim4_up.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_tim4_up.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  hdma_tim4_up.Init.Mode = DMA_NORMAL;
+  hdma_tim4_up.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+  hdma_tim4_up.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&hdma_tim4_up);
+  hdma_tim4_up.XferCpltCallback = dshot_reply_done;
+
+  // Below the control step (1), above UART traffic
+  HAL_NVIC_SetPriority(DMA1_Stream0_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+  HAL_NVIC_SetPriority(TIM4_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(TIM4_IRQn);
+
+  htim4.Instance->CCER |= TIM_CCER_CC1E;
+  capture_ccmr1 = htim4.Instance->CCMR1;
+  capture_ccer = htim4.Instance->CCER;
+  __HAL_TIM_ENABLE(&htim4);
+  dshot_hunt();
+
+  uart_commands_register(dshot_commands, sizeof(dshot_commands) / sizeof(dshot_commands[0]));
+}
+
+// Timestamps -> 16-bit frame. 0 on a timing or CRC error.
+static int dshot_decode(const volatile uint16_t* e, uint16_t* out, uint32_t* rate) {
+  // First edge to the first edge of the last bit: 15 bit periods
+  uint32_t bit = (uint16_t)(e[DSHOT_EDGES - 2] - e[0]) / (DSHOT_BITS - 1);
+  uint32_t min, max;
+  if (bit >= DSHOT600_BIT_MIN && bit <= DSHOT600_BIT_MAX) {
+    min = DSHOT600_BIT_MIN; max = DSHOT600_BIT_MAX; *rate = 600000;
+  } else if (bit >= DSHOT300_BIT_MIN && bit <= DSHOT300_BIT_MAX) {
+    min = DSHOT300_BIT_MIN; max = DSHOT300_BIT_MAX; *rate = 300000;
+  } else {
+    return 0;
+  }
+
+  uint16_t frame = 0;
+  for (int i = 0; i < DSHOT_BITS; i++) {
+    uint32_t high = (uint16_t)(e[2 * i + 1] - e[2 * i]);
+    if (i < DSHOT_BITS - 1) {
+      uint32_t period = (uint16_t)(e[2 * i + 2] - e[2 * i]);
+      if (period < min || period > max || high >= period) return 0;
+    }
+    // 1 = 75% high, 0 = 37.5% high
+    frame = (uint16_t)((frame << 1) | (high * 2 > bit ? 1u : 0u));
+  }
+
+  // bidirectional frames carry the inverted checksum
+  uint16_t data = frame >> 4;
+  uint16_t crc = (data ^ (data >> 4) ^ (data >> 8)) & 0xF;
+  if (bidirectional) crc = ~crc & 0xF;
+  if (crc != (frame & 0xF)) return 0;
+  *out = frame;
+  return 1;
+}
+
+// A valid frame: throttle straight to the controller, commands counted
+static void dshot_handle(uint16_t frame) {
+  uint16_t value = frame >> 5;
+  uint32_t now = HAL_GetTick();
+  last_value = value;
+  last_frame_ms = now;
+  frames_ok++;
+
+  if (value == DSHOT_CMD_MOTOR_STOP) {
+    if (zero_since_ms == 0) zero_since_ms = now ? now : 1;
+  } else {
+    zero_since_ms = 0;
+  }
+
+  if (value >= DSHOT_THROTTLE_MIN) {
+    cmd_value = 0xFFFF;
+    esc_set_dshot_throttle((uint16_t)(value - DSHOT_THROTTLE_MIN));
+    return;
+  }
+  esc_set_dshot_throttle(0);
+  if (value == DSHOT_CMD_MOTOR_STOP) {
+    cmd_value = 0xFFFF;
+    return;
+  }
+
+  // Special command: count identical frames, hand over once enough arrived
+  if (value != cmd_value) {
+    cmd_value = value;
+    cmd_count = 0;
+  }
+  cmd_count++;
+  uint32_t needed = (value >= DSHOT_CMD_SPIN_DIRECTION_1) ? DSHOT_CMD_REPEATS : 1;
+  if (cmd_count == needed) cmd_pending = (int16_t)value;
+}
+
+// eRPM telemetry word: period as 3-bit exponent + 9-bit mantissa (us),
+// inverted 4-bit checksum. 0xFFF means stopped.
+static uint16_t dshot_telemetry_value(uint32_t period_us) {
+  uint32_t code = 0xFFF;
+  if (period_us != 0 && period_us <= (511u << 7)) {
+    uint32_t e = 0;
+    while (period_us > 511) {
+      period_us >>= 1;
+      e++;
+    }
+    code = (e << 9) | period_us;
+  }
+  uint32_t crc = ~(code ^ (code >> 4) ^ (code >> 8)) & 0xF;
+  return (uint16_t)((code << 4) | crc);
+}
+
+// Build and start the reply: idle-high turnaround padding, start bit, then
+// each GCR bit as a transition (1) or no transition (0) of the line
+static void dshot_send_reply(uint32_t rate) {
+  uint32_t reply_rate = rate / 4 * 5;
+  uint32_t bit_ticks = tim4_clk / reply_rate;
+  uint16_t high = (uint16_t)(bit_ticks + 1);
+  uint32_t pad = DSHOT_TELEM_TURNAROUND_US * reply_rate / 1000000u;
+
+  uint16_t value = dshot_telemetry_value(esc_control_erev_period_us());
+  uint32_t gcr = 0;
+  for (int shift = 12; shift >= 0; shift -= 4) {
+    gcr = (gcr << 5) | gcr_table[(value >> shift) & 0xF];
+  }
+
+  uint32_t n = 0;
+  while (n < pad) reply_buf[n++] = high;
+  int level = 0;
+  reply_buf[n++] = 0;  // start bit
+  for (int bit = DSHOT_TELEM_BITS - 2; bit >= 0; bit--) {
+    if ((gcr >> bit) & 1u) level ^= 1;
+    reply_buf[n++] = level ? high : 0;
+  }
+  reply_buf[n++] = high;  // release to idle
+
+  // CH1 becomes a PWM output (preloaded CCR1) clocked at the reply bit rate,
+  // starting high so the line does not glitch while it changes direction
+  __HAL_TIM_DISABLE_DMA(&htim4, TIM_DMA_CC1);
+  htim4.Instance->CCER = capture_ccer & ~(TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC1NP);
+  htim4.Instance->CCMR1 = (capture_ccmr1 & ~0xFFu) | TIM_OCMODE_PWM1 | TIM_CCMR1_OC1PE;
+  htim4.Instance->ARR = bit_ticks - 1;
+  htim4.Instance->CCR1 = high;
+  htim4.Instance->EGR = TIM_EGR_UG;
+  htim4.Instance->CCER |= TIM_CCER_CC1E;
+
+  HAL_DMA_Start_IT(&hdma_tim4_up, (uint32_t)reply_buf, (uint32_t)&htim4.Instance->CCR1, n);
+  __HAL_TIM_ENABLE_DMA(&htim4, TIM_DMA_UPDATE);
+}
+
+// Last word (idle high) is out: back to edge capture for the next frame
+static void dshot_reply_done(DMA_HandleTypeDef* hdma) {
+  __HAL_TIM_DISABLE_DMA(&htim4, TIM_DMA_UPDATE);
+  htim4.Instance->CCER = capture_ccer & ~TIM_CCER_CC1E;
+  htim4.Instance->CCMR1 = capture_ccmr1;
+  htim4.Instance->ARR = 0xFFFF;
+  htim4.Instance->CCER = capture_ccer;
+  replies_sent++;
+  dshot_arm_capture();
+}
+
+static void dshot_dma_done(DMA_HandleTypeDef* hdma) {
+  uint16_t frame;
+  uint32_t rate;
+  if (dshot_decode(edge_buf, &frame, &rate)) {
+    bitrate = rate;
+    if (bidirectional) {
+      // answer first (the turnaround is fixed), capture resumes afterwards
+      dshot_send_reply(rate);
+    } else {
+      // the line is in the inter-frame gap now: restart capture straight away
+      dshot_arm_capture();
+    }
+    dshot_handle(frame);
+  } else {
+    frames_bad++;
+    dshot_hunt();
+  }
+}
+
+void DMA1_Stream0_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma_tim4_ch1);
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma_tim4_up);
+}
+
+// Hunting: every edge pushes the idle deadline out; the deadline passing
+// means we are between frames, and the idle level gives the polarity
+void TIM4_IRQHandler(void) {
+  if (__HAL_TIM_GET_FLAG(&htim4, TIM_FLAG_CC1) && __HAL_TIM_GET_IT_SOURCE(&htim4, TIM_IT_CC1)) {
+    uint16_t at = (uint16_t)htim4.Instance->CCR1;  // reading clears CC1IF
+    __HAL_TIM_SET_COMPARE(&htim4, TIM_CHANNEL_2, (uint16_t)(at + DSHOT_IDLE_TICKS));
+    __HAL_TIM_CLEAR_IT(&htim4, TIM_IT_CC2);
+  }
+  if (__HAL_TIM_GET_FLAG(&htim4, TIM_FLAG_CC2) && __HAL_TIM_GET_IT_SOURCE(&htim4, TIM_IT_CC2)) {
+    __HAL_TIM_CLEAR_IT(&htim4, TIM_IT_CC2);
+    // idle low = standard DShot, idle high = bidirectional (inverted)
+    int idle_high = (DSHOT_GPIO_PORT->IDR & DSHOT_PIN) != 0;
+    if (idle_high != bidirectional) {
+      bidirectional = idle_high;
+      // hold the line at its idle level between replies
+      uint32_t pupd = DSHOT_GPIO_PORT->PUPDR & ~(3u << (DSHOT_PIN_INDEX * 2));
+      pupd |= (idle_high ? 1u : 2u) << (DSHOT_PIN_INDEX * 2);
+      DSHOT_GPIO_PORT->PUPDR = pupd;
+    }
+    dshot_arm_capture();
+  }
+}
+
+static void dshot_run_command(int16_t cmd) {
+  switch (cmd) {
+    case DSHOT_CMD_ESC_INFO:
+      uart_tx_printf("DSHOT: ESC_INFO rate=%lu ok=%lu bad=%lu\r\n", (unsigned long)bitrate,
+                     (unsigned long)frames_ok, (unsigned long)frames_bad);
+      break;
+    default:
+      if (cmd >= DSHOT_CMD_BEEP1 && cmd <= DSHOT_CMD_BEEP5) break;  // no beeper fitted
+      // spin direction, 3D mode and settings storage are fixed by the config frame
+      uart_tx_printf("DSHOT: command %d not supported\r\n", cmd);
+      break;
+  }
+}
+
+void dshot_poll(void) {
+  uint32_t now = HAL_GetTick();
+  int link = dshot_link_ok();
+
+  if (link != link_reported) {
+    link_reported = link;
+    if (link) uart_tx_printf("DSHOT%lu: LINK UP%s\r\n", (unsigned long)(bitrate / 1000),
+                             bidirectional ? " (bidirectional)" : "");
+    else uart_tx_puts("DSHOT: LINK LOST\r\n");
+  }
+
+  esc_state_t state = esc_control_get_state();
+  if (!link) {
+    // failsafe: a motor armed by DShot stops when its frames stop
+    if (dshot_armed && (state == ESC_ARMED || state == ESC_RUNNING)) esc_disarm();
+    dshot_armed = 0;
+    return;
+  }
+
+  // Flight controllers arm by streaming zero throttle
+  uint32_t zero_since = zero_since_ms;
+  if (zero_since && now - zero_since >= DSHOT_ARM_MS &&
+      (state == ESC_CONFIG_READY || state == ESC_WAIT_CONFIG)) {
+    esc_arm();
+    dshot_armed = (esc_control_get_state() == ESC_ARMED);
+  }
+
+  int16_t cmd = cmd_pending;
+  if (cmd >= 0) {
+    cmd_pending = -1;
+    dshot_run_command(cmd);
+  }
+}
+
+int dshot_link_ok(void) {
+  return frames_ok != 0 && (HAL_GetTick() - last_frame_ms) < DSHOT_LINK_TIMEOUT_MS;
+}
+
+uint32_t dshot_bitrate(void) {
+  return bitrate;
+}
+
+uint16_t dshot_last_value(void) {
+  return last_value;
+}
+
+uint32_t dshot_frames_ok(void) {
+  return frames_ok;
+}
+
+uint32_t dshot_frames_bad(void) {
+  return frames_bad;
+}
+
+int dshot_is_bidirectional(void) {
+  return bidirectional;
+}
+
+uint32_t dshot_telemetry_sent(void) {
+  return replies_sent;
+}
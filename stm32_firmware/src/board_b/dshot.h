@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// DShot300/600 throttle input on PB6 (TIM4_CH1). Every edge is captured by
+// TIM4 and moved by DMA (DMA1 Stream0 Channel2); a whole frame is decoded in
+// the DMA complete interrupt, so the throttle reaches esc_control within
+// microseconds of the last bit. The bit rate is detected per frame.
+//
+// Bidirectional DShot (inverted, idle-high line) is detected from the idle
+// level. Each such frame is answered 30 us later on the same pin with the
+// GCR-encoded eRPM period from the hall edges or the sensorless engine.
+
+// Frame value: 11-bit throttle/command, telemetry request bit, 4-bit CRC
+#define DSHOT_THROTTLE_MIN 48
+#define DSHOT_THROTTLE_MAX 2047
+
+// Special command values (throttle field 1..47, telemetry bit set)
+enum {
+  DSHOT_CMD_MOTOR_STOP = 0,
+  DSHOT_CMD_BEEP1 = 1,
+  DSHOT_CMD_BEEP5 = 5,
+  DSHOT_CMD_ESC_INFO = 6,
+  DSHOT_CMD_SPIN_DIRECTION_1 = 7,
+  DSHOT_CMD_SPIN_DIRECTION_2 = 8,
+  DSHOT_CMD_3D_MODE_OFF = 9,
+  DSHOT_CMD_3D_MODE_ON = 10,
+  DSHOT_CMD_SETTINGS_REQUEST = 11,
+  DSHOT_CMD_SAVE_SETTINGS = 12,
+  DSHOT_CMD_SPIN_DIRECTION_NORMAL = 20,
+  DSHOT_CMD_SPIN_DIRECTION_REVERSED = 21,
+  DSHOT_CMD_MAX = 47
+};
+
+// Configure PB6, TIM4 capture and DMA, and start hunting for frames
+void dshot_init(void);
+
+// Background work (call from loop): arming on a zero-throttle stream, link
+// loss failsafe, and commands that are not safe to run in the interrupt
+void dshot_poll(void);
+
+// Valid frame within the last DSHOT_LINK_TIMEOUT_MS
+int dshot_link_ok(void);
+
+// Detected bit rate (300000 or 600000), 0 before the first valid frame
+uint32_t dshot_bitrate(void);
+
+// Latest valid 11-bit value (throttle or command)
+uint16_t dshot_last_value(void);
+
+// Frame counters since boot
+uint32_t dshot_frames_ok(void);
+uint32_t dshot_frames_bad(void);
+
+// Bidirectional link detected, and telemetry replies sent since boot
+int dshot_is_bidirectional(void);
+uint32_t dshot_telemetry_sent(void);
+
+#ifdef __cplusplus
+}
+#endif
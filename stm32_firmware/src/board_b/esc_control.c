@@ -3,58 +3,164 @@
 #include "driver_tim1.h"
 #include "hall_sensor.h"
 #include "uart_commands.h"
+#include "fixed_point.h"
+#include "simplefoc_wrapper.h"
+#include "speed_ctrl.h"
+#include "current_ctrl.h"
+#include "bemf_sensorless.h"
+#include "bldc_commutation.h"
+#include "telemetry.h"
+#include "blackbox.h"
+#include "prof.h"
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include "stm32f4xx_hal.h"
+#include "uart_tx.h"
 
-// UART handle is declared in main.cpp
-extern UART_HandleTypeDef huart4;
 extern int safety_get_bypass(void);
 extern uint8_t hall_sensor_read(void);
 
 static esc_config_t g_cfg;
-static esc_state_t g_state = ESC_BOOT;
-static float max_motor_voltage = 0.0f;
+static uint8_t configured_mode = 0;  // control_mode before the bypass override
+static volatile esc_state_t g_state = ESC_BOOT;
 static uint32_t max_current = 0;
 static uint32_t overcurrent_trip = 0;
 static uint16_t max_temp_limit = 0;
 
+// Integer limits and scales precomputed from the config in esc_control_init
+static uint32_t overvoltage_mv = 0;        // max motor voltage + 0.5 V margin
+static uint32_t undervoltage_mv = 0;       // cutoff, or 70% of battery voltage
+static const q15_t DERATE_MIN_Q15 = Q15_FROM_FLOAT(0.1f);
+static const q15_t DERATE_HALF_Q15 = Q15_FROM_FLOAT(0.5f);
+
 // Targets
 static int32_t target_rpm = 0;
 static int32_t target_current_mA = 0;
 static int pwm_percent = 0;
 static int target_pwm_percent = 0;
 static uint32_t arm_time_ms = 0;
-static const uint32_t ARM_STABILIZE_MS = 80;
 static const int RAMP_RATE_PERCENT_PER_SEC = 250;
 
+// Duty computed by the background update, applied by the control step
+static volatile int16_t g_duty = 0;
+
+// Torque mode: derated current command for the per-period current loop
+static volatile int32_t g_cmd_mA = 0;
+
+// Torque and speed modes drive sinusoidally through the FOC engine
+static int foc_enabled = 0;
+
 // Simple 6-step commutation for Hall fallback
 static uint8_t commutation_step = 0;
 static const uint8_t commutation_sequence[] = {0x1, 0x3, 0x2, 0x6, 0x4, 0x5};
-static uint32_t step_divider = 0;      // Counter for adaptive stepping
-static uint32_t step_divider_low = 0;  // Counter for very low speeds
+
+// Open-loop start while neither halls nor BEMF give the rotor position:
+// TIM7 steps from OPEN_LOOP_START_HZ towards a duty-dependent rate
+static const float OPEN_LOOP_START_HZ = 200.0f;
+static const float OPEN_LOOP_RAMP_HZ_PER_S = 2000.0f;
+
+// ESC_FLAG_* derating bits (refreshed by esc_control_update) and fault cause
+static volatile uint8_t derate_flags = 0;
+static volatile uint8_t fault_flags = 0;
+
+// Sensorless desyncs already reported (esc_control_update raises the fault)
+static uint32_t desyncs_seen = 0;
+
+// Hardware trip reported by interrupt, completed by esc_control_update
+static volatile uint8_t hw_trip = 0;
+
+// Hall edge: switch to the new sector immediately instead of waiting for the
+// next control tick. Runs at the same interrupt priority as the control step.
+static void esc_control_on_hall_edge(uint8_t hall) {
+  esc_state_t state = g_state;
+  if (state != ESC_ARMED && state != ESC_RUNNING) return;
+  if (foc_enabled) return;  // FOC interpolates the angle every step instead
+  driver_set_phase_pwm(hall, g_duty);
+}
+
+// Sensorless commutation: the BEMF engine moved to the next step (TIM5 alarm)
+static void esc_control_on_bemf_step(uint8_t step) {
+  commutation_step = step;
+  driver_set_phase_pwm(commutation_sequence[step], g_duty);
+}
+
+// Open-loop step from TIM7. Ignored once halls or BEMF own commutation.
+static void esc_control_on_open_loop_step(uint8_t step) {
+  uint8_t hall = hall_sensor_read();
+  if (hall != 0x0 && hall != 0x7) return;
+  if (bemf_sensorless_is_locked()) return;
+  commutation_step = step;
+  bemf_sensorless_forced_step(step);
+  driver_set_phase_pwm(commutation_sequence[step], g_duty);
+}
+
+// Hardware trip (break input or ADC watchdog, priority 0): the bridge is
+// already off. Stop the control step driving and freeze the blackbox now;
+// esc_control_update finishes the fault (driver_disable, report).
+static void esc_control_on_trip(driver_trip_t source) {
+  hw_trip = (uint8_t)source;
+  esc_state_t state = g_state;
+  if (state != ESC_ARMED && state != ESC_RUNNING) return;
+  g_state = ESC_FAULT;
+  g_duty = 0;
+  g_cmd_mA = 0;
+  blackbox_trigger(BLACKBOX_TRIG_FAULT);
+}
+
+// Step rate for the open-loop start: faster with more power
+static float open_loop_step_hz(int16_t duty) {
+  if (duty > 500) return 1000.0f;   // High power: step every 1ms (fastest)
+  if (duty > 200) return 500.0f;    // Medium power: step every 2ms
+  return 333.0f;                    // Low power: step every 3ms (more torque)
+}
 
 void esc_control_init(const esc_config_t* cfg) {
   if (cfg) memcpy(&g_cfg, cfg, sizeof(g_cfg));
+  configured_mode = g_cfg.control_mode;
 
   // Override control mode to OPEN_LOOP when safety bypass is active (for bring-up testing)
   if (safety_get_bypass()) {
     g_cfg.control_mode = CONTROL_MODE_OPEN_LOOP;
-    HAL_UART_Transmit(&huart4, (uint8_t*)"CONTROL MODE OVERRIDDEN: OPEN_LOOP (BYPASS)\r\n", 45, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"Temperature protection disabled (BYPASS)\r\n", 42, 50);
+    uart_tx_puts("CONTROL MODE OVERRIDDEN: OPEN_LOOP (BYPASS)\r\n");
+    uart_tx_puts("Temperature protection disabled (BYPASS)\r\n");
   }
 
   // Derive safety limits
-  max_motor_voltage = (float)g_cfg.battery_nominal_mv / 1000.0f * 0.9f;
   max_current = g_cfg.current_limit;
   overcurrent_trip = g_cfg.overcurrent_limit;
   max_temp_limit = g_cfg.max_temp;
+  overvoltage_mv = (uint32_t)g_cfg.battery_nominal_mv * 9 / 10 + 500;
+  undervoltage_mv = g_cfg.voltage_cutoff_mv ? g_cfg.voltage_cutoff_mv
+                                            : (uint32_t)g_cfg.battery_voltage_mv * 7 / 10;
+
+  // Commutate directly from the hall edge interrupt
+  hall_sensor_set_callback(esc_control_on_hall_edge);
+
+  // Without valid halls, BEMF zero crossings take over from the blind stepper
+  bemf_sensorless_init(esc_control_on_bemf_step);
+
+  foc_enabled = (g_cfg.control_mode == CONTROL_MODE_TORQUE || g_cfg.control_mode == CONTROL_MODE_SPEED)
+                && motor_initFOC(&g_cfg);
+
+  // Open-loop steps come from TIM7 at an exact rate
+  bldc_commutation_init();
+  bldc_commutation_set_ramp(OPEN_LOOP_RAMP_HZ_PER_S);
+  bldc_commutation_set_step_callback(esc_control_on_open_loop_step);
 
   // Initialize driver (keep outputs disabled until arm)
   driver_init();
   driver_disable();
 
+  // Hardware trips: TIM1 break input and the ADC watchdogs at the same limits
+  // as the checks in esc_control_update
+  driver_set_trip_callback(esc_control_on_trip);
+  safety_set_trip_limits(overcurrent_trip, overvoltage_mv);
+
+  // Peak current held at the current limit pulse by pulse (TIM1 OCREF clear);
+  // the derating in esc_control_update then only acts on the average
+  safety_set_pulse_limit(max_current);
+
   g_state = ESC_CONFIG_READY;
 }
 
@@ -63,46 +169,63 @@ void esc_arm(void) {
   if (g_state == ESC_CONFIG_READY || g_state == ESC_WAIT_CONFIG) {
     // do not allow arming during calibration
     if (safety_is_calibrating()) {
-      HAL_UART_Transmit(&huart4, (uint8_t*)"ARM REJECTED: calibration active\r\n", 33, 50);
+      uart_tx_puts("ARM REJECTED: calibration active\r\n");
       return;
     }
     if (target_rpm != 0 || target_current_mA != 0) {
-      HAL_UART_Transmit(&huart4, (uint8_t*)"ARM REJECTED: non-zero target\r\n", 30, 50);
+      uart_tx_puts("ARM REJECTED: non-zero target\r\n");
       return;
     }
+    g_cmd_mA = 0;
+    fault_flags = 0;
     
     // Initialize software commutation
     commutation_step = 0;
-    step_divider = 0;
-    step_divider_low = 0;
+    g_duty = 0;
+    bemf_sensorless_reset();
+    desyncs_seen = bemf_sensorless_desyncs();
+    if (foc_enabled) motor_resetFOC();
     
     // Set minimum startup throttle (10%)
     pwm_percent = 10;
     target_pwm_percent = 10;
     arm_time_ms = HAL_GetTick();
     
-    // enable driver outputs
+    // zero-current offset while the outputs are still off, so the trip
+    // thresholds armed below sit above the true zero
+    if (!safety_calibrate_offset()) {
+      uart_tx_printf("ARM: offset burst failed, offset_raw=%lu kept\r\n",
+                     (unsigned long)safety_get_shunt_offset_raw());
+    }
+
+    // enable driver outputs, hardware trips first
+    hw_trip = 0;
+    safety_arm_trips();
     driver_enable();
     g_state = ESC_ARMED;
-    HAL_UART_Transmit(&huart4, (uint8_t*)"ESC ARMED\r\n", 11, 50);
+    uart_tx_puts("ESC ARMED\r\n");
   }
 }
 
 void esc_disarm(void) {
+  // leave the run states first so the control step stops driving
+  g_state = ESC_WAIT_CONFIG;
+  g_duty = 0;
+  g_cmd_mA = 0;
+
   // safe stop
   target_rpm = 0;
   target_current_mA = 0;
   pwm_percent = 0;
   target_pwm_percent = 0;
   commutation_step = 0;
-  step_divider = 0;
-  step_divider_low = 0;
   arm_time_ms = 0;
+  bldc_commutation_stop();
+  bemf_sensorless_reset();
   
   // disable outputs
   driver_disable();
-  g_state = ESC_WAIT_CONFIG;
-  HAL_UART_Transmit(&huart4, (uint8_t*)"ESC DISARMED\r\n", 14, 50);
+  uart_tx_puts("ESC DISARMED\r\n");
 }
 
 
@@ -122,67 +245,128 @@ void esc_set_torque_mA(int32_t milliamp) {
 
 esc_state_t esc_control_get_state(void) { return g_state; }
 
+uint8_t esc_control_get_flags(void) { return (uint8_t)(derate_flags | fault_flags); }
+
+int16_t esc_control_get_duty(void) { return g_duty; }
+
+// Electrical revolution period from whichever source knows the rotor speed
+uint32_t esc_control_erev_period_us(void) {
+  if (bemf_sensorless_is_locked()) return bemf_sensorless_step_us() * 6;
+  return hall_sensor_erev_period_us();
+}
+
+int esc_control_get_config(esc_config_t* out) {
+  if (g_state == ESC_BOOT || !out) return 0;
+  memcpy(out, &g_cfg, sizeof(g_cfg));
+  out->control_mode = configured_mode;
+  return 1;
+}
+
 void esc_control_set_fault(const char* reason) {
   g_state = ESC_FAULT;
+  g_duty = 0;
+  g_cmd_mA = 0;
   target_rpm = 0;
   target_current_mA = 0;
+  bldc_commutation_stop();
+  // no pending 30-degree alarm may commutate, and no stale lock survives to
+  // the next arm
+  bemf_sensorless_reset();
   driver_disable();
+  blackbox_trigger(BLACKBOX_TRIG_FAULT);
   if (reason) {
-    HAL_UART_Transmit(&huart4, (uint8_t*)"FAULT: ", 7, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)reason, strlen(reason), 200);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n", 2, 50);
+    uart_tx_printf("FAULT: %s\r\n", reason);
+  }
+}
+
+// Latch a fault and remember its cause for the status flags
+static void esc_control_fault(uint8_t flag, const char* reason) {
+  fault_flags = flag;
+  esc_control_set_fault(reason);
+}
+
+// Fault for a hardware trip that hit while the outputs were enabled
+static void esc_control_finish_trip(void) {
+  uint8_t source = hw_trip;
+  if (!source) return;
+  hw_trip = 0;
+  if (!driver_is_enabled()) return;
+  switch (source) {
+    case DRIVER_TRIP_OVERCURRENT:
+      esc_control_fault(ESC_FLAG_FAULT_OVERCURRENT, "hw_overcurrent");
+      break;
+    case DRIVER_TRIP_OVERVOLTAGE:
+      esc_control_fault(ESC_FLAG_FAULT_OVERVOLTAGE, "hw_over_voltage");
+      break;
+    default:
+      esc_control_fault(ESC_FLAG_FAULT_OVERCURRENT, "hw_break_input");
+      break;
   }
 }
 
 void esc_control_update(void) {
+  PROF_SCOPE(PROF_ESC_UPDATE);
+
+  esc_control_finish_trip();
+
   // === NORMAL MOTOR CONTROL ===
   if (g_state == ESC_ARMED || g_state == ESC_RUNNING) {
     // read sensors
     int32_t current_mA = safety_get_motor_current_mA();
-    float voltage_v = safety_get_driver_voltage_v();
+    uint32_t vbus_mv = safety_get_vbus_mV();
     uint16_t temp_c = safety_get_temperature_c();
 
     // watchdog: require recent UART commands (fail safe) - skip when bypass is active
     if (!safety_get_bypass()) {
       uint32_t last_cmd = uart_commands_last_seen_ms();
       if (HAL_GetTick() - last_cmd > 5000) {
-        esc_control_set_fault("cmd_watchdog");
+        esc_control_fault(ESC_FLAG_FAULT_OTHER, "cmd_watchdog");
         return;
       }
     }
 
     // derating and protective actions
-    float derate_factor = 1.0f;
+    q15_t derate = Q15_ONE;
+    uint8_t flags = 0;
     if ((uint32_t)current_mA > max_current) {
-      derate_factor = (float)max_current / (float)current_mA;
-      if (derate_factor < 0.1f) derate_factor = 0.1f;
+      // only divide when actually over the limit
+      derate = (q15_t)(((uint64_t)max_current << Q15_SHIFT) / (uint32_t)current_mA);
+      if (derate < DERATE_MIN_Q15) derate = DERATE_MIN_Q15;
+      flags |= ESC_FLAG_CURRENT_LIMIT;
     }
     if (temp_c > (max_temp_limit - 5)) {
       if (!safety_get_bypass()) {
-        derate_factor *= 0.5f;
+        derate = q15_mul(derate, DERATE_HALF_Q15);
+        flags |= ESC_FLAG_TEMP_DERATE;
       }
     }
-    if (voltage_v < ((float)g_cfg.battery_voltage_mv / 1000.0f * 0.7f)) {
-      derate_factor *= 0.5f;
+    if (vbus_mv < undervoltage_mv) {
+      derate = q15_mul(derate, DERATE_HALF_Q15);
+      flags |= ESC_FLAG_UNDERVOLTAGE;
     }
+    derate_flags = flags;
 
     if ((uint32_t)current_mA > overcurrent_trip) {
-      esc_control_set_fault("overcurrent_trip");
+      esc_control_fault(ESC_FLAG_FAULT_OVERCURRENT, "overcurrent_trip");
       return;
     }
-    if (voltage_v > max_motor_voltage + 0.5f) {
-      esc_control_set_fault("over_voltage");
+    if (vbus_mv > overvoltage_mv) {
+      esc_control_fault(ESC_FLAG_FAULT_OVERVOLTAGE, "over_voltage");
       return;
     }
     if (!safety_get_bypass() && temp_c > max_temp_limit) {
-      esc_control_set_fault("over_temperature");
+      esc_control_fault(ESC_FLAG_FAULT_OVERTEMP, "over_temperature");
+      return;
+    }
+    if (bemf_sensorless_desyncs() != desyncs_seen) {
+      esc_control_fault(ESC_FLAG_FAULT_DESYNC, "sensorless_desync");
       return;
     }
 
     // clamp commanded current and apply derating
     int32_t cmd_mA = target_current_mA;
     if ((uint32_t)cmd_mA > (uint32_t)max_current) cmd_mA = (int32_t)max_current;
-    cmd_mA = (int32_t)((float)cmd_mA * derate_factor);
+    cmd_mA = q15_scale(cmd_mA, derate);
 
     // SMOOTH THROTTLE RAMP
     {
@@ -214,58 +398,78 @@ void esc_control_update(void) {
     int16_t duty = 0;
     
     if (g_cfg.control_mode == CONTROL_MODE_TORQUE) {
-      duty = (int16_t)((cmd_mA * 1680) / max_current);
-      if (duty < 0) duty = 0;
-      if (duty > 1680) duty = 1680;
+      // regulated against the shunt every period in esc_control_step
+      g_cmd_mA = cmd_mA;
+      duty = g_duty;
+      if (foc_enabled) motor_move_torque_mA(cmd_mA);
     } else if (g_cfg.control_mode == CONTROL_MODE_SPEED) {
-      duty = (int16_t)((target_rpm * 1680) / 500);
-      if (duty < 0) duty = 0;
-      if (duty > 1680) duty = 1680;
+      // six-step fallback has no speed feedback: kv feed-forward only
+      q15_t mod = speed_ctrl_feedforward(target_rpm, vbus_mv);
+      duty = (int16_t)(((int32_t)mod * DRIVER_PWM_PERIOD) >> Q15_SHIFT);
+      if (foc_enabled) motor_move_speed_rpm(target_rpm);
     } else if (g_cfg.control_mode == CONTROL_MODE_OPEN_LOOP) {
       duty = (int16_t)((pwm_percent * 1680) / 100);
       if (duty < 0) duty = 0;
       if (duty > 1680) duty = 1680;
     } else {
-      esc_control_set_fault("unsupported_control_mode");
+      esc_control_fault(ESC_FLAG_FAULT_OTHER, "unsupported_control_mode");
       return;
     }
 
-    // Commutation: Use real Hall sensors if available, otherwise use software 6-step
+    g_duty = duty;
+
+    // Open-loop start while neither halls nor BEMF know the rotor position
     uint8_t hall = hall_sensor_read();
-    
-    if (hall == 0x7 || hall == 0x0) {
-      // Hall sensors invalid/floating - use software 6-step with adaptive stepping
-      if (duty > 500) {
-        // High power: step at every 1ms (fastest)
-        step_divider++;
-        if (step_divider >= 1) {
-          step_divider = 0;
-          commutation_step = (commutation_step + 1) % 6;
-        }
-      } else if (duty > 200) {
-        // Medium power: step every 2ms
-        step_divider++;
-        if (step_divider >= 2) {
-          step_divider = 0;
-          commutation_step = (commutation_step + 1) % 6;
-        }
-      } else if (duty > 0) {
-        // Low power: step every 3ms (more torque)
-        step_divider_low++;
-        if (step_divider_low >= 3) {
-          step_divider_low = 0;
-          commutation_step = (commutation_step + 1) % 6;
-        }
-      }
-      
-      hall = commutation_sequence[commutation_step];
+    if ((hall == 0x0 || hall == 0x7) && !bemf_sensorless_is_locked() && duty > 0) {
+      if (!bldc_commutation_is_running()) bldc_commutation_start(OPEN_LOOP_START_HZ);
+      bldc_commutation_set_frequency(open_loop_step_hz(duty));
+    } else if (bldc_commutation_is_running()) {
+      bldc_commutation_stop();
     }
-    
-    // Apply commutation
-    driver_set_phase_pwm(hall, duty);
   }
 }
 
+void esc_control_step(void) {
+  PROF_SCOPE(PROF_CONTROL_STEP);
+
+  // latch this period's ADC scan so the getters see fresh values
+  safety_sample_once();
+
+  // periodic telemetry record and blackbox sample from this period's readings
+  telemetry_control_tick();
+  blackbox_control_tick();
+
+  esc_state_t state = g_state;
+  if (state != ESC_ARMED && state != ESC_RUNNING) return;
+
+  // Sinusoidal drive while the hall sensors give a rotor angle
+  if (foc_enabled && motor_loopFOC()) return;
+
+  int16_t duty = g_duty;
+  if (g_cfg.control_mode == CONTROL_MODE_TORQUE) {
+    // inner current loop on the shunt, once per PWM period
+    duty = current_ctrl_run_six_step(g_cmd_mA, safety_get_motor_current_sample_mA());
+    g_duty = duty;
+  }
+
+  // Commutation: Use real Hall sensors if available, otherwise use software 6-step
+  uint8_t hall = hall_sensor_read();
+  
+  if (hall == 0x7 || hall == 0x0) {
+    // Hall sensors invalid/floating: commutate on BEMF zero crossings once
+    // locked; until then TIM7 steps open-loop (esc_control_update) to get
+    // the rotor turning fast enough for the BEMF to be seen
+    bemf_sensorless_update();
+    hall = commutation_sequence[commutation_step];
+  } else if (bemf_sensorless_is_locked()) {
+    // halls came back: they own commutation again
+    bemf_sensorless_reset();
+  }
+  
+  // Apply commutation
+  driver_set_phase_pwm(hall, duty);
+}
+
 void esc_set_pwm_percent(int percent) {
   if (percent < 0) percent = 0;
   if (percent > 100) percent = 100;
@@ -283,4 +487,19 @@ void esc_set_throttle(int throttle_value) {
   if (throttle_value > 100) throttle_value = 100;
   
   esc_set_pwm_percent(throttle_value);
-}
\ No newline at end of file
+}
+void esc_set_dshot_throttle(uint16_t level) {
+  const uint32_t full = 1999;
+  if (level > full) level = (uint16_t)full;
+  esc_state_t state = g_state;
+  if (state != ESC_ARMED && state != ESC_RUNNING) return;
+
+  if (g_cfg.control_mode == CONTROL_MODE_SPEED) {
+    target_rpm = (int32_t)(((uint64_t)g_cfg.sensor_max_rpm * level) / full);
+  } else if (g_cfg.control_mode == CONTROL_MODE_TORQUE) {
+    target_current_mA = (int32_t)(((uint64_t)max_current * level) / full);
+  } else {
+    target_pwm_percent = (int)((level * 100u) / full);
+  }
+  if (state == ESC_ARMED && level) g_state = ESC_RUNNING;
+}
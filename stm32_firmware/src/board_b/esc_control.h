@@ -7,6 +7,17 @@ extern "C" {
 
 typedef enum { ESC_BOOT=0, ESC_WAIT_CONFIG, ESC_CONFIG_READY, ESC_ARMED, ESC_RUNNING, ESC_FAULT } esc_state_t;
 
+// Status flags: active derating causes, and the cause of a latched fault
+// (cleared on the next arm)
+#define ESC_FLAG_CURRENT_LIMIT     0x01
+#define ESC_FLAG_TEMP_DERATE       0x02
+#define ESC_FLAG_UNDERVOLTAGE      0x04
+#define ESC_FLAG_FAULT_OVERCURRENT 0x08
+#define ESC_FLAG_FAULT_OVERVOLTAGE 0x10
+#define ESC_FLAG_FAULT_OVERTEMP    0x20
+#define ESC_FLAG_FAULT_DESYNC      0x40
+#define ESC_FLAG_FAULT_OTHER       0x80   // command watchdog, bad control mode
+
 // Initialize controller with parsed config
 void esc_control_init(const esc_config_t* cfg);
 
@@ -18,18 +29,37 @@ void esc_disarm(void);
 void esc_set_speed_rpm(int32_t rpm);
 void esc_set_torque_mA(int32_t milliamp);
 
-// Periodic update to apply control and enforce limits (call from loop)
+// Background supervision: sensors, limits, watchdog and throttle ramp (call from loop)
 void esc_control_update(void);
 
+// Fast control step: commutation and duty output. Runs from the TIM1 update
+// interrupt at the control rate (see driver_set_control_callback).
+void esc_control_step(void);
+
 // Query current state
 esc_state_t esc_control_get_state(void);
 
+// Status flags (ESC_FLAG_*), duty applied by the control step (timer ticks)
+// and the electrical revolution period from halls or BEMF (0 = stopped).
+// Safe to call from interrupts.
+uint8_t esc_control_get_flags(void);
+int16_t esc_control_get_duty(void);
+uint32_t esc_control_erev_period_us(void);
+
+// Copy of the active config. Returns 0 before the first esc_control_init.
+int esc_control_get_config(esc_config_t* out);
+
 // Set PWM duty for open-loop testing (0-100%)
 void esc_set_pwm_percent(int percent);
 
 // Set throttle directly (0-1000 for Pixhawk compatibility, or 0-100%)
 void esc_set_throttle(int throttle_value);
 
+// Digital throttle (DShot steps 0..1999), scaled to the control mode's target:
+// open-loop duty, fraction of max rpm, or fraction of the current limit.
+// Safe to call from interrupts.
+void esc_set_dshot_throttle(uint16_t level);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,259 @@
+#include "esc_protocol.h"
+#include "esc_control.h"
+#include "config_parser.h"
+#include "frame_store.h"
+#include "safety_monitor.h"
+#include "speed_ctrl.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+#include "stm32f4xx_hal.h"
+
+// LEN bounds: CMD + CRC at least, plus at most ESC_PROTO_MAX_PAYLOAD data bytes
+#define ESC_PROTO_LEN_MIN     3u
+#define ESC_PROTO_LEN_MAX     (ESC_PROTO_LEN_MIN + ESC_PROTO_MAX_PAYLOAD)
+// START, LEN_H, LEN_L before the LEN bytes, END after them
+#define ESC_PROTO_OVERHEAD    4u
+
+// A started packet must complete within this time (~40 byte times at 115200)
+#define ESC_PROTO_TIMEOUT_MS  20u
+
+// SET_CONFIG / GET_CONFIG payload: five big-endian 16-bit fields
+#define ESC_PROTO_CONFIG_LEN  10u
+
+static const uint16_t crc16_table[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+static uint32_t packets = 0;
+static uint32_t errors = 0;
+
+// Incomplete packet at the head of the ring since wait_since_ms
+static int waiting = 0;
+static uint32_t wait_since_ms = 0;
+
+static uint16_t crc16_update(uint16_t crc, uint8_t b) {
+  return (uint16_t)((crc << 8) ^ crc16_table[(uint8_t)(crc >> 8) ^ b]);
+}
+
+static uint16_t peek_be16(size_t offset) {
+  return (uint16_t)(uart_rx_peek(offset) << 8 | uart_rx_peek(offset + 1));
+}
+
+static void put_be16(uint8_t* p, uint32_t v) {
+  if (v > 0xFFFF) v = 0xFFFF;
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+// Frame and queue one reply packet
+static void send_packet(uint8_t cmd, const uint8_t* data, size_t len) {
+  uint8_t pkt[ESC_PROTO_OVERHEAD + ESC_PROTO_LEN_MAX];
+  size_t n = 0;
+  uint16_t crc = crc16_update(0xFFFF, cmd);
+
+  pkt[n++] = ESC_PROTO_START;
+  pkt[n++] = 0;
+  pkt[n++] = (uint8_t)(len + ESC_PROTO_LEN_MIN);
+  pkt[n++] = cmd;
+  for (size_t i = 0; i < len; ++i) {
+    pkt[n++] = data[i];
+    crc = crc16_update(crc, data[i]);
+  }
+  pkt[n++] = (uint8_t)(crc >> 8);
+  pkt[n++] = (uint8_t)crc;
+  pkt[n++] = ESC_PROTO_END;
+  uart_tx_write(pkt, n);
+}
+
+static void send_ack(uint8_t cmd) {
+  const uint8_t ok = 0;
+  send_packet(cmd, &ok, 1);
+}
+
+static void send_nack(uint8_t cmd, uint8_t err) {
+  const uint8_t data[2] = {cmd, err};
+  errors++;
+  send_packet(ESC_PROTO_CMD_NACK, data, sizeof(data));
+}
+
+// Undervoltage threshold in effect (see esc_control_init)
+static uint32_t cutoff_mv(const esc_config_t* cfg) {
+  return cfg->voltage_cutoff_mv ? cfg->voltage_cutoff_mv : cfg->battery_voltage_mv * 7 / 10;
+}
+
+// maxRPM, currentLimit (A), pwmFreq (Hz), tempLimit (C), voltageCutoff (10 mV)
+static void handle_get_config(void) {
+  esc_config_t cfg;
+  if (!esc_control_get_config(&cfg)) {
+    send_nack(ESC_PROTO_CMD_GET_CONFIG, ESC_PROTO_ERR_NO_CONFIG);
+    return;
+  }
+  uint8_t data[ESC_PROTO_CONFIG_LEN];
+  put_be16(&data[0], cfg.sensor_max_rpm);
+  put_be16(&data[2], cfg.current_limit / 1000u);
+  put_be16(&data[4], (uint32_t)cfg.pwm_frequency_khz * 1000u);
+  put_be16(&data[6], cfg.max_temp);
+  put_be16(&data[8], cutoff_mv(&cfg) / 10u);
+  send_packet(ESC_PROTO_CMD_GET_CONFIG, data, sizeof(data));
+}
+
+// Same fields as GET_CONFIG, read straight from the ring (payload at offset 4)
+static void handle_set_config(size_t data_len) {
+  esc_config_t cfg;
+  esc_state_t state = esc_control_get_state();
+  if (data_len < ESC_PROTO_CONFIG_LEN) {
+    send_nack(ESC_PROTO_CMD_SET_CONFIG, ESC_PROTO_ERR_LENGTH);
+    return;
+  }
+  // re-init would drop a latched fault, and must not happen under power
+  if (state == ESC_ARMED || state == ESC_RUNNING || state == ESC_FAULT) {
+    send_nack(ESC_PROTO_CMD_SET_CONFIG, ESC_PROTO_ERR_BUSY);
+    return;
+  }
+  if (!esc_control_get_config(&cfg)) {
+    send_nack(ESC_PROTO_CMD_SET_CONFIG, ESC_PROTO_ERR_NO_CONFIG);
+    return;
+  }
+
+  cfg.sensor_max_rpm = peek_be16(4);
+  cfg.current_limit = (uint32_t)peek_be16(6) * 1000u;
+  cfg.pwm_frequency_khz = (uint16_t)(peek_be16(8) / 1000u);
+  cfg.max_temp = peek_be16(10);
+  cfg.voltage_cutoff_mv = (uint16_t)(peek_be16(12) * 10u);
+  if (cfg.pwm_frequency_khz == 0) cfg.pwm_frequency_khz = 20;  // as parse_esc_config
+
+  esc_control_init(&cfg);
+  send_ack(ESC_PROTO_CMD_SET_CONFIG);
+}
+
+// Persist the active config as a stored frame (reloaded at boot)
+static void handle_save_flash(void) {
+  esc_config_t cfg;
+  uint8_t frame[ESC_CONFIG_FRAME_LEN_V4];
+  esc_state_t state = esc_control_get_state();
+  // the sector erase stalls the CPU (control step and trip interrupts
+  // included) for most of a second, so never with the bridge live
+  if (state == ESC_ARMED || state == ESC_RUNNING || state == ESC_FAULT) {
+    send_nack(ESC_PROTO_CMD_SAVE_FLASH, ESC_PROTO_ERR_BUSY);
+    return;
+  }
+  if (!esc_control_get_config(&cfg)) {
+    send_nack(ESC_PROTO_CMD_SAVE_FLASH, ESC_PROTO_ERR_NO_CONFIG);
+    return;
+  }
+  size_t len = build_esc_config_frame(&cfg, frame, sizeof(frame));
+  if (!len || !frame_store_save(frame, len)) {
+    send_nack(ESC_PROTO_CMD_SAVE_FLASH, ESC_PROTO_ERR_FLASH);
+    return;
+  }
+  send_ack(ESC_PROTO_CMD_SAVE_FLASH);
+}
+
+// voltage (10 mV), current (100 mA), rpm, temperature (C), ESC state
+static void handle_get_status(void) {
+  uint8_t data[8];
+  int32_t current_mA = safety_get_motor_current_mA();
+  int32_t rpm = speed_ctrl_measured_rpm();
+  uint16_t temp_c = safety_get_temperature_c();
+
+  put_be16(&data[0], safety_get_vbus_mV() / 10u);
+  put_be16(&data[2], (uint32_t)(current_mA > 0 ? current_mA : 0) / 100u);
+  put_be16(&data[4], (uint32_t)(rpm >= 0 ? rpm : -rpm));
+  data[6] = (uint8_t)(temp_c > 255 ? 255 : temp_c);
+  data[7] = (uint8_t)esc_control_get_state();
+  send_packet(ESC_PROTO_CMD_GET_STATUS, data, sizeof(data));
+}
+
+// Incomplete packet at the head: wait for the rest, up to ESC_PROTO_TIMEOUT_MS
+static esc_proto_result_t wait_for_rest(void) {
+  if (!waiting) {
+    waiting = 1;
+    wait_since_ms = HAL_GetTick();
+    return ESC_PROTO_WAIT;
+  }
+  if (HAL_GetTick() - wait_since_ms < ESC_PROTO_TIMEOUT_MS) return ESC_PROTO_WAIT;
+  // truncated packet: give the bytes to the text parsers
+  waiting = 0;
+  errors++;
+  return ESC_PROTO_NONE;
+}
+
+esc_proto_result_t esc_protocol_poll(void) {
+  size_t avail = uart_rx_available();
+  if (avail == 0 || uart_rx_peek(0) != ESC_PROTO_START) {
+    waiting = 0;
+    return ESC_PROTO_NONE;
+  }
+
+  // LEN must be known before anything else can be said about the packet
+  if (avail < 3) return wait_for_rest();
+  size_t len = ((size_t)uart_rx_peek(1) << 8) | uart_rx_peek(2);
+  if (len < ESC_PROTO_LEN_MIN || len > ESC_PROTO_LEN_MAX) {
+    // config frame (AA 55) or stray byte: not ours
+    waiting = 0;
+    return ESC_PROTO_NONE;
+  }
+  size_t total = len + ESC_PROTO_OVERHEAD;
+  if (avail < total) return wait_for_rest();
+  waiting = 0;
+
+  // CMD at offset 3, DATA from offset 4, CRC after DATA, END last
+  uint8_t cmd = uart_rx_peek(3);
+  size_t data_len = len - ESC_PROTO_LEN_MIN;
+  if (uart_rx_peek(total - 1) != ESC_PROTO_END) {
+    // leave the bytes to the text parsers; the next 0xAA is tried again
+    send_nack(cmd, ESC_PROTO_ERR_FRAMING);
+    return ESC_PROTO_NONE;
+  }
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i <= data_len; ++i) crc = crc16_update(crc, uart_rx_peek(3 + i));
+  if (crc != peek_be16(4 + data_len)) {
+    send_nack(cmd, ESC_PROTO_ERR_CRC);
+    return ESC_PROTO_NONE;
+  }
+
+  packets++;
+  switch (cmd) {
+    case ESC_PROTO_CMD_GET_CONFIG: handle_get_config(); break;
+    case ESC_PROTO_CMD_SET_CONFIG: handle_set_config(data_len); break;
+    case ESC_PROTO_CMD_SAVE_FLASH: handle_save_flash(); break;
+    case ESC_PROTO_CMD_GET_STATUS: handle_get_status(); break;
+    default: send_nack(cmd, ESC_PROTO_ERR_COMMAND); break;
+  }
+  uart_rx_skip(total);
+  return ESC_PROTO_HANDLED;
+}
+
+uint32_t esc_protocol_packets(void) { return packets; }
+uint32_t esc_protocol_errors(void) { return errors; }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary command protocol of the backend (backend_node/core/escProtocol.js):
+//   [0xAA][LEN_H][LEN_L][CMD][DATA...][CRC_H][CRC_L][0x55]
+// LEN counts CMD, DATA and the CRC; the CRC16-CCITT (poly 0x1021, init
+// 0xFFFF) covers CMD and DATA. Replies use the same framing and command.
+//
+// Packets are parsed in place at the head of the UART4 receive ring and only
+// consumed once complete. A stored config frame also starts with 0xAA but is
+// followed by 0x55, which is never a valid LEN_H here.
+#define ESC_PROTO_START       0xAA
+#define ESC_PROTO_END         0x55
+#define ESC_PROTO_MAX_PAYLOAD 32    // DATA bytes accepted per packet
+
+enum {
+  ESC_PROTO_CMD_GET_CONFIG = 0x01,
+  ESC_PROTO_CMD_SET_CONFIG = 0x02,
+  ESC_PROTO_CMD_SAVE_FLASH = 0x03,
+  ESC_PROTO_CMD_GET_STATUS = 0x04,
+  ESC_PROTO_CMD_NACK       = 0x7F   // reply: DATA = [cmd, error]
+};
+
+// NACK error codes
+enum {
+  ESC_PROTO_ERR_CRC = 1,
+  ESC_PROTO_ERR_FRAMING,
+  ESC_PROTO_ERR_LENGTH,
+  ESC_PROTO_ERR_COMMAND,
+  ESC_PROTO_ERR_BUSY,       // config change or flash save while armed, running or faulted
+  ESC_PROTO_ERR_NO_CONFIG,
+  ESC_PROTO_ERR_FLASH
+};
+
+// esc_protocol_poll results
+typedef enum {
+  ESC_PROTO_NONE = 0,  // head of the ring is not a packet: hand it to the text parsers
+  ESC_PROTO_WAIT,      // packet incomplete, leave the ring alone for now
+  ESC_PROTO_HANDLED    // a packet was consumed and answered
+} esc_proto_result_t;
+
+// Look at the head of the receive ring and handle at most one packet
+esc_proto_result_t esc_protocol_poll(void);
+
+// Counters since boot
+uint32_t esc_protocol_packets(void);
+uint32_t esc_protocol_errors(void);
+
+#ifdef __cplusplus
+}
+#endif
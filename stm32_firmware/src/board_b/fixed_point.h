@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed-point helpers for the control path. Q15 holds [-1, 1) in int16,
+// Q31 holds [-1, 1) in int32, and Q16 unit scales (e.g. mV per ADC count)
+// hold a 16.16 multiplier. Products widen to 32/64 bits so the M4 uses
+// single-cycle MUL/SMULL, then shift back; no divides on the sample path.
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+#define Q15_ONE 32767
+#define Q15_SHIFT 15
+#define Q31_SHIFT 31
+#define Q16_SHIFT 16
+
+// Compile/init-time conversion from a float constant (do not use per sample)
+#define Q15_FROM_FLOAT(x) ((q15_t)((x) >= 1.0f ? Q15_ONE : (x) <= -1.0f ? -32768 : (int32_t)((x) * 32768.0f)))
+#define Q16_FROM_FLOAT(x) ((int32_t)((x) * 65536.0f + 0.5f))
+
+static inline q15_t q15_sat(int32_t x) {
+  if (x > Q15_ONE) return Q15_ONE;
+  if (x < -32768) return -32768;
+  return (q15_t)x;
+}
+
+static inline q15_t q15_mul(q15_t a, q15_t b) {
+  return (q15_t)(((int32_t)a * b) >> Q15_SHIFT);
+}
+
+static inline q31_t q31_mul(q31_t a, q31_t b) {
+  return (q31_t)(((int64_t)a * b) >> Q31_SHIFT);
+}
+
+// Scale an integer quantity by a Q15 factor
+static inline int32_t q15_scale(int32_t x, q15_t k) {
+  return (int32_t)(((int64_t)x * k) >> Q15_SHIFT);
+}
+
+// Apply a Q16.16 unit scale, rounded to nearest
+static inline int32_t q16_apply(int32_t x, int32_t scale_q16) {
+  return (int32_t)(((int64_t)x * scale_q16 + (1 << (Q16_SHIFT - 1))) >> Q16_SHIFT);
+}
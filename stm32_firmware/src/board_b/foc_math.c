@@ -0,0 +1,144 @@
+#include "foc_math.h"
+
+#define Q15_INV_SQRT3 18919    // 1/sqrt(3)
+#define Q15_SQRT3_HALF 28378   // sqrt(3)/2
+
+// One period of sin() in Q15; entry 256 repeats entry 0 for interpolation
+static const int16_t sin_table[257] = {
+  0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739,
+  9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811,
+  25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+  30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+  32609, 32678, 32728, 32757, 32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+  32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571, 30273, 29956, 29621, 29268,
+  28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+  23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868, 18204, 17530, 16846, 16151,
+  15446, 14732, 14010, 13279, 12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+  6393, 5602, 4808, 4011, 3212, 2410, 1608, 804, 0, -804, -1608, -2410,
+  -3212, -4011, -4808, -5602, -6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+  -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530, -18204, -18868, -19519, -20159,
+  -20787, -21403, -22005, -22594, -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+  -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956, -30273, -30571, -30852, -31113,
+  -31356, -31580, -31785, -31971, -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+  -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285, -32137, -31971, -31785, -31580,
+  -31356, -31113, -30852, -30571, -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+  -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731, -23170, -22594, -22005, -21403,
+  -20787, -20159, -19519, -18868, -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+  -12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179, -6393, -5602, -4808, -4011,
+  -3212, -2410, -1608, -804, 0
+};
+
+static q15_t sin_lookup(foc_angle_t angle) {
+  uint32_t idx = angle >> 8;
+  int32_t frac = angle & 0xFF;
+  int32_t a = sin_table[idx];
+  int32_t b = sin_table[idx + 1];
+  return (q15_t)(a + (((b - a) * frac) >> 8));
+}
+
+void foc_sin_cos(foc_angle_t angle, q15_t* s, q15_t* c) {
+  *s = sin_lookup(angle);
+  *c = sin_lookup((foc_angle_t)(angle + 16384));
+}
+
+void foc_clarke(int32_t ia, int32_t ib, int32_t* alpha, int32_t* beta) {
+  *alpha = ia;
+  *beta = (int32_t)(((int64_t)(ia + 2 * ib) * Q15_INV_SQRT3) >> Q15_SHIFT);
+}
+
+void foc_inv_clarke(int32_t alpha, int32_t beta, int32_t v[3]) {
+  int32_t sb = (beta * Q15_SQRT3_HALF) >> Q15_SHIFT;
+  v[0] = alpha;
+  v[1] = -alpha / 2 + sb;
+  v[2] = -alpha / 2 - sb;
+}
+
+void foc_park(int32_t alpha, int32_t beta, q15_t s, q15_t c, int32_t* d, int32_t* q) {
+  *d = (int32_t)(((int64_t)alpha * c + (int64_t)beta * s) >> Q15_SHIFT);
+  *q = (int32_t)(((int64_t)beta * c - (int64_t)alpha * s) >> Q15_SHIFT);
+}
+
+void foc_inv_park(int32_t d, int32_t q, q15_t s, q15_t c, int32_t* alpha, int32_t* beta) {
+  *alpha = (int32_t)(((int64_t)d * c - (int64_t)q * s) >> Q15_SHIFT);
+  *beta = (int32_t)(((int64_t)d * s + (int64_t)q * c) >> Q15_SHIFT);
+}
+
+uint32_t foc_isqrt(uint32_t x) {
+  uint32_t res = 0;
+  uint32_t bit = 1u << 30;
+  while (bit > x) bit >>= 2;
+  while (bit) {
+    if (x >= res + bit) {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return res;
+}
+
+void foc_limit_circle(int32_t* d, int32_t* q, int32_t limit) {
+  if (*d > limit) *d = limit;
+  if (*d < -limit) *d = -limit;
+  uint32_t q_max = foc_isqrt((uint32_t)(limit * limit) - (uint32_t)(*d * *d));
+  if (*q > (int32_t)q_max) *q = (int32_t)q_max;
+  if (*q < -(int32_t)q_max) *q = -(int32_t)q_max;
+}
+
+void foc_svpwm(int32_t alpha, int32_t beta, uint16_t period, uint16_t ccr[3]) {
+  // inverse Clarke to phase voltages
+  int32_t v[3];
+  foc_inv_clarke(alpha, beta, v);
+
+  // centre the three references between the rails (equivalent to SVPWM)
+  int32_t vmax = v[0], vmin = v[0];
+  for (int i = 1; i < 3; ++i) {
+    if (v[i] > vmax) vmax = v[i];
+    if (v[i] < vmin) vmin = v[i];
+  }
+  int32_t offset = -(vmax + vmin) / 2;
+
+  // Q15_ONE is Vbus/sqrt(3): scale to ticks of a full period
+  int32_t ticks_per_unit = ((int32_t)period * Q15_INV_SQRT3) >> Q15_SHIFT;
+  for (int i = 0; i < 3; ++i) {
+    int32_t t = (int32_t)period / 2 + (((v[i] + offset) * ticks_per_unit) >> Q15_SHIFT);
+    if (t < 0) t = 0;
+    if (t > (int32_t)period) t = period;
+    ccr[i] = (uint16_t)t;
+  }
+}
+
+void foc_pi_init(foc_pi_t* pi, int32_t kp_q16, int32_t ki_q16, int32_t out_min, int32_t out_max) {
+  pi->kp_q16 = kp_q16;
+  pi->ki_q16 = ki_q16;
+  pi->out_min = out_min;
+  pi->out_max = out_max;
+  pi->integ = 0;
+}
+
+void foc_pi_reset(foc_pi_t* pi) {
+  pi->integ = 0;
+}
+
+int32_t foc_pi_run(foc_pi_t* pi, int32_t err) {
+  int64_t p = (int64_t)err * pi->kp_q16;
+  int64_t lo = (int64_t)pi->out_min << Q16_SHIFT;
+  int64_t hi = (int64_t)pi->out_max << Q16_SHIFT;
+
+  // integrate only while that does not push further into saturation
+  int64_t next = pi->integ + (int64_t)err * pi->ki_q16;
+  int64_t out = p + next;
+  if (!((out > hi && err > 0) || (out < lo && err < 0))) {
+    pi->integ = next;
+  }
+  if (pi->integ > hi) pi->integ = hi;
+  if (pi->integ < lo) pi->integ = lo;
+
+  out = (p + pi->integ) >> Q16_SHIFT;
+  if (out > pi->out_max) out = pi->out_max;
+  if (out < pi->out_min) out = pi->out_min;
+  return (int32_t)out;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Field-oriented control building blocks, all integer. Currents are in mA;
+// voltages are Q15 fractions of the largest linear SVPWM amplitude
+// (Vbus / sqrt(3)), so Q15_ONE is full modulation whatever the bus voltage.
+
+// Electrical angle, one full turn = 65536
+typedef uint16_t foc_angle_t;
+#define FOC_ANGLE_FROM_DEG(d) ((foc_angle_t)(((int32_t)(d) * 65536 / 360) & 0xFFFF))
+
+// Sine/cosine (Q15) from a 256-entry table with linear interpolation
+void foc_sin_cos(foc_angle_t angle, q15_t* s, q15_t* c);
+
+// Clarke: two phase currents (third = -(a + b)) to alpha/beta, and back to
+// all three phases
+void foc_clarke(int32_t ia, int32_t ib, int32_t* alpha, int32_t* beta);
+void foc_inv_clarke(int32_t alpha, int32_t beta, int32_t v[3]);
+
+// Park: alpha/beta to the rotor d/q frame, and back
+void foc_park(int32_t alpha, int32_t beta, q15_t s, q15_t c, int32_t* d, int32_t* q);
+void foc_inv_park(int32_t d, int32_t q, q15_t s, q15_t c, int32_t* alpha, int32_t* beta);
+
+// Keep |(d, q)| <= limit, giving d priority (it holds the field angle)
+void foc_limit_circle(int32_t* d, int32_t* q, int32_t limit);
+
+// Space-vector PWM (min/max zero-sequence injection): alpha/beta voltage to
+// three compare values on [0, period]
+void foc_svpwm(int32_t alpha, int32_t beta, uint16_t period, uint16_t ccr[3]);
+
+uint32_t foc_isqrt(uint32_t x);
+
+// PI controller with clamped output and conditional-integration anti-windup.
+// Gains are Q16: output units per input unit (ki is per call).
+typedef struct {
+  int32_t kp_q16;
+  int32_t ki_q16;
+  int64_t integ;  // output units << 16
+  int32_t out_min;
+  int32_t out_max;
+} foc_pi_t;
+
+void foc_pi_init(foc_pi_t* pi, int32_t kp_q16, int32_t ki_q16, int32_t out_min, int32_t out_max);
+void foc_pi_reset(foc_pi_t* pi);
+int32_t foc_pi_run(foc_pi_t* pi, int32_t err);
+
+#ifdef __cplusplus
+}
+#endif
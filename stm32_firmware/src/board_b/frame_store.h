@@ -2,8 +2,32 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Access stored frame (copied). Returns number of bytes written to buf (0 if none).
 size_t frame_store_get(uint8_t* buf, size_t maxlen);
 
 // Return whether a stored frame exists
 int frame_store_has(void);
+
+// Write a frame to flash and make it the stored frame. Returns 1 on success.
+int frame_store_save(const uint8_t* data, size_t len);
+
+// Sensor calibration, kept in the config sector beside the frame
+typedef struct {
+  uint16_t shunt_offset_raw;  // zero-current shunt ADC count
+  uint16_t reserved;
+  int32_t vbus_gain_q16;      // VBUS scale correction, Q16.16 (65536 = none)
+} frame_store_cal_t;
+
+// Last stored calibration. Returns 0 if none.
+int frame_store_get_cal(frame_store_cal_t* cal);
+
+// Store a calibration without erasing (the frame is kept). Returns 1 on success.
+int frame_store_save_cal(const frame_store_cal_t* cal);
+
+#ifdef __cplusplus
+}
+#endif
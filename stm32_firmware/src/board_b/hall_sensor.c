@@ -1,45 +1,87 @@
 #include "hall_sensor.h"
+#include "timebase.h"
 #include "stm32f4xx_hal.h"
 
-// Hall sensor pins: PC0, PC1, PC2
+// Hall sensor pins: PC0, PC1, PC2 (EXTI lines 0-2)
 #define HALL_PORT GPIOC
 #define HALL_U_PIN GPIO_PIN_0
 #define HALL_V_PIN GPIO_PIN_1
 #define HALL_W_PIN GPIO_PIN_2
+#define HALL_PIN_MASK (HALL_U_PIN | HALL_V_PIN | HALL_W_PIN)
 
-static hall_callback_t user_callback = NULL;
-static uint8_t last_hall_state = 0;
+// No edge for this long means the rotor is considered stopped
+#define HALL_STALL_US 100000u
+
+static volatile hall_callback_t user_callback = NULL;
+static volatile uint8_t last_hall_state = 0;
+
+// Edge capture state (written by the EXTI handler only)
+static volatile uint32_t edge_count = 0;
+static volatile uint32_t last_edge_us = 0;
+static volatile uint32_t edge_intervals[HALL_EDGE_RING];
+static volatile uint32_t edge_head = 0;  // next slot to write
 
 void hall_sensor_init(void) {
   __HAL_RCC_GPIOC_CLK_ENABLE();
+  timebase_init();
   
   GPIO_InitTypeDef gpio = {0};
-  gpio.Pin = HALL_U_PIN | HALL_V_PIN | HALL_W_PIN;
-  gpio.Mode = GPIO_MODE_INPUT;
+  gpio.Pin = HALL_PIN_MASK;
+  gpio.Mode = GPIO_MODE_IT_RISING_FALLING;
   gpio.Pull = GPIO_PULLUP;
   gpio.Speed = GPIO_SPEED_FREQ_HIGH;
   
   HAL_GPIO_Init(HALL_PORT, &gpio);
   
   last_hall_state = hall_sensor_read();
+  last_edge_us = timebase_micros();
+
+  // Same priority as the TIM1 control tick: the two never preempt each other
+  // while writing the commutation outputs
+  HAL_NVIC_SetPriority(EXTI0_IRQn, 1, 0);
+  HAL_NVIC_SetPriority(EXTI1_IRQn, 1, 0);
+  HAL_NVIC_SetPriority(EXTI2_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(EXTI0_IRQn);
+  HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+  HAL_NVIC_EnableIRQ(EXTI2_IRQn);
 }
 
 uint8_t hall_sensor_read(void) {
-  uint8_t state = 0;
-  
-  if (HAL_GPIO_ReadPin(HALL_PORT, HALL_U_PIN) == GPIO_PIN_SET) state |= 0x01;
-  if (HAL_GPIO_ReadPin(HALL_PORT, HALL_V_PIN) == GPIO_PIN_SET) state |= 0x02;
-  if (HAL_GPIO_ReadPin(HALL_PORT, HALL_W_PIN) == GPIO_PIN_SET) state |= 0x04;
-  
-  // Check for state change and call callback
-  if (state != last_hall_state) {
-    last_hall_state = state;
-    if (user_callback) {
-      user_callback(state);
-    }
-  }
-  
-  return state;
+  // PC0..PC2 map directly onto bits 0..2
+  return (uint8_t)(HALL_PORT->IDR & HALL_PIN_MASK);
+}
+
+// Common edge handler: timestamp, record the interval and commutate
+static void hall_edge_isr(void) {
+  uint32_t now = timebase_micros();
+  uint8_t state = hall_sensor_read();
+  if (state == last_hall_state) return;  // glitch, or both edges of one line
+  last_hall_state = state;
+  if (state == 0x0 || state == 0x7) return;  // invalid pattern, no timing
+
+  uint32_t head = edge_head;
+  edge_intervals[head] = now - last_edge_us;
+  edge_head = (head + 1) % HALL_EDGE_RING;
+  last_edge_us = now;
+  edge_count++;
+
+  hall_callback_t cb = user_callback;
+  if (cb) cb(state);
+}
+
+void EXTI0_IRQHandler(void) {
+  EXTI->PR = HALL_U_PIN;
+  hall_edge_isr();
+}
+
+void EXTI1_IRQHandler(void) {
+  EXTI->PR = HALL_V_PIN;
+  hall_edge_isr();
+}
+
+void EXTI2_IRQHandler(void) {
+  EXTI->PR = HALL_W_PIN;
+  hall_edge_isr();
 }
 
 const char* hall_sensor_state_name(uint8_t state) {
@@ -58,3 +100,34 @@ const char* hall_sensor_state_name(uint8_t state) {
 void hall_sensor_set_callback(hall_callback_t cb) {
   user_callback = cb;
 }
+
+uint32_t hall_sensor_edge_count(void) { return edge_count; }
+uint32_t hall_sensor_last_edge_us(void) { return last_edge_us; }
+
+uint32_t hall_sensor_get_intervals(uint32_t* out, uint32_t n) {
+  if (!out) return 0;
+  uint32_t avail = edge_count < HALL_EDGE_RING ? edge_count : HALL_EDGE_RING;
+  if (n > avail) n = avail;
+  // snapshot with the edge interrupt masked so the ring is consistent
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t idx = edge_head;
+  for (uint32_t i = 0; i < n; ++i) {
+    idx = (idx + HALL_EDGE_RING - 1) % HALL_EDGE_RING;
+    out[i] = edge_intervals[idx];
+  }
+  __set_PRIMASK(primask);
+  return n;
+}
+
+uint32_t hall_sensor_erev_period_us(void) {
+  uint32_t iv[6];
+  if (hall_sensor_get_intervals(iv, 6) < 6) return 0;
+  if (timebase_micros() - last_edge_us > HALL_STALL_US) return 0;
+  uint32_t sum = 0;
+  for (int i = 0; i < 6; ++i) {
+    if (iv[i] > HALL_STALL_US) return 0;  // spans a standstill
+    sum += iv[i];
+  }
+  return sum;
+}
@@ -6,7 +6,11 @@
 extern "C" {
 #endif
 
-// Initialize Hall sensor inputs on PC0, PC1, PC2
+// Number of recent edge intervals kept by the capture engine
+#define HALL_EDGE_RING 16
+
+// Initialize Hall sensor inputs on PC0, PC1, PC2. Every edge raises an EXTI
+// interrupt that timestamps it (1 us, see timebase.h) and fires the callback.
 void hall_sensor_init(void);
 
 // Read current Hall sensor state (0-7, representing the 3 bits)
@@ -18,10 +22,23 @@ uint8_t hall_sensor_read(void);
 // Get human-readable Hall state name
 const char* hall_sensor_state_name(uint8_t state);
 
-// Register callback for Hall state change (optional)
+// Register callback for Hall state change. Called from the EXTI interrupt
+// as soon as a new valid state is captured.
 typedef void (*hall_callback_t)(uint8_t new_state);
 void hall_sensor_set_callback(hall_callback_t cb);
 
+// Edge timing
+uint32_t hall_sensor_edge_count(void);    // valid state changes since init
+uint32_t hall_sensor_last_edge_us(void);  // timestamp of the latest edge
+
+// Copy up to n of the most recent edge intervals (us), newest first.
+// Returns the number copied.
+uint32_t hall_sensor_get_intervals(uint32_t* out, uint32_t n);
+
+// Duration of the last electrical revolution (sum of the last 6 intervals)
+// in us, or 0 when fewer than 6 edges were seen or the rotor has stalled
+uint32_t hall_sensor_erev_period_us(void);
+
 #ifdef __cplusplus
 }
 #endif
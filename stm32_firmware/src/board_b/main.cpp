@@ -1,17 +1,31 @@
 #include <Arduino.h>
 #include <vector>
+#include <algorithm>
 #include "stm32f4xx.h"
 #include "stm32f4xx_hal.h"
 #include "config_parser.h"
+#include "frame_store.h"
 #include "esc_control.h"
 #include "safety_monitor.h"
 #include "uart_commands.h"
 #include "driver_tim1.h"
 #include "hall_sensor.h"
 #include "safety_params.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+#include "dshot.h"
+#include "esc_protocol.h"
+#include "telemetry.h"
+#include "blackbox.h"
+#include "prof.h"
 
 UART_HandleTypeDef huart4;
 
+// UART4 TX DMA (DMA1 Stream4 Channel4) drains the shared transmit queue
+extern "C" void DMA1_Stream4_IRQHandler(void) {
+  uart_tx_dma_irq();
+}
+
 // Buffer and state for receiving frames over UART4
 static std::vector<uint8_t> frame_buf;
 static bool in_frame = false;
@@ -37,7 +51,15 @@ extern "C" int frame_store_has(void) {
 // Flash storage configuration (same approach used by board_a)
 #define FLASH_STORAGE_BASE 0x08060000UL
 #define FLASH_MAGIC 0xDEADBEEFUL
-#define FLASH_MAX_BYTES (128 * 1024)
+#define FLASH_MAX_BYTES (64 * 1024)
+
+// The upper half of sector 7 is a log of calibration records, appended into
+// the erased space so a calibration never erases the sector; the last
+// record wins. A frame save erases the sector and rewrites the latest one.
+#define FLASH_CAL_BASE (FLASH_STORAGE_BASE + FLASH_MAX_BYTES)
+#define FLASH_CAL_END (FLASH_STORAGE_BASE + 128 * 1024)
+#define FLASH_CAL_MAGIC 0xCA1B0001UL
+#define FLASH_CAL_WORDS 4   // magic, offset, gain, check
 
 static bool flash_erase_sector7() {
   HAL_FLASH_Unlock();
@@ -91,6 +113,74 @@ static bool flash_read_bytes(std::vector<uint8_t>& out) {
   return true;
 }
 
+static uint32_t flash_cal_check(const uint32_t* w) {
+  return ~(w[0] ^ w[1] ^ w[2]);
+}
+
+// Address of the latest valid calibration record (0 if none) and of the
+// first blank slot after it (FLASH_CAL_END if the log is full)
+static uint32_t flash_find_cal(uint32_t* next) {
+  uint32_t found = 0;
+  uint32_t addr = FLASH_CAL_BASE;
+  for (; addr < FLASH_CAL_END; addr += FLASH_CAL_WORDS * 4) {
+    const uint32_t* w = (const uint32_t*)addr;
+    if (w[0] == 0xFFFFFFFFUL) break;
+    if (w[0] == FLASH_CAL_MAGIC && w[3] == flash_cal_check(w)) found = addr;
+  }
+  if (next) *next = addr;
+  return found;
+}
+
+static bool flash_append_cal(const frame_store_cal_t* cal) {
+  uint32_t addr;
+  flash_find_cal(&addr);
+  if (addr >= FLASH_CAL_END) return false;  // full until the next frame save
+  uint32_t w[FLASH_CAL_WORDS];
+  w[0] = FLASH_CAL_MAGIC;
+  w[1] = cal->shunt_offset_raw;
+  w[2] = (uint32_t)cal->vbus_gain_q16;
+  w[3] = flash_cal_check(w);
+  HAL_FLASH_Unlock();
+  for (uint32_t i = 0; i < FLASH_CAL_WORDS; ++i) {
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + 4 * i, w[i]) != HAL_OK) {
+      HAL_FLASH_Lock();
+      return false;
+    }
+  }
+  HAL_FLASH_Lock();
+  return true;
+}
+
+extern "C" int frame_store_get_cal(frame_store_cal_t* cal) {
+  uint32_t addr = flash_find_cal(NULL);
+  if (!addr) return 0;
+  const uint32_t* w = (const uint32_t*)addr;
+  cal->shunt_offset_raw = (uint16_t)w[1];
+  cal->reserved = 0;
+  cal->vbus_gain_q16 = (int32_t)w[2];
+  return 1;
+}
+
+extern "C" int frame_store_save_cal(const frame_store_cal_t* cal) {
+  return flash_append_cal(cal) ? 1 : 0;
+}
+
+// Persist a frame and make it the stored frame (config frames and the
+// binary protocol's SAVE_FLASH). Skips the erase when nothing changed.
+extern "C" int frame_store_save(const uint8_t* data, size_t len) {
+  if (has_stored && stored_data.size() == len &&
+      std::equal(stored_data.begin(), stored_data.end(), data)) {
+    return 1;
+  }
+  frame_store_cal_t cal;
+  int has_cal = frame_store_get_cal(&cal);
+  if (!flash_write_bytes(data, (uint32_t)len)) return 0;
+  if (has_cal) flash_append_cal(&cal);
+  stored_data.assign(data, data + len);
+  has_stored = true;
+  return 1;
+}
+
 // Initialize UART4 (PC10 TX, PC11 RX)
 void initUART4() {
   __HAL_RCC_GPIOC_CLK_ENABLE();
@@ -124,7 +214,8 @@ void initUART4() {
   huart4.Init.OverSampling = UART_OVERSAMPLING_16;
   
   if (HAL_UART_Init(&huart4) == HAL_OK) {
-    HAL_UART_Transmit(&huart4, (uint8_t*)"UART4 Ready!\r\n", 14, 100);
+    uart_tx_init(&huart4, DMA1_Stream4, DMA_CHANNEL_4, DMA1_Stream4_IRQn);
+    uart_tx_puts("UART4 Ready!\r\n");
   }
 }
 
@@ -137,15 +228,13 @@ void print_hex(const uint8_t* buf, size_t len) {
     s[0] = hex[(buf[i] >> 4) & 0xF];
     s[1] = hex[buf[i] & 0xF];
     s[2] = ' ';
-    HAL_UART_Transmit(&huart4, (uint8_t*)s, 3, 50);
+    uart_tx_write(s, 3);
   }
-  HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n", 2, 50);
+  uart_tx_puts("\r\n");
 }
 
 // Handle received bytes and detect frames
-void handle_received_byte(uint8_t b) {
-  rx_count++;
-  
+static void handle_received_byte(uint8_t b) {
   if (!in_frame) {
     if (b == 0xAA) {
       in_frame = true;
@@ -154,31 +243,20 @@ void handle_received_byte(uint8_t b) {
     }
   } else {
     frame_buf.push_back(b);
-    const size_t EXPECTED_FRAME_LEN = 29;
     
     if (frame_buf.size() >= 2) {
       if (frame_buf[0] != 0xAA || frame_buf[1] != 0x55) {
         in_frame = false;
         frame_buf.clear();
-      } else if (frame_buf.size() >= EXPECTED_FRAME_LEN) {
-          bool need_store = true;
-          if (has_stored && stored_data.size() == frame_buf.size()) {
-            bool same = true;
-            for (size_t i = 0; i < frame_buf.size(); ++i) {
-              if (stored_data[i] != frame_buf[i]) { same = false; break; }
-            }
-            if (same) need_store = false;
-          }
-
-          if (need_store) {
+      } else if (frame_buf.size() >= 3 && frame_buf.size() >= esc_config_frame_len(frame_buf[2])) {
+          bool unchanged = has_stored && stored_data == frame_buf;
+          if (!unchanged) {
             // attempt to persist to flash
-            if (flash_write_bytes(frame_buf.data(), (uint32_t)frame_buf.size())) {
-              stored_data = frame_buf;
-              has_stored = true;
+            if (frame_store_save(frame_buf.data(), frame_buf.size())) {
               // minimal confirmation only
-              HAL_UART_Transmit(&huart4, (uint8_t*)"Frame saved\r\n", 13, 50);
+              uart_tx_puts("Frame saved\r\n");
             } else {
-              HAL_UART_Transmit(&huart4, (uint8_t*)"Error: failed to write frame to flash\r\n", 36, 100);
+              uart_tx_puts("Error: failed to write frame to flash\r\n");
             }
           }
 
@@ -190,46 +268,62 @@ void handle_received_byte(uint8_t b) {
   }
 }
 
+// Feed a chunk drained from the UART4 receive ring to the frame detector
+void handle_received_bytes(const uint8_t* data, size_t len) {
+  rx_count += len;
+  for (size_t i = 0; i < len; ++i) handle_received_byte(data[i]);
+}
+
 void setup() {
   HAL_Init();
   initUART4();
+  uart_rx_init(&huart4);
   
   // Welcome message
   HAL_Delay(500);
-  HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n", 2, 50);
-  HAL_UART_Transmit(&huart4, (uint8_t*)"================================\r\n", 34, 100);
-  HAL_UART_Transmit(&huart4, (uint8_t*)"  STM32 UART4 Data Receiver\r\n", 31, 100);
-  HAL_UART_Transmit(&huart4, (uint8_t*)"  Waiting for data...\r\n", 24, 100);
-  HAL_UART_Transmit(&huart4, (uint8_t*)"================================\r\n\r\n", 36, 100);
+  uart_tx_puts("\r\n");
+  uart_tx_puts("================================\r\n");
+  uart_tx_puts("  STM32 UART4 Data Receiver\r\n");
+  uart_tx_puts("  Waiting for data...\r\n");
+  uart_tx_puts("================================\r\n\r\n");
 
   // initialize safety and command parser
   safety_monitor_init();
   uart_commands_init();
+  telemetry_init();
+  blackbox_init();
+  prof_init();
   
   // Initialize Hall sensor inputs (PC0, PC1, PC2)
   hall_sensor_init();
-  HAL_UART_Transmit(&huart4, (uint8_t*)"Hall sensors initialized (PC0/PC1/PC2)\r\n", 41, 50);
+  uart_tx_puts("Hall sensors initialized (PC0/PC1/PC2)\r\n");
 
   // Initialize TIM1-based driver (PA8, PA9, PA10 for U/V/W phases)
   driver_init_tim1();
   driver_disable();
 
+  // Commutation and duty output run in the TIM1 update interrupt from here on
+  driver_set_control_callback(esc_control_step);
+
   // Load stored frame from flash (if present) and apply config
   esc_config_t cfg;
   if (flash_read_bytes(stored_data)) {
     has_stored = true;
-    HAL_UART_Transmit(&huart4, (uint8_t*)"Frame loaded from EEPROM\r\n", 27, 100);
+    uart_tx_puts("Frame loaded from EEPROM\r\n");
     if (parse_esc_config(stored_data.data(), stored_data.size(), &cfg)) {
       esc_control_init(&cfg);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"ESC READY\r\n", 11, 100);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"Commands: a(ARM) s(STOP) t<N>(THROTTLE%)\r\n", 43, 100);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"Type 'h' for help\r\n", 19, 100);
+      uart_tx_puts("ESC READY\r\n");
+      uart_tx_puts("Commands: a(ARM) s(STOP) t<N>(THROTTLE%)\r\n");
+      uart_tx_puts("Type 'h' for help\r\n");
     } else {
-      HAL_UART_Transmit(&huart4, (uint8_t*)"Failed to parse stored config\r\n", 32, 100);
+      uart_tx_puts("Failed to parse stored config\r\n");
     }
   } else {
     has_stored = false;
   }
+
+  // DShot300/600 throttle input on PB6 (decoded in the DMA interrupt)
+  dshot_init();
 }
 
 void loop() {
@@ -239,12 +333,28 @@ void loop() {
   // Write 0xAAAA to the KR register to refresh the Independent Watchdog
   IWDG->KR = 0xAAAA;
   
-  // Receiving data over UART4 - process only 1 byte per loop iteration to keep loop fast
-  uint8_t rb;
-  if (HAL_UART_Receive(&huart4, &rb, 1, 1) == HAL_OK) {
-    handle_received_byte(rb);
-    uart_commands_feed(rb);
-    uart_commands_reset_watchdog();  // Feed the watchdog on each byte received
+  // Receiving data over UART4 - DMA fills the ring in the background, drain
+  // everything that arrived since the last pass. Binary protocol packets are
+  // parsed in place at the head of the ring; other bytes go out in chunks
+  // that end before the next 0xAA, so a packet always starts a chunk.
+  uint8_t rx_chunk[64];
+  size_t rx_len;
+  for (;;) {
+    esc_proto_result_t proto = in_frame ? ESC_PROTO_NONE : esc_protocol_poll();
+    if (proto == ESC_PROTO_WAIT) break;
+    if (proto == ESC_PROTO_HANDLED) {
+      uart_commands_reset_watchdog();
+      continue;
+    }
+
+    size_t avail = uart_rx_available();
+    if (avail == 0) break;
+    size_t n = 1;
+    while (n < avail && n < sizeof(rx_chunk) && uart_rx_peek(n) != ESC_PROTO_START) ++n;
+    rx_len = uart_rx_read(rx_chunk, n);
+    handle_received_bytes(rx_chunk, rx_len);
+    uart_commands_feed(rx_chunk, rx_len);
+    uart_commands_reset_watchdog();  // Feed the watchdog on each chunk received
   }
   
   // Kick watchdog periodically even if no UART activity
@@ -257,18 +367,16 @@ void loop() {
   
   // no periodic stored-frame printing to avoid UART flooding
   
-  // ESC control periodic update (reads Hall sensors, applies commutation)
+  // ESC background supervision (limits, watchdog, ramp). Commutation itself
+  // runs in the TIM1 update interrupt, so loop timing no longer affects it.
   esc_control_update();
 
-  // If calibrating, ensure the safety monitor samples regularly (10Hz prints handled inside)
-  if (safety_is_calibrating()) {
-    static uint32_t last_cal_sample = 0;
-    uint32_t now = HAL_GetTick();
-    if (now - last_cal_sample >= SAFETY_CAL_PRINT_MS) {
-      last_cal_sample = now;
-      safety_sample_once();
-    }
-  }
-  // Small delay to prevent CPU overload and allow stable commutation (very important!)
-  delayMicroseconds(100);  // 100 usec = allows stable loop rate around 10kHz
+  // DShot arming, link-loss failsafe and special commands
+  dshot_poll();
+
+  // Stream a requested blackbox dump as the transmit ring drains
+  blackbox_poll();
+
+  // Calibration reports and ADC housekeeping (sampling itself runs in the control step)
+  safety_monitor_poll();
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "prof.h"
+
+#ifdef ENABLE_PROFILING
+
+#include "driver_tim1.h"
+#include "uart_commands.h"
+#include "uart_tx.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t hist[PROF_HIST_BINS];
+  uint32_t over;  // runs above the budget
+} prof_stats_t;
+
+static prof_stats_t stats[PROF_SECTION_COUNT];
+static uint32_t budget[PROF_SECTION_COUNT];
+
+// Sections run at most at the control step's priority (TIM1 update and the
+// other priority-1 interrupts). Masking from there down through BASEPRI
+// keeps the priority-0 trips (TIM1 break, ADC watchdogs) live.
+#define PROF_MASK_PRIORITY 1u
+
+static inline uint32_t prof_lock(void) {
+  uint32_t basepri = __get_BASEPRI();
+  __set_BASEPRI_MAX(PROF_MASK_PRIORITY << (8u - __NVIC_PRIO_BITS));
+  return basepri;
+}
+
+static inline void prof_unlock(uint32_t basepri) {
+  __set_BASEPRI(basepri);
+}
+
+static const char* const section_names[PROF_SECTION_COUNT] = {
+  "control_step", "safety_sample", "phase_pwm", "esc_update", "command",
+};
+
+static void prof_reset(void) {
+  uint32_t basepri = prof_lock();
+  memset(stats, 0, sizeof(stats));
+  for (int i = 0; i < PROF_SECTION_COUNT; ++i) stats[i].min = UINT32_MAX;
+  prof_unlock(basepri);
+}
+
+void prof_record(prof_section_t section, uint32_t cycles) {
+  uint32_t bin = 31u - __CLZ(cycles | 1u);
+  bin = (bin > PROF_HIST_MIN_LOG2) ? bin - PROF_HIST_MIN_LOG2 : 0;
+  if (bin >= PROF_HIST_BINS) bin = PROF_HIST_BINS - 1;
+
+  // the same section runs from the loop and from interrupts
+  uint32_t basepri = prof_lock();
+  prof_stats_t* s = &stats[section];
+  s->count++;
+  s->total += cycles;
+  if (cycles < s->min) s->min = cycles;
+  if (cycles > s->max) s->max = cycles;
+  s->hist[bin]++;
+  if (budget[section] != 0 && cycles > budget[section]) s->over++;
+  prof_unlock(basepri);
+}
+
+void prof_set_budget(prof_section_t section, uint32_t cycles) {
+  budget[section] = cycles;
+}
+
+// Text to ITM stimulus port 0, the SWO console (blocking while the FIFO is
+// full; skipped when no debugger enabled tracing)
+static int itm_write(const void* data, size_t len) {
+#ifdef ENABLE_ITM
+  if ((CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk) == 0) return 0;
+  if ((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0 || (ITM->TER & 1) == 0) return 0;
+  const char* p = (const char*)data;
+  for (size_t i = 0; i < len; ++i) {
+    while (ITM->PORT[0].u32 == 0);
+    ITM->PORT[0].u8 = (uint8_t)p[i];
+  }
+  return 1;
+#else
+  (void)data;
+  (void)len;
+  return 0;
+#endif
+}
+
+// One line per section, then the histograms of sections that ran
+static void prof_report(int (*out)(const void*, size_t)) {
+  char line[160];
+  uint32_t mhz = SystemCoreClock / 1000000u;
+  if (mhz == 0) mhz = 1;
+
+  int n = snprintf(line, sizeof(line), "PROF: cycles @ %luMHz  count min mean max (max us)\r\n",
+                   (unsigned long)mhz);
+  out(line, (size_t)n);
+  for (int i = 0; i < PROF_SECTION_COUNT; ++i) {
+    prof_stats_t s;
+    uint32_t basepri = prof_lock();
+    s = stats[i];
+    prof_unlock(basepri);
+
+    if (s.count == 0) {
+      n = snprintf(line, sizeof(line), "  %-14s -\r\n", section_names[i]);
+      out(line, (size_t)n);
+      continue;
+    }
+    n = snprintf(line, sizeof(line), "  %-14s %lu %lu %lu %lu (%lu.%02lu)\r\n", section_names[i],
+                 (unsigned long)s.count, (unsigned long)s.min, (unsigned long)(s.total / s.count),
+                 (unsigned long)s.max, (unsigned long)(s.max / mhz),
+                 (unsigned long)((s.max % mhz) * 100u / mhz));
+    out(line, (size_t)n);
+
+    if (budget[i] != 0) {
+      n = snprintf(line, sizeof(line), "    budget %lu: max %lu%%, %lu over\r\n", (unsigned long)budget[i],
+                   (unsigned long)((uint64_t)s.max * 100u / budget[i]), (unsigned long)s.over);
+      out(line, (size_t)n);
+    }
+
+    n = snprintf(line, sizeof(line), "    hist(<%u..>=%u):", 1u << (PROF_HIST_MIN_LOG2 + 1),
+                 1u << (PROF_HIST_MIN_LOG2 + PROF_HIST_BINS - 1));
+    for (int b = 0; b < PROF_HIST_BINS && n < (int)sizeof(line) - 14; ++b) {
+      n += snprintf(line + n, sizeof(line) - n, " %lu", (unsigned long)s.hist[b]);
+    }
+    n += snprintf(line + n, sizeof(line) - n, "\r\n");
+    out(line, (size_t)n);
+  }
+}
+
+// PROF | PROF RESET | PROF ITM
+static void prof_cmd(const uart_cmd_args_t* a) {
+  if (strcasecmp(a->text, "RESET") == 0) {
+    prof_reset();
+    uart_tx_puts("PROF: reset\r\n");
+  } else if (strcasecmp(a->text, "ITM") == 0) {
+    prof_report(itm_write);
+  } else {
+    prof_report(uart_tx_write);
+  }
+}
+
+static const uart_cmd_t prof_commands[] = {
+  {"PROF", UART_ARG_TEXT, prof_cmd, "[RESET|ITM] Cycle counts per section"},
+};
+
+void prof_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  prof_reset();
+  // the step runs from every control-rate TIM1 update and has to end before
+  // the next one
+  prof_set_budget(PROF_CONTROL_STEP, SystemCoreClock / driver_get_control_hz());
+  uart_commands_register(prof_commands, sizeof(prof_commands) / sizeof(prof_commands[0]));
+}
+
+#endif  // ENABLE_PROFILING
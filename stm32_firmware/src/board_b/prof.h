@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cycle-count profiling on the DWT cycle counter. Each section keeps count,
+// min, max, mean and a log2 histogram of its run time; the PROF command
+// prints them on UART4 or on ITM stimulus port 0 (SWO). A section with a
+// cycle budget also counts the runs that went over it; the control step's
+// budget is one control period.
+//
+// Probes cost a couple of register reads when ENABLE_PROFILING is defined
+// (the stm32f405_prof environment in platformio.ini) and compile to nothing
+// otherwise. Recording masks only the interrupts at or below the control
+// step's priority.
+
+typedef enum {
+  PROF_CONTROL_STEP = 0,   // esc_control_step, the TIM1 update interrupt body
+  PROF_SAFETY_SAMPLE,      // safety_sample_once
+  PROF_PHASE_PWM,          // driver_set_phase_pwm
+  PROF_ESC_UPDATE,         // esc_control_update
+  PROF_COMMAND,            // console command dispatch and handler
+  PROF_SECTION_COUNT
+} prof_section_t;
+
+// Histogram bin i counts runs of [2^(i+6), 2^(i+7)) cycles; the first and
+// last bins also take everything below and above
+#define PROF_HIST_BINS 10
+#define PROF_HIST_MIN_LOG2 6
+
+#ifdef ENABLE_PROFILING
+
+// Start the cycle counter and register the PROF command
+void prof_init(void);
+
+// Add one run of a section. Safe from interrupts.
+void prof_record(prof_section_t section, uint32_t cycles);
+
+// Count runs of a section longer than this many cycles (0: no budget)
+void prof_set_budget(prof_section_t section, uint32_t cycles);
+
+typedef struct {
+  prof_section_t section;
+  uint32_t start;
+} prof_scope_t;
+
+static inline prof_scope_t prof_scope_begin(prof_section_t section) {
+  prof_scope_t s = {section, DWT->CYCCNT};
+  return s;
+}
+
+static inline void prof_scope_end(prof_scope_t* s) {
+  prof_record(s->section, DWT->CYCCNT - s->start);
+}
+
+#define PROF_CAT_(a, b) a##b
+#define PROF_CAT(a, b) PROF_CAT_(a, b)
+
+// Time from here to the end of the enclosing block, every exit path included
+#define PROF_SCOPE(section) \
+  prof_scope_t PROF_CAT(prof_scope_, __LINE__) __attribute__((cleanup(prof_scope_end), unused)) = \
+    prof_scope_begin(section)
+
+#else
+
+#define prof_init() ((void)0)
+#define prof_record(section, cycles) ((void)0)
+#define prof_set_budget(section, cycles) ((void)0)
+#define PROF_SCOPE(section) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,7 +1,11 @@
 #include "safety_monitor.h"
-#include "safety_monitor.h"
 #include "safety_params.h"
+#include "driver_tim1.h"
+#include "fixed_point.h"
+#include "frame_store.h"
 #include "stm32f4xx_hal.h"
+#include "uart_tx.h"
+#include "prof.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -18,12 +22,32 @@
 #define TEMP_ADC_PIN GPIO_PIN_2
 #define TEMP_ADC_CHANNEL ADC_CHANNEL_2
 
+// Current limit threshold (DAC1 into the ETR comparator)
+#define LIMIT_DAC_GPIO_PORT GPIOA
+#define LIMIT_DAC_PIN GPIO_PIN_4
+#define LIMIT_DAC_CHANNEL DAC_CHANNEL_1
+
+// Scan order of the regular sequence (index into one DMA buffer). The shunt
+// goes first so it is sampled right at the trigger, inside the single-shunt
+// window that FOC places the trigger in.
+enum { ADC_IDX_SHUNT = 0, ADC_IDX_VBUS, ADC_IDX_TEMP, ADC_NUM_CHANNELS };
+
 static ADC_HandleTypeDef hadc1;
+static ADC_HandleTypeDef hadc3;
+static DAC_HandleTypeDef hdac;
+static DMA_HandleTypeDef hdma_adc1;
+static TIM_HandleTypeDef htim2;
+
+// DMA double buffer: the stream fills one scan while the other is read
+static volatile uint16_t adc_dma_buf[2][ADC_NUM_CHANNELS];
+static uint32_t adc_overruns = 0;
+
 static uint32_t last_raw_vbus = 0;
 static uint32_t last_raw_shunt = 0;
 static uint32_t last_raw_temp = 0;
 static uint32_t last_vbus_mv = 0;
 static int32_t last_current_ma = 0;
+static int32_t last_current_sample_ma = 0;
 static uint16_t last_temp_c = 25;
 static int calibrate_mode = 0;
 static int temp_valid = 0;
@@ -31,119 +55,385 @@ static int current_valid = 0;
 static int bypass_printed = 0;
 static int sensor_bypass = 1;
 
-// calibration averaging
+// Hardware limits (safety_set_trip_limits, safety_set_pulse_limit), kept to
+// redo the shunt thresholds when the zero-current offset changes
+static uint32_t trip_overcurrent_ma = 0;
+static uint32_t trip_overvoltage_mv = 0;
+static uint32_t pulse_limit_ma = 0;
+
+// calibration averaging (accumulated in the control step, reported by the poll)
 static uint32_t cal_start_ms = 0;
 static uint64_t cal_shunt_sum = 0;
 static uint32_t cal_shunt_count = 0;
 static uint32_t cal_offset_raw = 0;
-static int cal_offset_ready = 0;
+static volatile int cal_offset_ready = 0;
+static int cal_offset_reported = 0;
+
+// arm-time offset burst (safety_calibrate_offset), accumulated by the control step
+static volatile uint32_t cal_burst_left = 0;
+static uint32_t cal_burst_sum = 0;
+
+// calibration last written to the config sector
+static frame_store_cal_t stored_cal;
+static int stored_cal_valid = 0;
 
 static uint32_t adc_max = ((1u << SAFETY_ADC_RESOLUTION_BITS) - 1u);
 
+// Filter per channel between the DMA scan and the getters
+static const adc_filter_config_t filter_defaults[SAFETY_NUM_CH] = {
+  [SAFETY_CH_SHUNT] = SAFETY_FILTER_SHUNT,
+  [SAFETY_CH_VBUS] = SAFETY_FILTER_VBUS,
+  [SAFETY_CH_TEMP] = SAFETY_FILTER_TEMP,
+};
+static adc_filter_t filters[SAFETY_NUM_CH];
+
+// Q16.16 unit scales per ADC count, derived once from safety_params.h so the
+// per-sample conversion is a multiply and shift
+static int32_t vbus_mv_per_count_q16 = 0;
+static int32_t shunt_ma_per_count_q16 = 0;
+static int32_t temp_c_per_count_q16 = 0;
+
+// VBUS divider correction (CAL VBUS), applied to its nominal scale
+static int32_t vbus_gain_q16 = 1 << Q16_SHIFT;
+
+static int vbus_gain_ok(int64_t gain_q16) {
+  return gain_q16 >= Q16_FROM_FLOAT(1.0f - SAFETY_CAL_VBUS_GAIN_RANGE) &&
+         gain_q16 <= Q16_FROM_FLOAT(1.0f + SAFETY_CAL_VBUS_GAIN_RANGE);
+}
+
+static void safety_scales_init(void) {
+  float volts_per_count = SAFETY_ADC_REF_VOLTAGE / (float)adc_max;
+  float shunt_ohms = SAFETY_SHUNT_MOHMS / 1000.0f;
+  vbus_mv_per_count_q16 = Q16_FROM_FLOAT(volts_per_count * SAFETY_VBUS_DIVIDER * 1000.0f);
+  vbus_mv_per_count_q16 = (int32_t)(((int64_t)vbus_mv_per_count_q16 * vbus_gain_q16) >> Q16_SHIFT);
+  shunt_ma_per_count_q16 = Q16_FROM_FLOAT(volts_per_count / (shunt_ohms * SAFETY_SHUNT_AMP_GAIN) * 1000.0f);
+  temp_c_per_count_q16 = Q16_FROM_FLOAT(volts_per_count * 1000.0f / SAFETY_TEMP_MV_PER_DEG);
+}
+
+// ADC counts of a value in the units of a Q16.16 per-count scale, clamped to
+// the ADC range (a threshold at full scale never trips)
+static uint32_t safety_counts_of(uint32_t value, int32_t per_count_q16) {
+  uint64_t counts = ((uint64_t)value << Q16_SHIFT) / (uint32_t)per_count_q16;
+  return counts > adc_max ? adc_max : (uint32_t)counts;
+}
+
 static int adc_valid(uint16_t v) {
   return (v > 20 && v < 4000);
 }
 
+// Apply a Q16.16 unit scale to a filter output (counts with
+// ADC_FILTER_FRAC_BITS fractional bits), rounded to nearest
+static int32_t filtered_apply(int32_t counts_frac, int32_t scale_q16) {
+  const int shift = Q16_SHIFT + ADC_FILTER_FRAC_BITS;
+  return (int32_t)(((int64_t)counts_frac * scale_q16 + (1 << (shift - 1))) >> shift);
+}
+
+// TIM2 relays TIM1's mid-pulse trigger to ADC1: regular conversions cannot be
+// started by TIM1_CC4/TRGO directly, so TIM2 is reset by TIM1 TRGO (ITR0) and
+// re-emits the reset on its own TRGO.
+static void adc_trigger_init(void) {
+  __HAL_RCC_TIM2_CLK_ENABLE();
+  htim2.Instance = TIM2;
+  htim2.Init.Prescaler = 0;
+  htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim2.Init.Period = 0xFFFFFFFF;
+  htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  HAL_TIM_Base_Init(&htim2);
+
+  TIM_SlaveConfigTypeDef sSlaveConfig = {0};
+  sSlaveConfig.SlaveMode = TIM_SLAVEMODE_RESET;
+  sSlaveConfig.InputTrigger = TIM_TS_ITR0;
+  HAL_TIM_SlaveConfigSynchro(&htim2, &sSlaveConfig);
+
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig);
+
+  HAL_TIM_Base_Start(&htim2);
+}
+
+// HAL sample time code of a cycle count from safety_params.h
+#define ADC_SAMPLETIME_OF(cycles) \
+  ((cycles) == 3u ? ADC_SAMPLETIME_3CYCLES : (cycles) == 15u ? ADC_SAMPLETIME_15CYCLES : \
+   (cycles) == 28u ? ADC_SAMPLETIME_28CYCLES : ADC_SAMPLETIME_56CYCLES)
+
+// A scan triggered at the earliest point of a period is read by the next
+// control step, so it must be converted by then
+_Static_assert(DRIVER_ADC_MIN_SAMPLE_TICKS +
+                   SAFETY_ADC_SCAN_CYCLES * (DRIVER_TIM1_CLOCK_HZ / SAFETY_ADC_CLOCK_HZ) <=
+                   DRIVER_PWM_PERIOD,
+               "ADC1 scan does not fit in one PWM period");
+
+static void adc_config_rank(ADC_HandleTypeDef* hadc, uint32_t channel, uint32_t rank, uint32_t sampling_time) {
+  ADC_ChannelConfTypeDef sConfig = {0};
+  sConfig.Channel = channel;
+  sConfig.Rank = rank;
+  sConfig.SamplingTime = sampling_time;
+  HAL_ADC_ConfigChannel(hadc, &sConfig);
+}
+
+// Guard one regular channel against an upper threshold. The interrupt is
+// left off; safety_arm_trips enables it.
+static void adc_config_watchdog(ADC_HandleTypeDef* hadc, uint32_t channel, uint32_t high) {
+  ADC_AnalogWDGConfTypeDef awd = {0};
+  awd.WatchdogMode = ADC_ANALOGWATCHDOG_SINGLE_REG;
+  awd.HighThreshold = high;
+  awd.LowThreshold = 0;
+  awd.Channel = channel;
+  awd.ITMode = DISABLE;
+  HAL_ADC_AnalogWDGConfig(hadc, &awd);
+}
+
+// (Re)start the double-buffered DMA stream and enable ADC DMA requests
+static void adc_dma_start(void) {
+  __HAL_ADC_DISABLE(&hadc1);
+  HAL_DMA_Abort(&hdma_adc1);
+  __HAL_ADC_CLEAR_FLAG(&hadc1, ADC_FLAG_OVR | ADC_FLAG_EOC);
+  HAL_DMAEx_MultiBufferStart(&hdma_adc1, (uint32_t)&hadc1.Instance->DR,
+                             (uint32_t)adc_dma_buf[0], (uint32_t)adc_dma_buf[1], ADC_NUM_CHANNELS);
+  hadc1.Instance->CR2 |= ADC_CR2_DMA | ADC_CR2_DDS;
+  __HAL_ADC_ENABLE(&hadc1);
+}
+
 static void MX_ADC1_Init(void) {
   __HAL_RCC_ADC1_CLK_ENABLE();
-  ADC_ChannelConfTypeDef sConfig = {0};
+  __HAL_RCC_DMA2_CLK_ENABLE();
 
+  // One scan of VBUS, shunt and temperature per TIM2 TRGO (once per PWM period)
   hadc1.Instance = ADC1;
   hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
   hadc1.Init.Resolution = (SAFETY_ADC_RESOLUTION_BITS == 12) ? ADC_RESOLUTION_12B : ADC_RESOLUTION_12B;
-  hadc1.Init.ScanConvMode = DISABLE;
+  hadc1.Init.ScanConvMode = ENABLE;
   hadc1.Init.ContinuousConvMode = DISABLE;
   hadc1.Init.DiscontinuousConvMode = DISABLE;
-  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
-  hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
   hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-  hadc1.Init.NbrOfConversion = 1;
-  hadc1.Init.DMAContinuousRequests = DISABLE;
-  hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  hadc1.Init.NbrOfConversion = ADC_NUM_CHANNELS;
+  hadc1.Init.DMAContinuousRequests = ENABLE;
+  hadc1.Init.EOCSelection = ADC_EOC_SEQ_CONV;
   HAL_ADC_Init(&hadc1);
+
+  // shunt: 15 cycles at 21 MHz (~0.7us) so it fits between switching edges;
+  // the scan as a whole in ~5us (SAFETY_ADC_SCAN_CYCLES)
+  adc_config_rank(&hadc1, SHUNT_ADC_CHANNEL, ADC_IDX_SHUNT + 1, ADC_SAMPLETIME_OF(SAFETY_ADC_SHUNT_SAMPLE_CYCLES));
+  adc_config_rank(&hadc1, VBUS_ADC_CHANNEL, ADC_IDX_VBUS + 1, ADC_SAMPLETIME_OF(SAFETY_ADC_SLOW_SAMPLE_CYCLES));
+  adc_config_rank(&hadc1, TEMP_ADC_CHANNEL, ADC_IDX_TEMP + 1, ADC_SAMPLETIME_OF(SAFETY_ADC_SLOW_SAMPLE_CYCLES));
+
+  // ADC1 -> DMA2 Stream0 Channel0, double-buffer mode (implies circular)
+  hdma_adc1.Instance = DMA2_Stream0;
+  hdma_adc1.Init.Channel = DMA_CHANNEL_0;
+  hdma_adc1.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_adc1.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_adc1.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_adc1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_adc1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  hdma_adc1.Init.Mode = DMA_CIRCULAR;
+  hdma_adc1.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma_adc1.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&hdma_adc1);
+  __HAL_LINKDMA(&hadc1, DMA_Handle, hdma_adc1);
+
+  adc_dma_start();
 }
 
-static uint32_t adc_sample_channel(uint32_t channel) {
-  ADC_ChannelConfTypeDef sConfig = {0};
-  sConfig.Channel = channel;
-  sConfig.Rank = 1;
-  sConfig.SamplingTime = ADC_SAMPLETIME_56CYCLES;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) return 0;
-  HAL_ADC_Start(&hadc1);
-  if (HAL_ADC_PollForConversion(&hadc1, 20) == HAL_OK) {
-    uint32_t v = HAL_ADC_GetValue(&hadc1);
-    HAL_ADC_Stop(&hadc1);
-    return v;
+// Each ADC has a single analog watchdog, and ADC1's guards the shunt, so
+// ADC3 converts VBUS on its own (same trigger, no DMA: only its watchdog is
+// used, the monitored value still comes from ADC1)
+static void MX_ADC3_Init(void) {
+  __HAL_RCC_ADC3_CLK_ENABLE();
+
+  hadc3.Instance = ADC3;
+  hadc3.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+  hadc3.Init.Resolution = ADC_RESOLUTION_12B;
+  hadc3.Init.ScanConvMode = DISABLE;
+  hadc3.Init.ContinuousConvMode = DISABLE;
+  hadc3.Init.DiscontinuousConvMode = DISABLE;
+  hadc3.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  hadc3.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_TRGO;
+  hadc3.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  hadc3.Init.NbrOfConversion = 1;
+  hadc3.Init.DMAContinuousRequests = DISABLE;
+  hadc3.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+  HAL_ADC_Init(&hadc3);
+
+  adc_config_rank(&hadc3, VBUS_ADC_CHANNEL, 1, ADC_SAMPLETIME_OF(SAFETY_ADC_SLOW_SAMPLE_CYCLES));
+  __HAL_ADC_ENABLE(&hadc3);
+}
+
+// DAC1 drives the current limit comparator; the shunt amplifier output and
+// the DAC share the 3.3 V reference, so a DAC code equals an ADC count
+static void MX_DAC_Init(void) {
+  __HAL_RCC_DAC_CLK_ENABLE();
+  hdac.Instance = DAC;
+  HAL_DAC_Init(&hdac);
+
+  DAC_ChannelConfTypeDef sConfig = {0};
+  sConfig.DAC_Trigger = DAC_TRIGGER_NONE;
+  sConfig.DAC_OutputBuffer = DAC_OUTPUTBUFFER_ENABLE;
+  HAL_DAC_ConfigChannel(&hdac, &sConfig, LIMIT_DAC_CHANNEL);
+  HAL_DAC_SetValue(&hdac, LIMIT_DAC_CHANNEL, DAC_ALIGN_12B_R, adc_max);
+  HAL_DAC_Start(&hdac, LIMIT_DAC_CHANNEL);
+}
+
+// Shunt ADC count (or DAC code) of a current, above the zero-current offset
+static uint32_t safety_shunt_counts(uint32_t mA) {
+  if (!mA) return adc_max;
+  uint32_t counts = safety_counts_of(mA, shunt_ma_per_count_q16);
+  if (cal_offset_ready) counts += cal_offset_raw;
+  return counts > adc_max ? adc_max : counts;
+}
+
+// Program the watchdogs and the limit comparator from the limits and the
+// current shunt offset
+static void safety_apply_trip_limits(void) {
+  uint32_t vbus_high = trip_overvoltage_mv ? safety_counts_of(trip_overvoltage_mv, vbus_mv_per_count_q16)
+                                           : adc_max;
+  adc_config_watchdog(&hadc1, SHUNT_ADC_CHANNEL, safety_shunt_counts(trip_overcurrent_ma));
+  adc_config_watchdog(&hadc3, VBUS_ADC_CHANNEL, vbus_high);
+  HAL_DAC_SetValue(&hdac, LIMIT_DAC_CHANNEL, DAC_ALIGN_12B_R, safety_shunt_counts(pulse_limit_ma));
+}
+
+void safety_set_trip_limits(uint32_t overcurrent_mA, uint32_t overvoltage_mV) {
+  trip_overcurrent_ma = overcurrent_mA;
+  trip_overvoltage_mv = overvoltage_mV;
+  safety_apply_trip_limits();
+}
+
+void safety_set_pulse_limit(uint32_t limit_mA) {
+  pulse_limit_ma = limit_mA;
+  safety_apply_trip_limits();
+}
+
+void safety_arm_trips(void) {
+  __HAL_ADC_CLEAR_FLAG(&hadc1, ADC_FLAG_AWD);
+  __HAL_ADC_CLEAR_FLAG(&hadc3, ADC_FLAG_AWD);
+  __HAL_ADC_ENABLE_IT(&hadc1, ADC_IT_AWD);
+  __HAL_ADC_ENABLE_IT(&hadc3, ADC_IT_AWD);
+}
+
+// Analog watchdogs (shared ADC interrupt). Priority 0, above the control
+// step: the bridge is off within one conversion of a limit being crossed.
+void ADC_IRQHandler(void) {
+  if (__HAL_ADC_GET_IT_SOURCE(&hadc1, ADC_IT_AWD) && __HAL_ADC_GET_FLAG(&hadc1, ADC_FLAG_AWD)) {
+    __HAL_ADC_DISABLE_IT(&hadc1, ADC_IT_AWD);
+    __HAL_ADC_CLEAR_FLAG(&hadc1, ADC_FLAG_AWD);
+    driver_trip(DRIVER_TRIP_OVERCURRENT);
+  }
+  if (__HAL_ADC_GET_IT_SOURCE(&hadc3, ADC_IT_AWD) && __HAL_ADC_GET_FLAG(&hadc3, ADC_FLAG_AWD)) {
+    __HAL_ADC_DISABLE_IT(&hadc3, ADC_IT_AWD);
+    __HAL_ADC_CLEAR_FLAG(&hadc3, ADC_FLAG_AWD);
+    driver_trip(DRIVER_TRIP_OVERVOLTAGE);
+  }
+}
+
+// Keep the calibration in the config sector. Small offset moves from one
+// arm to the next are not worth a record.
+static void safety_store_calibration(void) {
+  frame_store_cal_t cal = {0};
+  cal.shunt_offset_raw = (uint16_t)(cal_offset_ready ? cal_offset_raw : 0);
+  cal.vbus_gain_q16 = vbus_gain_q16;
+  if (stored_cal_valid && cal.vbus_gain_q16 == stored_cal.vbus_gain_q16 &&
+      abs((int)cal.shunt_offset_raw - (int)stored_cal.shunt_offset_raw) < SAFETY_CAL_SAVE_DELTA) {
+    return;
+  }
+  if (frame_store_save_cal(&cal)) {
+    stored_cal = cal;
+    stored_cal_valid = 1;
   }
-  HAL_ADC_Stop(&hadc1);
-  return 0;
+}
+
+// Offset and gain of the last calibration, so the first arm starts from them
+static void safety_load_calibration(void) {
+  frame_store_cal_t cal;
+  if (!frame_store_get_cal(&cal)) return;
+  stored_cal = cal;
+  stored_cal_valid = 1;
+  if (cal.shunt_offset_raw <= SAFETY_CAL_OFFSET_MAX) {
+    cal_offset_raw = cal.shunt_offset_raw;
+    cal_offset_ready = 1;
+  }
+  if (vbus_gain_ok(cal.vbus_gain_q16)) vbus_gain_q16 = cal.vbus_gain_q16;
 }
 
 void safety_monitor_init(void) {
   // configure GPIOs for analog
   __HAL_RCC_GPIOA_CLK_ENABLE();
   GPIO_InitTypeDef gpio = {0};
-  gpio.Pin = VBUS_ADC_PIN | SHUNT_ADC_PIN | TEMP_ADC_PIN;
+  gpio.Pin = VBUS_ADC_PIN | SHUNT_ADC_PIN | TEMP_ADC_PIN | LIMIT_DAC_PIN;
   gpio.Mode = GPIO_MODE_ANALOG;
   gpio.Pull = GPIO_NOPULL;
   HAL_GPIO_Init(GPIOA, &gpio);
 
+  safety_load_calibration();
+  safety_scales_init();
+  for (int ch = 0; ch < SAFETY_NUM_CH; ++ch) adc_filter_init(&filters[ch], &filter_defaults[ch]);
   MX_ADC1_Init();
+  MX_ADC3_Init();
+  MX_DAC_Init();
+  safety_apply_trip_limits();  // no limits until the config sets them
+  HAL_NVIC_SetPriority(ADC_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(ADC_IRQn);
+  adc_trigger_init();
 
-  // initial sample
-  safety_sample_once();
+  // samples start flowing once TIM1 runs (driver_init_tim1)
   
   // print sensor bypass message once at boot
   if (!bypass_printed) {
     bypass_printed = 1;
-    extern UART_HandleTypeDef huart4;
-    HAL_UART_Transmit(&huart4, (uint8_t*)"SENSOR BYPASS ACTIVE\r\n", 22, 50);
+    uart_tx_puts("SENSOR BYPASS ACTIVE\r\n");
   }
 }
 
 void safety_sample_once(void) {
-  uint32_t v_vbus = adc_sample_channel(VBUS_ADC_CHANNEL);
-  uint32_t v_shunt = adc_sample_channel(SHUNT_ADC_CHANNEL);
-  uint32_t v_temp = adc_sample_channel(TEMP_ADC_CHANNEL);
+  PROF_SCOPE(PROF_SAFETY_SAMPLE);
+
+  // Copy the scan DMA is not writing (CT = buffer in use); retry if the
+  // stream switched buffers while we were copying
+  uint32_t v_vbus, v_shunt, v_temp, ct;
+  do {
+    ct = hdma_adc1.Instance->CR & DMA_SxCR_CT;
+    const volatile uint16_t* scan = adc_dma_buf[ct ? 0 : 1];
+    v_vbus = scan[ADC_IDX_VBUS];
+    v_shunt = scan[ADC_IDX_SHUNT];
+    v_temp = scan[ADC_IDX_TEMP];
+  } while (ct != (hdma_adc1.Instance->CR & DMA_SxCR_CT));
 
   last_raw_vbus = v_vbus;
   last_raw_shunt = v_shunt;
   last_raw_temp = v_temp;
 
-  float vbus_volts = ((float)v_vbus / (float)adc_max) * SAFETY_ADC_REF_VOLTAGE * SAFETY_VBUS_DIVIDER;
-  last_vbus_mv = (uint32_t)(vbus_volts * 1000.0f + 0.5f);
+  // convert using offset-corrected ADC raw once calibrated
+  int32_t offset = cal_offset_ready ? (int32_t)cal_offset_raw : 0;
+  last_current_sample_ma = adc_valid((uint16_t)v_shunt)
+                             ? q16_apply((int32_t)v_shunt - offset, shunt_ma_per_count_q16) : 0;
 
-  // Check current sensor validity
-  if (!adc_valid(v_shunt)) {
-    last_current_ma = 0;
-    current_valid = 0;
-  } else {
-    float v_shunt_volts = ((float)v_shunt / (float)adc_max) * SAFETY_ADC_REF_VOLTAGE;
-    float shunt_ohms = (SAFETY_SHUNT_MOHMS / 1000.0f);
-    float current_a = 0.0f;
-    if (cal_offset_ready) {
-      // convert using offset-corrected ADC raw
-      int32_t raw_corr = (int32_t)v_shunt - (int32_t)cal_offset_raw;
-      float v_shunt_corr = ((float)raw_corr / (float)adc_max) * SAFETY_ADC_REF_VOLTAGE;
-      current_a = v_shunt_corr / (shunt_ohms * SAFETY_SHUNT_AMP_GAIN);
-    } else {
-      current_a = v_shunt_volts / (shunt_ohms * SAFETY_SHUNT_AMP_GAIN);
-    }
-    last_current_ma = (int32_t)(current_a * 1000.0f + 0.5f);
-    current_valid = 1;
+  // Filtered values: each scan only adds to a channel's oversampling sum, the
+  // filter stages and the conversion run when the sum is complete
+  if (adc_filter_push(&filters[SAFETY_CH_SHUNT], (uint16_t)v_shunt)) {
+    uint16_t f = adc_filter_output(&filters[SAFETY_CH_SHUNT]);
+    current_valid = adc_valid(f >> ADC_FILTER_FRAC_BITS);
+    last_current_ma = current_valid
+                        ? filtered_apply((int32_t)f - (offset << ADC_FILTER_FRAC_BITS), shunt_ma_per_count_q16)
+                        : 0;
+  }
+  if (adc_filter_push(&filters[SAFETY_CH_VBUS], (uint16_t)v_vbus)) {
+    last_vbus_mv = (uint32_t)filtered_apply(adc_filter_output(&filters[SAFETY_CH_VBUS]), vbus_mv_per_count_q16);
+  }
+  if (adc_filter_push(&filters[SAFETY_CH_TEMP], (uint16_t)v_temp)) {
+    uint16_t f = adc_filter_output(&filters[SAFETY_CH_TEMP]);
+    temp_valid = adc_valid(f >> ADC_FILTER_FRAC_BITS);
+    last_temp_c = temp_valid ? (uint16_t)filtered_apply(f, temp_c_per_count_q16) : 25;
   }
 
-  // Check temperature sensor validity
-  if (!adc_valid(v_temp)) {
-    last_temp_c = 25;
-    temp_valid = 0;
-  } else {
-    float temp_volts = ((float)v_temp / (float)adc_max) * SAFETY_ADC_REF_VOLTAGE;
-    last_temp_c = (uint16_t)( (temp_volts * 1000.0f) / SAFETY_TEMP_MV_PER_DEG + 0.5f );
-    temp_valid = 1;
+  if (cal_burst_left) {
+    cal_burst_sum += v_shunt;
+    cal_burst_left--;
   }
 
-  // calibration handling
+  // calibration handling (accumulate only; reporting happens in safety_monitor_poll)
   if (calibrate_mode) {
     uint32_t now = HAL_GetTick();
     // accumulate shunt raw for offset during first SAFETY_CAL_AVG_MS
@@ -152,32 +442,14 @@ void safety_sample_once(void) {
       cal_shunt_sum = 0;
       cal_shunt_count = 0;
       cal_offset_ready = 0;
-      // ensure driver is disabled during calibration
-      driver_disable();
-    }
-    cal_shunt_sum += v_shunt;
-    cal_shunt_count++;
-
-    if (!cal_offset_ready && (now - cal_start_ms) >= SAFETY_CAL_AVG_MS) {
-      cal_offset_raw = (uint32_t)(cal_shunt_sum / (cal_shunt_count ? cal_shunt_count : 1));
-      cal_offset_ready = 1;
-      // announce offset
-      extern UART_HandleTypeDef huart4;
-      char buf[80];
-      int n = snprintf(buf, sizeof(buf), "CAL: offset_raw=%lu\r\n", (unsigned long)cal_offset_raw);
-      HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
     }
-
-    // print at configured interval
-    static uint32_t last_print = 0;
-    if ((HAL_GetTick() - last_print) >= SAFETY_CAL_PRINT_MS) {
-      last_print = HAL_GetTick();
-      extern UART_HandleTypeDef huart4;
-      char buf[160];
-      int n = snprintf(buf, sizeof(buf), "ADC RAW: VBUS=%lu SHUNT=%lu TEMP=%lu | Vbus_mv=%lu mV Curr_ma=%ld mA Temp_c=%u\r\n",
-                       (unsigned long)v_vbus, (unsigned long)v_shunt, (unsigned long)v_temp,
-                       (unsigned long)last_vbus_mv, (long)last_current_ma, (unsigned)last_temp_c);
-      HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 100);
+    if (!cal_offset_ready) {
+      cal_shunt_sum += v_shunt;
+      cal_shunt_count++;
+      if ((now - cal_start_ms) >= SAFETY_CAL_AVG_MS) {
+        cal_offset_raw = (uint32_t)(cal_shunt_sum / (cal_shunt_count ? cal_shunt_count : 1));
+        cal_offset_ready = 1;
+      }
     }
   } else {
     // reset calibration state when not calibrating
@@ -187,13 +459,94 @@ void safety_sample_once(void) {
   }
 }
 
+void safety_monitor_poll(void) {
+  // ADC overrun stops DMA requests; restart the stream so sampling resumes
+  if (__HAL_ADC_GET_FLAG(&hadc1, ADC_FLAG_OVR)) {
+    adc_overruns++;
+    adc_dma_start();
+  }
+
+  if (!calibrate_mode) return;
+
+  if (cal_offset_ready && !cal_offset_reported) {
+    cal_offset_reported = 1;
+    // announce offset
+    uart_tx_printf("CAL: offset_raw=%lu\r\n", (unsigned long)cal_offset_raw);
+    // the overcurrent threshold sits above the measured zero
+    safety_apply_trip_limits();
+    safety_store_calibration();
+  }
+
+  // print at configured interval
+  static uint32_t last_print = 0;
+  if ((HAL_GetTick() - last_print) >= SAFETY_CAL_PRINT_MS) {
+    last_print = HAL_GetTick();
+    uart_tx_printf("ADC RAW: VBUS=%lu SHUNT=%lu TEMP=%lu | Vbus_mv=%lu mV Curr_ma=%ld mA Temp_c=%u\r\n",
+                   (unsigned long)last_raw_vbus, (unsigned long)last_raw_shunt, (unsigned long)last_raw_temp,
+                   (unsigned long)last_vbus_mv, (long)last_current_ma, (unsigned)last_temp_c);
+  }
+}
+
+uint32_t safety_get_adc_overruns(void) { return adc_overruns; }
+
+int safety_calibrate_offset(void) {
+  if (driver_is_enabled()) return 0;
+  cal_burst_sum = 0;
+  cal_burst_left = SAFETY_CAL_BURST_SCANS;
+  uint32_t start = HAL_GetTick();
+  while (cal_burst_left && (HAL_GetTick() - start) < SAFETY_CAL_BURST_TIMEOUT_MS) {
+    HAL_Delay(1);
+  }
+  if (cal_burst_left) {
+    // scans stopped (ADC overrun) or the control step is not running
+    cal_burst_left = 0;
+    return 0;
+  }
+  uint32_t offset = (cal_burst_sum + SAFETY_CAL_BURST_SCANS / 2) / SAFETY_CAL_BURST_SCANS;
+  if (offset > SAFETY_CAL_OFFSET_MAX) return 0;
+  cal_offset_raw = offset;
+  cal_offset_ready = 1;
+  safety_apply_trip_limits();
+  safety_store_calibration();
+  return 1;
+}
+
+int safety_calibrate_vbus(uint32_t actual_mV) {
+  if (driver_is_enabled() || last_vbus_mv == 0) return 0;
+  int64_t gain = (int64_t)vbus_gain_q16 * actual_mV / last_vbus_mv;
+  if (!vbus_gain_ok(gain)) return 0;
+  vbus_gain_q16 = (int32_t)gain;
+  safety_scales_init();
+  safety_apply_trip_limits();
+  safety_store_calibration();
+  return 1;
+}
+
+uint32_t safety_get_shunt_offset_raw(void) { return cal_offset_ready ? cal_offset_raw : 0; }
+int32_t safety_get_vbus_gain_q16(void) { return vbus_gain_q16; }
+
+int safety_set_filter(safety_channel_t ch, const adc_filter_config_t* cfg) {
+  if ((unsigned)ch >= SAFETY_NUM_CH) return 0;
+  // the control step pushes into the filter
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  int ok = adc_filter_init(&filters[ch], cfg);
+  __set_PRIMASK(primask);
+  return ok;
+}
+
+void safety_get_filter(safety_channel_t ch, adc_filter_config_t* cfg) {
+  if ((unsigned)ch < SAFETY_NUM_CH) *cfg = filters[ch].cfg;
+}
+
 void safety_enable_calibration(int enable) {
   if (enable) {
-    calibrate_mode = 1;
     cal_start_ms = 0;
     cal_shunt_sum = 0;
     cal_shunt_count = 0;
     cal_offset_ready = 0;
+    cal_offset_reported = 0;
+    calibrate_mode = 1;
     // force driver off
     driver_disable();
   } else {
@@ -221,7 +574,6 @@ int safety_get_safe_flag(void) {
     return 1;
   }
   // Determine SAFE: VBUS in reasonable range (> 2V), current near zero if valid (abs < 50mA), temp reasonable if valid (<85C), driver disabled
-  safety_sample_once();
   int safe = 1;
   if (last_vbus_mv < 2000) safe = 0;
   // Only check current fault if current sensor is valid
@@ -233,18 +585,24 @@ int safety_get_safe_flag(void) {
   return safe;
 }
 
+// Getters return the values latched by the last control-step sample
 int32_t safety_get_motor_current_mA(void) {
-  safety_sample_once();
   return last_current_ma;
 }
 
+int32_t safety_get_motor_current_sample_mA(void) {
+  return last_current_sample_ma;
+}
+
 float safety_get_driver_voltage_v(void) {
-  safety_sample_once();
   return ((float)last_vbus_mv) / 1000.0f;
 }
 
+uint32_t safety_get_vbus_mV(void) {
+  return last_vbus_mv;
+}
+
 uint16_t safety_get_temperature_c(void) {
-  safety_sample_once();
   // When bypass is enabled, return nominal temp to disable temperature protection
   extern int safety_get_bypass(void);
   if (safety_get_bypass()) {
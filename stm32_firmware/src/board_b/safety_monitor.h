@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include "adc_filter.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,14 +11,69 @@ extern "C" {
 // Initialize safety monitor hardware (ADC, temp sensor, etc.)
 void safety_monitor_init(void);
 
-// Runtime getters (implementations may read ADC / sensors)
+// Runtime getters: filtered values (safety_set_filter), refreshed by
+// safety_sample_once at each channel's filter rate, no ADC access
 int32_t safety_get_motor_current_mA(void);
 float   safety_get_driver_voltage_v(void);
+uint32_t safety_get_vbus_mV(void);
 uint16_t safety_get_temperature_c(void);
 
-// Force a single ADC sample for all channels (non-blocking not required)
+// Shunt current of the latest scan, unfiltered (offset-corrected), for the
+// loops that act on every PWM period and place their own sample instant
+int32_t safety_get_motor_current_sample_mA(void);
+
+// Filter pipeline between the DMA scan and the getters, one per channel
+typedef enum {
+  SAFETY_CH_SHUNT = 0,
+  SAFETY_CH_VBUS,
+  SAFETY_CH_TEMP,
+  SAFETY_NUM_CH
+} safety_channel_t;
+
+// Replace a channel's filter (defaults: SAFETY_FILTER_* in safety_params.h).
+// Returns 0 and keeps the old one if cfg is out of range. The getter holds
+// its last value until the new filter has produced an output.
+int safety_set_filter(safety_channel_t ch, const adc_filter_config_t* cfg);
+void safety_get_filter(safety_channel_t ch, adc_filter_config_t* cfg);
+
+// Latch and convert the latest DMA scan. ADC1 converts all channels once per
+// PWM period (TIM1 mid-pulse trigger); this is called from the control step.
 void safety_sample_once(void);
 
+// Background housekeeping: calibration reports and ADC overrun recovery (call from loop)
+void safety_monitor_poll(void);
+
+// Number of ADC overruns recovered since boot
+uint32_t safety_get_adc_overruns(void);
+
+// Hardware trip limits. The ADC analog watchdogs check every shunt (ADC1) and
+// VBUS (ADC3) conversion against them and call driver_trip from the ADC
+// interrupt, once per PWM period whatever the loop is doing. 0 = no limit.
+void safety_set_trip_limits(uint32_t overcurrent_mA, uint32_t overvoltage_mV);
+
+// Cycle-by-cycle current limit. DAC1 (PA4) sets the threshold of the
+// comparator on TIM1_ETR, which ends the PWM on-time of every period in
+// which the shunt current reaches it. 0 = no limit.
+void safety_set_pulse_limit(uint32_t limit_mA);
+
+// Clear and enable the watchdog interrupts. A trip disables its own
+// interrupt, so this is called once per arm.
+void safety_arm_trips(void);
+
+// Zero-current shunt offset from SAFETY_CAL_BURST_SCANS scans (a few ms),
+// taken by esc_arm with the driver off. Stored in the config sector when it
+// moved. Returns 0 and keeps the previous offset if the driver is on, the
+// burst did not complete or the result is implausible.
+int safety_calibrate_offset(void);
+
+// VBUS gain correction: the bus is at actual_mV (reference meter) now.
+// Stored with the offset. Returns 0 if the correction is out of range.
+int safety_calibrate_vbus(uint32_t actual_mV);
+
+// Current zero-current offset (ADC counts) and VBUS gain (Q16.16)
+uint32_t safety_get_shunt_offset_raw(void);
+int32_t safety_get_vbus_gain_q16(void);
+
 // Calibration mode: when enabled, safety monitor will print raw ADC and converted values periodically.
 void safety_enable_calibration(int enable);
 int safety_is_calibrating(void);
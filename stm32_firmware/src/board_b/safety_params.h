@@ -8,9 +8,24 @@
 // ADC resolution in bits (e.g., 12)
 #define SAFETY_ADC_RESOLUTION_BITS 12
 
+// ADC clock (PCLK2 / 4) and ADC1 scan timing in ADC cycles: each rank takes
+// its sample time plus 12 conversion cycles, and the whole scan (shunt,
+// VBUS, temperature) has to finish inside the PWM period it is triggered
+// in. The shunt is sampled inside a single-shunt window; VBUS and
+// temperature are slow signals and get just enough time to settle.
+#define SAFETY_ADC_CLOCK_HZ 21000000u
+#define SAFETY_ADC_CONV_CYCLES 12u
+#define SAFETY_ADC_SHUNT_SAMPLE_CYCLES 15u
+#define SAFETY_ADC_SLOW_SAMPLE_CYCLES 28u
+#define SAFETY_ADC_SCAN_CYCLES \
+  (SAFETY_ADC_SHUNT_SAMPLE_CYCLES + 2u * SAFETY_ADC_SLOW_SAMPLE_CYCLES + 3u * SAFETY_ADC_CONV_CYCLES)
+
 // Vbus divider ratio (Vbus = adc_voltage * VBUS_DIVIDER)
 #define SAFETY_VBUS_DIVIDER 11.0f
 
+// Phase voltage divider ratio for the sensorless BEMF taps (PC3-PC5)
+#define SAFETY_PHASE_DIVIDER 11.0f
+
 // Shunt resistance in milliohms (mΩ). Example: 1 mΩ -> 1.0f
 #define SAFETY_SHUNT_MOHMS 1.0f
 
@@ -23,3 +38,26 @@
 // Calibration settings
 #define SAFETY_CAL_PRINT_MS 100 // print interval during calibration (10Hz)
 #define SAFETY_CAL_AVG_MS 2000  // average duration for zero-current offset
+
+// Zero-current offset taken at every arm (safety_calibrate_offset): scans
+// averaged with the driver off (256 = 2.56 ms at the PWM rate), and the wait
+// allowed for them
+#define SAFETY_CAL_BURST_SCANS 256
+#define SAFETY_CAL_BURST_TIMEOUT_MS 10
+// An offset above this many counts means current is flowing (or a fault)
+#define SAFETY_CAL_OFFSET_MAX 400
+// Offset change (counts) worth a new record in flash
+#define SAFETY_CAL_SAVE_DELTA 2
+// Accepted VBUS gain correction (CAL VBUS), +/- this fraction
+#define SAFETY_CAL_VBUS_GAIN_RANGE 0.2f
+
+// ADC filter pipeline (adc_filter.h), per channel:
+//   {oversample, median, ADC_FILTER_IIR | ADC_FILTER_AVERAGE, shift}
+// Scans arrive at the PWM rate (100 kHz). The hardware trips (analog
+// watchdogs, break input, pulse limit) act on the unfiltered signal.
+// Shunt: 25 kHz steps, median of 3, IIR tau ~160 us
+#define SAFETY_FILTER_SHUNT {4, 3, ADC_FILTER_IIR, 2}
+// VBUS: 6.25 kHz steps, median of 3, IIR tau ~1.3 ms
+#define SAFETY_FILTER_VBUS  {16, 3, ADC_FILTER_IIR, 3}
+// Temperature: 1.56 kHz steps, median of 5, 16-step average (~10 ms)
+#define SAFETY_FILTER_TEMP  {64, 5, ADC_FILTER_AVERAGE, 4}
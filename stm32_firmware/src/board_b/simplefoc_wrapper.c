@@ -0,0 +1,339 @@
+#include "simplefoc_wrapper.h"
+#include "foc_math.h"
+#include "driver_tim1.h"
+#include "hall_sensor.h"
+#include "safety_monitor.h"
+#include "timebase.h"
+#include "speed_ctrl.h"
+#include "current_ctrl.h"
+#include "safety_params.h"
+#include <stdlib.h>
+
+// Rotor angle comes from the hall sensors, interpolated between edges. The
+// d-axis sits 90 degrees behind the vector the six-step table drives for the
+// same hall state; FOC_HALL_OFFSET_DEG trims sensor placement.
+#define FOC_HALL_OFFSET_DEG 0
+
+// Keep some off-time for the bootstrap supplies
+#define FOC_VOLTAGE_LIMIT (Q15_ONE * 95 / 100)
+
+// Single-shunt reconstruction: the DC-link shunt carries one phase current
+// while exactly one or exactly two high sides are on. The trigger goes this
+// many ticks into such a window (dead-time + ringing) and the shunt's sample
+// time has to follow inside it.
+#define FOC_TICKS_PER_ADC_CYCLE (DRIVER_TIM1_CLOCK_HZ / SAFETY_ADC_CLOCK_HZ)
+#define FOC_SHUNT_SETTLE_TICKS (DRIVER_DEADTIME_TICKS + DRIVER_ADC_MIN_SAMPLE_TICKS)
+#define FOC_SHUNT_SAMPLE_TICKS (SAFETY_ADC_SHUNT_SAMPLE_CYCLES * FOC_TICKS_PER_ADC_CYCLE)
+
+// The whole ADC1 scan must finish before the next update so the control
+// step reads it exactly two steps after tagging it
+#define FOC_SCAN_TICKS (SAFETY_ADC_SCAN_CYCLES * FOC_TICKS_PER_ADC_CYCLE)
+#define FOC_SAMPLE_LATEST (DRIVER_PWM_PERIOD - FOC_SCAN_TICKS)
+
+// Width of a usable window, and the latest compare one can start at
+#define FOC_SHUNT_WINDOW_TICKS (FOC_SHUNT_SETTLE_TICKS + FOC_SHUNT_SAMPLE_TICKS)
+#define FOC_WINDOW_START_MAX (FOC_SAMPLE_LATEST - FOC_SHUNT_SETTLE_TICKS)
+
+_Static_assert(FOC_WINDOW_START_MAX >= 0, "no single-shunt window can be sampled in time");
+
+// Current estimate is dropped after this many steps without a usable window
+#define FOC_CURRENT_STALE_STEPS 8
+
+// The third phase is only rebuilt from two samples at most this many steps apart
+#define FOC_PAIR_MAX_STEPS 4
+
+// Speed loop rate (decimated from the control step)
+#define FOC_SPEED_LOOP_HZ 1000
+
+typedef enum { FOC_MODE_TORQUE = 0, FOC_MODE_SPEED } foc_mode_t;
+
+// hall state -> sector in forward order (sequence 1,3,2,6,4,5)
+static const int8_t hall_sector[8] = { -1, 0, 2, 1, 4, 5, 3, -1 };
+
+static foc_mode_t foc_mode = FOC_MODE_SPEED;
+static volatile int32_t iq_ref_mA = 0;
+static int32_t iq_limit_mA = 0;
+static uint32_t speed_div = 1;
+static uint32_t speed_count = 0;
+
+static foc_pi_t pi_d;
+static foc_pi_t pi_q;
+static int32_t vd_out = 0;
+static int32_t vq_out = 0;
+
+// Phase currents (mA) rebuilt from shunt samples
+static int32_t i_phase[3];
+static uint8_t phase_age[3];
+static uint8_t current_age = FOC_CURRENT_STALE_STEPS;
+
+// Direction the phase currents are expected to have this period, from the
+// current reference
+static int32_t i_expect[3];
+
+// A compare value written now is loaded at the next update event and the
+// scan it triggers is read one step after that: tags run two steps behind.
+// Tag: 0 = no usable sample, +/-(phase + 1) = sign and phase seen by the shunt
+static int8_t shunt_tag[2];
+static int8_t tagged_phase = -1;
+
+// Below some modulation neither window is wide enough (at zero voltage all
+// compares are equal). One compare is then moved a window away from the
+// other two and given the difference back in the next period, so the
+// volt-seconds of the pair are unchanged; ccr_comp holds what is owed.
+static int32_t ccr_comp[3];
+static uint8_t forced_last = 0;
+
+int motor_initFOC(const esc_config_t* cfg) {
+  if (!cfg) return 0;
+  foc_mode = (cfg->control_mode == CONTROL_MODE_TORQUE) ? FOC_MODE_TORQUE : FOC_MODE_SPEED;
+  speed_div = driver_get_control_hz() / FOC_SPEED_LOOP_HZ;
+  if (speed_div == 0) speed_div = 1;
+  speed_ctrl_init(cfg, driver_get_control_hz() / speed_div);
+  iq_limit_mA = (int32_t)cfg->current_limit;
+
+  // d/q current loops run every control step (PWM rate)
+  int32_t kp_q16, ki_q16;
+  current_ctrl_init(cfg, driver_get_control_hz());
+  current_ctrl_phase_gains(&kp_q16, &ki_q16);
+  foc_pi_init(&pi_d, kp_q16, ki_q16, -FOC_VOLTAGE_LIMIT, FOC_VOLTAGE_LIMIT);
+  foc_pi_init(&pi_q, kp_q16, ki_q16, -FOC_VOLTAGE_LIMIT, FOC_VOLTAGE_LIMIT);
+  motor_resetFOC();
+  return 1;
+}
+
+void motor_resetFOC(void) {
+  foc_pi_reset(&pi_d);
+  foc_pi_reset(&pi_q);
+  vd_out = vq_out = 0;
+  iq_ref_mA = 0;
+  speed_count = 0;
+  speed_ctrl_reset();
+  current_ctrl_reset();
+  for (int i = 0; i < 3; ++i) {
+    i_phase[i] = 0;
+    phase_age[i] = FOC_CURRENT_STALE_STEPS;
+    i_expect[i] = 0;
+  }
+  current_age = FOC_CURRENT_STALE_STEPS;
+  shunt_tag[0] = shunt_tag[1] = 0;
+  ccr_comp[0] = ccr_comp[1] = ccr_comp[2] = 0;
+  forced_last = 0;
+  tagged_phase = -1;
+}
+
+void motor_move_torque_mA(int32_t milliamp) {
+  if (milliamp > iq_limit_mA) milliamp = iq_limit_mA;
+  if (milliamp < -iq_limit_mA) milliamp = -iq_limit_mA;
+  iq_ref_mA = milliamp;
+}
+
+// Speed mode: the speed loop (run from motor_loopFOC) sets the q current
+void motor_move_speed_rpm(int32_t rpm) {
+  speed_ctrl_set_target(rpm);
+}
+
+// Interpolate within the sector using the time since the last edge and the
+// average sector time of the last electrical revolution
+static foc_angle_t rotor_angle(int sector) {
+  int32_t start_deg = sector * 60 - 90 + FOC_HALL_OFFSET_DEG;
+  foc_angle_t angle = FOC_ANGLE_FROM_DEG(start_deg);
+  uint32_t sector_us = hall_sensor_erev_period_us() / 6;
+  if (sector_us == 0) {
+    // stalled or starting: assume the middle of the sector
+    return (foc_angle_t)(angle + FOC_ANGLE_FROM_DEG(30));
+  }
+  uint32_t dt = timebase_micros() - hall_sensor_last_edge_us();
+  if (dt >= sector_us) return (foc_angle_t)(angle + FOC_ANGLE_FROM_DEG(60));
+  return (foc_angle_t)(angle + (uint32_t)FOC_ANGLE_FROM_DEG(60) * dt / sector_us);
+}
+
+// Fold the shunt sample tagged two steps ago into the phase currents
+static void update_phase_currents(void) {
+  int8_t tag = shunt_tag[0];
+  shunt_tag[0] = shunt_tag[1];
+  shunt_tag[1] = 0;
+  if (current_age < FOC_CURRENT_STALE_STEPS) current_age++;
+  for (int i = 0; i < 3; ++i) {
+    if (phase_age[i] < FOC_CURRENT_STALE_STEPS) phase_age[i]++;
+  }
+  if (tag == 0) return;
+
+  int32_t ibus = safety_get_motor_current_sample_mA();
+  int8_t p = (int8_t)((tag > 0 ? tag : -tag) - 1);
+  i_phase[p] = (tag > 0) ? ibus : -ibus;
+  phase_age[p] = 0;
+
+  // pair with the more recent of the other two phases
+  int q = (p + 1) % 3, r = (p + 2) % 3;
+  if (phase_age[r] < phase_age[q]) {
+    q = r;
+    r = (p + 1) % 3;
+  }
+  if (phase_age[q] <= FOC_PAIR_MAX_STEPS) {
+    i_phase[r] = -(i_phase[p] + i_phase[q]);
+    phase_age[r] = phase_age[q];
+    current_age = 0;
+  }
+}
+
+// Move all three compares by k: the line voltages, which are all the motor
+// sees, stay the same
+static void shift_common(int32_t e[3], int32_t k) {
+  e[0] += k;
+  e[1] += k;
+  e[2] += k;
+}
+
+// Window from the lowest compare (two high sides on, shunt = -i[lo]), with
+// the compares moved down if needed so the trigger comes in time
+static int open_low_window(int32_t e[3], int lo, int mid) {
+  if (e[mid] - e[lo] < FOC_SHUNT_WINDOW_TICKS) return 0;
+  if (e[lo] > FOC_WINDOW_START_MAX) shift_common(e, FOC_WINDOW_START_MAX - e[lo]);
+  if (e[lo] < 0) shift_common(e, -e[lo]);
+  return 1;
+}
+
+// Window from the middle compare (only the highest high side on, shunt =
+// +i[hi]), with the compares moved down if needed; what that takes off the
+// lowest below zero is carried into the next period
+static int open_high_window(int32_t e[3], int hi, int mid) {
+  if (e[hi] - e[mid] < FOC_SHUNT_WINDOW_TICKS) return 0;
+  if (e[mid] > FOC_WINDOW_START_MAX) shift_common(e, FOC_WINDOW_START_MAX - e[mid]);
+  return 1;
+}
+
+// Set the compares for this period from the SVPWM ones and place the ADC
+// trigger in a window where the shunt sees one phase current. A sample goes
+// to a phase other than the one tagged last whenever possible, so each pair
+// of samples rebuilds all three; without a natural window for one, a window
+// is forced (ccr_comp) unless this period pays back the last one. The shunt
+// amplifier is unipolar, so a window only counts if i_expect has the highest
+// phase alone sourcing current or the lowest alone sinking it.
+static uint16_t pick_sample_point(uint16_t ccr[3]) {
+  const int32_t* dir = i_expect;
+
+  int payback = forced_last;
+  forced_last = 0;
+  int32_t e[3];
+  for (int i = 0; i < 3; ++i) {
+    e[i] = (int32_t)ccr[i] + ccr_comp[i];
+    ccr_comp[i] = 0;
+  }
+  int hi = 0, lo = 0;
+  for (int i = 1; i < 3; ++i) {
+    if (e[i] > e[hi]) hi = i;
+    if (e[i] < e[lo]) lo = i;
+  }
+  if (hi == lo) lo = (hi + 1) % 3;
+  int mid = 3 - hi - lo;
+
+  int8_t tag = 0;
+  int32_t start = 0;
+  if (lo != tagged_phase && dir[lo] <= 0 && open_low_window(e, lo, mid)) {
+    tag = (int8_t)-(lo + 1);
+    start = e[lo];
+  } else if (hi != tagged_phase && dir[hi] >= 0 && open_high_window(e, hi, mid)) {
+    tag = (int8_t)(hi + 1);
+    start = e[mid];
+  } else if (!payback) {
+    // the untagged phase expected to carry the most current; at rest (all
+    // zero) the next one round
+    int p = (tagged_phase + 1) % 3;
+    int alt = (p + 1) % 3;
+    if (alt != tagged_phase && labs(dir[alt]) > labs(dir[p])) p = alt;
+    int a = (p + 1) % 3, b = (p + 2) % 3;
+    if (dir[p] <= 0) {
+      // p alone off below the lower of the other two
+      int o_lo = e[a] < e[b] ? a : b;
+      int32_t d = e[p] - (e[o_lo] - FOC_SHUNT_WINDOW_TICKS);
+      if (d > 0) {
+        e[p] -= d;
+        ccr_comp[p] += d;
+        forced_last = 1;
+      }
+      open_low_window(e, p, o_lo);
+      tag = (int8_t)-(p + 1);
+      start = e[p];
+    } else {
+      // p alone on above the higher of the other two
+      int o_hi = e[a] > e[b] ? a : b;
+      int32_t d = e[o_hi] + FOC_SHUNT_WINDOW_TICKS - e[p];
+      if (d > 0) {
+        e[p] += d;
+        ccr_comp[p] -= d;
+        forced_last = 1;
+      }
+      open_high_window(e, p, o_hi);
+      tag = (int8_t)(p + 1);
+      start = e[o_hi];
+    }
+  }
+  if (tag == 0) {
+    // a fresh sample of the same phase still beats none
+    if (dir[lo] <= 0 && open_low_window(e, lo, mid)) {
+      tag = (int8_t)-(lo + 1);
+      start = e[lo];
+    } else if (dir[hi] >= 0 && open_high_window(e, hi, mid)) {
+      tag = (int8_t)(hi + 1);
+      start = e[mid];
+    }
+  }
+  if (tag) tagged_phase = (int8_t)((tag > 0 ? tag : -tag) - 1);
+
+  // a compare beyond the period is carried over as well
+  for (int i = 0; i < 3; ++i) {
+    if (e[i] > DRIVER_PWM_PERIOD) {
+      ccr_comp[i] += e[i] - DRIVER_PWM_PERIOD;
+      e[i] = DRIVER_PWM_PERIOD;
+    } else if (e[i] < 0) {
+      ccr_comp[i] += e[i];
+      e[i] = 0;
+    }
+    ccr[i] = (uint16_t)e[i];
+  }
+  shunt_tag[1] = tag;
+  return tag ? (uint16_t)(start + FOC_SHUNT_SETTLE_TICKS) : DRIVER_ADC_MIN_SAMPLE_TICKS;
+}
+
+int motor_loopFOC(void) {
+  int sector = hall_sector[hall_sensor_read() & 7];
+  if (sector < 0) {
+    // the fallback drive moves the trigger; pending tags no longer apply
+    shunt_tag[0] = shunt_tag[1] = 0;
+    return 0;
+  }
+
+  update_phase_currents();
+
+  q15_t s, c;
+  foc_sin_cos(rotor_angle(sector), &s, &c);
+
+  // speed mode: the speed loop sets the q current reference
+  if (foc_mode == FOC_MODE_SPEED && ++speed_count >= speed_div) {
+    speed_count = 0;
+    iq_ref_mA = speed_ctrl_run();
+  }
+
+  // d/q current loops in both modes, id held at zero
+  if (current_age < FOC_CURRENT_STALE_STEPS) {
+    int32_t i_alpha, i_beta, id, iq;
+    foc_clarke(i_phase[0], i_phase[1], &i_alpha, &i_beta);
+    foc_park(i_alpha, i_beta, s, c, &id, &iq);
+    vd_out = foc_pi_run(&pi_d, 0 - id);
+    vq_out = foc_pi_run(&pi_q, iq_ref_mA - iq);
+  }
+  // a window is forced when none opens, so this holds for at most the
+  // first few steps after a reset and the pay-back periods
+  foc_limit_circle(&vd_out, &vq_out, FOC_VOLTAGE_LIMIT);
+
+  int32_t v_alpha, v_beta;
+  foc_inv_park(vd_out, vq_out, s, c, &v_alpha, &v_beta);
+  int32_t i_alpha, i_beta;
+  foc_inv_park(0, iq_ref_mA, s, c, &i_alpha, &i_beta);
+  foc_inv_clarke(i_alpha, i_beta, i_expect);
+
+  uint16_t ccr[3];
+  foc_svpwm(v_alpha, v_beta, DRIVER_PWM_PERIOD, ccr);
+  driver_set_svpwm(ccr, pick_sample_point(ccr));
+  return 1;
+}
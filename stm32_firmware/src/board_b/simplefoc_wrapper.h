@@ -8,8 +8,13 @@ extern "C" {
 // Initialize FOC motor structures with config
 int motor_initFOC(const esc_config_t* cfg);
 
-// Run control loop step (should be called frequently)
-void motor_loopFOC(void);
+// Clear controller state (call when the bridge is (re)enabled)
+void motor_resetFOC(void);
+
+// Run control loop step (should be called frequently). Called from the
+// control interrupt. Returns 0 without driving when no rotor angle is
+// available (invalid hall state); the caller keeps its fallback drive.
+int motor_loopFOC(void);
 
 // Apply target: torque in mA or speed in rpm depending on mode
 void motor_move_torque_mA(int32_t milliamp);
@@ -0,0 +1,77 @@
+#include "speed_ctrl.h"
+#include "foc_math.h"
+#include "hall_sensor.h"
+
+static foc_pi_t pi_speed;
+static uint32_t kv = 0;
+static uint32_t pole_pairs = 1;
+static int32_t accel_step_q16 = 0;     // setpoint slew per call, rpm << 16
+static volatile int32_t target_rpm = 0;
+static int64_t ramp_rpm_q16 = 0;       // slewed setpoint, rpm << 16
+
+void speed_ctrl_init(const esc_config_t* cfg, uint32_t rate_hz) {
+  if (rate_hz == 0) rate_hz = 1;
+  kv = cfg->motor_kv;
+  pole_pairs = cfg->motor_poles >= 2 ? cfg->motor_poles / 2 : 1;
+  int32_t limit_ma = (int32_t)cfg->current_limit;
+
+  // gains arrive in 0.01 mA units; the PI works in mA
+  int32_t kp_q16 = (int32_t)(((int64_t)cfg->speed_kp << Q16_SHIFT) / 100);
+  int32_t ki_q16 = (int32_t)(((int64_t)cfg->speed_ki << Q16_SHIFT) / (100 * (int64_t)rate_hz));
+  foc_pi_init(&pi_speed, kp_q16, ki_q16, -limit_ma, limit_ma);
+
+  accel_step_q16 = cfg->accel_rpm_s
+                   ? (int32_t)(((int64_t)cfg->accel_rpm_s << Q16_SHIFT) / rate_hz)
+                   : 0;
+  speed_ctrl_reset();
+}
+
+void speed_ctrl_reset(void) {
+  foc_pi_reset(&pi_speed);
+  target_rpm = 0;
+  ramp_rpm_q16 = 0;
+}
+
+void speed_ctrl_set_target(int32_t rpm) {
+  target_rpm = rpm < 0 ? 0 : rpm;
+}
+
+int32_t speed_ctrl_measured_rpm(void) {
+  uint32_t erev_us = hall_sensor_erev_period_us();
+  if (erev_us == 0) return 0;
+  return (int32_t)(60000000u / (erev_us * pole_pairs));
+}
+
+static q15_t mv_to_modulation(int32_t mv, uint32_t vbus_mv) {
+  if (mv <= 0 || vbus_mv == 0) return 0;
+  if ((uint32_t)mv >= vbus_mv) return Q15_ONE;
+  return (q15_t)(((int64_t)mv * Q15_ONE) / vbus_mv);
+}
+
+static int32_t feedforward_mv(int32_t rpm) {
+  // back-EMF (line-line) at this speed: rpm / kv volts
+  return kv ? (int32_t)((int64_t)rpm * 1000 / kv) : 0;
+}
+
+q15_t speed_ctrl_feedforward(int32_t rpm, uint32_t vbus_mv) {
+  return mv_to_modulation(feedforward_mv(rpm), vbus_mv);
+}
+
+int32_t speed_ctrl_run(void) {
+  // slew the setpoint toward the request
+  int64_t goal_q16 = (int64_t)target_rpm << Q16_SHIFT;
+  if (accel_step_q16 == 0) {
+    ramp_rpm_q16 = goal_q16;
+  } else if (ramp_rpm_q16 < goal_q16) {
+    ramp_rpm_q16 = (goal_q16 - ramp_rpm_q16 > accel_step_q16) ? ramp_rpm_q16 + accel_step_q16 : goal_q16;
+  } else if (ramp_rpm_q16 > goal_q16) {
+    ramp_rpm_q16 = (ramp_rpm_q16 - goal_q16 > accel_step_q16) ? ramp_rpm_q16 - accel_step_q16 : goal_q16;
+  }
+  int32_t setpoint = (int32_t)(ramp_rpm_q16 >> Q16_SHIFT);
+
+  if (setpoint == 0) {
+    foc_pi_reset(&pi_speed);
+    return 0;
+  }
+  return foc_pi_run(&pi_speed, setpoint - speed_ctrl_measured_rpm());
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include "config_parser.h"
+#include "fixed_point.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Closed-loop speed controller: a PI on the measured speed whose output is
+// the q-axis current reference (mA), clamped to the configured current
+// limit. The FOC current loops turn that into voltage, so bus voltage and
+// back-EMF need no compensation here. The six-step fallback, which has no
+// speed feedback, uses the kv feed-forward modulation instead.
+
+// Configure gains and slew from the config; rate_hz is how often
+// speed_ctrl_run() is called
+void speed_ctrl_init(const esc_config_t* cfg, uint32_t rate_hz);
+void speed_ctrl_reset(void);
+
+// Requested mechanical speed (rpm); the loop slews toward it at accel_rpm_s
+void speed_ctrl_set_target(int32_t rpm);
+
+// One loop iteration. Returns the q current reference in mA.
+int32_t speed_ctrl_run(void);
+
+// Feed-forward only (no speed feedback available)
+q15_t speed_ctrl_feedforward(int32_t rpm, uint32_t vbus_mv);
+
+// Mechanical speed from the hall edge period (0 when stalled)
+int32_t speed_ctrl_measured_rpm(void);
+
+#ifdef __cplusplus
+}
+#endif
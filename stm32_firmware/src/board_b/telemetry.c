@@ -0,0 +1,94 @@
+#include "telemetry.h"
+#include "esc_control.h"
+#include "safety_monitor.h"
+#include "hall_sensor.h"
+#include "driver_tim1.h"
+#include "timebase.h"
+#include "uart_commands.h"
+#include "uart_tx.h"
+#include "cobs.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TELEMETRY_FRAME_MAX COBS_FRAME_MAX(sizeof(telemetry_record_t))
+
+static volatile uint32_t period_steps = 0;   // control steps per record, 0 = off
+static uint32_t step_count = 0;
+static uint8_t seq = 0;
+static volatile uint32_t rate_hz = 0;
+static volatile uint32_t records_sent = 0;
+static volatile uint32_t records_dropped = 0;
+
+uint32_t telemetry_set_rate(uint32_t hz) {
+  uint32_t control_hz = driver_get_control_hz();
+  if (hz == 0 || control_hz == 0) {
+    period_steps = 0;
+    rate_hz = 0;
+    return 0;
+  }
+
+  const uint32_t link_hz = (TELEMETRY_LINK_BAUD / 10u) * TELEMETRY_LINK_SHARE_PCT / 100u
+                           / TELEMETRY_FRAME_MAX;
+  if (hz < TELEMETRY_MIN_HZ) hz = TELEMETRY_MIN_HZ;
+  if (hz > TELEMETRY_MAX_HZ) hz = TELEMETRY_MAX_HZ;
+  if (hz > link_hz) hz = link_hz;
+
+  uint32_t steps = (control_hz + hz / 2) / hz;
+  if (steps == 0) steps = 1;
+  step_count = 0;
+  period_steps = steps;
+  rate_hz = control_hz / steps;
+  return rate_hz;
+}
+
+uint32_t telemetry_get_rate(void) {
+  return rate_hz;
+}
+
+void telemetry_control_tick(void) {
+  uint32_t steps = period_steps;
+  if (steps == 0 || ++step_count < steps) return;
+  step_count = 0;
+
+  telemetry_record_t rec;
+  rec.type = TELEMETRY_RECORD_STATUS;
+  rec.seq = seq++;
+  rec.time_us = timebase_micros();
+  rec.state = (uint8_t)esc_control_get_state();
+  rec.flags = esc_control_get_flags();
+  rec.hall = hall_sensor_read();
+  rec.duty = esc_control_get_duty();
+  uint32_t erev_us = esc_control_erev_period_us();
+  rec.erpm = erev_us ? 60000000u / erev_us : 0;
+  uint32_t vbus_mv = safety_get_vbus_mV();
+  rec.vbus_mv = (uint16_t)(vbus_mv > 0xFFFF ? 0xFFFF : vbus_mv);
+  rec.current_ma = safety_get_motor_current_mA();
+  rec.temp_c = (int16_t)safety_get_temperature_c();
+
+  uint8_t frame[TELEMETRY_FRAME_MAX];
+  size_t n = cobs_frame(&rec, sizeof(rec), frame);
+  if (uart_tx_write(frame, n)) records_sent++;
+  else records_dropped++;
+}
+
+uint32_t telemetry_records_sent(void) { return records_sent; }
+uint32_t telemetry_records_dropped(void) { return records_dropped; }
+
+// TELEM <hz> | TELEM OFF | TELEM (show)
+static void telemetry_cmd(const uart_cmd_args_t* a) {
+  if (strcasecmp(a->text, "OFF") == 0) {
+    telemetry_set_rate(0);
+  } else if (*a->text) {
+    telemetry_set_rate((uint32_t)atoi(a->text));
+  }
+  uart_tx_printf("TELEM: %luHz sent=%lu dropped=%lu\r\n", (unsigned long)telemetry_get_rate(),
+                 (unsigned long)records_sent, (unsigned long)records_dropped);
+}
+
+static const uart_cmd_t telemetry_commands[] = {
+  {"TELEM", UART_ARG_TEXT, telemetry_cmd, "<hz>|OFF Binary telemetry stream"},
+};
+
+void telemetry_init(void) {
+  uart_commands_register(telemetry_commands, sizeof(telemetry_commands) / sizeof(telemetry_commands[0]));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Periodic binary telemetry on UART4. Records are built in the control
+// interrupt at the configured rate and queued on the shared transmit ring,
+// which DMA drains; nothing is formatted or sampled on request.
+//
+// Each record is one COBS frame (cobs.h), little-endian.
+#define TELEMETRY_MIN_HZ 100
+#define TELEMETRY_MAX_HZ 1000
+
+// UART4 baud rate (see initUART4). Telemetry takes at most
+// TELEMETRY_LINK_SHARE_PCT of the link so console replies still get through.
+#ifndef TELEMETRY_LINK_BAUD
+#define TELEMETRY_LINK_BAUD 115200
+#endif
+#define TELEMETRY_LINK_SHARE_PCT 80
+
+#define TELEMETRY_RECORD_STATUS 0x01
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;          // TELEMETRY_RECORD_STATUS
+  uint8_t seq;           // +1 per record; gaps are records dropped on a full ring
+  uint32_t time_us;      // timebase_micros() at the control step
+  uint8_t state;         // esc_state_t
+  uint8_t flags;         // ESC_FLAG_*
+  uint8_t hall;          // hall pattern read by the step (0/7 = invalid)
+  int16_t duty;          // PWM compare value, 0..DRIVER_PWM_PERIOD
+  uint32_t erpm;         // electrical rpm, 0 when stopped
+  uint16_t vbus_mv;
+  int32_t current_ma;
+  int16_t temp_c;
+} telemetry_record_t;
+
+// Register the TELEM console command. The stream starts off.
+void telemetry_init(void);
+
+// Stream rate in Hz: 0 stops it, other values are clamped to
+// TELEMETRY_MIN_HZ..TELEMETRY_MAX_HZ and to what the link can carry.
+// Returns the rate in effect.
+uint32_t telemetry_set_rate(uint32_t hz);
+uint32_t telemetry_get_rate(void);
+
+// Called every control step (TIM1 update interrupt)
+void telemetry_control_tick(void);
+
+// Records queued and dropped since boot
+uint32_t telemetry_records_sent(void);
+uint32_t telemetry_records_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
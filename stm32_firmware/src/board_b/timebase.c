@@ -0,0 +1,62 @@
+#include "timebase.h"
+#include "stm32f4xx_hal.h"
+
+static TIM_HandleTypeDef htim5;
+static int timebase_ready = 0;
+static volatile timebase_alarm_cb_t alarm_cb = NULL;
+
+void timebase_init(void) {
+  if (timebase_ready) return;
+  __HAL_RCC_TIM5_CLK_ENABLE();
+
+  // TIM5 sits on APB1; its clock is 2x PCLK1 when the APB1 prescaler is not 1
+  uint32_t clk = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) clk *= 2;
+
+  htim5.Instance = TIM5;
+  htim5.Init.Prescaler = clk / 1000000 - 1;
+  htim5.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim5.Init.Period = 0xFFFFFFFF;
+  htim5.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim5.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  HAL_TIM_Base_Init(&htim5);
+  HAL_TIM_Base_Start(&htim5);
+
+  // CC1 is a pinless compare used as the alarm; its interrupt is only enabled
+  // while an alarm is pending
+  TIM5->CCMR1 &= ~TIM_CCMR1_CC1S;
+  HAL_NVIC_SetPriority(TIM5_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(TIM5_IRQn);
+
+  timebase_ready = 1;
+}
+
+uint32_t timebase_micros(void) {
+  return TIM5->CNT;
+}
+
+void timebase_set_alarm(uint32_t at_us, timebase_alarm_cb_t cb) {
+  __HAL_TIM_DISABLE_IT(&htim5, TIM_IT_CC1);
+  alarm_cb = cb;
+  TIM5->CCR1 = at_us;
+  __HAL_TIM_CLEAR_IT(&htim5, TIM_IT_CC1);
+  // compare only matches on equality: raise the event by hand if we are late
+  if ((int32_t)(at_us - TIM5->CNT) <= 0) TIM5->EGR = TIM_EGR_CC1G;
+  __HAL_TIM_ENABLE_IT(&htim5, TIM_IT_CC1);
+}
+
+void timebase_cancel_alarm(void) {
+  __HAL_TIM_DISABLE_IT(&htim5, TIM_IT_CC1);
+  __HAL_TIM_CLEAR_IT(&htim5, TIM_IT_CC1);
+  alarm_cb = NULL;
+}
+
+void TIM5_IRQHandler(void) {
+  if (__HAL_TIM_GET_FLAG(&htim5, TIM_FLAG_CC1)) {
+    __HAL_TIM_CLEAR_IT(&htim5, TIM_IT_CC1);
+    __HAL_TIM_DISABLE_IT(&htim5, TIM_IT_CC1);
+    timebase_alarm_cb_t cb = alarm_cb;
+    alarm_cb = NULL;
+    if (cb) cb();
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Free-running 1 MHz timebase on TIM5 (32-bit, wraps after ~71 minutes)
+void timebase_init(void);
+
+// Current time in microseconds. Differences are wrap-safe with uint32_t math.
+uint32_t timebase_micros(void);
+
+// One-shot alarm on TIM5 channel 1. The callback runs from the TIM5 interrupt
+// (same priority as the control step). A time already in the past fires at
+// once; setting a new alarm replaces the pending one.
+typedef void (*timebase_alarm_cb_t)(void);
+void timebase_set_alarm(uint32_t at_us, timebase_alarm_cb_t cb);
+void timebase_cancel_alarm(void);
+
+#ifdef __cplusplus
+}
+#endif
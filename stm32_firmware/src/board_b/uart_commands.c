@@ -2,419 +2,551 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include "esc_control.h"
 #include "stm32f4xx_hal.h"
 #include "safety_monitor.h"
 #include "frame_store.h"
 #include "hall_sensor.h"
 #include "driver_tim1.h"
-
-extern UART_HandleTypeDef huart4;
+#include "uart_tx.h"
+#include "prof.h"
 
 // Simple line-based command parser over UART4. Commands are ASCII lines
-// terminated by \n. Recognized commands (case-insensitive):
-// ARM, STOP, SPD <rpm>, TRQ <mA>
+// terminated by \n, dispatched through the registered command tables.
 
 static char cmd_buf[64];
 static size_t cmd_pos = 0;
 static volatile uint32_t last_cmd_ms = 0;
 
-void uart_commands_init(void) {
-  cmd_pos = 0;
-  memset(cmd_buf, 0, sizeof(cmd_buf));
-  last_cmd_ms = HAL_GetTick();
-}
+// Registered tables (for HELP) and the name hash over all their entries
+static const uart_cmd_t* cmd_tables[UART_CMD_MAX_TABLES];
+static size_t cmd_table_len[UART_CMD_MAX_TABLES];
+static size_t cmd_table_count = 0;
+static const uart_cmd_t* cmd_slots[UART_CMD_SLOTS];
+static size_t cmd_count = 0;
 
-static void process_command(const char* s) {
-  if (!s) return;
-  // trim
-  while (*s == ' ' || *s == '\t') ++s;
-  
-  // === SHORT COMMAND ALIASES FOR DRONE CONTROL ===
-  // a/A = ARM
-  if ((s[0] == 'a' || s[0] == 'A') && s[1] == '\0') {
-    esc_arm();
-    return;
+// FNV-1a over the upper-cased name
+static uint32_t cmd_hash(const char* name, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (uint8_t)toupper((unsigned char)name[i]);
+    h *= 16777619u;
   }
-  // s/S = STOP/DISARM
-  if ((s[0] == 's' || s[0] == 'S') && s[1] == '\0') {
-    esc_disarm();
-    return;
+  return h;
+}
+
+// Slot holding name, or the empty slot where it would go. Linear probing;
+// the table is never full (cmd_count < UART_CMD_SLOTS).
+static size_t cmd_slot(const char* name, size_t len) {
+  size_t i = cmd_hash(name, len) & (UART_CMD_SLOTS - 1);
+  while (cmd_slots[i]) {
+    const char* n = cmd_slots[i]->name;
+    if (strlen(n) == len && strncasecmp(n, name, len) == 0) break;
+    i = (i + 1) & (UART_CMD_SLOTS - 1);
   }
-  // t N = THROTTLE N% (e.g., "t 50" or "t50")
-  if (s[0] == 't' || s[0] == 'T') {
-    const char* p = s + 1;
-    while (*p == ' ') ++p;
-    int percent = atoi(p);
-    if (percent < 0) percent = 0;
-    if (percent > 100) percent = 100;
-    esc_set_pwm_percent(percent);
-    // Minimal output for fast drone control feedback
-    if (percent == 0) {
-      HAL_UART_Transmit(&huart4, (uint8_t*)"OK\r\n", 4, 50);
-    } else {
-      char buf[8];
-      snprintf(buf, sizeof(buf), "%d\r\n", percent);
-      HAL_UART_Transmit(&huart4, (uint8_t*)buf, strlen(buf), 50);
+  return i;
+}
+
+int uart_commands_register(const uart_cmd_t* cmds, size_t count) {
+  if (!cmds || cmd_table_count >= UART_CMD_MAX_TABLES) return 0;
+  if (cmd_count + count >= UART_CMD_SLOTS) return 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t len = strlen(cmds[i].name);
+    if (len == 0 || len > UART_CMD_NAME_MAX || !cmds[i].handler) return 0;
+    if (cmd_slots[cmd_slot(cmds[i].name, len)]) return 0;
+    // duplicates within the table itself
+    for (size_t j = 0; j < i; ++j) {
+      if (strcasecmp(cmds[i].name, cmds[j].name) == 0) return 0;
     }
-    return;
   }
-  
-  // === FULL COMMAND NAMES (BACKWARDS COMPATIBLE) ===
-  if (strcasecmp(s, "ARM") == 0) {
-    esc_arm();
-    return;
+  for (size_t i = 0; i < count; ++i) {
+    cmd_slots[cmd_slot(cmds[i].name, strlen(cmds[i].name))] = &cmds[i];
   }
-  if (strncasecmp(s, "CAL", 3) == 0) {
-    const char* p = s + 3;
-    while (*p == ' ') ++p;
-    if (strcasecmp(p, "START") == 0) {
-      safety_enable_calibration(1);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"CAL: STARTED\r\n", 15, 50);
-      return;
-    } else if (strcasecmp(p, "STOP") == 0) {
-      safety_enable_calibration(0);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"CAL: STOPPED\r\n", 15, 50);
-      return;
-    }
+  cmd_count += count;
+  cmd_tables[cmd_table_count] = cmds;
+  cmd_table_len[cmd_table_count] = count;
+  cmd_table_count++;
+  return 1;
+}
+
+static const char* skip_blanks(const char* p) {
+  while (*p == ' ' || *p == '\t') ++p;
+  return p;
+}
+
+// === SHORT COMMAND ALIASES FOR DRONE CONTROL ===
+
+// t N = THROTTLE N% (e.g., "t 50" or "t50")
+static void cmd_t(const uart_cmd_args_t* a) {
+  int percent = (int)a->value;
+  if (percent < 0) percent = 0;
+  if (percent > 100) percent = 100;
+  esc_set_pwm_percent(percent);
+  // Minimal output for fast drone control feedback
+  if (percent == 0) {
+    uart_tx_puts("OK\r\n");
+  } else {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%d\r\n", percent);
+    uart_tx_puts(buf);
   }
-  if (strcasecmp(s, "HALL") == 0) {
-    // Read Hall continuously for 500ms to see pattern
-    uint8_t states[100];
-    int count = 0;
-    uint32_t start = HAL_GetTick();
-    while (HAL_GetTick() - start < 500 && count < 100) {
-      states[count++] = hall_sensor_read();
-      delay(10);
-    }
-    
-    char buf[200];
-    int n = snprintf(buf, sizeof(buf), "HALL READ 500ms (%d samples):\r\n", count);
-    HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
-    
-    // Show all unique states found
-    int valid_count = 0;
-    int invalid_count = 0;
-    int prev = -1;
-    for (int i = 0; i < count; i++) {
-      if (states[i] >= 1 && states[i] <= 6) valid_count++;
-      if (states[i] == 0 || states[i] == 0x7) invalid_count++;
-      
-      // Print state changes
-      if (states[i] != prev) {
-        n = snprintf(buf, sizeof(buf), "  [%dms] 0x%X (%s)\r\n", i*10, states[i], hall_sensor_state_name(states[i]));
-        HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
-        prev = states[i];
-      }
-    }
-    
-    n = snprintf(buf, sizeof(buf), "SUMMARY: %d valid / %d invalid\r\n", valid_count, invalid_count);
-    HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
-    
-    // Read raw GPIO pins
-    GPIO_PinState u = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_0);
-    GPIO_PinState v = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_1);
-    GPIO_PinState w = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_2);
-    n = snprintf(buf, sizeof(buf), "RAW PINS: PC0=%d PC1=%d PC2=%d\r\n", u, v, w);
-    HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
-    
+}
+
+// === FULL COMMAND NAMES (BACKWARDS COMPATIBLE) ===
+
+static void cmd_arm(const uart_cmd_args_t* a) {
+  (void)a;
+  esc_arm();
+}
+
+static void cmd_disarm(const uart_cmd_args_t* a) {
+  (void)a;
+  esc_disarm();
+}
+
+// CAL [START|STOP|OFFSET|VBUS <mV>]. The offset is also taken at every arm;
+// VBUS trims the bus voltage scale to a meter reading. Both are stored.
+static void cmd_cal(const uart_cmd_args_t* a) {
+  const char* p = a->text;
+  if (strcasecmp(p, "START") == 0) {
+    safety_enable_calibration(1);
+    uart_tx_puts("CAL: STARTED\r\n");
     return;
-  }
-  if (strcasecmp(s, "STATUS") == 0) {
-    // print safety values and state
-    char buf[200];
-    // sample once to update readings
-    safety_sample_once();
-    uint32_t raw_v = safety_get_last_raw_vbus();
-    uint32_t raw_s = safety_get_last_raw_shunt();
-    uint32_t raw_t = safety_get_last_raw_temp();
-    int32_t c = safety_get_motor_current_mA();
-    float v = safety_get_driver_voltage_v();
-    uint16_t t = safety_get_temperature_c();
-    int safe = safety_get_safe_flag();
-    snprintf(buf, sizeof(buf), "STATUS: V=%.2fV I=%ldmA T=%uc | RAW: VBUS=%lu SHUNT=%lu TEMP=%lu | SAFE=%s\r\n",
-             v, (long)c, (unsigned)t, (unsigned long)raw_v, (unsigned long)raw_s, (unsigned long)raw_t, safe?"YES":"NO");
-    HAL_UART_Transmit(&huart4, (uint8_t*)buf, strlen(buf), 100);
+  } else if (strcasecmp(p, "STOP") == 0) {
+    safety_enable_calibration(0);
+    uart_tx_puts("CAL: STOPPED\r\n");
     return;
-  }
-  if (strcasecmp(s, "FRAME") == 0) {
-    // print stored frame once
-    if (!frame_store_has()) {
-      HAL_UART_Transmit(&huart4, (uint8_t*)"FRAME: <none>\r\n", 16, 50);
-      return;
+  } else if (strcasecmp(p, "OFFSET") == 0) {
+    if (!safety_calibrate_offset()) uart_tx_puts("CAL: offset failed (driver on or no scans)\r\n");
+  } else if (strncasecmp(p, "VBUS", 4) == 0) {
+    int mv = atoi(p + 4);
+    if (mv <= 0 || !safety_calibrate_vbus((uint32_t)mv)) {
+      uart_tx_puts("CAL: VBUS <mV> rejected (driver on or correction out of range)\r\n");
     }
-    uint8_t bufdata[128];
-    size_t len = frame_store_get(bufdata, sizeof(bufdata));
-    HAL_UART_Transmit(&huart4, (uint8_t*)"FRAME:\r\n", 8, 50);
-    // print hex inline
-    for (size_t i = 0; i < len; ++i) {
-      char s2[4];
-      snprintf(s2, sizeof(s2), "%02X", bufdata[i]);
-      HAL_UART_Transmit(&huart4, (uint8_t*)s2, 2, 50);
-      if (i + 1 < len) HAL_UART_Transmit(&huart4, (uint8_t*)" ", 1, 20);
-    }
-    HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n", 2, 50);
+  } else if (*p) {
+    uart_tx_puts("Usage: CAL [START|STOP|OFFSET|VBUS <mV>]\r\n");
     return;
   }
-  if (strncasecmp(s, "FRAME RAW", 9) == 0) {
-    if (!frame_store_has()) {
-      HAL_UART_Transmit(&huart4, (uint8_t*)"FRAME LEN: 0\r\nCHECKSUM: N/A\r\nDATA:\r\n\r\n", 36, 50);
-      return;
-    }
-    uint8_t bufdata[128];
-    size_t len = frame_store_get(bufdata, sizeof(bufdata));
-    // compute SUM checksum over all but last byte and compare to last
-    int chk_ok = 0;
-    if (len >= 1) {
-      uint8_t sum = 0;
-      for (size_t i = 0; i + 1 < len; ++i) sum += bufdata[i];
-      if (sum == bufdata[len-1]) chk_ok = 1;
-    }
-    char hdr[64];
-    snprintf(hdr, sizeof(hdr), "FRAME LEN: %lu\r\nCHECKSUM: %s\r\nDATA:\r\n", (unsigned long)len, chk_ok?"OK":"FAIL");
-    HAL_UART_Transmit(&huart4, (uint8_t*)hdr, strlen(hdr), 100);
-    for (size_t i = 0; i < len; ++i) {
-      char s2[4];
-      snprintf(s2, sizeof(s2), "%02X", bufdata[i]);
-      HAL_UART_Transmit(&huart4, (uint8_t*)s2, 2, 50);
-      if (i + 1 < len) HAL_UART_Transmit(&huart4, (uint8_t*)" ", 1, 20);
+  int32_t gain = safety_get_vbus_gain_q16();
+  uart_tx_printf("CAL: offset_raw=%lu vbus_gain=%ld.%04ld\r\n", (unsigned long)safety_get_shunt_offset_raw(),
+                 (long)(gain >> 16), (long)(((gain & 0xFFFF) * 10000L) >> 16));
+}
+
+static void cmd_hall(const uart_cmd_args_t* a) {
+  (void)a;
+  // Read Hall continuously for 500ms to see pattern
+  uint8_t states[100];
+  int count = 0;
+  uint32_t start = HAL_GetTick();
+  while (HAL_GetTick() - start < 500 && count < 100) {
+    states[count++] = hall_sensor_read();
+    HAL_Delay(10);
+  }
+  
+  char buf[200];
+  int n = snprintf(buf, sizeof(buf), "HALL READ 500ms (%d samples):\r\n", count);
+  uart_tx_write(buf, n);
+  
+  // Show all unique states found
+  int valid_count = 0;
+  int invalid_count = 0;
+  int prev = -1;
+  for (int i = 0; i < count; i++) {
+    if (states[i] >= 1 && states[i] <= 6) valid_count++;
+    if (states[i] == 0 || states[i] == 0x7) invalid_count++;
+    
+    // Print state changes
+    if (states[i] != prev) {
+      n = snprintf(buf, sizeof(buf), "  [%dms] 0x%X (%s)\r\n", i*10, states[i], hall_sensor_state_name(states[i]));
+      uart_tx_write(buf, n);
+      prev = states[i];
     }
-    HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n", 2, 50);
-    return;
   }
-  if (strcasecmp(s, "STOP") == 0 || strcasecmp(s, "DISARM") == 0) {
-    esc_disarm();
-    return;
+  
+  n = snprintf(buf, sizeof(buf), "SUMMARY: %d valid / %d invalid\r\n", valid_count, invalid_count);
+  uart_tx_write(buf, n);
+  
+  // Read raw GPIO pins
+  GPIO_PinState u = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_0);
+  GPIO_PinState v = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_1);
+  GPIO_PinState w = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_2);
+  n = snprintf(buf, sizeof(buf), "RAW PINS: PC0=%d PC1=%d PC2=%d\r\n", u, v, w);
+  uart_tx_write(buf, n);
+  
+  // Edge timing captured by the EXTI engine
+  uint32_t iv[6];
+  uint32_t niv = hall_sensor_get_intervals(iv, 6);
+  n = snprintf(buf, sizeof(buf), "EDGES: count=%lu erev=%luus last intervals:",
+               (unsigned long)hall_sensor_edge_count(), (unsigned long)hall_sensor_erev_period_us());
+  for (uint32_t i = 0; i < niv && n < (int)sizeof(buf) - 12; ++i) {
+    n += snprintf(buf + n, sizeof(buf) - n, " %lu", (unsigned long)iv[i]);
   }
-  if (strncasecmp(s, "BYPASS", 6) == 0) {
-    const char* p = s + 6;
-    while (*p == ' ') ++p;
-    if (strcasecmp(p, "ON") == 0) {
-      safety_set_bypass(1);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"SAFETY BYPASS ENABLED\r\n", 23, 50);
-      return;
-    } else if (strcasecmp(p, "OFF") == 0) {
-      safety_set_bypass(0);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"SAFETY BYPASS DISABLED\r\n", 24, 50);
+  n += snprintf(buf + n, sizeof(buf) - n, "\r\n");
+  uart_tx_write(buf, n);
+}
+
+static void cmd_status(const uart_cmd_args_t* a) {
+  (void)a;
+  // print safety values and state
+  char buf[200];
+  // readings are refreshed every control step
+  uint32_t raw_v = safety_get_last_raw_vbus();
+  uint32_t raw_s = safety_get_last_raw_shunt();
+  uint32_t raw_t = safety_get_last_raw_temp();
+  int32_t c = safety_get_motor_current_mA();
+  float v = safety_get_driver_voltage_v();
+  uint16_t t = safety_get_temperature_c();
+  int safe = safety_get_safe_flag();
+  snprintf(buf, sizeof(buf), "STATUS: V=%.2fV I=%ldmA T=%uc | RAW: VBUS=%lu SHUNT=%lu TEMP=%lu | SAFE=%s | TXDROP=%lu\r\n",
+           v, (long)c, (unsigned)t, (unsigned long)raw_v, (unsigned long)raw_s, (unsigned long)raw_t, safe?"YES":"NO",
+           (unsigned long)uart_tx_overflow_count());
+  uart_tx_puts(buf);
+}
+
+static const char* const filter_channel_names[SAFETY_NUM_CH] = {"SHUNT", "VBUS", "TEMP"};
+static const char* const filter_kind_names[] = {"OFF", "IIR", "AVG"};
+
+// FILTER [SHUNT|VBUS|TEMP <oversample> <median> OFF|IIR|AVG <shift>]
+// sets one channel's filter (adc_filter.h) and prints all of them
+static void cmd_filter(const uart_cmd_args_t* a) {
+  const char* p = a->text;
+  if (*p) {
+    int ch = 0;
+    while (ch < SAFETY_NUM_CH && strncasecmp(p, filter_channel_names[ch], strlen(filter_channel_names[ch])) != 0) ch++;
+    int ok = 0;
+    if (ch < SAFETY_NUM_CH) {
+      char* end;
+      p += strlen(filter_channel_names[ch]);
+      long os = strtol(p, &end, 10);
+      long med = strtol(end, &end, 10);
+      p = skip_blanks(end);
+      int kind = 0;
+      while (kind < 3 && strncasecmp(p, filter_kind_names[kind], 3) != 0) kind++;
+      long shift = (kind < 3) ? strtol(p + 3, &end, 10) : 0;
+      adc_filter_config_t cfg = {(uint8_t)os, (uint8_t)med, (uint8_t)kind, (uint8_t)shift};
+      ok = kind < 3 && os > 0 && os <= 255 && med > 0 && med <= 255 && shift >= 0 && shift <= 255 &&
+           safety_set_filter((safety_channel_t)ch, &cfg);
+    }
+    if (!ok) {
+      uart_tx_puts("Usage: FILTER SHUNT|VBUS|TEMP <oversample 1-64> <median 1|3|5> OFF|IIR|AVG <shift>\r\n");
       return;
     }
   }
-  if (strncasecmp(s, "THROTTLE", 8) == 0) {
-    const char* p = s + 8;
-    while (*p == ' ') ++p;
-    int throttle = atoi(p);
-    esc_set_throttle(throttle);
-    uart_commands_reset_watchdog();
-    
-    // Print feedback
-    char buf[80];
-    int percent = (throttle > 100) ? ((throttle * 100) / 1000) : throttle;
-    int n = snprintf(buf, sizeof(buf), "THROTTLE: %d%% (raw=%d)\r\n", percent, throttle);
-    HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
-    return;
+  for (int ch = 0; ch < SAFETY_NUM_CH; ++ch) {
+    adc_filter_config_t cfg;
+    safety_get_filter((safety_channel_t)ch, &cfg);
+    uart_tx_printf("FILTER %s: oversample=%u median=%u %s shift=%u\r\n", filter_channel_names[ch],
+                   (unsigned)cfg.oversample, (unsigned)cfg.median,
+                   filter_kind_names[cfg.kind < 3 ? cfg.kind : 0], (unsigned)cfg.shift);
+  }
+}
+
+static void print_hex_bytes(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    char s2[4];
+    snprintf(s2, sizeof(s2), "%02X", data[i]);
+    uart_tx_write(s2, 2);
+    if (i + 1 < len) uart_tx_puts(" ");
   }
-  if (strcasecmp(s, "SPEED") == 0) {
-    // SPEED is an alias for THROTTLE (for semantic clarity)
-    // Just treat as PWM / throttle command
-    // Example: SPEED 50 means 50% throttle
-    esc_set_throttle(50);  // Default to middle throttle on SPEED command
-    uart_commands_reset_watchdog();
-    HAL_UART_Transmit(&huart4, (uint8_t*)"SPEED: 50% idle\r\n", 20, 50);
+  uart_tx_puts("\r\n");
+}
+
+// FRAME prints the stored frame once, FRAME RAW adds length and checksum
+static void cmd_frame(const uart_cmd_args_t* a) {
+  int raw = strncasecmp(a->text, "RAW", 3) == 0;
+  if (*a->text && !raw) return;
+  if (!frame_store_has()) {
+    uart_tx_puts(raw ? "FRAME LEN: 0\r\nCHECKSUM: N/A\r\nDATA:\r\n\r\n" : "FRAME: <none>\r\n");
     return;
   }
-  if (strncasecmp(s, "PWM", 3) == 0) {
-    const char* p = s + 3;
-    while (*p == ' ') ++p;
-    int pwm = atoi(p);
-    esc_set_pwm_percent(pwm);
-    // Reset watchdog timer for bypass mode
-    uart_commands_reset_watchdog();
-    char buf[40];
-    int n = snprintf(buf, sizeof(buf), "PWM: %d%%\r\n", pwm);
-    HAL_UART_Transmit(&huart4, (uint8_t*)buf, n, 50);
+  uint8_t bufdata[128];
+  size_t len = frame_store_get(bufdata, sizeof(bufdata));
+  if (!raw) {
+    uart_tx_puts("FRAME:\r\n");
+    print_hex_bytes(bufdata, len);
     return;
   }
-  if (strcasecmp(s, "START") == 0) {
-    // START is deprecated - use ARM + THROTTLE instead
-    HAL_UART_Transmit(&huart4, (uint8_t*)"Use ARM then THROTTLE <value>\r\n", 32, 50);
+  // compute SUM checksum over all but last byte and compare to last
+  int chk_ok = 0;
+  if (len >= 1) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i + 1 < len; ++i) sum += bufdata[i];
+    if (sum == bufdata[len-1]) chk_ok = 1;
+  }
+  char hdr[64];
+  snprintf(hdr, sizeof(hdr), "FRAME LEN: %lu\r\nCHECKSUM: %s\r\nDATA:\r\n", (unsigned long)len, chk_ok?"OK":"FAIL");
+  uart_tx_puts(hdr);
+  print_hex_bytes(bufdata, len);
+}
+
+static void cmd_bypass(const uart_cmd_args_t* a) {
+  if (strcasecmp(a->text, "ON") == 0) {
+    safety_set_bypass(1);
+    uart_tx_puts("SAFETY BYPASS ENABLED\r\n");
+  } else if (strcasecmp(a->text, "OFF") == 0) {
+    safety_set_bypass(0);
+    uart_tx_puts("SAFETY BYPASS DISABLED\r\n");
+  }
+}
+
+static void cmd_throttle(const uart_cmd_args_t* a) {
+  int throttle = (int)a->value;
+  esc_set_throttle(throttle);
+  uart_commands_reset_watchdog();
+  
+  // Print feedback
+  char buf[80];
+  int percent = (throttle > 100) ? ((throttle * 100) / 1000) : throttle;
+  int n = snprintf(buf, sizeof(buf), "THROTTLE: %d%% (raw=%d)\r\n", percent, throttle);
+  uart_tx_write(buf, n);
+}
+
+static void cmd_speed(const uart_cmd_args_t* a) {
+  (void)a;
+  // SPEED is an alias for THROTTLE (for semantic clarity)
+  // Just treat as PWM / throttle command
+  // Example: SPEED 50 means 50% throttle
+  esc_set_throttle(50);  // Default to middle throttle on SPEED command
+  uart_commands_reset_watchdog();
+  uart_tx_puts("SPEED: 50% idle\r\n");
+}
+
+static void cmd_pwm(const uart_cmd_args_t* a) {
+  int pwm = (int)a->value;
+  esc_set_pwm_percent(pwm);
+  // Reset watchdog timer for bypass mode
+  uart_commands_reset_watchdog();
+  char buf[40];
+  int n = snprintf(buf, sizeof(buf), "PWM: %d%%\r\n", pwm);
+  uart_tx_write(buf, n);
+}
+
+static void cmd_start(const uart_cmd_args_t* a) {
+  (void)a;
+  // START is deprecated - use ARM + THROTTLE instead
+  uart_tx_puts("Use ARM then THROTTLE <value>\r\n");
+}
+
+static void cmd_pulse(const uart_cmd_args_t* a) {
+  (void)a;
+  // PULSE command is deprecated - Hall sensors now handle commutation
+  uart_tx_puts("PULSE: command deprecated (Hall sensors control commutation)\r\n");
+}
+
+static void cmd_spd(const uart_cmd_args_t* a) {
+  esc_set_speed_rpm(a->value);
+}
+
+static void cmd_trq(const uart_cmd_args_t* a) {
+  esc_set_torque_mA(a->value);
+}
+
+// TEST command: Manual phase control for debugging
+static void cmd_test(const uart_cmd_args_t* a) {
+  const char* p = a->text;
+  
+  // Read Hall pins and show raw state
+  if (strncasecmp(p, "HALL_DEBUG", 10) == 0) {
+    uint8_t hall = hall_sensor_read();
+    // Read raw GPIO pins directly
+    GPIO_PinState u = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_0);
+    GPIO_PinState v = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_1);
+    GPIO_PinState w = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_2);
+    char buf[100];
+    snprintf(buf, sizeof(buf), 
+      "HALL_RAW: PC0=%d PC1=%d PC2=%d | State=0x%X (%s)\r\n",
+      u, v, w, hall, hall_sensor_state_name(hall));
+    uart_tx_puts(buf);
     return;
   }
-  if (strncasecmp(s, "PULSE", 5) == 0) {
-    // Test single-phase pulse: PULSE A 50
-    const char* p = s + 5;
-    while (*p == ' ') ++p;
-    char phase = *p;
-    p++;
+  
+  // TEST PHASE: manually apply a specific Hall pattern
+  if (strncasecmp(p, "PHASE", 5) == 0) {
+    p += 5;
     while (*p == ' ') ++p;
-    int duty = atoi(p);
-    if (duty < 0) duty = 0;
-    if (duty > 100) duty = 100;
+    int pattern = atoi(p);  // 0-6 for Hall states
+    if (pattern < 0 || pattern > 6) pattern = 0;
     
-    // PULSE command is deprecated - Hall sensors now handle commutation
-    HAL_UART_Transmit(&huart4, (uint8_t*)"PULSE: command deprecated (Hall sensors control commutation)\r\n", 65, 50);
+    driver_enable();
+    int duty = 400;  // 50% duty with dead-time protection
+    driver_set_phase_pwm((uint8_t)pattern, (int16_t)duty);
+    
+    char buf[80];
+    snprintf(buf, sizeof(buf), "TEST_PHASE: Applied 0x%X duty=%d\r\n", pattern, duty);
+    uart_tx_puts(buf);
     return;
   }
-  if (strncasecmp(s, "SPD", 3) == 0) {
-    const char* p = s + 3;
-    while (*p == ' ') ++p;
-    int rpm = atoi(p);
-    esc_set_speed_rpm(rpm);
+  
+  // TEST PWM_DIRECT: Output PWM directly on U phase pin (PA8/TIM1_CH1) only
+  if (strncasecmp(p, "PWM_DIRECT", 10) == 0) {
+    driver_enable();
+    // Set U phase to 50% duty, V/W to 0
+    driver_set_pwm_u(420);  // 50% of 840
+    driver_set_pwm_v(0);
+    driver_set_pwm_w(0);
+    uart_tx_puts("TEST: 50% PWM on U phase (PA8)\r\n");
     return;
   }
-  if (strncasecmp(s, "TRQ", 3) == 0) {
-    const char* p = s + 3;
-    while (*p == ' ') ++p;
-    int mA = atoi(p);
-    esc_set_torque_mA(mA);
+  
+  // TEST OFF: Stop all PWM
+  if (strncasecmp(p, "OFF", 3) == 0) {
+    driver_set_pwm_u(0);
+    driver_set_pwm_v(0);
+    driver_set_pwm_w(0);
+    uart_tx_puts("TEST: All PWM off\r\n");
     return;
   }
   
-  // TEST command: Manual phase control for debugging
-  if (strncasecmp(s, "TEST", 4) == 0) {
-    const char* p = s + 4;
-    while (*p == ' ') ++p;
+  // TEST SWEEP: Try each of 6-step patterns continuously
+  if (strncasecmp(p, "SWEEP", 5) == 0) {
+    driver_enable();
+    const uint8_t patterns[] = {0x1, 0x3, 0x2, 0x6, 0x4, 0x5};
     
-    // Read Hall pins and show raw state
-    if (strncasecmp(p, "HALL_DEBUG", 10) == 0) {
-      uint8_t hall = hall_sensor_read();
-      // Read raw GPIO pins directly
-      GPIO_PinState u = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_0);
-      GPIO_PinState v = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_1);
-      GPIO_PinState w = HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_2);
-      char buf[100];
-      snprintf(buf, sizeof(buf), 
-        "HALL_RAW: PC0=%d PC1=%d PC2=%d | State=0x%X (%s)\r\n",
-        u, v, w, hall, hall_sensor_state_name(hall));
-      HAL_UART_Transmit(&huart4, (uint8_t*)buf, strlen(buf), 50);
-      return;
-    }
+    uart_tx_puts("TEST SWEEP: Cycling through 6-step patterns...\r\n");
+    uart_tx_puts("Send THROTTLE 0 or DISARM to stop\r\n");
     
-    // TEST PHASE: manually apply a specific Hall pattern
-    if (strncasecmp(p, "PHASE", 5) == 0) {
-      p += 5;
-      while (*p == ' ') ++p;
-      int pattern = atoi(p);  // 0-6 for Hall states
-      if (pattern < 0 || pattern > 6) pattern = 0;
+    for (int i = 0; i < 30; i++) {  // 30 cycles = 5 seconds @ 6Hz
+      uint8_t pattern = patterns[i % 6];
+      driver_set_phase_pwm(pattern, 400);  // 50% duty with dead-time protection
       
-      driver_enable();
-      int duty = 400;  // 50% duty with dead-time protection
-      driver_set_phase_pwm((uint8_t)pattern, (int16_t)duty);
+      char buf[100];
+      snprintf(buf, sizeof(buf), "  Step %d: Pattern 0x%X\r\n", i % 6, pattern);
+      uart_tx_puts(buf);
       
-      char buf[80];
-      snprintf(buf, sizeof(buf), "TEST_PHASE: Applied 0x%X duty=%d\r\n", pattern, duty);
-      HAL_UART_Transmit(&huart4, (uint8_t*)buf, strlen(buf), 50);
-      return;
+      // Brief delay between steps
+      for (int j = 0; j < 100; j++) {
+        IWDG->KR = 0xAAAA;  // Feed watchdog
+        HAL_Delay(10);
+      }
     }
     
-    // TEST PWM_DIRECT: Output PWM directly on U phase pin (PA8/TIM1_CH1) only
-    if (strncasecmp(p, "PWM_DIRECT", 10) == 0) {
-      driver_enable();
-      // Set U phase to 50% duty, V/W to 0
-      driver_set_pwm_u(420);  // 50% of 840
-      driver_set_pwm_v(0);
-      driver_set_pwm_w(0);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"TEST: 50% PWM on U phase (PA8)\r\n", 33, 50);
-      return;
-    }
+    driver_set_pwm_u(0);
+    driver_set_pwm_v(0);
+    driver_set_pwm_w(0);
+    uart_tx_puts("SWEEP complete\r\n");
+    return;
+  }
+  
+  // TEST SINGLE: Test individual phases U, V, W
+  if (strncasecmp(p, "SINGLE", 6) == 0) {
+    p += 6;
+    while (*p == ' ') ++p;
+    char phase = *p;
     
-    // TEST OFF: Stop all PWM
-    if (strncasecmp(p, "OFF", 3) == 0) {
-      driver_set_pwm_u(0);
-      driver_set_pwm_v(0);
-      driver_set_pwm_w(0);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"TEST: All PWM off\r\n", 19, 50);
-      return;
-    }
+    driver_enable();
+    int duty = 400;  // 50% duty with proper dead-time
     
-    // TEST SWEEP: Try each of 6-step patterns continuously
-    if (strncasecmp(p, "SWEEP", 5) == 0) {
-      driver_enable();
-      const uint8_t patterns[] = {0x1, 0x3, 0x2, 0x6, 0x4, 0x5};
-      
-      HAL_UART_Transmit(&huart4, (uint8_t*)"TEST SWEEP: Cycling through 6-step patterns...\r\n", 49, 50);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"Send THROTTLE 0 or DISARM to stop\r\n", 37, 50);
-      
-      for (int i = 0; i < 30; i++) {  // 30 cycles = 5 seconds @ 6Hz
-        uint8_t pattern = patterns[i % 6];
-        driver_set_phase_pwm(pattern, 400);  // 50% duty with dead-time protection
-        
-        char buf[100];
-        snprintf(buf, sizeof(buf), "  Step %d: Pattern 0x%X\r\n", i % 6, pattern);
-        HAL_UART_Transmit(&huart4, (uint8_t*)buf, strlen(buf), 50);
-        
-        // Brief delay between steps
-        for (int j = 0; j < 100; j++) {
-          IWDG->KR = 0xAAAA;  // Feed watchdog
-          delay(10);
-        }
-      }
-      
-      driver_set_pwm_u(0);
-      driver_set_pwm_v(0);
-      driver_set_pwm_w(0);
-      HAL_UART_Transmit(&huart4, (uint8_t*)"SWEEP complete\r\n", 17, 50);
-      return;
-    }
+    driver_set_pwm_u(0);
+    driver_set_pwm_v(0);
+    driver_set_pwm_w(0);
     
-    // TEST SINGLE: Test individual phases U, V, W
-    if (strncasecmp(p, "SINGLE", 6) == 0) {
-      p += 6;
-      while (*p == ' ') ++p;
-      char phase = *p;
-      
-      driver_enable();
-      int duty = 400;  // 50% duty with proper dead-time
-      
-      driver_set_pwm_u(0);
-      driver_set_pwm_v(0);
-      driver_set_pwm_w(0);
-      
-      if (phase == 'U' || phase == 'u') {
-        driver_set_pwm_u(duty);
-        HAL_UART_Transmit(&huart4, (uint8_t*)"TEST: U phase ON (PA8)\r\n", 24, 50);
-      } else if (phase == 'V' || phase == 'v') {
-        driver_set_pwm_v(duty);
-        HAL_UART_Transmit(&huart4, (uint8_t*)"TEST: V phase ON (PA9)\r\n", 24, 50);
-      } else if (phase == 'W' || phase == 'w') {
-        driver_set_pwm_w(duty);
-        HAL_UART_Transmit(&huart4, (uint8_t*)"TEST: W phase ON (PA10)\r\n", 25, 50);
-      } else {
-        HAL_UART_Transmit(&huart4, (uint8_t*)"Usage: TEST SINGLE U|V|W\r\n", 27, 50);
-      }
-      return;
+    if (phase == 'U' || phase == 'u') {
+      driver_set_pwm_u(duty);
+      uart_tx_puts("TEST: U phase ON (PA8)\r\n");
+    } else if (phase == 'V' || phase == 'v') {
+      driver_set_pwm_v(duty);
+      uart_tx_puts("TEST: V phase ON (PA9)\r\n");
+    } else if (phase == 'W' || phase == 'w') {
+      driver_set_pwm_w(duty);
+      uart_tx_puts("TEST: W phase ON (PA10)\r\n");
+    } else {
+      uart_tx_puts("Usage: TEST SINGLE U|V|W\r\n");
     }
     return;
   }
-  
-  // TEST DEBUG: FOR SMOOTHNESS TESTING - t50 continuous
-  if (strncasecmp(s, "DEBUG", 5) == 0) {
-    esc_state_t state = esc_control_get_state();
-    if (state != ESC_ARMED && state != ESC_RUNNING) {
-      esc_arm();
-      HAL_Delay(100);
+}
+
+// DEBUG: FOR SMOOTHNESS TESTING - t50 continuous
+static void cmd_debug(const uart_cmd_args_t* a) {
+  (void)a;
+  esc_state_t state = esc_control_get_state();
+  if (state != ESC_ARMED && state != ESC_RUNNING) {
+    esc_arm();
+    HAL_Delay(100);
+  }
+  esc_set_pwm_percent(50);
+  uart_tx_puts("DEBUG: t50 sustained (s=STOP)\r\n");
+}
+
+static void cmd_help(const uart_cmd_args_t* a) {
+  (void)a;
+  uart_tx_puts("\r\n=== ESC DRONE CONTROL ===\r\n");
+  for (size_t t = 0; t < cmd_table_count; ++t) {
+    for (size_t i = 0; i < cmd_table_len[t]; ++i) {
+      const uart_cmd_t* c = &cmd_tables[t][i];
+      if (c->help) uart_tx_printf("%-12s - %s\r\n", c->name, c->help);
     }
-    esc_set_pwm_percent(50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"DEBUG: t50 sustained (s=STOP)\r\n", 32, 50);
-    return;
   }
-  
-  // HELP command
-  if (strcasecmp(s, "HELP") == 0 || strcasecmp(s, "H") == 0) {
-    HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n=== ESC DRONE CONTROL ===\r\n", 29, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"a            - ARM\r\n", 19, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"s            - STOP/DISARM\r\n", 28, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"t <0-100>   - THROTTLE (e.g., t50 for 50%)\r\n", 44, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"STATUS      - Show voltage/current/temp\r\n", 41, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"HALL        - Show hall sensor state\r\n", 38, 50);
-    HAL_UART_Transmit(&huart4, (uint8_t*)"\r\n", 2, 50);
-    return;
+  uart_tx_puts("\r\n");
+}
+
+static const uart_cmd_t core_commands[] = {
+  {"a",        UART_ARG_NONE, cmd_arm,      "ARM"},
+  {"s",        UART_ARG_NONE, cmd_disarm,   "STOP/DISARM"},
+  {"t",        UART_ARG_INT,  cmd_t,        "THROTTLE <0-100>% (e.g., t50)"},
+  {"ARM",      UART_ARG_NONE, cmd_arm,      NULL},
+  {"STOP",     UART_ARG_NONE, cmd_disarm,   NULL},
+  {"DISARM",   UART_ARG_NONE, cmd_disarm,   NULL},
+  {"CAL",      UART_ARG_TEXT, cmd_cal,      "[START|STOP|OFFSET|VBUS <mV>] Sensor calibration"},
+  {"HALL",     UART_ARG_NONE, cmd_hall,     "Show hall sensor state"},
+  {"STATUS",   UART_ARG_NONE, cmd_status,   "Show voltage/current/temp"},
+  {"FILTER",   UART_ARG_TEXT, cmd_filter,   "[SHUNT|VBUS|TEMP os med IIR|AVG|OFF k] ADC filters"},
+  {"FRAME",    UART_ARG_TEXT, cmd_frame,    "[RAW] Show the stored config frame"},
+  {"BYPASS",   UART_ARG_TEXT, cmd_bypass,   NULL},
+  {"THROTTLE", UART_ARG_INT,  cmd_throttle, NULL},
+  {"SPEED",    UART_ARG_NONE, cmd_speed,    NULL},
+  {"PWM",      UART_ARG_INT,  cmd_pwm,      NULL},
+  {"START",    UART_ARG_NONE, cmd_start,    NULL},
+  {"PULSE",    UART_ARG_TEXT, cmd_pulse,    NULL},
+  {"SPD",      UART_ARG_INT,  cmd_spd,      NULL},
+  {"TRQ",      UART_ARG_INT,  cmd_trq,      NULL},
+  {"TEST",     UART_ARG_TEXT, cmd_test,     NULL},
+  {"DEBUG",    UART_ARG_NONE, cmd_debug,    NULL},
+  {"HELP",     UART_ARG_NONE, cmd_help,     NULL},
+  {"H",        UART_ARG_NONE, cmd_help,     NULL},
+};
+
+void uart_commands_init(void) {
+  cmd_pos = 0;
+  memset(cmd_buf, 0, sizeof(cmd_buf));
+  last_cmd_ms = HAL_GetTick();
+  if (cmd_table_count == 0) {
+    uart_commands_register(core_commands, sizeof(core_commands) / sizeof(core_commands[0]));
   }
-  
-  // unknown notthing happens 
-  
 }
 
-int uart_commands_feed(uint8_t b) {
+// Split off the first token, look it up and run it. Unknown commands are
+// ignored, as are arguments to commands that take none.
+static void process_command(const char* s) {
+  PROF_SCOPE(PROF_COMMAND);
+  if (!s) return;
+  s = skip_blanks(s);
+
+  size_t len = 0;
+  while (isalpha((unsigned char)s[len]) || s[len] == '_') ++len;
+  if (len == 0 || len > UART_CMD_NAME_MAX) return;
+
+  const uart_cmd_t* cmd = cmd_slots[cmd_slot(s, len)];
+  if (!cmd) return;
+
+  uart_cmd_args_t args;
+  args.text = skip_blanks(s + len);
+  args.value = 0;
+  switch (cmd->arg) {
+    case UART_ARG_NONE:
+      if (*args.text) return;
+      break;
+    case UART_ARG_INT:
+      args.value = atoi(args.text);
+      break;
+    case UART_ARG_TEXT:
+      break;
+  }
+  cmd->handler(&args);
+}
+
+static int uart_commands_feed_byte(uint8_t b) {
   if (b == '\r') return 0; // ignore
   if (b == '\n') {
     cmd_buf[cmd_pos] = '\0';
@@ -432,6 +564,12 @@ int uart_commands_feed(uint8_t b) {
   return 0;
 }
 
+int uart_commands_feed(const uint8_t* data, size_t len) {
+  int processed = 0;
+  for (size_t i = 0; i < len; ++i) processed += uart_commands_feed_byte(data[i]);
+  return processed;
+}
+
 uint32_t uart_commands_last_seen_ms(void) {
   return last_cmd_ms;
 }
@@ -1,16 +1,51 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Initialize UART command parser
+// Console commands are looked up by their first token (a run of letters or
+// '_', case-insensitive) in a hash table, so dispatch costs the same however
+// many commands are registered. The rest of the line is the argument:
+// "t50", "t 50" and "FRAME RAW" split into "t"/"50", "t"/"50", "FRAME"/"RAW".
+#define UART_CMD_NAME_MAX   15   // longest command name
+#define UART_CMD_SLOTS      64   // hash slots (power of two), > total commands
+#define UART_CMD_MAX_TABLES 8    // register calls accepted
+
+// How the argument is parsed before the handler sees it
+typedef enum {
+  UART_ARG_NONE = 0,  // no argument; lines with one are ignored
+  UART_ARG_INT,       // decimal integer in value (0 if absent, as atoi)
+  UART_ARG_TEXT       // free text, handler parses it
+} uart_arg_kind_t;
+
+typedef struct {
+  const char* text;   // argument text, leading blanks skipped ("" if none)
+  int32_t value;      // UART_ARG_INT only
+} uart_cmd_args_t;
+
+typedef void (*uart_cmd_handler_t)(const uart_cmd_args_t* args);
+
+typedef struct {
+  const char* name;
+  uart_arg_kind_t arg;
+  uart_cmd_handler_t handler;
+  const char* help;   // one line for HELP, NULL to leave the command unlisted
+} uart_cmd_t;
+
+// Add a subsystem's commands. The table is kept by reference (use static
+// storage). Returns 0 if a name is taken or the registry is full.
+int uart_commands_register(const uart_cmd_t* cmds, size_t count);
+
+// Initialize UART command parser and register the core commands
 void uart_commands_init(void);
 
-// Feed bytes (non-blocking). Returns 1 if a full command processed.
-int uart_commands_feed(uint8_t b);
+// Feed a chunk of received bytes (non-blocking). Returns the number of
+// complete commands processed.
+int uart_commands_feed(const uint8_t* data, size_t len);
 
 // Return time (HAL_GetTick) of last received command (ms)
 uint32_t uart_commands_last_seen_ms(void);
@@ -0,0 +1,132 @@
+#include "uart_rx.h"
+
+static UART_HandleTypeDef* rx_huart = NULL;
+static DMA_HandleTypeDef hdma_uart4_rx;
+static uint8_t rx_ring[UART_RX_RING_SIZE];
+
+// Running byte counts: write side is advanced from the DMA position by the
+// interrupts (half/full ring, idle line) and by readers
+static volatile uint32_t rx_write_total = 0;
+static uint32_t rx_read_total = 0;
+static uint32_t rx_last_pos = 0;
+static volatile int rx_idle = 0;
+static uint32_t rx_overrun = 0;
+
+// Fold DMA progress since the last call into rx_write_total. Must run often
+// enough that the DMA never laps rx_last_pos; the half/full interrupts ensure it.
+static void uart_rx_sync(void) {
+  uint32_t pos = UART_RX_RING_SIZE - __HAL_DMA_GET_COUNTER(&hdma_uart4_rx);
+  if (pos >= UART_RX_RING_SIZE) pos = 0;
+  rx_write_total += (pos - rx_last_pos + UART_RX_RING_SIZE) % UART_RX_RING_SIZE;
+  rx_last_pos = pos;
+}
+
+static void uart_rx_dma_event(DMA_HandleTypeDef* hdma) {
+  (void)hdma;
+  uart_rx_sync();
+}
+
+void uart_rx_init(UART_HandleTypeDef* huart) {
+  rx_huart = huart;
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  // UART4_RX -> DMA1 Stream2 Channel4
+  hdma_uart4_rx.Instance = DMA1_Stream2;
+  hdma_uart4_rx.Init.Channel = DMA_CHANNEL_4;
+  hdma_uart4_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_uart4_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_uart4_rx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_uart4_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_uart4_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_uart4_rx.Init.Mode = DMA_CIRCULAR;
+  hdma_uart4_rx.Init.Priority = DMA_PRIORITY_MEDIUM;
+  hdma_uart4_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HAL_DMA_Init(&hdma_uart4_rx);
+  hdma_uart4_rx.XferHalfCpltCallback = uart_rx_dma_event;
+  hdma_uart4_rx.XferCpltCallback = uart_rx_dma_event;
+
+  rx_write_total = 0;
+  rx_read_total = 0;
+  rx_last_pos = 0;
+
+  HAL_DMA_Start_IT(&hdma_uart4_rx, (uint32_t)&huart->Instance->DR, (uint32_t)rx_ring, UART_RX_RING_SIZE);
+  huart->Instance->CR3 |= USART_CR3_DMAR;
+
+  // Idle line marks the end of a command burst
+  __HAL_UART_CLEAR_IDLEFLAG(huart);
+  __HAL_UART_ENABLE_IT(huart, UART_IT_IDLE);
+
+  HAL_NVIC_SetPriority(DMA1_Stream2_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream2_IRQn);
+  HAL_NVIC_SetPriority(UART4_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(UART4_IRQn);
+}
+
+// Bytes between the reader and the DMA, after folding in DMA progress
+static uint32_t uart_rx_pending(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uart_rx_sync();
+  uint32_t written = rx_write_total;
+  rx_idle = 0;
+  __set_PRIMASK(primask);
+
+  uint32_t pending = written - rx_read_total;
+  if (pending > UART_RX_RING_SIZE) {
+    // reader fell a full ring behind: skip to the oldest byte still intact
+    rx_overrun += pending - UART_RX_RING_SIZE;
+    rx_read_total = written - UART_RX_RING_SIZE;
+    pending = UART_RX_RING_SIZE;
+  }
+  return pending;
+}
+
+size_t uart_rx_read(uint8_t* dst, size_t maxlen) {
+  if (!rx_huart || !dst || maxlen == 0) return 0;
+
+  uint32_t pending = uart_rx_pending();
+  if (pending > maxlen) pending = maxlen;
+
+  for (uint32_t i = 0; i < pending; ++i) {
+    dst[i] = rx_ring[(rx_read_total + i) % UART_RX_RING_SIZE];
+  }
+  rx_read_total += pending;
+  return pending;
+}
+
+size_t uart_rx_available(void) {
+  if (!rx_huart) return 0;
+  return uart_rx_pending();
+}
+
+uint8_t uart_rx_peek(size_t offset) {
+  return rx_ring[(rx_read_total + offset) % UART_RX_RING_SIZE];
+}
+
+void uart_rx_skip(size_t n) {
+  uint32_t pending = uart_rx_pending();
+  rx_read_total += (n < pending) ? n : pending;
+}
+
+int uart_rx_idle_pending(void) {
+  return rx_idle;
+}
+
+uint32_t uart_rx_overrun_bytes(void) {
+  return rx_overrun;
+}
+
+void DMA1_Stream2_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma_uart4_rx);
+}
+
+void UART4_IRQHandler(void) {
+  if (!rx_huart) return;
+  uint32_t sr = rx_huart->Instance->SR;
+  if (sr & (USART_SR_IDLE | USART_SR_ORE)) {
+    // SR then DR read clears IDLE and ORE; DMA owns the data register otherwise
+    (void)rx_huart->Instance->DR;
+    uart_rx_sync();
+    if (sr & USART_SR_IDLE) rx_idle = 1;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// UART4 receive ring filled by DMA1 Stream2 in circular mode. Bytes keep
+// arriving while the loop is busy; at 115200 baud the ring covers ~90 ms.
+#define UART_RX_RING_SIZE 1024
+
+// Start circular DMA reception on an initialized UART4 handle
+void uart_rx_init(UART_HandleTypeDef* huart);
+
+// Copy up to maxlen received bytes into dst. Returns the number copied.
+size_t uart_rx_read(uint8_t* dst, size_t maxlen);
+
+// In-place access for parsers that look before they consume: bytes waiting,
+// the byte at offset (0 = oldest, offset < available) and dropping n bytes
+size_t uart_rx_available(void);
+uint8_t uart_rx_peek(size_t offset);
+void uart_rx_skip(size_t n);
+
+// Set by the idle-line interrupt when a burst has ended; cleared on read
+int uart_rx_idle_pending(void);
+
+// Bytes lost because the ring wrapped past the reader
+uint32_t uart_rx_overrun_bytes(void);
+
+#ifdef __cplusplus
+}
+#endif